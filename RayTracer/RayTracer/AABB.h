@@ -11,6 +11,11 @@ public:
 	AABB(const Vec3 &_min, const Vec3 &_max) : m_min(_min), m_max(_max) {}
 
 	BOOL Hit(const Ray &r, float t_min, float t_max) const;
+	float SurfaceArea() const
+	{
+		Vec3 extent = m_max - m_min;
+		return 2.0f * (extent.x() * extent.y() + extent.y() * extent.z() + extent.z() * extent.x());
+	}
 
 	Vec3 m_min;
 	Vec3 m_max;
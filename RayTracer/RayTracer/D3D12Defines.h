@@ -1,9 +1,11 @@
 #pragma once
 
+#if !defined(HEADLESS_RENDERING)
 struct PipelineState
 {
 	ComPtr<ID3D12RootSignature>					m_RS;
 	ComPtr<ID3D12PipelineState>					m_PSO;
 };
+#endif
 
 #define MAX_POINT_LIGHT 4
\ No newline at end of file
@@ -4,7 +4,13 @@
 FileIO::FileIO(const char *filePath)
 	: m_path(filePath)
 {
+#if defined(_WIN32)
 	 fopen_s(&m_handle, m_path, "rb"); // TODO writing
+#else
+	std::string path = m_path;
+	std::replace(path.begin(), path.end(), '\\', '/');
+	fopen_s(&m_handle, path.c_str(), "rb");
+#endif
 	if (m_handle)
 	{
 		fseek(m_handle, 0, SEEK_END);
@@ -2,6 +2,24 @@
 #include "Hitables.h"
 
 #include "Ray.h"
+#include "Materials.h"
+#include "FastMath.h"
+
+BOOL IHitable::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+{
+	if (!Intersect(r, t_min, t_max, out_rec))
+		return FALSE;
+
+	ComputeAttributes(r, out_rec);
+	return TRUE;
+}
+
+BOOL IHitable::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	// hitables without a cheaper test
+	HitRecord rec;
+	return Intersect(r, t_min, t_max, rec);
+}
 
 SphereHitable::SphereHitable(const Vec3 &center, float radius)
 	: m_center(center)
@@ -10,7 +28,7 @@ SphereHitable::SphereHitable(const Vec3 &center, float radius)
 
 }
 
-BOOL SphereHitable::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+BOOL SphereHitable::Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
 {
 	// dot(ray(t) - center, ray(t) - center) = radius * radius
 	// dot(org + t * dir - center, org + t * dir - center) = radius * radius
@@ -29,52 +47,119 @@ BOOL SphereHitable::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_r
 	{
 		// when discriminant == 0, there is only one solution that is -b / (2.0f * a), which means hit with the edge of Sphere
 		// when discriminant > 0, it is could be +/- sqrt(discriminant), which mean hit with separate far/near point on the Sphere
-		float t = (-b - sqrt(discriminant)) / (2.0f * a);
+		// sqrtf, sqrt of a float is the double one with some toolchains
+		float t = (-b - sqrtf(discriminant)) / (2.0f * a);
 		if (t <= t_max && t >= t_min)
 		{
 			out_rec.m_time = t;
-			out_rec.m_position = r.PointAt(t);
-			out_rec.m_normal = (out_rec.m_position - m_center) / m_radius; // same as normalize, cos the length is know as m_radius
-			out_rec.m_hitMaterial = m_material;
-			CalculateUV(out_rec);
 			return TRUE; // the nearest hitting on ray direction
 		}
-		t = (-b + sqrt(discriminant)) / (2.0f * a);
+		t = (-b + sqrtf(discriminant)) / (2.0f * a);
 		if (t <= t_max && t >= t_min)
 		{
 			out_rec.m_time = t;
-			out_rec.m_position = r.PointAt(t);
-			out_rec.m_normal = (out_rec.m_position - m_center) / m_radius; // same as normalize, cos the length is know as m_radius
-			out_rec.m_hitMaterial = m_material;
-			CalculateUV(out_rec);
 			return TRUE; // the farthest hitting on ray direction
 		}
 	}
 	return FALSE; // no hit
 }
 
+void SphereHitable::ComputeAttributes(const Ray &r, HitRecord &io_rec) const
+{
+	io_rec.m_position = r.PointAt(io_rec.m_time);
+	io_rec.m_normal = (io_rec.m_position - m_center) / m_radius; // same as normalize, cos the length is know as m_radius
+	io_rec.m_hitMaterial = m_material;
+	if (m_needsUV)
+	{
+		CalculateUV(io_rec.m_normal, io_rec.m_u, io_rec.m_v);
+		// the unit square of the coordinates spread over the area 4 pi r^2
+		io_rec.m_uvDensity = 0.2820948f / m_radius;
+	}
+	else
+	{
+		io_rec.m_u = io_rec.m_v = 0.0f;
+		io_rec.m_uvDensity = 0.0f;
+	}
+}
+
+void SphereHitable::BindMaterial(IMaterial *m)
+{
+	m_material = m;
+	m_needsUV = !m || m->NeedsUV();
+}
+
+BOOL SphereHitable::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	// the roots of Hit, either of them in the segment is enough
+	Vec3 oc = r.m_org - m_center;
+	float a = dot(r.m_dir, r.m_dir);
+	float b = 2.0f * dot(r.m_dir, oc);
+	float c = dot(oc, oc) - m_radius * m_radius;
+
+	float discriminant = b * b - 4 * a * c;
+	if (discriminant <= 0)
+		return FALSE;
+
+	float t = (-b - sqrtf(discriminant)) / (2.0f * a);
+	if (t <= t_max && t >= t_min)
+		return TRUE;
+	t = (-b + sqrtf(discriminant)) / (2.0f * a);
+	return t <= t_max && t >= t_min;
+}
+
 AABB SphereHitable::BoundingBox() const
 {
 	Vec3 radius(m_radius, m_radius, m_radius);
 	return AABB(-radius, radius);
 }
 
-void SphereHitable::CalculateUV(HitRecord &rec) const
+float SphereHitable::Area() const
+{
+	return 4.0f * (float)M_PI * m_radius * m_radius;
+}
+
+void SphereHitable::SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const
+{
+	// uniform on the sphere, z is uniform in [-1, 1] (Archimedes)
+	float z = 1.0f - 2.0f * u1;
+	float r = sqrtf(1.0f - z * z);
+	float phi = 2.0f * (float)M_PI * u2;
+	out_normal = Vec3(r * cosf(phi), r * sinf(phi), z);
+	out_position = m_center + m_radius * out_normal;
+}
+
+void SphereHitable::CalculateUV(const Vec3 &normal, float &out_u, float &out_v)
 {
-	// hit point in model space
-	Vec3 p = rec.m_position - m_center;
-	p.normalize();
+	// the normal is the hit point in model space, of unit length up to the rounding, Asin clamps the rest
+	const Vec3 &p = normal;
 
-	float theta = atan2(p.z(), p.x());
-	float phi = asin(p.y());
+	float theta = FastMath::Atan2(p.z(), p.x());
+	float phi = FastMath::Asin(p.y());
 
 	// Sorry for trick code, but it is for matching with what we got from simple mesh builder, 
 	// still right hand, but +z faces up and +x faces left
 	//float theta = atan2(p.y(), -p.x());
 	//float phi = asin(-p.z());
 
-	rec.m_u = 1.0f - (theta + (float)M_PI) / (2.0f * (float)M_PI);
-	rec.m_v = (phi + (float)M_PI / 2.0f) / (float)M_PI;
+	out_u = 1.0f - (theta + (float)M_PI) / (2.0f * (float)M_PI);
+	out_v = (phi + (float)M_PI / 2.0f) / (float)M_PI;
+}
+
+void SphereHitable::CalculateUVs(const float *nx, const float *ny, const float *nz, UINT32 count, float *out_u, float *out_v)
+{
+	UINT32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		Float4 theta = FastMath::Atan2(Float4::LoadUnaligned(nz + i), Float4::LoadUnaligned(nx + i));
+		Float4 phi = FastMath::Asin(Float4::LoadUnaligned(ny + i));
+		alignas(16) float lanes[2][4];
+		(Float4(1.0f) - (theta + Float4((float)M_PI)) / Float4(2.0f * (float)M_PI)).Store(lanes[0]);
+		((phi + Float4((float)M_PI / 2.0f)) / Float4((float)M_PI)).Store(lanes[1]);
+		memcpy(out_u + i, lanes[0], sizeof(lanes[0]));
+		memcpy(out_v + i, lanes[1], sizeof(lanes[1]));
+	}
+	for (; i < count; i++)
+		CalculateUV(Vec3(nx[i], ny[i], nz[i]), out_u[i], out_v[i]);
 }
 
 AxisAlignedRectHitable::AxisAlignedRectHitable(UINT32 aAxisIndex, UINT32 bAxisIndex, float a0, float a1, float b0, float b1, float c, BOOL reverseFace)
@@ -90,7 +175,7 @@ AxisAlignedRectHitable::AxisAlignedRectHitable(UINT32 aAxisIndex, UINT32 bAxisIn
 		std::swap(m_b0, m_b1);
 }
 
-BOOL AxisAlignedRectHitable::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+BOOL AxisAlignedRectHitable::Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
 {
 	float t = (m_c - r.m_org[m_cAxisIndex]) / r.m_dir[m_cAxisIndex];
 	if (t <= t_max && t >= t_min)
@@ -99,14 +184,7 @@ BOOL AxisAlignedRectHitable::Hit(const Ray &r, float t_min, float t_max, HitReco
 		float b = r.m_org[m_bAxisIndex] + t * r.m_dir[m_bAxisIndex];
 		if (a >= m_a0 && a <= m_a1 && b >= m_b0 && b <= m_b1)
 		{
-			out_rec.m_u = (a - m_a0) / (m_a1 - m_a0);
-			out_rec.m_v = (b - m_b0) / (m_b1 - m_b0);
 			out_rec.m_time = t;
-			out_rec.m_hitMaterial = m_material;
-			out_rec.m_position = r.PointAt(t);
-			out_rec.m_normal.set(m_aAxisIndex, 0.0f);
-			out_rec.m_normal.set(m_bAxisIndex, 0.0f);
-			out_rec.m_normal.set(m_cAxisIndex, m_reverseFace ? -1.0f : 1.0f);
 			return TRUE;
 		}
 	}
@@ -114,6 +192,42 @@ BOOL AxisAlignedRectHitable::Hit(const Ray &r, float t_min, float t_max, HitReco
 	return FALSE;
 }
 
+void AxisAlignedRectHitable::ComputeAttributes(const Ray &r, HitRecord &io_rec) const
+{
+	float t = io_rec.m_time;
+	float a = r.m_org[m_aAxisIndex] + t * r.m_dir[m_aAxisIndex];
+	float b = r.m_org[m_bAxisIndex] + t * r.m_dir[m_bAxisIndex];
+	io_rec.m_u = (a - m_a0) / (m_a1 - m_a0);
+	io_rec.m_v = (b - m_b0) / (m_b1 - m_b0);
+	io_rec.m_uvDensity = 1.0f / sqrtf(fabsf((m_a1 - m_a0) * (m_b1 - m_b0)));
+	io_rec.m_hitMaterial = m_material;
+	io_rec.m_position = r.PointAt(t);
+	io_rec.m_normal.set(m_aAxisIndex, 0.0f);
+	io_rec.m_normal.set(m_bAxisIndex, 0.0f);
+	io_rec.m_normal.set(m_cAxisIndex, m_reverseFace ? -1.0f : 1.0f);
+}
+
+BOOL AxisAlignedRectHitable::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	float t = (m_c - r.m_org[m_cAxisIndex]) / r.m_dir[m_cAxisIndex];
+	if (t > t_max || t < t_min)
+		return FALSE;
+
+	float a = r.m_org[m_aAxisIndex] + t * r.m_dir[m_aAxisIndex];
+	float b = r.m_org[m_bAxisIndex] + t * r.m_dir[m_bAxisIndex];
+	return a >= m_a0 && a <= m_a1 && b >= m_b0 && b <= m_b1;
+}
+
+void AxisAlignedRectHitable::SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const
+{
+	out_position.set(m_aAxisIndex, m_a0 + u1 * (m_a1 - m_a0));
+	out_position.set(m_bAxisIndex, m_b0 + u2 * (m_b1 - m_b0));
+	out_position.set(m_cAxisIndex, m_c);
+	out_normal.set(m_aAxisIndex, 0.0f);
+	out_normal.set(m_bAxisIndex, 0.0f);
+	out_normal.set(m_cAxisIndex, m_reverseFace ? -1.0f : 1.0f);
+}
+
 AABB AxisAlignedRectHitable::BoundingBox() const
 {
 	Vec3 _min, _max;
@@ -127,12 +241,12 @@ AABB AxisAlignedRectHitable::BoundingBox() const
 	return AABB(_min, _max);
 }
 
-BOOL HitableCombo::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+BOOL HitableCombo::Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
 {
 	BOOL hitAnything = FALSE;
 	for (UINT32 i = 0; i < m_hitableCount; ++i)
 	{
-		if (m_hitableList[i]->Hit(r, t_min, t_max, out_rec))
+		if (m_hitableList[i]->Intersect(r, t_min, t_max, out_rec))
 		{
 			t_max = out_rec.m_time; // closest so far
 			hitAnything = TRUE;
@@ -141,6 +255,36 @@ BOOL HitableCombo::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_re
 	return hitAnything;
 }
 
+void HitableCombo::ComputeAttributes(const Ray &r, HitRecord &io_rec) const
+{
+	// the record does not tell the child, combos are a handful of hitables so they are tested again at the hit distance,
+	// the last one at that distance is the one Intersect kept
+	const IHitable *closest = nullptr;
+	HitRecord rec;
+	for (UINT32 i = 0; i < m_hitableCount; ++i)
+	{
+		if (m_hitableList[i]->Intersect(r, io_rec.m_time, io_rec.m_time, rec))
+		{
+			closest = m_hitableList[i];
+			io_rec.m_primitiveID = rec.m_primitiveID;
+			io_rec.m_b1 = rec.m_b1;
+			io_rec.m_b2 = rec.m_b2;
+		}
+	}
+	assert(closest && "ComputeAttributes without a hit of Intersect");
+	closest->ComputeAttributes(r, io_rec);
+}
+
+BOOL HitableCombo::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	for (UINT32 i = 0; i < m_hitableCount; ++i)
+	{
+		if (m_hitableList[i]->Occluded(r, t_min, t_max))
+			return TRUE;
+	}
+	return FALSE;
+}
+
 void HitableCombo::BindMaterial(IMaterial *m)
 {
 	for (UINT32 i = 0; i < m_hitableCount; ++i)
@@ -160,16 +304,29 @@ AABB HitableCombo::BoundingBox() const
 	return box;
 }
 
-BOOL TranslatedInstance::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+BOOL TranslatedInstance::Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
 {
-	BOOL hitMe = FALSE;
 	Ray moved_r(r.m_org - m_offset, r.m_dir);
-	if (m_hitable->Hit(moved_r, t_min, t_max, out_rec))
-	{
-		out_rec.m_position += m_offset;
-		hitMe = TRUE;
-	}
-	return hitMe;
+	return m_hitable->Intersect(moved_r, t_min, t_max, out_rec);
+}
+
+void TranslatedInstance::ComputeAttributes(const Ray &r, HitRecord &io_rec) const
+{
+	Ray moved_r(r.m_org - m_offset, r.m_dir);
+	m_hitable->ComputeAttributes(moved_r, io_rec);
+	io_rec.m_position += m_offset;
+}
+
+BOOL TranslatedInstance::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	Ray moved_r(r.m_org - m_offset, r.m_dir);
+	return m_hitable->Occluded(moved_r, t_min, t_max);
+}
+
+void TranslatedInstance::SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const
+{
+	m_hitable->SampleSurface(u1, u2, out_position, out_normal);
+	out_position += m_offset;
 }
 
 AABB TranslatedInstance::BoundingBox() const
@@ -238,27 +395,46 @@ RotatedInstance::RotatedInstance(IHitable *hitable, float angle, UINT32 rotateAx
 	m_boundingBox = AABB(_min, _max);
 }
 
-BOOL RotatedInstance::Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+Ray RotatedInstance::ToHitableSpace(const Ray &r) const
 {
-	BOOL hitMe = FALSE;
 	Vec3 org = r.m_org;
 	Vec3 dir = r.m_dir;
 	org.set(m_aAxisIndex, m_cosTheta * r.m_org[m_aAxisIndex] + m_oppositeOP * m_sinTheta * r.m_org[m_bAxisIndex]);
 	org.set(m_bAxisIndex, -m_oppositeOP * m_sinTheta * r.m_org[m_aAxisIndex] + m_cosTheta * r.m_org[m_bAxisIndex]);
 	dir.set(m_aAxisIndex, m_cosTheta * r.m_dir[m_aAxisIndex] + m_oppositeOP * m_sinTheta * r.m_dir[m_bAxisIndex]);
 	dir.set(m_bAxisIndex, -m_oppositeOP * m_sinTheta * r.m_dir[m_aAxisIndex] + m_cosTheta * r.m_dir[m_bAxisIndex]);
-	Ray moved_r(org, dir);
-	if (m_hitable->Hit(moved_r, t_min, t_max, out_rec))
-	{
-		Vec3 pos = out_rec.m_position;
-		Vec3 nor = out_rec.m_normal;
-		pos.set(m_aAxisIndex, m_cosTheta * out_rec.m_position[m_aAxisIndex] + m_OP * m_sinTheta * out_rec.m_position[m_bAxisIndex]);
-		pos.set(m_bAxisIndex, -m_OP * m_sinTheta * out_rec.m_position[m_aAxisIndex] + m_cosTheta * out_rec.m_position[m_bAxisIndex]);
-		nor.set(m_aAxisIndex, m_cosTheta * out_rec.m_normal[m_aAxisIndex] + m_OP * m_sinTheta * out_rec.m_normal[m_bAxisIndex]);
-		nor.set(m_bAxisIndex, -m_OP * m_sinTheta * out_rec.m_normal[m_aAxisIndex] + m_cosTheta * out_rec.m_normal[m_bAxisIndex]);
-		out_rec.m_position = pos;
-		out_rec.m_normal = nor;
-		hitMe = TRUE;
-	}
-	return hitMe;
+	return Ray(org, dir);
+}
+
+BOOL RotatedInstance::Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+{
+	return m_hitable->Intersect(ToHitableSpace(r), t_min, t_max, out_rec);
+}
+
+Vec3 RotatedInstance::FromHitableSpace(const Vec3 &v) const
+{
+	Vec3 rotated = v;
+	rotated.set(m_aAxisIndex, m_cosTheta * v[m_aAxisIndex] + m_OP * m_sinTheta * v[m_bAxisIndex]);
+	rotated.set(m_bAxisIndex, -m_OP * m_sinTheta * v[m_aAxisIndex] + m_cosTheta * v[m_bAxisIndex]);
+	return rotated;
+}
+
+void RotatedInstance::ComputeAttributes(const Ray &r, HitRecord &io_rec) const
+{
+	m_hitable->ComputeAttributes(ToHitableSpace(r), io_rec);
+	io_rec.m_position = FromHitableSpace(io_rec.m_position);
+	io_rec.m_normal = FromHitableSpace(io_rec.m_normal);
+}
+
+void RotatedInstance::SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const
+{
+	m_hitable->SampleSurface(u1, u2, out_position, out_normal);
+	out_position = FromHitableSpace(out_position);
+	out_normal = FromHitableSpace(out_normal);
+}
+
+BOOL RotatedInstance::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	// no record to rotate back
+	return m_hitable->Occluded(ToHitableSpace(r), t_min, t_max);
 }
\ No newline at end of file
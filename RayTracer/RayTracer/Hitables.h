@@ -2,18 +2,28 @@
 
 #include "Vec3.h"
 #include "AABB.h"
+#include "SceneArena.h"
 
 class Ray;
 class IMaterial;
+class Object;
 
+// The intersection tests only record the distance, the primitive and its barycentrics,
+// the rest is evaluated once for the closest hit after the traversal, see IHitable::ComputeAttributes
 struct HitRecord
 {
 	float						m_time;
+	UINT32						m_primitiveID;	// the triangle of a mesh
+	float						m_b1;			// barycentrics of the second and third vertices of the triangle
+	float						m_b2;
 	Vec3						m_position;
 	Vec3						m_normal;
 	float						m_u;
 	float						m_v;
+	float						m_uvDensity{ 0.0f };	// texture coordinates per world unit around the hit, for the texture filtering
+	float						m_footprint{ 0.0f };	// world width of the area seen by the ray at the hit, set by the integrators
 	IMaterial *					m_hitMaterial;
+	const Object *				m_hitObject;	// set by Object::ComputeAttributes, for the queries of the world
 };
 
 // General hitable interface
@@ -21,11 +31,24 @@ class IHitable
 {
 public:
 	IMaterial *					m_material{ nullptr };
+	BOOL						m_inSceneArena{ FALSE };	// destroyed by its SceneArena, not by its owner
 
 	virtual	~IHitable() = default;
-	virtual BOOL				Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const = 0;
+	// closest hit in [t_min, t_max] with all its attributes, Intersect then ComputeAttributes
+	BOOL						Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const;
+	// closest hit in [t_min, t_max], only m_time, m_primitiveID and the barycentrics are written
+	virtual BOOL				Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const = 0;
+	// position, normal, UV and material of a hit found by Intersect with the same ray
+	virtual void				ComputeAttributes(const Ray &r, HitRecord &io_rec) const = 0;
+	// TRUE when Hit would find something in [t_min, t_max], without the closest one nor its attributes
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const;
 	virtual void				BindMaterial(IMaterial *m) { m_material = m; }
 	virtual AABB				BoundingBox() const = 0;
+
+	// area lights, 0 when the surface cannot be sampled
+	virtual float				Area() const { return 0.0f; }
+	// a point uniformly distributed over the surface from two uniform numbers, and its normal
+	virtual void				SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const { assert(false && "Not an area light"); }
 };
 
 // Sphere hitable
@@ -36,11 +59,22 @@ public:
 	float						m_radius;
 
 	SphereHitable(const Vec3 &center, float radius);
-	virtual BOOL				Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual BOOL				Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual void				ComputeAttributes(const Ray &r, HitRecord &io_rec) const override;
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const override;
 	virtual AABB				BoundingBox() const override;
+	virtual float				Area() const override;
+	virtual void				SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const override;
+	// the texture coordinates are only computed when the material reads them
+	virtual void				BindMaterial(IMaterial *m) override;
+
+	// the coordinates of count unit normals, 4 at a time, the same values as the hits get
+	static void					CalculateUVs(const float *nx, const float *ny, const float *nz, UINT32 count, float *out_u, float *out_v);
 
 private:
-	void						CalculateUV(HitRecord &rec) const;
+	static void					CalculateUV(const Vec3 &normal, float &out_u, float &out_v);
+
+	BOOL						m_needsUV{ TRUE };	// without a material bound, a shared geometry, the coordinates are always computed
 };
 
 // Axis-aligned rectangle hitable
@@ -51,8 +85,12 @@ public:
 	UINT32						m_aAxisIndex, m_bAxisIndex, m_cAxisIndex;
 	BOOL						m_reverseFace;
 	AxisAlignedRectHitable(UINT32 aAxisIndex, UINT32 bAxisIndex, float a0, float a1, float b0, float b1, float c, BOOL reverseFace);
-	virtual BOOL				Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual BOOL				Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual void				ComputeAttributes(const Ray &r, HitRecord &io_rec) const override;
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const override;
 	virtual AABB				BoundingBox() const override;
+	virtual float				Area() const override { return (m_a1 - m_a0) * (m_b1 - m_b0); }
+	virtual void				SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const override;
 };
 
 
@@ -65,7 +103,9 @@ public:
 	UINT32						m_hitableCount{ 0 };
 
 	HitableCombo(IHitable **plist, UINT32 count) : m_hitableList(plist), m_hitableCount(count) {}
-	virtual BOOL				Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual BOOL				Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual void				ComputeAttributes(const Ray &r, HitRecord &io_rec) const override;
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const override;
 	virtual void				BindMaterial(IMaterial *m) override;
 	virtual AABB				BoundingBox() const override;
 };
@@ -77,8 +117,10 @@ public:
 	IHitable *					m_hitable;
 
 	TransformedInstance(IHitable *hitable) : m_hitable(hitable) {}
-	virtual	~TransformedInstance() { if (m_hitable) delete m_hitable; }
+	virtual	~TransformedInstance() { SceneArena::Delete(m_hitable); }
 	virtual void				BindMaterial(IMaterial *m) override { if (m_hitable) m_hitable->BindMaterial(m); }
+	// rigid transforms, the area is the one of the hitable
+	virtual float				Area() const override { return m_hitable->Area(); }
 };
 
 class TranslatedInstance : public TransformedInstance
@@ -87,8 +129,11 @@ public:
 	Vec3						m_offset;
 
 	TranslatedInstance(IHitable *hitable, const Vec3 &displacement) : TransformedInstance(hitable), m_offset(displacement) {}
-	virtual BOOL				Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual BOOL				Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual void				ComputeAttributes(const Ray &r, HitRecord &io_rec) const override;
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const override;
 	virtual AABB				BoundingBox() const override;
+	virtual void				SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const override;
 };
 
 class RotatedInstance : public TransformedInstance
@@ -101,6 +146,15 @@ public:
 	float						m_OP, m_oppositeOP;
 
 	RotatedInstance(IHitable *hitable, float angle, UINT32 rotateAxis);
-	virtual BOOL				Hit(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual BOOL				Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual void				ComputeAttributes(const Ray &r, HitRecord &io_rec) const override;
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const override;
 	virtual AABB				BoundingBox() const override { return m_boundingBox; }
+	virtual void				SampleSurface(float u1, float u2, Vec3 &out_position, Vec3 &out_normal) const override;
+
+private:
+	// the ray in the space of the rotated hitable
+	Ray							ToHitableSpace(const Ray &r) const;
+	// a position or a direction of the rotated hitable, back to the space of the instance
+	Vec3						FromHitableSpace(const Vec3 &v) const;
 };
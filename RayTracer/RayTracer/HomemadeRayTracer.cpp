@@ -6,6 +6,8 @@
 #include "OutputImage.h"
 #include "SimpleCamera.h"
 #include "Randomizer.h"
+#include "ThreadPool.h"
+#include "RayPacket.h"
 
 #include "InputListener.h"
 #include "Materials.h"
@@ -23,6 +25,8 @@ using namespace std;
 
 HomemadeRayTracer::HomemadeRayTracer(InputListener *inputListener, OutputImage *image, const World *world)
 	: m_inputListener(inputListener)
+	, m_samplePerPixel(SAMPLE_PER_PIXEL)
+	, m_maxSampleDepth(MAX_SAMPLE_DEPTH)
 	, m_world(world)
 {
 
@@ -30,25 +34,45 @@ HomemadeRayTracer::HomemadeRayTracer(InputListener *inputListener, OutputImage *
 
 HomemadeRayTracer::~HomemadeRayTracer()
 {
-
+	if (m_threadPool)
+	{
+		delete m_threadPool;
+		m_threadPool = nullptr;
+	}
+	delete m_sampler;
 }
 
 void HomemadeRayTracer::OnInit()
 {
 	cout << "[HomemadeRayTracer] Init" << endl;
+	if (!m_inputListener)
+		return; // headless, no hot keys
+
 	m_inputListener->RegisterKey(VK_SPACE);
 	m_inputListener->RegisterKey('H');
 	m_inputListener->RegisterKey('N');
 	m_inputListener->RegisterKey('M');
+	m_inputListener->RegisterKey('P');
 }
 
 void HomemadeRayTracer::OnUpdate(const SimpleCamera *camera, OutputImage *image)
 {
+	if (!m_inputListener)
+		return;
+
 	if (m_inputListener->WhenReleaseKey(VK_SPACE))
 	{
 		TraceRay(camera, image);
 	}
 
+	if (m_inputListener->WhenReleaseKey('P'))
+	{
+		// the camera is not tracked, press space after moving it to start over
+		TracePass(camera, image, 1);
+
+		cout << "[HomemadeRayTracer][Progressive] SPP: " << m_accumulatedSPP << ", relative error: " << EstimateRelativeError() << endl;
+	}
+
 	if (m_inputListener->WhenReleaseKey('H'))
 	{
 		HelpInfo();
@@ -82,8 +106,11 @@ void HomemadeRayTracer::HelpInfo()
 	cout << "  [space] Render result to output image and upload it to viewer." << endl;
 	cout << "  [n] Switch on/off normal display." << endl;
 	cout << "  [m] Switch on/off 1-SPP." << endl;
+	cout << "  [p] Add a 1-SPP pass to the accumulated image." << endl;
 	cout << "[NormalDisplay] " << (m_enableNormalDisplay ? "Enabled" : "Disabled") << endl;
 	cout << "[1SPP] " << (m_enable1SPP ? "Enabled" : "Disabled") << endl;
+	cout << "[SPP] " << m_samplePerPixel << endl;
+	cout << "[MaxDepth] " << m_maxSampleDepth << endl;
 	cout << "==========================================" << endl;
 }
 
@@ -93,73 +120,802 @@ void HomemadeRayTracer::TraceRay(const SimpleCamera *camera, OutputImage *image)
 	if (m_enable1SPP)
 		cout << "[HomemadeRayTracer] SPP: 1" << endl;
 	else
-		cout << "[HomemadeRayTracer] SPP: " << SAMPLE_PER_PIXEL << endl;
+		cout << "[HomemadeRayTracer] SPP: " << m_samplePerPixel << endl;
 
 	//image->RenderAsRainbow();
 
+	if (m_enableAdaptiveSampling && !m_enable1SPP)
+	{
+		TraceAdaptive(camera, image);
+		cout << "[HomemadeRayTracer] Done" << endl;
+		return;
+	}
+
+	// the 1-SPP preview samples the pixel corners, like it always did
+	ResetAccumulation();
+	TracePassInternal(camera, image, GetSamplePerPixel(), !m_enable1SPP);
+
+	cout << "[HomemadeRayTracer] Done" << endl;
+}
+
+void HomemadeRayTracer::ResetAccumulation()
+{
+	std::fill(m_accumulation.begin(), m_accumulation.end(), zero());
+	std::fill(m_luminanceSums.begin(), m_luminanceSums.end(), 0.0f);
+	std::fill(m_luminanceSquares.begin(), m_luminanceSquares.end(), 0.0f);
+	std::fill(m_sampleCounts.begin(), m_sampleCounts.end(), 0);
+	m_activePixels.clear();
+	m_accumulatedSPP = 0;
+}
+
+void HomemadeRayTracer::TracePass(const SimpleCamera *camera, OutputImage *image, UINT32 samplesPerPixel)
+{
+	TracePassInternal(camera, image, samplesPerPixel, TRUE);
+}
+
+void HomemadeRayTracer::TracePassInternal(const SimpleCamera *camera, OutputImage *image, UINT32 samplesPerPixel, BOOL jitter)
+{
 	UINT32 width = image->m_width;
 	UINT32 height = image->m_height;
 
-	Vec3 *pixels = new Vec3[width * height];
+	if (width != m_accumulationWidth || height != m_accumulationHeight)
+	{
+		size_t pixelCount = (size_t)width * height;
+		m_accumulation.assign(pixelCount, zero());
+		m_luminanceSums.assign(pixelCount, 0.0f);
+		m_luminanceSquares.assign(pixelCount, 0.0f);
+		m_sampleCounts.assign(pixelCount, 0);
+		m_resolved.assign(pixelCount, zero());
+		m_activePixels.clear();
+		m_accumulationWidth = width;
+		m_accumulationHeight = height;
+		m_accumulatedSPP = 0;
+	}
+
+	CreateThreadPool();
+
+	m_footprintOrigin = camera->GetOrigin();
+	m_footprintSpread = m_enableTextureLod ? camera->GetPixelSpread(height) : 0.0f;
 
-	INT32 nthreads, tid;
-	UINT32 progress = 0;
-#pragma omp parallel for default(none) shared(pixels, progress) private(nthreads, tid)
-	for (INT32 j = 0; j < (INT32)height; j++) // To use omp, I have to use signed index.
+	vector<Tile> tiles;
+	TileScheduler::GenerateTiles(width, height, m_tileWidth, m_tileHeight, m_tileOrder, tiles);
+
+	atomic<UINT32> progress(0);
+	atomic<UINT64> rayCount(0);
+	Randomizer::SetSampler(m_sampler);
+	m_threadPool->Dispatch((UINT32)tiles.size(), [&](UINT32 taskIndex, UINT32 threadIndex)
+	{
+		const Tile &tile = tiles[taskIndex];
+		rayCount += AccumulateTile(camera, tile, width, height, samplesPerPixel, jitter);
+		Randomizer::EndSample();
+
+		// the finished tile goes straight to the output image
+		ResolveRegion(image, tile.m_x0, tile.m_y0, tile.m_x1, tile.m_y1);
+
+#if defined(SHOW_PROGRESS)
+		UINT32 done = ++progress;
+		printf("[Thread %02u(%u)]%.2lf%%\r", threadIndex, m_threadPool->GetThreadCount(), done * 100.0 / tiles.size());
+#endif
+	}, m_enableWorkStealing);
+	Randomizer::SetSampler(nullptr);
+
+	image->m_isDirty = TRUE;
+	m_accumulatedSPP += samplesPerPixel;
+	m_lastPassRayCount = rayCount;
+	m_frameIndex++;
+	printf("[HomemadeRayTracer] %zu tiles (%ux%u, %s), %u threads%s, %u SPP accumulated\n", tiles.size(), m_tileWidth, m_tileHeight, TileScheduler::GetOrderName(m_tileOrder), m_threadPool->GetThreadCount(), m_enableWorkStealing ? "" : ", no stealing", m_accumulatedSPP);
+}
+
+void HomemadeRayTracer::TraceAdaptive(const SimpleCamera *camera, OutputImage *image)
+{
+	UINT32 maxSPP = max(m_samplePerPixel, m_adaptiveMinSPP);
+	ResetAccumulation();
+
+	// every pixel gets the minimum first, the error estimates are meaningless below it
+	UINT32 passSPP = min(m_adaptiveMinSPP, maxSPP);
+	TracePassInternal(camera, image, passSPP, TRUE);
+	UINT64 rayCount = m_lastPassRayCount;
+	while (m_accumulatedSPP < maxSPP)
+	{
+		UINT32 activeCount = UpdateActivePixels();
+		printf("[HomemadeRayTracer][Adaptive] %u SPP, %u pixels (%.2lf%%) above the error threshold %.4f\n",
+			m_accumulatedSPP, activeCount, activeCount * 100.0 / m_activePixels.size(), m_adaptiveErrorThreshold);
+		if (activeCount == 0)
+			break;
+
+		TracePassInternal(camera, image, min(m_adaptiveMinSPP, maxSPP - m_accumulatedSPP), TRUE);
+		rayCount += m_lastPassRayCount;
+	}
+	m_activePixels.clear();
+	m_lastPassRayCount = rayCount;
+
+	UINT64 sampleCount = GetAccumulatedSampleCount();
+	printf("[HomemadeRayTracer][Adaptive] %.2lf SPP on average, %u to %u, %.2lf%% of the uniform samples\n",
+		(double)sampleCount / m_sampleCounts.size(), m_adaptiveMinSPP, maxSPP, sampleCount * 100.0 / ((double)m_sampleCounts.size() * maxSPP));
+}
+
+UINT32 HomemadeRayTracer::UpdateActivePixels()
+{
+	m_activePixels.resize(m_sampleCounts.size());
+	UINT32 activeCount = 0;
+	for (size_t index = 0; index < m_sampleCounts.size(); index++)
+	{
+		BOOL active = (PixelAdaptiveError(index) > m_adaptiveErrorThreshold);
+		m_activePixels[index] = active ? 1 : 0;
+		activeCount += active;
+	}
+	return activeCount;
+}
+
+float HomemadeRayTracer::PixelRelativeError(size_t index) const
+{
+	UINT32 n = m_sampleCounts[index];
+	if (n < 2)
+		return FLT_MAX;
+
+	float mean = m_luminanceSums[index] / n;
+	float variance = max(0.0f, (m_luminanceSquares[index] / n - mean * mean) * n / (n - 1));
+	// dark pixels are compared against a floor, their relative error would never settle otherwise
+	return sqrt(variance / n) / max(mean, 0.01f);
+}
+
+float HomemadeRayTracer::PixelAdaptiveError(size_t index) const
+{
+	// one more sample, as if the next one could still find a light: a pixel whose few samples all
+	// missed the lights has no variance yet, it must not be taken as converged. Its luminance is one over
+	// the count of the samples taken, about the chance of a light they all missed, so the prior fades:
+	// a black pixel is under the 0.01 floor from 10 samples on and retires after 10 / sqrt(threshold), 32 for 0.1
+	UINT32 sampleCount = m_sampleCounts[index];
+	float prior = 1.0f / sampleCount;
+	UINT32 n = sampleCount + 1;
+	float mean = (m_luminanceSums[index] + prior) / n;
+	float variance = max(0.0f, ((m_luminanceSquares[index] + prior * prior) / n - mean * mean) * n / (n - 1));
+	return sqrt(variance / n) / max(mean, 0.01f);
+}
+
+UINT64 HomemadeRayTracer::GetAccumulatedSampleCount() const
+{
+	UINT64 sampleCount = 0;
+	for (UINT32 n : m_sampleCounts)
+		sampleCount += n;
+	return sampleCount;
+}
+
+void HomemadeRayTracer::RenderSampleCountHeatMap(OutputImage *image)
+{
+	assert(image->m_width == m_accumulationWidth && image->m_height == m_accumulationHeight);
+	if (m_sampleCounts.empty())
+		return;
+
+	UINT32 minCount = *min_element(m_sampleCounts.begin(), m_sampleCounts.end());
+	UINT32 maxCount = *max_element(m_sampleCounts.begin(), m_sampleCounts.end());
+	float scale = (maxCount > minCount) ? 1.0f / (maxCount - minCount) : 0.0f;
+	for (size_t index = 0; index < m_sampleCounts.size(); index++)
+	{
+		// jet color map, blue, cyan, green, yellow, red
+		float t = (m_sampleCounts[index] - minCount) * scale;
+		m_resolved[index] = Vec3(1.5f - fabs(4.0f * t - 3.0f), 1.5f - fabs(4.0f * t - 2.0f), 1.5f - fabs(4.0f * t - 1.0f));
+		m_resolved[index].clamp(zero(), Vec3(1.0f, 1.0f, 1.0f));
+	}
+	image->RenderRegion(m_resolved.data(), 0, 0, m_accumulationWidth, m_accumulationHeight);
+	image->m_isDirty = TRUE;
+	printf("[HomemadeRayTracer] Sample count heat map, %u (blue) to %u (red) samples per pixel\n", minCount, maxCount);
+}
+
+void HomemadeRayTracer::Resolve(OutputImage *image)
+{
+	assert(image->m_width == m_accumulationWidth && image->m_height == m_accumulationHeight);
+	ResolveRegion(image, 0, 0, m_accumulationWidth, m_accumulationHeight);
+	image->m_isDirty = TRUE;
+}
+
+void HomemadeRayTracer::ResolveRegion(OutputImage *image, UINT32 x0, UINT32 y0, UINT32 x1, UINT32 y1)
+{
+	for (UINT32 j = y0; j < y1; j++)
 	{
-		for (UINT32 i = 0; i < width; i++)
+		for (UINT32 i = x0; i < x1; i++)
 		{
-			Vec3 &col = pixels[j * width + i];
+			UINT32 index = j * m_accumulationWidth + i;
+			Vec3 col = m_sampleCounts[index] ? m_accumulation[index] / float(m_sampleCounts[index]) : zero();
 
-			if (m_enable1SPP)
+			// the gamma correction, to the approximation, use the power 1/gamma, and the gamma == 2, which is just square-root.
+			m_resolved[index] = Vec3(sqrt(col[0]), sqrt(col[1]), sqrt(col[2]));
+		}
+	}
+	image->RenderRegion(m_resolved.data(), x0, y0, x1, y1);
+}
+
+float HomemadeRayTracer::EstimateRelativeError() const
+{
+	double errorSum = 0.0;
+	UINT32 pixelCount = 0;
+	for (size_t index = 0; index < m_sampleCounts.size(); index++)
+	{
+		if (m_sampleCounts[index] < 2)
+			continue;
+
+		errorSum += PixelRelativeError(index);
+		pixelCount++;
+	}
+	return pixelCount ? (float)(errorSum / pixelCount) : FLT_MAX;
+}
+
+Vec3 HomemadeRayTracer::GetMeanRadiance() const
+{
+	double sums[3] = { 0.0, 0.0, 0.0 };
+	UINT32 pixelCount = 0;
+	for (size_t index = 0; index < m_sampleCounts.size(); index++)
+	{
+		UINT32 n = m_sampleCounts[index];
+		if (n == 0)
+			continue;
+
+		for (UINT32 c = 0; c < 3; c++)
+			sums[c] += m_accumulation[index][c] / n;
+		pixelCount++;
+	}
+	return pixelCount ? Vec3((float)(sums[0] / pixelCount), (float)(sums[1] / pixelCount), (float)(sums[2] / pixelCount)) : zero();
+}
+
+void HomemadeRayTracer::SetPacketWidth(UINT32 width)
+{
+	assert(width <= 1 || width == 4 || width == 8 || width == 16);
+	m_packetWidth = (width <= 1) ? 1 : width;
+}
+
+void HomemadeRayTracer::SetSampler(SamplerType type)
+{
+	delete m_sampler;
+	m_sampler = ISampler::Create(type, Randomizer::GetSeed());
+}
+
+void HomemadeRayTracer::SetThreadCount(UINT32 threadCount)
+{
+	m_threadCount = threadCount;
+	if (m_threadPool)
+	{
+		delete m_threadPool;
+		m_threadPool = nullptr;
+	}
+}
+
+ThreadPool *HomemadeRayTracer::CreateThreadPool()
+{
+	if (!m_threadPool)
+		m_threadPool = new ThreadPool(m_threadCount);
+	return m_threadPool;
+}
+
+void HomemadeRayTracer::PrintThreadStats() const
+{
+	if (!m_threadPool)
+		return;
+
+	double wallSeconds = m_threadPool->GetDispatchSeconds();
+	double minBusy = DBL_MAX, maxBusy = 0.0, totalBusy = 0.0;
+	for (UINT32 t = 0; t < m_threadPool->GetThreadCount(); t++)
+	{
+		const ThreadPool::ThreadStats &stats = m_threadPool->GetThreadStats(t);
+		printf("[HomemadeRayTracer][Thread %02u] busy %.3lfs (%5.1lf%%), %u tiles, %u stolen\n", t, stats.m_busySeconds, stats.m_busySeconds * 100.0 / wallSeconds, stats.m_taskCount, stats.m_stealCount);
+		minBusy = min(minBusy, stats.m_busySeconds);
+		maxBusy = max(maxBusy, stats.m_busySeconds);
+		totalBusy += stats.m_busySeconds;
+	}
+	printf("[HomemadeRayTracer] busy min/avg/max %.3lf/%.3lf/%.3lfs over %.3lfs, max/avg %.3lf\n",
+		minBusy, totalBusy / m_threadPool->GetThreadCount(), maxBusy, wallSeconds, maxBusy * m_threadPool->GetThreadCount() / totalBusy);
+}
+
+// only the displayable range counts for the error, a few very bright samples would dominate it otherwise
+static inline float DisplayLuminance(const Vec3 &sample)
+{
+	return min(1.0f, 0.2126f * sample.r() + 0.7152f * sample.g() + 0.0722f * sample.b());
+}
+
+// power heuristic, the weight of a strategy of density pdf against the other one
+static inline float PowerHeuristic(float pdf, float otherPdf)
+{
+	float pdf2 = pdf * pdf;
+	float sum = pdf2 + otherPdf * otherPdf;
+	return (sum > 0.0f) ? pdf2 / sum : 0.0f;
+}
+
+// Next event estimation at a hit that scattered off a material that is not specular, the radiance of a point
+// on the lights weighted against the chance that the scattered ray finds it. io_rayCount counts the shadow ray.
+static Vec3 SampleDirectLight(const World *world, const Ray &r_in, const HitRecord &rec, UINT32 &io_rayCount)
+{
+	// without lights the path keeps the random numbers of BSDF sampling alone
+	const LightSources *lightSources = world->GetLightSources();
+	if (lightSources->GetSampledLightCount() == 0)
+		return zero();
+
+	float u0 = Randomizer::RandomUNorm();
+	float u1 = Randomizer::RandomUNorm();
+	float u2 = Randomizer::RandomUNorm();
+	LightSample light;
+	if (!lightSources->SampleLight(rec.m_position, rec.m_normal, u0, u1, u2, light))
+		return zero();
+
+	Vec3 toLight = light.m_position - rec.m_position;
+	float distanceSquared = dot(toLight, toLight);
+	float cosineLight = fabsf(dot(light.m_normal, toLight)) / sqrtf(distanceSquared);	// both sides emit
+	float scatterPdf = rec.m_hitMaterial->Pdf(r_in, rec, toLight);
+	if (scatterPdf <= 0.0f || cosineLight <= 0.0f)
+		return zero();
+
+	io_rayCount++;
+	if (world->Occluded(Ray(rec.m_position, toLight), 0.001f, 0.999f))
+		return zero();
+
+	float lightPdf = light.m_pdfArea * distanceSquared / cosineLight;
+	return rec.m_hitMaterial->Eval(r_in, rec, toLight) * light.m_emitted * (PowerHeuristic(lightPdf, scatterPdf) / lightPdf);
+}
+
+// the weight of the emission found by a scattered ray, the other half of SampleDirectLight.
+// scatterPdf is the density of the ray leaving from the scatter point, 0 when the light was not sampled there.
+static float EmissionWeight(const World *world, const HitRecord &rec, const Vec3 &scatterPosition, const Vec3 &scatterNormal, float scatterPdf)
+{
+	if (scatterPdf <= 0.0f)
+		return 1.0f;
+	float pdfArea = world->GetLightSources()->PdfArea(rec.m_hitObject, scatterPosition, scatterNormal);
+	if (pdfArea <= 0.0f)
+		return 1.0f;
+
+	Vec3 toLight = rec.m_position - scatterPosition;
+	float distanceSquared = dot(toLight, toLight);
+	float cosineLight = fabsf(dot(rec.m_normal, toLight)) / sqrtf(distanceSquared);
+	if (cosineLight <= 0.0f)
+		return 1.0f;
+	return PowerHeuristic(scatterPdf, pdfArea * distanceSquared / cosineLight);
+}
+
+UINT64 HomemadeRayTracer::AccumulateTile(const SimpleCamera *camera, const Tile &tile, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter)
+{
+	UINT64 rayCount = 0;
+	if (m_packetWidth > 1 && m_integrator == INTEGRATOR_ITERATIVE)
+	{
+		UINT32 blockWidth = (m_packetWidth == 4) ? 2 : 4;
+		UINT32 blockHeight = m_packetWidth / blockWidth;
+		for (UINT32 y = tile.m_y0; y < tile.m_y1; y += blockHeight)
+		{
+			for (UINT32 x = tile.m_x0; x < tile.m_x1; x += blockWidth)
 			{
-				// Single-sample
-				float u = float(i) / float(width);
-				float v = float(j) / float(height);
-				Ray r = camera->GetRay(u, v);
-				col = Sample(r, 0);
+				UINT32 x1 = min(tile.m_x1, x + blockWidth);
+				UINT32 y1 = min(tile.m_y1, y + blockHeight);
+				switch (m_packetWidth)
+				{
+				case 4:		rayCount += AccumulatePixelBlock<4>(camera, x, y, x1, y1, width, height, samplesPerPixel, jitter); break;
+				case 8:		rayCount += AccumulatePixelBlock<8>(camera, x, y, x1, y1, width, height, samplesPerPixel, jitter); break;
+				default:	rayCount += AccumulatePixelBlock<16>(camera, x, y, x1, y1, width, height, samplesPerPixel, jitter); break;
+				}
 			}
-			else
+		}
+		return rayCount;
+	}
+
+	if (m_integrator == INTEGRATOR_WAVEFRONT)
+		return AccumulateTileWavefront(camera, tile, width, height, samplesPerPixel, jitter);
+
+	for (UINT32 j = tile.m_y0; j < tile.m_y1; j++)
+	{
+		for (UINT32 i = tile.m_x0; i < tile.m_x1; i++)
+		{
+			if (IsPixelActive(j * width + i))
+				rayCount += AccumulatePixel(camera, i, j, width, height, samplesPerPixel, jitter);
+		}
+	}
+	return rayCount;
+}
+
+UINT32 HomemadeRayTracer::AccumulatePixel(const SimpleCamera *camera, UINT32 i, UINT32 j, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter)
+{
+	UINT32 index = j * width + i;
+	Randomizer::BeginStream(((UINT64)m_frameIndex << 32) | index); // one stream per pixel per pass
+
+	Vec3 col = zero();
+	float luminanceSum = 0.0f;
+	float luminanceSquares = 0.0f;
+	UINT32 rayCount = 0;
+	for (UINT32 s = 0; s < samplesPerPixel; s++)
+	{
+		Randomizer::BeginSample(i, j, m_sampleCounts[index] + s);
+		float du = jitter ? Randomizer::RandomUNorm() : 0.0f;
+		float dv = jitter ? Randomizer::RandomUNorm() : 0.0f;
+		float u = float(i + du) / float(width);
+		float v = float(j + dv) / float(height);
+
+		Ray r = camera->GetRay(u, v);
+		Vec3 sample = (m_integrator == INTEGRATOR_RECURSIVE) ? Sample(r, 0, rayCount) : SampleIterative(r, rayCount);
+		col += sample;
+
+		float luminance = DisplayLuminance(sample);
+		luminanceSum += luminance;
+		luminanceSquares += luminance * luminance;
+	}
+
+	m_accumulation[index] += col;
+	m_luminanceSums[index] += luminanceSum;
+	m_luminanceSquares[index] += luminanceSquares;
+	m_sampleCounts[index] += samplesPerPixel;
+	return rayCount;
+}
+
+template<UINT32 N>
+UINT32 HomemadeRayTracer::AccumulatePixelBlock(const SimpleCamera *camera, UINT32 x0, UINT32 y0, UINT32 x1, UINT32 y1, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter)
+{
+	const UINT32 blockWidth = (N == 4) ? 2 : 4;
+
+	// every lane keeps the random stream of its pixel, the samples are exactly the ones of AccumulatePixel
+	RandomStream streams[N];
+	UINT32 indices[N];
+	Vec3 cols[N];
+	float luminanceSums[N];
+	float luminanceSquares[N];
+	UINT32 laneMask = 0;
+	for (UINT32 j = y0; j < y1; j++)
+	{
+		for (UINT32 i = x0; i < x1; i++)
+		{
+			UINT32 lane = (j - y0) * blockWidth + (i - x0);
+			indices[lane] = j * width + i;
+			if (!IsPixelActive(indices[lane]))
+				continue;
+			Randomizer::BeginStream(((UINT64)m_frameIndex << 32) | indices[lane]);
+			streams[lane] = Randomizer::SaveStream();
+			cols[lane] = zero();
+			luminanceSums[lane] = 0.0f;
+			luminanceSquares[lane] = 0.0f;
+			laneMask |= 1u << lane;
+		}
+	}
+
+	if (laneMask == 0)
+		return 0;
+
+	// the lanes outside of the tile stay zeroed, they go through the SIMD math but are masked out
+	RayPacket<N> packet{};
+	HitRecord recs[N];
+	UINT32 rayCount = 0;
+	for (UINT32 s = 0; s < samplesPerPixel; s++)
+	{
+		packet.m_activeMask = 0;
+		for (UINT32 lanes = laneMask; lanes; lanes &= lanes - 1)
+		{
+			UINT32 lane = LowestBit(lanes);
+			Randomizer::RestoreStream(streams[lane]);
+			Randomizer::BeginSample(x0 + lane % blockWidth, y0 + lane / blockWidth, m_sampleCounts[indices[lane]] + s);
+			float du = jitter ? Randomizer::RandomUNorm() : 0.0f;
+			float dv = jitter ? Randomizer::RandomUNorm() : 0.0f;
+			float u = float(x0 + lane % blockWidth + du) / float(width);
+			float v = float(y0 + lane / blockWidth + dv) / float(height);
+			packet.SetRay(lane, camera->GetRay(u, v), FLT_MAX);
+			streams[lane] = Randomizer::SaveStream();
+		}
+
+		UINT32 hitMask = m_world->HitPacket(packet, 0.001f, recs);
+		rayCount += PopCount(laneMask);
+
+		// the bounces scatter, they are traced one path at a time
+		for (UINT32 lanes = laneMask; lanes; lanes &= lanes - 1)
+		{
+			UINT32 lane = LowestBit(lanes);
+			Randomizer::RestoreStream(streams[lane]);
+			Vec3 sample = ShadePath(packet.GetRay(lane), (hitMask >> lane) & 1, recs[lane], rayCount);
+			streams[lane] = Randomizer::SaveStream();
+			cols[lane] += sample;
+
+			float luminance = DisplayLuminance(sample);
+			luminanceSums[lane] += luminance;
+			luminanceSquares[lane] += luminance * luminance;
+		}
+	}
+
+	for (UINT32 lanes = laneMask; lanes; lanes &= lanes - 1)
+	{
+		UINT32 lane = LowestBit(lanes);
+		UINT32 index = indices[lane];
+		m_accumulation[index] += cols[lane];
+		m_luminanceSums[index] += luminanceSums[lane];
+		m_luminanceSquares[index] += luminanceSquares[lane];
+		m_sampleCounts[index] += samplesPerPixel;
+	}
+	return rayCount;
+}
+
+// a path in flight of the wavefront integrator
+struct WavefrontPath
+{
+	Ray							m_ray;
+	Vec3						m_throughput;
+	Vec3						m_radiance;
+	RandomStream				m_random;		// the path's own stream, paths of a pixel are in flight together
+	UINT32						m_pixel;		// in the tile
+	UINT32						m_depth;
+	Vec3						m_scatterPosition;	// where m_ray left from, for the weight of the lights it finds
+	Vec3						m_scatterNormal;
+	float						m_scatterPdf;		// of m_ray, 0 when the lights were not sampled there
+};
+
+// reused from tile to tile, one set per render thread
+struct WavefrontBuffers
+{
+	std::vector<WavefrontPath>	m_paths;
+	std::vector<HitRecord>		m_hits;			// by path
+	std::vector<UINT8>			m_hitFlags;		// by path
+	std::vector<UINT32>			m_active;		// paths to intersect
+	std::vector<UINT32>			m_queues;		// hit paths sorted by material
+	std::vector<Vec3>			m_pixelRadiance;
+	std::vector<float>			m_pixelLuminanceSums;
+	std::vector<float>			m_pixelLuminanceSquares;
+	std::vector<UINT32>			m_pixels;		// the pixels of the tile sampled by the pass
+};
+
+static thread_local WavefrontBuffers s_wavefront;
+
+// at most that many paths per wave, the samples of a tile are split over several waves beyond it
+#define MAX_WAVEFRONT_PATHS (1 << 14)
+
+static void IntersectPaths(const World *world, const UINT32 *indices, UINT32 count, WavefrontBuffers &buffers)
+{
+	for (UINT32 k = 0; k < count; k++)
+	{
+		UINT32 p = indices[k];
+		float nearest = 0.001f;
+		float cloestSoFar = FLT_MAX;
+		buffers.m_hitFlags[p] = (UINT8)world->Hit(buffers.m_paths[p].m_ray, nearest, cloestSoFar, buffers.m_hits[p]);
+	}
+}
+
+// consecutive paths go through the packet traversal, this is for the camera rays, which are still coherent
+template<UINT32 N>
+static void IntersectPathPackets(const World *world, const UINT32 *indices, UINT32 count, WavefrontBuffers &buffers)
+{
+	RayPacket<N> packet{};
+	HitRecord recs[N];
+	for (UINT32 begin = 0; begin < count; begin += N)
+	{
+		UINT32 laneCount = min(N, count - begin);
+		packet.m_activeMask = 0;
+		for (UINT32 lane = 0; lane < laneCount; lane++)
+			packet.SetRay(lane, buffers.m_paths[indices[begin + lane]].m_ray, FLT_MAX);
+
+		UINT32 hitMask = world->HitPacket(packet, 0.001f, recs);
+		for (UINT32 lane = 0; lane < laneCount; lane++)
+		{
+			UINT32 p = indices[begin + lane];
+			buffers.m_hitFlags[p] = (UINT8)((hitMask >> lane) & 1);
+			buffers.m_hits[p] = recs[lane];
+		}
+	}
+}
+
+// One material type, so that Scatter is called directly and the loop stays on the same code.
+// Same steps as ShadePath after a hit, returns the number of paths appended to io_next, io_rayCount counts the shadow rays.
+template<typename MaterialType>
+static UINT32 ShadeQueue(const World *world, const UINT32 *queue, UINT32 count, WavefrontBuffers &buffers, UINT32 maxDepth, UINT32 russianRouletteDepth, BOOL lightSampling, const Vec3 &footprintOrigin, float footprintSpread, UINT32 *io_next, UINT64 &io_rayCount)
+{
+	const BOOL weightEmission = lightSampling && MaterialType::GetStaticID() == MID_DIFFUSE_LIGHT;
+	UINT32 rayCount = 0;
+	UINT32 nextCount = 0;
+	for (UINT32 k = 0; k < count; k++)
+	{
+		UINT32 p = queue[k];
+		WavefrontPath &path = buffers.m_paths[p];
+		HitRecord &rec = buffers.m_hits[p];
+		rec.m_footprint = footprintSpread * (rec.m_position - footprintOrigin).length();
+		const MaterialType *material = static_cast<const MaterialType *>(rec.m_hitMaterial);
+
+		// the lights are sampled unless the material only scatters toward single directions
+		const BOOL sampleLights = lightSampling && !material->MaterialType::IsSpecular();
+		Randomizer::RestoreStream(path.m_random);
+		Vec3 attenuation;
+		Ray r_scattered;
+		Vec3 emmitted;
+		emmitted.zero();
+		BOOL alive = (path.m_depth < maxDepth && material->MaterialType::Scatter(path.m_ray, rec, attenuation, r_scattered, emmitted));
+		if (weightEmission)
+			emmitted *= EmissionWeight(world, rec, path.m_scatterPosition, path.m_scatterNormal, path.m_scatterPdf);
+		path.m_radiance += path.m_throughput * emmitted;
+		if (alive)
+		{
+			path.m_scatterPdf = 0.0f;
+			if (sampleLights)
 			{
-				// Multi-sample
-				col.zero();
-				for (UINT32 s = 0; s < SAMPLE_PER_PIXEL; s++)
-				{
-					float u = float(i + Randomizer::RandomUNorm()) / float(width);
-					float v = float(j + Randomizer::RandomUNorm()) / float(height);
+				path.m_radiance += path.m_throughput * SampleDirectLight(world, path.m_ray, rec, rayCount);
+				path.m_scatterPosition = rec.m_position;
+				path.m_scatterNormal = rec.m_normal;
+				path.m_scatterPdf = material->MaterialType::Pdf(path.m_ray, rec, r_scattered.m_dir);
+			}
+			path.m_throughput *= attenuation;
+			path.m_ray = r_scattered;
+
+			// Russian roulette, the surviving paths are weighted up to keep the estimate unbiased
+			if (path.m_depth + 1 >= russianRouletteDepth)
+			{
+				float survival = min(0.95f, max(path.m_throughput.x(), max(path.m_throughput.y(), path.m_throughput.z())));
+				if (survival <= 0.0f || Randomizer::RandomUNorm() >= survival)
+					alive = FALSE;
+				else
+					path.m_throughput /= survival;
+			}
+		}
+		path.m_random = Randomizer::SaveStream();
+		path.m_depth++;
+
+		if (alive)
+			io_next[nextCount++] = p;
+		else
+			path.m_depth = UINT_MAX;	// done
+	}
+	io_rayCount += rayCount;
+	return nextCount;
+}
+
+UINT64 HomemadeRayTracer::AccumulateTileWavefront(const SimpleCamera *camera, const Tile &tile, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter)
+{
+	WavefrontBuffers &buffers = s_wavefront;
+	UINT32 tileWidth = tile.m_x1 - tile.m_x0;
+	UINT32 pixelCount = tileWidth * (tile.m_y1 - tile.m_y0);
+	buffers.m_pixelRadiance.assign(pixelCount, zero());
+	buffers.m_pixelLuminanceSums.assign(pixelCount, 0.0f);
+	buffers.m_pixelLuminanceSquares.assign(pixelCount, 0.0f);
+	buffers.m_pixels.clear();
+	for (UINT32 pixel = 0; pixel < pixelCount; pixel++)
+	{
+		if (IsPixelActive((tile.m_y0 + pixel / tileWidth) * width + tile.m_x0 + pixel % tileWidth))
+			buffers.m_pixels.push_back(pixel);
+	}
+	UINT32 activePixelCount = (UINT32)buffers.m_pixels.size();
+	if (activePixelCount == 0)
+		return 0;
 
-					Ray r = camera->GetRay(u, v);
-					col += Sample(r, 0);
+	UINT32 samplesPerWave = max(1u, min(samplesPerPixel, MAX_WAVEFRONT_PATHS / activePixelCount));
+	UINT64 rayCount = 0;
+	for (UINT32 firstSample = 0; firstSample < samplesPerPixel; firstSample += samplesPerWave)
+	{
+		UINT32 waveSamples = min(samplesPerWave, samplesPerPixel - firstSample);
+		UINT32 pathCount = activePixelCount * waveSamples;
+		buffers.m_paths.resize(pathCount);
+		buffers.m_hits.resize(pathCount);
+		buffers.m_hitFlags.resize(pathCount);
+		buffers.m_active.resize(pathCount);
+		buffers.m_queues.resize(pathCount);
+
+		// camera rays, the first sample of a pixel uses the pixel's stream of the other integrators,
+		// the others get their own, hashed from the pixel's stream and the sample index
+		for (UINT32 k = 0; k < activePixelCount; k++)
+		{
+			UINT32 pixel = buffers.m_pixels[k];
+			UINT32 i = tile.m_x0 + pixel % tileWidth;
+			UINT32 j = tile.m_y0 + pixel / tileWidth;
+			UINT64 streamID = ((UINT64)m_frameIndex << 32) | (j * width + i);
+			for (UINT32 s = 0; s < waveSamples; s++)
+			{
+				UINT32 p = k * waveSamples + s;
+				Randomizer::BeginStream(Randomizer::SubStreamID(streamID, firstSample + s));
+				Randomizer::BeginSample(i, j, m_sampleCounts[j * width + i] + firstSample + s);
+				float du = jitter ? Randomizer::RandomUNorm() : 0.0f;
+				float dv = jitter ? Randomizer::RandomUNorm() : 0.0f;
+				float u = float(i + du) / float(width);
+				float v = float(j + dv) / float(height);
+
+				WavefrontPath &path = buffers.m_paths[p];
+				path.m_ray = camera->GetRay(u, v);
+				path.m_throughput = Vec3(1.0f, 1.0f, 1.0f);
+				path.m_radiance = zero();
+				path.m_random = Randomizer::SaveStream();
+				path.m_pixel = pixel;
+				path.m_depth = 0;
+				path.m_scatterPdf = 0.0f;
+				buffers.m_active[p] = p;
+			}
+		}
+
+		UINT32 activeCount = pathCount;
+		for (UINT32 wave = 0; activeCount > 0; wave++)
+		{
+			// intersect the whole wave
+			const UINT32 *active = buffers.m_active.data();
+			rayCount += activeCount;
+			switch ((wave == 0) ? m_packetWidth : 1)
+			{
+			case 4:		IntersectPathPackets<4>(m_world, active, activeCount, buffers); break;
+			case 8:		IntersectPathPackets<8>(m_world, active, activeCount, buffers); break;
+			case 16:	IntersectPathPackets<16>(m_world, active, activeCount, buffers); break;
+			default:	IntersectPaths(m_world, active, activeCount, buffers); break;
+			}
+
+			// misses end here, the hits are sorted into one queue per material, counting sort on the material ID
+			UINT32 queueSizes[MID_COUNT] = { 0 };
+			for (UINT32 k = 0; k < activeCount; k++)
+			{
+				UINT32 p = active[k];
+				WavefrontPath &path = buffers.m_paths[p];
+				const HitRecord &rec = buffers.m_hits[p];
+				if (!buffers.m_hitFlags[p])
+				{
+					path.m_radiance += path.m_throughput * m_world->GetLightSources()->GetAmbientLight();
+					path.m_depth = UINT_MAX;
+				}
+				else if (m_enableNormalDisplay)
+				{
+					path.m_radiance = 0.5f * Vec3(rec.m_normal.x() + 1.0f, rec.m_normal.y() + 1.0f, rec.m_normal.z() + 1.0f);
+					path.m_depth = UINT_MAX;
+				}
+				else if (!rec.m_hitMaterial)
+				{
+					path.m_depth = UINT_MAX;
+				}
+				else
+				{
+					queueSizes[rec.m_hitMaterial->GetID()]++;
 				}
-				col /= float(SAMPLE_PER_PIXEL);
 			}
 
-			// the gamma correction, to the approximation, use the power 1/gamma, and the gamma == 2, which is just square-root.
-			col = Vec3(sqrt(col[0]), sqrt(col[1]), sqrt(col[2]));
+			UINT32 queueOffsets[MID_COUNT];
+			UINT32 queuedCount = 0;
+			for (UINT32 id = 0; id < MID_COUNT; id++)
+			{
+				queueOffsets[id] = queuedCount;
+				queuedCount += queueSizes[id];
+			}
+			UINT32 queueEnds[MID_COUNT];
+			memcpy(queueEnds, queueOffsets, sizeof(queueEnds));
+			for (UINT32 k = 0; k < activeCount; k++)
+			{
+				UINT32 p = active[k];
+				if (buffers.m_paths[p].m_depth != UINT_MAX)
+					buffers.m_queues[queueEnds[buffers.m_hits[p].m_hitMaterial->GetID()]++] = p;
+			}
+
+			// shade queue by queue, the survivors make the next wave
+			UINT32 *next = buffers.m_active.data();
+			UINT32 nextCount = 0;
+			const UINT32 *queues = buffers.m_queues.data();
+			for (UINT32 id = 0; id < MID_COUNT; id++)
+			{
+				const UINT32 *queue = queues + queueOffsets[id];
+				UINT32 count = queueSizes[id];
+				switch (id)
+				{
+				case MID_DIFFUSE_LIGHT:	nextCount += ShadeQueue<DiffuseLight>(m_world, queue, count, buffers, m_maxSampleDepth, m_russianRouletteDepth, m_enableLightSampling, m_footprintOrigin, m_footprintSpread, next + nextCount, rayCount); break;
+				case MID_LAMBERTIAN:	nextCount += ShadeQueue<Lambertian>(m_world, queue, count, buffers, m_maxSampleDepth, m_russianRouletteDepth, m_enableLightSampling, m_footprintOrigin, m_footprintSpread, next + nextCount, rayCount); break;
+				case MID_METAL:			nextCount += ShadeQueue<Metal>(m_world, queue, count, buffers, m_maxSampleDepth, m_russianRouletteDepth, m_enableLightSampling, m_footprintOrigin, m_footprintSpread, next + nextCount, rayCount); break;
+				case MID_DIELECTRIC:	nextCount += ShadeQueue<Dielectric>(m_world, queue, count, buffers, m_maxSampleDepth, m_russianRouletteDepth, m_enableLightSampling, m_footprintOrigin, m_footprintSpread, next + nextCount, rayCount); break;
+				default:				assert(false); break;
+				}
+			}
+			activeCount = nextCount;
 		}
 
-#if defined(SHOW_PROGRESS)
-		nthreads = omp_get_num_threads();
-		tid = omp_get_thread_num();
-		progress++;
-		printf("[Thread %02d(%d)]%.2lf%%\r", tid, nthreads, progress * 100.0 / height);
-#endif
+		for (UINT32 p = 0; p < pathCount; p++)
+		{
+			const WavefrontPath &path = buffers.m_paths[p];
+			float luminance = DisplayLuminance(path.m_radiance);
+			buffers.m_pixelRadiance[path.m_pixel] += path.m_radiance;
+			buffers.m_pixelLuminanceSums[path.m_pixel] += luminance;
+			buffers.m_pixelLuminanceSquares[path.m_pixel] += luminance * luminance;
+		}
 	}
-	image->Render(pixels);
-
-	// housekeeping
-	delete[] pixels;
 
-	cout << "[HomemadeRayTracer] Done" << endl;
+	for (UINT32 pixel : buffers.m_pixels)
+	{
+		UINT32 index = (tile.m_y0 + pixel / tileWidth) * width + tile.m_x0 + pixel % tileWidth;
+		m_accumulation[index] += buffers.m_pixelRadiance[pixel];
+		m_luminanceSums[index] += buffers.m_pixelLuminanceSums[pixel];
+		m_luminanceSquares[index] += buffers.m_pixelLuminanceSquares[pixel];
+		m_sampleCounts[index] += samplesPerPixel;
+	}
+	return rayCount;
 }
 
-Vec3 HomemadeRayTracer::Sample(const Ray &r, UINT32 depth) const
+Vec3 HomemadeRayTracer::Sample(const Ray &r, UINT32 depth, UINT32 &io_rayCount) const
 {
 	Vec3 col;
 	HitRecord rec;
 	float nearest = 0.001f; // Ignore hits very near 0 to get rid of the shadow acne.
 	float cloestSoFar = FLT_MAX;
-	if (m_world->GetObjectBVHTree()->Hit(r, nearest, cloestSoFar, rec))
+	io_rayCount++;
+	if (m_world->Hit(r, nearest, cloestSoFar, rec))
 	{
 		if (m_enableNormalDisplay)
 		{
@@ -167,13 +923,14 @@ Vec3 HomemadeRayTracer::Sample(const Ray &r, UINT32 depth) const
 		}
 		else
 		{
+			rec.m_footprint = FootprintAt(rec.m_position);
 			Vec3 attenuation;
 			Ray r_scattered;
 			Vec3 emmitted;
 			emmitted.zero();
-			if (depth < MAX_SAMPLE_DEPTH && rec.m_hitMaterial && rec.m_hitMaterial->Scatter(r, rec, attenuation, r_scattered, emmitted))
+			if (depth < m_maxSampleDepth && rec.m_hitMaterial && rec.m_hitMaterial->Scatter(r, rec, attenuation, r_scattered, emmitted))
 			{
-				col = emmitted + attenuation * Sample(r_scattered, depth + 1);
+				col = emmitted + attenuation * Sample(r_scattered, depth + 1, io_rayCount);
 			}
 			else
 			{
@@ -188,3 +945,81 @@ Vec3 HomemadeRayTracer::Sample(const Ray &r, UINT32 depth) const
 
 	return col;
 }
+
+
+Vec3 HomemadeRayTracer::SampleIterative(const Ray &r, UINT32 &io_rayCount) const
+{
+	HitRecord rec;
+	float nearest = 0.001f; // Ignore hits very near 0 to get rid of the shadow acne.
+	float cloestSoFar = FLT_MAX;
+	io_rayCount++;
+	BOOL hit = m_world->Hit(r, nearest, cloestSoFar, rec);
+	return ShadePath(r, hit, rec, io_rayCount);
+}
+
+Vec3 HomemadeRayTracer::ShadePath(const Ray &r, BOOL hit, const HitRecord &primaryRec, UINT32 &io_rayCount) const
+{
+	// same estimator as Sample, the radiance is gathered front to back instead of on the way back up
+	Vec3 radiance = zero();
+	Vec3 throughput(1.0f, 1.0f, 1.0f);
+	Ray ray = r;
+	HitRecord rec = primaryRec;
+	Vec3 scatterPosition;
+	Vec3 scatterNormal;
+	float scatterPdf = 0.0f;	// of ray, 0 when the lights were not sampled where it left from
+	for (UINT32 depth = 0; ; depth++)
+	{
+		if (depth > 0)
+		{
+			float nearest = 0.001f;
+			float cloestSoFar = FLT_MAX;
+			io_rayCount++;
+			hit = m_world->Hit(ray, nearest, cloestSoFar, rec);
+		}
+
+		if (!hit)
+		{
+			radiance += throughput * m_world->GetLightSources()->GetAmbientLight();
+			break;
+		}
+
+		if (m_enableNormalDisplay)
+		{
+			return 0.5f * Vec3(rec.m_normal.x() + 1.0f, rec.m_normal.y() + 1.0f, rec.m_normal.z() + 1.0f);
+		}
+
+		rec.m_footprint = FootprintAt(rec.m_position);
+		Vec3 attenuation;
+		Ray r_scattered;
+		Vec3 emmitted;
+		emmitted.zero();
+		BOOL scattered = (depth < m_maxSampleDepth && rec.m_hitMaterial && rec.m_hitMaterial->Scatter(ray, rec, attenuation, r_scattered, emmitted));
+		if (m_enableLightSampling && rec.m_hitMaterial && rec.m_hitMaterial->GetID() == MID_DIFFUSE_LIGHT)
+			emmitted *= EmissionWeight(m_world, rec, scatterPosition, scatterNormal, scatterPdf);
+		radiance += throughput * emmitted;
+		if (!scattered)
+			break;
+
+		scatterPdf = 0.0f;
+		if (m_enableLightSampling && !rec.m_hitMaterial->IsSpecular())
+		{
+			radiance += throughput * SampleDirectLight(m_world, ray, rec, io_rayCount);
+			scatterPosition = rec.m_position;
+			scatterNormal = rec.m_normal;
+			scatterPdf = rec.m_hitMaterial->Pdf(ray, rec, r_scattered.m_dir);
+		}
+		throughput *= attenuation;
+		ray = r_scattered;
+
+		// Russian roulette, the surviving paths are weighted up to keep the estimate unbiased
+		if (depth + 1 >= m_russianRouletteDepth)
+		{
+			float survival = min(0.95f, max(throughput.x(), max(throughput.y(), throughput.z())));
+			if (survival <= 0.0f || Randomizer::RandomUNorm() >= survival)
+				break;
+			throughput /= survival;
+		}
+	}
+
+	return radiance;
+}
\ No newline at end of file
@@ -1,12 +1,23 @@
 #pragma once
 
 #include "Vec3.h"
+#include "TileScheduler.h"
+#include "Sampler.h"
 
 class OutputImage;
 class Ray;
 class InputListener;
 class SimpleCamera;
 class World;
+class ThreadPool;
+struct HitRecord;
+
+enum IntegratorType
+{
+	INTEGRATOR_ITERATIVE = 0,	// loop carrying the path throughput, with Russian roulette
+	INTEGRATOR_RECURSIVE,		// the original recursive Sample, kept for comparison
+	INTEGRATOR_WAVEFRONT,		// breadth first, all the paths of a tile advance one bounce at a time, shaded per material
+};
 
 class HomemadeRayTracer
 {
@@ -19,15 +30,125 @@ public:
 	void						OnDestroy();
 	void						HelpInfo();
 
+	// a full frame from scratch, GetSamplePerPixel() samples per pixel, or adaptively up to as many when enabled
 	void						TraceRay(const SimpleCamera *camera, OutputImage *image);
 
+	// progressive rendering, each pass adds samples to a persistent accumulation buffer
+	// and the finished tiles are resolved to the image as they complete
+	void						ResetAccumulation();
+	void						TracePass(const SimpleCamera *camera, OutputImage *image, UINT32 samplesPerPixel);
+	void						Resolve(OutputImage *image);
+	inline UINT32				GetAccumulatedSamplePerPixel() const { return m_accumulatedSPP; }
+	// rays cast by the last pass, camera rays and bounces, or by the whole frame when adaptive
+	inline UINT64				GetLastPassRayCount() const { return m_lastPassRayCount; }
+	// samples accumulated over all the pixels
+	UINT64						GetAccumulatedSampleCount() const;
+	// mean over the pixels of the standard error of the displayable luminance, relative to the luminance
+	float						EstimateRelativeError() const;
+	// mean over the pixels of the accumulated linear radiance, before tone mapping
+	Vec3						GetMeanRadiance() const;
+
+	inline void					SetSamplePerPixel(UINT32 spp) { m_samplePerPixel = spp; m_enable1SPP = (spp <= 1); }
+	inline void					SetMaxSampleDepth(UINT32 depth) { m_maxSampleDepth = depth; }
+	inline void					SetNormalDisplay(BOOL enable) { m_enableNormalDisplay = enable; }
+	inline void					SetIntegrator(IntegratorType integrator) { m_integrator = integrator; }
+	// paths longer than depth bounces are randomly terminated, according to their throughput
+	inline void					SetRussianRouletteDepth(UINT32 depth) { m_russianRouletteDepth = depth; }
+	// next event estimation, a point on the area lights is sampled at every hit that is not specular and weighted
+	// against the bounce by multiple importance sampling. Iterative and wavefront integrators only.
+	inline void					SetLightSampling(BOOL enable) { m_enableLightSampling = enable; }
+	inline BOOL					GetLightSampling() const { return m_enableLightSampling; }
+	// the textures are filtered over the footprint of the pixel at every hit, from the distance to the camera like a
+	// cone of rays, instead of the first level only
+	inline void					SetTextureLod(BOOL enable) { m_enableTextureLod = enable; }
+	inline BOOL					GetTextureLod() const { return m_enableTextureLod; }
+	inline UINT32				GetSamplePerPixel() const { return m_enable1SPP ? 1 : m_samplePerPixel; }
+	// adaptive sampling, TraceRay gives every pixel minSPP samples, then keeps adding passes of minSPP samples
+	// to the pixels whose relative error is still above errorThreshold, until GetSamplePerPixel()
+	inline void					SetAdaptiveSampling(BOOL enable) { m_enableAdaptiveSampling = enable; }
+	inline BOOL					GetAdaptiveSampling() const { return m_enableAdaptiveSampling; }
+	inline void					SetAdaptiveMinSamplePerPixel(UINT32 minSPP) { m_adaptiveMinSPP = (minSPP < 2) ? 2 : minSPP; }
+	inline void					SetAdaptiveErrorThreshold(float errorThreshold) { m_adaptiveErrorThreshold = errorThreshold; }
+	// where the random numbers of the pixel samples come from, the pixel jitter, the lens and the bounces
+	void						SetSampler(SamplerType type);
+	inline SamplerType			GetSamplerType() const { return m_sampler ? m_sampler->GetType() : SAMPLER_INDEPENDENT; }
+	// debug output, the samples of every pixel from blue (the fewest) to red (the most), instead of the image
+	void						RenderSampleCountHeatMap(OutputImage *image);
+	// camera rays of neighbouring pixels traced together, 4, 8 or 16 wide, 1 for single rays.
+	// Used by the iterative and wavefront integrators, the image is the same as with single rays.
+	void						SetPacketWidth(UINT32 width);
+	inline UINT32				GetPacketWidth() const { return m_packetWidth; }
+
+	// tile scheduling, the pool is created on the next TraceRay
+	void						SetThreadCount(UINT32 threadCount);
+	// the pool right away, e.g. for World::ConstructWorld to build with the render threads, deleted by the next SetThreadCount
+	ThreadPool *				CreateThreadPool();
+	inline void					SetTileSize(UINT32 tileWidth, UINT32 tileHeight) { m_tileWidth = tileWidth; m_tileHeight = tileHeight; }
+	inline void					SetTileOrder(TileOrder order) { m_tileOrder = order; }
+	inline void					SetWorkStealing(BOOL enable) { m_enableWorkStealing = enable; }
+	inline const ThreadPool *	GetThreadPool() const { return m_threadPool; }
+	void						PrintThreadStats() const;
+
 private:
-	Vec3						Sample(const Ray &r, UINT32 depth) const;
+	void						TracePassInternal(const SimpleCamera *camera, OutputImage *image, UINT32 samplesPerPixel, BOOL jitter);
+	void						TraceAdaptive(const SimpleCamera *camera, OutputImage *image);
+	// the pixels still above the error threshold stay active for the next adaptive pass, returns how many
+	UINT32						UpdateActivePixels();
+	inline BOOL					IsPixelActive(UINT32 index) const { return m_activePixels.empty() || m_activePixels[index]; }
+	// standard error of the mean display luminance, relative to it, FLT_MAX under 2 samples
+	float						PixelRelativeError(size_t index) const;
+	// the same, with a prior against the pixels that never found a light, what the adaptive passes go by
+	float						PixelAdaptiveError(size_t index) const;
+	UINT32						AccumulatePixel(const SimpleCamera *camera, UINT32 i, UINT32 j, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter);
+	UINT64						AccumulateTile(const SimpleCamera *camera, const Tile &tile, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter);
+	UINT64						AccumulateTileWavefront(const SimpleCamera *camera, const Tile &tile, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter);
+	// the tile is covered by blocks of 2x2, 4x2 or 4x4 pixels, one packet lane per pixel
+	template<UINT32 N>
+	UINT32						AccumulatePixelBlock(const SimpleCamera *camera, UINT32 x0, UINT32 y0, UINT32 x1, UINT32 y1, UINT32 width, UINT32 height, UINT32 samplesPerPixel, BOOL jitter);
+	void						ResolveRegion(OutputImage *image, UINT32 x0, UINT32 y0, UINT32 x1, UINT32 y1);
+	Vec3						Sample(const Ray &r, UINT32 depth, UINT32 &io_rayCount) const;
+	Vec3						SampleIterative(const Ray &r, UINT32 &io_rayCount) const;
+	// the rest of SampleIterative once the camera ray is traced
+	Vec3						ShadePath(const Ray &r, BOOL hit, const HitRecord &rec, UINT32 &io_rayCount) const;
+	// world width of the footprint of a pixel at position, 0 without texture LOD
+	inline float				FootprintAt(const Vec3 &position) const { return m_footprintSpread * (position - m_footprintOrigin).length(); }
 
 	InputListener *				m_inputListener{ nullptr };
 
 	BOOL						m_enableNormalDisplay{ FALSE };
 	BOOL						m_enable1SPP{ TRUE };
+	UINT32						m_samplePerPixel;
+	UINT32						m_maxSampleDepth;
+	IntegratorType				m_integrator{ INTEGRATOR_ITERATIVE };
+	UINT32						m_russianRouletteDepth{ 5 };
+	BOOL						m_enableLightSampling{ FALSE };
+	BOOL						m_enableTextureLod{ TRUE };
+	Vec3						m_footprintOrigin;			// of the camera for the current pass
+	float						m_footprintSpread{ 0.0f };	// angle covered by a pixel, 0 without texture LOD
+	BOOL						m_enableAdaptiveSampling{ FALSE };
+	UINT32						m_adaptiveMinSPP{ 8 };
+	float						m_adaptiveErrorThreshold{ 0.05f };
+	UINT32						m_packetWidth{ 8 };
+	ISampler *					m_sampler{ nullptr };		// nullptr for the independent streams
+	UINT32						m_frameIndex{ 0 };
+
+	ThreadPool *				m_threadPool{ nullptr };
+	UINT32						m_threadCount{ 0 };
+	UINT32						m_tileWidth{ 32 };
+	UINT32						m_tileHeight{ 32 };
+	TileOrder					m_tileOrder{ TILE_ORDER_HILBERT };
+	BOOL						m_enableWorkStealing{ TRUE };
+
+	std::vector<Vec3>			m_accumulation;			// sum of the linear radiance
+	std::vector<float>			m_luminanceSums;		// sum of the luminance clamped to 1, for the error estimate
+	std::vector<float>			m_luminanceSquares;		// and of its square
+	std::vector<UINT32>			m_sampleCounts;
+	std::vector<UINT8>			m_activePixels;			// the pixels sampled by the next pass, empty for all of them
+	std::vector<Vec3>			m_resolved;				// gamma corrected average, what goes to the image
+	UINT32						m_accumulationWidth{ 0 };
+	UINT32						m_accumulationHeight{ 0 };
+	UINT32						m_accumulatedSPP{ 0 };
+	UINT64						m_lastPassRayCount{ 0 };
 
 	const World *				m_world{ nullptr };
 };
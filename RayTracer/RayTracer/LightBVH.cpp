@@ -0,0 +1,314 @@
+#include "stdafx.h"
+#include "LightBVH.h"
+
+using namespace std;
+
+static inline AABB EmptyAABB()
+{
+	return AABB(Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+}
+
+// v rotated by the angle around the unit axis, Rodrigues' formula
+static inline Vec3 Rotate(const Vec3 &v, const Vec3 &axis, float angle)
+{
+	float c = cosf(angle);
+	float s = sinf(angle);
+	return v * c + cross(axis, v) * s + axis * (dot(axis, v) * (1.0f - c));
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+static inline float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+	return (cosA > cosB) ? 1.0f : cosA * cosB + sinA * sinB;
+}
+
+static inline float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+	return (cosA > cosB) ? 0.0f : sinA * cosB - cosA * sinB;
+}
+
+static inline float SafeSqrt(float x)
+{
+	return sqrtf(max(0.0f, x));
+}
+
+LightBounds CombineLightBounds(const LightBounds &a, const LightBounds &b)
+{
+	if (a.m_power <= 0.0f)
+		return b;
+	if (b.m_power <= 0.0f)
+		return a;
+
+	LightBounds out;
+	out.m_bounds = CombineAABB(a.m_bounds, b.m_bounds);
+	out.m_power = a.m_power + b.m_power;
+	out.m_cosThetaE = min(a.m_cosThetaE, b.m_cosThetaE);
+
+	// the smallest cone around both cones of normals
+	out.m_axis = a.m_axis;
+	out.m_cosThetaO = -1.0f;
+	float thetaA = acosf(max(-1.0f, min(1.0f, a.m_cosThetaO)));
+	float thetaB = acosf(max(-1.0f, min(1.0f, b.m_cosThetaO)));
+	float thetaD = acosf(max(-1.0f, min(1.0f, dot(a.m_axis, b.m_axis))));
+	if (min(thetaD + thetaB, (float)M_PI) <= thetaA)
+	{
+		out.m_cosThetaO = a.m_cosThetaO;
+	}
+	else if (min(thetaD + thetaA, (float)M_PI) <= thetaB)
+	{
+		out.m_axis = b.m_axis;
+		out.m_cosThetaO = b.m_cosThetaO;
+	}
+	else
+	{
+		float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+		Vec3 rotationAxis = cross(a.m_axis, b.m_axis);
+		if (thetaO < (float)M_PI && rotationAxis.squared_length() > 0.0f)
+		{
+			out.m_axis = Rotate(a.m_axis, normalize(rotationAxis), thetaO - thetaA);
+			out.m_cosThetaO = cosf(thetaO);
+		}
+	}
+	return out;
+}
+
+// solid angle measure of the directions of emission, the orientation term of the split cost
+static float OrientationMeasure(float cosThetaO, float cosThetaE)
+{
+	float thetaO = acosf(max(-1.0f, min(1.0f, cosThetaO)));
+	float thetaE = acosf(max(-1.0f, min(1.0f, cosThetaE)));
+	float thetaW = min(thetaO + thetaE, (float)M_PI);
+	float sinThetaO = SafeSqrt(1.0f - cosThetaO * cosThetaO);
+	return 2.0f * (float)M_PI * (1.0f - cosThetaO)
+		+ 0.5f * (float)M_PI * (2.0f * thetaW * sinThetaO - cosf(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + cosThetaO);
+}
+
+void LightBVH::Build(const vector<LightBounds> &lights)
+{
+	Clear();
+	if (lights.empty())
+		return;
+
+	vector<BuildLight> buildLights(lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		buildLights[i].m_lightBounds = lights[i];
+		buildLights[i].m_centroid = 0.5f * (lights[i].m_bounds.m_min + lights[i].m_bounds.m_max);
+		buildLights[i].m_lightIndex = (UINT32)i;
+	}
+
+	m_nodes.reserve(lights.size() * 2 - 1);
+	m_lightLeaves.resize(lights.size());
+	BuildRange(buildLights, 0, (UINT32)buildLights.size(), UINT_MAX, 1);
+}
+
+void LightBVH::Clear()
+{
+	m_nodes.clear();
+	m_lightLeaves.clear();
+	m_depth = 0;
+}
+
+UINT32 LightBVH::BuildRange(vector<BuildLight> &lights, UINT32 begin, UINT32 end, UINT32 parent, UINT32 depth)
+{
+	UINT32 nodeIndex = (UINT32)m_nodes.size();
+	m_nodes.emplace_back();
+	m_nodes[nodeIndex].m_parent = parent;
+	m_depth = max(m_depth, depth);
+
+	if (end - begin == 1)
+	{
+		LightBVHNode &leaf = m_nodes[nodeIndex];
+		leaf.m_lightBounds = lights[begin].m_lightBounds;
+		leaf.m_lightIndex = lights[begin].m_lightIndex;
+		leaf.m_isLeaf = TRUE;
+		m_lightLeaves[leaf.m_lightIndex] = nodeIndex;
+		return nodeIndex;
+	}
+
+	AABB bounds = EmptyAABB();
+	AABB centroidBounds = EmptyAABB();
+	for (UINT32 i = begin; i < end; i++)
+	{
+		bounds = CombineAABB(bounds, lights[i].m_lightBounds.m_bounds);
+		centroidBounds = CombineAABB(centroidBounds, AABB(lights[i].m_centroid, lights[i].m_centroid));
+	}
+	Vec3 extent = bounds.m_max - bounds.m_min;
+	float maxExtent = max(extent.x(), max(extent.y(), extent.z()));
+
+	// binned split minimizing power x orientation measure x area, thin boxes are penalized across their small sides
+	float bestCost = FLT_MAX;
+	UINT32 bestAxis = 0;
+	UINT32 bestBin = 0;
+	for (UINT32 a = 0; a < 3; a++)
+	{
+		float centroidMin = centroidBounds.m_min[a];
+		float centroidExtent = centroidBounds.m_max[a] - centroidMin;
+		if (centroidExtent <= 0.0f)
+			continue;
+
+		LightBounds bins[BIN_COUNT];
+		for (UINT32 b = 0; b < BIN_COUNT; b++)
+			bins[b].m_power = 0.0f;
+		for (UINT32 i = begin; i < end; i++)
+		{
+			UINT32 b = min(BIN_COUNT - 1, (UINT32)((lights[i].m_centroid[a] - centroidMin) / centroidExtent * BIN_COUNT));
+			bins[b] = CombineLightBounds(bins[b], lights[i].m_lightBounds);
+		}
+
+		auto cost = [](const LightBounds &lightBounds)
+		{
+			if (lightBounds.m_power <= 0.0f)
+				return 0.0f;
+			return lightBounds.m_power * OrientationMeasure(lightBounds.m_cosThetaO, lightBounds.m_cosThetaE) * lightBounds.m_bounds.SurfaceArea();
+		};
+
+		float rightCosts[BIN_COUNT];
+		LightBounds right;
+		right.m_power = 0.0f;
+		for (UINT32 b = BIN_COUNT - 1; b > 0; b--)
+		{
+			right = CombineLightBounds(right, bins[b]);
+			rightCosts[b] = cost(right);
+		}
+
+		float regularization = maxExtent / max(extent[a], 1e-6f);
+		LightBounds left;
+		left.m_power = 0.0f;
+		for (UINT32 b = 0; b < BIN_COUNT - 1; b++)
+		{
+			left = CombineLightBounds(left, bins[b]);
+			float splitCost = regularization * (cost(left) + rightCosts[b + 1]);
+			if (left.m_power > 0.0f && splitCost < bestCost)
+			{
+				bestCost = splitCost;
+				bestAxis = a;
+				bestBin = b;
+			}
+		}
+	}
+
+	UINT32 mid = (begin + end) / 2;
+	if (bestCost < FLT_MAX)
+	{
+		float centroidMin = centroidBounds.m_min[bestAxis];
+		float centroidExtent = centroidBounds.m_max[bestAxis] - centroidMin;
+		auto pivot = partition(lights.begin() + begin, lights.begin() + end, [&](const BuildLight &light)
+		{
+			return min(BIN_COUNT - 1, (UINT32)((light.m_centroid[bestAxis] - centroidMin) / centroidExtent * BIN_COUNT)) <= bestBin;
+		});
+		mid = (UINT32)(pivot - lights.begin());
+		if (mid == begin || mid == end)
+			mid = (begin + end) / 2;
+	}
+	// otherwise all the centroids are at the same place, any half will do
+
+	BuildRange(lights, begin, mid, nodeIndex, depth + 1);
+	UINT32 secondChild = BuildRange(lights, mid, end, nodeIndex, depth + 1);
+
+	LightBVHNode &node = m_nodes[nodeIndex];
+	node.m_lightBounds = CombineLightBounds(m_nodes[nodeIndex + 1].m_lightBounds, m_nodes[secondChild].m_lightBounds);
+	node.m_secondChildOffset = secondChild;
+	node.m_isLeaf = FALSE;
+	return nodeIndex;
+}
+
+float LightBVH::Importance(const LightBounds &lightBounds, const Vec3 &position, const Vec3 &normal) const
+{
+	// the box is seen from the point within the cone of its bounding sphere, all around when inside of it
+	Vec3 center = 0.5f * (lightBounds.m_bounds.m_min + lightBounds.m_bounds.m_max);
+	Vec3 diagonal = lightBounds.m_bounds.m_max - lightBounds.m_bounds.m_min;
+	float radiusSquared = 0.25f * dot(diagonal, diagonal);
+	Vec3 toPoint = position - center;
+	float distanceSquared = dot(toPoint, toPoint);
+	float cosThetaB = -1.0f;
+	float sinThetaB = 0.0f;
+	if (distanceSquared > radiusSquared)
+	{
+		sinThetaB = sqrtf(radiusSquared / distanceSquared);
+		cosThetaB = SafeSqrt(1.0f - sinThetaB * sinThetaB);
+	}
+	Vec3 wi = (distanceSquared > 0.0f) ? toPoint / sqrtf(distanceSquared) : Vec3(0.0f, 1.0f, 0.0f);
+
+	// the smallest angle between an emitting normal and the point, the emission stops beyond thetaE
+	float cosThetaW = dot(lightBounds.m_axis, wi);
+	float sinThetaW = SafeSqrt(1.0f - cosThetaW * cosThetaW);
+	float sinThetaO = SafeSqrt(1.0f - lightBounds.m_cosThetaO * lightBounds.m_cosThetaO);
+	float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, lightBounds.m_cosThetaO);
+	float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, lightBounds.m_cosThetaO);
+	float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+	if (cosThetaP <= lightBounds.m_cosThetaE)
+		return 0.0f;
+
+	// the smallest angle between the normal of the surface and the lights, nothing below the surface
+	float cosThetaI = -dot(normal, wi);
+	float sinThetaI = SafeSqrt(1.0f - cosThetaI * cosThetaI);
+	float cosThetaIP = CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	if (cosThetaIP <= 0.0f)
+		return 0.0f;
+
+	// the distance is not let below half the diagonal of the box, like pbrt-v4 does, the lights of a group near the point
+	// would get it all otherwise. Not the squared radius, that would leave the top levels to the power alone.
+	return lightBounds.m_power * cosThetaP * cosThetaIP / max(distanceSquared, 0.5f * sqrtf(4.0f * radiusSquared));
+}
+
+BOOL LightBVH::Sample(const Vec3 &position, const Vec3 &normal, float u, UINT32 &out_lightIndex, float &out_pmf) const
+{
+	if (m_nodes.empty() || Importance(m_nodes[0].m_lightBounds, position, normal) <= 0.0f)
+		return FALSE;
+
+	// u is rescaled to the range of the child picked, a single number does the whole walk
+	float pmf = 1.0f;
+	UINT32 nodeIndex = 0;
+	while (!m_nodes[nodeIndex].m_isLeaf)
+	{
+		UINT32 first = nodeIndex + 1;
+		UINT32 second = m_nodes[nodeIndex].m_secondChildOffset;
+		float importance0 = Importance(m_nodes[first].m_lightBounds, position, normal);
+		float importance1 = Importance(m_nodes[second].m_lightBounds, position, normal);
+		if (importance0 <= 0.0f && importance1 <= 0.0f)
+			return FALSE;
+
+		float p0 = importance0 / (importance0 + importance1);
+		if (u < p0)
+		{
+			nodeIndex = first;
+			u = min(u / p0, 0.99999994f);
+			pmf *= p0;
+		}
+		else
+		{
+			nodeIndex = second;
+			u = min((u - p0) / (1.0f - p0), 0.99999994f);
+			pmf *= 1.0f - p0;
+		}
+	}
+
+	out_lightIndex = m_nodes[nodeIndex].m_lightIndex;
+	out_pmf = pmf;
+	return TRUE;
+}
+
+float LightBVH::PMF(const Vec3 &position, const Vec3 &normal, UINT32 lightIndex) const
+{
+	if (m_nodes.empty() || Importance(m_nodes[0].m_lightBounds, position, normal) <= 0.0f)
+		return 0.0f;
+
+	// up from the leaf, the choices Sample made on the way down
+	float pmf = 1.0f;
+	UINT32 nodeIndex = m_lightLeaves[lightIndex];
+	while (m_nodes[nodeIndex].m_parent != UINT_MAX)
+	{
+		UINT32 parent = m_nodes[nodeIndex].m_parent;
+		UINT32 first = parent + 1;
+		UINT32 second = m_nodes[parent].m_secondChildOffset;
+		float importance0 = Importance(m_nodes[first].m_lightBounds, position, normal);
+		float importance1 = Importance(m_nodes[second].m_lightBounds, position, normal);
+		float importance = (nodeIndex == first) ? importance0 : importance1;
+		if (importance <= 0.0f)
+			return 0.0f;
+		pmf *= importance / (importance0 + importance1);
+		nodeIndex = parent;
+	}
+	return pmf;
+}
\ No newline at end of file
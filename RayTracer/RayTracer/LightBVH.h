@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Vec3.h"
+#include "AABB.h"
+
+// Where a light or a group of lights can emit from and toward.
+// The normals are within the cone of half angle acos(m_cosThetaO) around m_axis,
+// and every point emits up to acos(m_cosThetaE) beyond its normal, pi / 2 for diffuse emitters.
+struct LightBounds
+{
+	AABB							m_bounds;
+	Vec3							m_axis;
+	float							m_cosThetaO;
+	float							m_cosThetaE;
+	float							m_power;
+};
+
+LightBounds							CombineLightBounds(const LightBounds &a, const LightBounds &b);
+
+// Nodes are stored depth first like LinearBVHNode, the first child of an interior node is the next one.
+struct LightBVHNode
+{
+	LightBounds						m_lightBounds;
+	union
+	{
+		UINT32						m_lightIndex;			// leaf
+		UINT32						m_secondChildOffset;	// interior
+	};
+	UINT32							m_parent;				// UINT_MAX for the root
+	BOOL							m_isLeaf;
+};
+
+// Light hierarchy for many-light scenes, after Conty and Kulla's "Importance Sampling of Many Lights with Adaptive Tree Splitting".
+// The lights are grouped by a binned heuristic on power, area and spread of orientation, one light per leaf.
+// A light is sampled by going down from the root, each child picked in proportion to its importance
+// for the shading point, an estimate of the power it sends there, so the sampling is O(log n) and favours the near lights.
+class LightBVH
+{
+public:
+	static const UINT32				BIN_COUNT = 12;
+
+	LightBVH() = default;
+	~LightBVH() = default;
+
+	// the light indices are the ones of lights
+	void							Build(const std::vector<LightBounds> &lights);
+	void							Clear();
+
+	// normal is the one of the receiving surface, only its upper hemisphere is lit.
+	// FALSE when no light can reach the point, out_pmf is the probability of the light picked.
+	BOOL							Sample(const Vec3 &position, const Vec3 &normal, float u, UINT32 &out_lightIndex, float &out_pmf) const;
+	// the probability that Sample picks lightIndex for the point
+	float							PMF(const Vec3 &position, const Vec3 &normal, UINT32 lightIndex) const;
+
+	inline BOOL						IsEmpty() const { return m_nodes.empty(); }
+	inline UINT32					GetNodeCount() const { return (UINT32)m_nodes.size(); }
+	inline UINT32					GetDepth() const { return m_depth; }
+
+private:
+	struct BuildLight
+	{
+		LightBounds					m_lightBounds;
+		Vec3						m_centroid;
+		UINT32						m_lightIndex;
+	};
+
+	// returns the index of the node
+	UINT32							BuildRange(std::vector<BuildLight> &lights, UINT32 begin, UINT32 end, UINT32 parent, UINT32 depth);
+	float							Importance(const LightBounds &lightBounds, const Vec3 &position, const Vec3 &normal) const;
+
+	std::vector<LightBVHNode>		m_nodes;
+	std::vector<UINT32>				m_lightLeaves;		// the leaf of every light
+	UINT32							m_depth{ 0 };
+};
\ No newline at end of file
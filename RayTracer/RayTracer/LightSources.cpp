@@ -3,9 +3,12 @@
 #include "SimpleObject.h"
 #include "Materials.h"
 #include "World.h"
+#include "Hitables.h"
 #include "SimpleCamera.h"
+#if !defined(HEADLESS_RENDERING)
 #include "D3D12Viewer.h"
 #include "D3D12Helper.h"
+#endif
 #include "std_cbuffer.h"
 
 #define AMBIENT_INTENSITY_ATTENUATION 0.8f // to simulate global attenuation of indirect light
@@ -27,21 +30,103 @@ LightSources::LightSources(World *world, std::vector<Object *> &objects, const V
 
 	m_lightSourceCount = (UINT32)m_lightSources.size();
 	m_lightSourceCountX = m_lightSourceCount == 0 ? 1 : m_lightSourceCount; // for constant we atlease keep 1 to matching with shader sig.
+
+	// the power of a diffuse light is its radiance times its area, up to pi and the two sides
+	std::vector<float> powers;
+	std::vector<LightBounds> lightBounds;
+	float totalPower = 0.0f;
+	for (auto i = m_lightSources.begin(); i != m_lightSources.end(); ++i)
+	{
+		const Object *lightSource = *i;
+		float area = lightSource->m_hitable ? lightSource->m_hitable->Area() : 0.0f;
+		const XMFLOAT4 &intensity = reinterpret_cast<const DiffuseLight *>(lightSource->m_material)->m_data.intensity;
+		float power = (0.2126f * intensity.x + 0.7152f * intensity.y + 0.0722f * intensity.z) * area;
+		if (power <= 0.0f)
+			continue;
+
+		m_sampledLightIndices[lightSource] = (UINT32)m_sampledLights.size();
+		m_sampledLights.push_back(lightSource);
+		m_sampledLightAreas.push_back(area);
+		powers.push_back(power);
+		totalPower += power;
+
+		// diffuse lights emit from both sides, whatever their shape the normals cover all directions
+		LightBounds bounds;
+		bounds.m_bounds = lightSource->m_hitable->BoundingBox();
+		bounds.m_axis = Vec3(0.0f, 1.0f, 0.0f);
+		bounds.m_cosThetaO = -1.0f;
+		bounds.m_cosThetaE = 0.0f;
+		bounds.m_power = power;
+		lightBounds.push_back(bounds);
+	}
+
+	float cumulated = 0.0f;
+	for (size_t l = 0; l < m_sampledLights.size(); ++l)
+	{
+		cumulated += powers[l];
+		m_sampledLightCDF.push_back(cumulated / totalPower);
+		m_sampledLightPdfArea.push_back(powers[l] / totalPower / m_sampledLights[l]->m_hitable->Area());
+	}
+	if (!m_sampledLightCDF.empty())
+		m_sampledLightCDF.back() = 1.0f;
+
+	m_lightBVH.Build(lightBounds);
 }
 
 LightSources::~LightSources()
 {
+#if !defined(HEADLESS_RENDERING)
 	if (m_IllumCbvHandles)
 	{
 		delete[] m_IllumCbvHandles;
 		m_IllumCbvHandles = nullptr;
 	}
+#endif
+}
+
+BOOL LightSources::SampleLight(const Vec3 &position, const Vec3 &normal, float u0, float u1, float u2, LightSample &out_sample) const
+{
+	if (m_sampledLights.empty())
+		return FALSE;
+
+	UINT32 index;
+	if (m_lightSelection == LIGHT_SELECTION_BVH)
+	{
+		float pmf;
+		if (!m_lightBVH.Sample(position, normal, u0, index, pmf))
+			return FALSE;
+		out_sample.m_pdfArea = pmf / m_sampledLightAreas[index];
+	}
+	else
+	{
+		index = (UINT32)(std::upper_bound(m_sampledLightCDF.begin(), m_sampledLightCDF.end(), u0) - m_sampledLightCDF.begin());
+		index = (index < m_sampledLights.size()) ? index : (UINT32)m_sampledLights.size() - 1;
+		out_sample.m_pdfArea = m_sampledLightPdfArea[index];
+	}
+
+	const Object *lightSource = m_sampledLights[index];
+	out_sample.m_lightSource = lightSource;
+	lightSource->m_hitable->SampleSurface(u1, u2, out_sample.m_position, out_sample.m_normal);
+	const XMFLOAT4 &intensity = reinterpret_cast<const DiffuseLight *>(lightSource->m_material)->m_data.intensity;
+	out_sample.m_emitted = Vec3(intensity.x, intensity.y, intensity.z);
+	return TRUE;
+}
+
+float LightSources::PdfArea(const Object *lightSource, const Vec3 &position, const Vec3 &normal) const
+{
+	auto found = m_sampledLightIndices.find(lightSource);
+	if (found == m_sampledLightIndices.end())
+		return 0.0f;
+	if (m_lightSelection == LIGHT_SELECTION_BVH)
+		return m_lightBVH.PMF(position, normal, found->second) / m_sampledLightAreas[found->second];
+	return m_sampledLightPdfArea[found->second];
 }
 
+#if !defined(HEADLESS_RENDERING)
 void LightSources::Update(SimpleCamera *camera, float elapsedSeconds)
 {
 	IllumGlobalConstants globalConstants;
-	DirectX::XMStoreFloat4(&globalConstants.ambientIntensity, (m_ambientLight * AMBIENT_INTENSITY_ATTENUATION).m_simd);
+	DirectX::XMStoreFloat4(&globalConstants.ambientIntensity, ToXMVECTOR(m_ambientLight * AMBIENT_INTENSITY_ATTENUATION));
 	globalConstants.lightSourceCount.x = (float)m_lightSourceCount;
 	memcpy(m_pIllumGlobalConstants + m_illumGlobalConstantBufferSize * m_world->GetFrameIndex(), &globalConstants, sizeof(IllumGlobalConstants));
 
@@ -133,3 +218,4 @@ void LightSources::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDL
 		}
 	}
 }
+#endif
@@ -1,25 +1,58 @@
 #pragma once
 
 #include "Vec3.h"
+#include "LightBVH.h"
 
 class Object;
 class SimpleCamera;
 class World;
 class D3D12Viewer;
 
+// a point on a light source, for next event estimation
+struct LightSample
+{
+	Vec3									m_position;
+	Vec3									m_normal;
+	Vec3									m_emitted;
+	float									m_pdfArea;		// density over the area of all the lights, the pick of the light included
+	const Object *							m_lightSource;
+};
+
+// how the light to sample is picked
+enum LightSelection
+{
+	LIGHT_SELECTION_POWER = 0,	// in proportion to the power alone, O(log n) in a CDF
+	LIGHT_SELECTION_BVH,		// by the importance for the shading point in a LightBVH, O(log n) too
+};
+
 class LightSources
 {
 public:
 	LightSources(World *world, std::vector<Object *> &objects, const Vec3 &ambientLight);
 	~LightSources();
 
+#if !defined(HEADLESS_RENDERING)
 	void									Update(SimpleCamera *camera, float elapsedSeconds);
 	void									ApplyCBV(D3D12Viewer *viewer) const;
 	void									BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &cbvGPUHandle);
+#endif
 
 	inline UINT32							GetLightSourceCount() const { return m_lightSourceCountX; }
 	inline const Vec3 &						GetAmbientLight() const { return m_ambientLight; }
+
+	// the area lights the CPU tracer samples directly, for the points of a surface of the given normal
+	inline UINT32							GetSampledLightCount() const { return (UINT32)m_sampledLights.size(); }
+	inline const Object *					GetSampledLight(UINT32 index) const { return m_sampledLights[index]; }
+	inline void								SetLightSelection(LightSelection selection) { m_lightSelection = selection; }
+	inline LightSelection					GetLightSelection() const { return m_lightSelection; }
+	inline const LightBVH &					GetLightBVH() const { return m_lightBVH; }
+	// FALSE when there is no light to sample, u0 picks the light and u1, u2 the point on it
+	BOOL									SampleLight(const Vec3 &position, const Vec3 &normal, float u0, float u1, float u2, LightSample &out_sample) const;
+	// density over the area that SampleLight gives to the points of the light, 0 for the lights it never samples
+	float									PdfArea(const Object *lightSource, const Vec3 &position, const Vec3 &normal) const;
+#if !defined(HEADLESS_RENDERING)
 	inline D3D12_GPU_DESCRIPTOR_HANDLE		GetIllumCbvHandle(UINT32 index) { return m_IllumCbvHandles[index]; }
+#endif
 
 private:
 	World *									m_world{ nullptr };
@@ -27,6 +60,15 @@ private:
 	UINT32									m_lightSourceCount{ 0 };
 	UINT32									m_lightSourceCountX{ 0 };
 
+	std::vector<const Object *>				m_sampledLights;	// the light sources with an area
+	std::vector<float>						m_sampledLightCDF;	// of the power, normalized
+	std::vector<float>						m_sampledLightPdfArea;	// picked by power
+	std::vector<float>						m_sampledLightAreas;
+	std::unordered_map<const Object *, UINT32>	m_sampledLightIndices;
+	LightBVH								m_lightBVH;
+	LightSelection							m_lightSelection{ LIGHT_SELECTION_BVH };
+
+#if !defined(HEADLESS_RENDERING)
 	UINT8 *									m_pIllumGlobalConstants{ nullptr };
 	ComPtr<ID3D12Resource>					m_illumGlobalConstantBuffer;
 	UINT32									m_illumGlobalConstantBufferSize{ 0 };
@@ -36,6 +78,7 @@ private:
 	UINT32									m_lightSourceConstantBufferSize{ 0 };
 
 	CD3DX12_GPU_DESCRIPTOR_HANDLE *			m_IllumCbvHandles{ nullptr };
+#endif
 
 	Vec3									m_ambientLight;
 };
\ No newline at end of file
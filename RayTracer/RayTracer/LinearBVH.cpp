@@ -0,0 +1,443 @@
+#include "stdafx.h"
+#include "LinearBVH.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace
+{
+	// below that depth the SAH splits are trusted, deeper subtrees are split at the median
+	// so that the traversal stack can never overflow
+	const UINT32 SAH_MAX_DEPTH = 32;
+
+	const float TRAVERSAL_COST = 1.0f;
+	const float INTERSECTION_COST = 1.0f;
+
+	AABB EmptyAABB()
+	{
+		return AABB(Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+	}
+
+	AABB GrowAABB(const AABB &box, const Vec3 &p)
+	{
+		return CombineAABB(box, AABB(p, p));
+	}
+
+	// func(chunkBegin, chunkEnd, result) over chunks of [begin, end) on every thread of the pool,
+	// the results are then merged in order, on the calling thread alone when the range is small
+	template<typename T, typename ChunkFunc, typename MergeFunc>
+	void ReduceRange(UINT32 begin, UINT32 end, ThreadPool *threadPool, T &out_result, ChunkFunc &&func, MergeFunc &&merge)
+	{
+		UINT32 count = end - begin;
+		if (threadPool == nullptr || count < LinearBVH::PARALLEL_BUILD_PRIMITIVES)
+		{
+			func(begin, end, out_result);
+			return;
+		}
+
+		UINT32 chunkCount = threadPool->GetThreadCount() * 4;
+		vector<T> chunkResults(chunkCount);
+		threadPool->Dispatch(chunkCount, [&](UINT32 chunk, UINT32)
+		{
+			func(begin + (UINT32)((UINT64)count * chunk / chunkCount), begin + (UINT32)((UINT64)count * (chunk + 1) / chunkCount), chunkResults[chunk]);
+		});
+		for (const T &result : chunkResults)
+			merge(out_result, result);
+	}
+}
+
+void LinearBVH::Build(const vector<AABB> &primitiveBounds, UINT32 maxLeafPrimitives, UINT32 leafBatchWidth, ThreadPool *threadPool)
+{
+	Clear();
+	assert(maxLeafPrimitives > 0 && maxLeafPrimitives <= 0xFFFF && leafBatchWidth > 0);
+	m_maxLeafPrimitives = maxLeafPrimitives;
+	m_leafBatchWidth = leafBatchWidth;
+	if (primitiveBounds.empty())
+		return;
+
+	vector<BuildPrimitive> primitives(primitiveBounds.size());
+	for (size_t i = 0; i < primitiveBounds.size(); i++)
+	{
+		primitives[i].m_bounds = primitiveBounds[i];
+		primitives[i].m_centroid = 0.5f * (primitiveBounds[i].m_min + primitiveBounds[i].m_max);
+		primitives[i].m_index = (UINT32)i;
+	}
+
+	UINT32 primitiveCount = (UINT32)primitives.size();
+	if (threadPool == nullptr || primitiveCount < PARALLEL_BUILD_PRIMITIVES)
+	{
+		// a binary tree has at most 2n - 1 nodes
+		m_nodes.reserve(primitives.size() * 2);
+		BuildRecursive(m_nodes, primitives, 0, primitiveCount, 0, nullptr);
+		m_nodes.shrink_to_fit();
+	}
+	else
+	{
+		// the top levels are split here, binned by the whole pool, until the subtrees are small enough
+		// to keep every thread busy, then each subtree is built by one task into its own nodes
+		BuildContext context;
+		context.m_threadPool = threadPool;
+		context.m_taskPrimitives = max(PARALLEL_BUILD_PRIMITIVES / 4, primitiveCount / (threadPool->GetThreadCount() * 8));
+		vector<LinearBVHNode> topNodes;
+		BuildRecursive(topNodes, primitives, 0, primitiveCount, 0, &context);
+
+		threadPool->Dispatch((UINT32)context.m_tasks.size(), [&](UINT32 taskIndex, UINT32)
+		{
+			BuildTask &task = context.m_tasks[taskIndex];
+			task.m_nodes.reserve((task.m_end - task.m_begin) * 2);
+			BuildRecursive(task.m_nodes, primitives, task.m_begin, task.m_end, task.m_depth, nullptr);
+		});
+
+		m_nodes.reserve(primitives.size() * 2);
+		SpliceSubtrees(topNodes, 0, context.m_tasks);
+		m_nodes.shrink_to_fit();
+	}
+
+	// the leaves cover the partitioned primitives in order
+	m_primitiveIndices.resize(primitives.size());
+	for (size_t i = 0; i < primitives.size(); i++)
+		m_primitiveIndices[i] = primitives[i].m_index;
+	m_buildSAHCost = GetSAHCost();
+}
+
+void LinearBVH::Clear()
+{
+	m_nodes.clear();
+	m_primitiveIndices.clear();
+	m_buildSAHCost = 0.0f;
+}
+
+void LinearBVH::Refit(const vector<AABB> &primitiveBounds)
+{
+	assert(primitiveBounds.size() == m_primitiveIndices.size());
+
+	// children are always stored after their parent, a reverse walk sees them first
+	for (size_t nodeIndex = m_nodes.size(); nodeIndex-- > 0;)
+	{
+		LinearBVHNode &node = m_nodes[nodeIndex];
+		if (node.m_primitiveCount == 0)
+		{
+			const LinearBVHNode &first = m_nodes[nodeIndex + 1];
+			const LinearBVHNode &second = m_nodes[node.m_secondChildOffset];
+			for (UINT32 axis = 0; axis < 3; axis++)
+			{
+				node.m_min[axis] = min(first.m_min[axis], second.m_min[axis]);
+				node.m_max[axis] = max(first.m_max[axis], second.m_max[axis]);
+			}
+			continue;
+		}
+
+		AABB bounds = EmptyAABB();
+		for (UINT32 i = 0; i < node.m_primitiveCount; i++)
+			bounds = CombineAABB(bounds, primitiveBounds[m_primitiveIndices[node.m_primitivesOffset + i]]);
+		for (UINT32 axis = 0; axis < 3; axis++)
+		{
+			node.m_min[axis] = bounds.m_min[axis];
+			node.m_max[axis] = bounds.m_max[axis];
+		}
+	}
+}
+
+BOOL LinearBVH::RefitOrRebuild(const vector<AABB> &primitiveBounds, float rebuildSAHGrowth, ThreadPool *threadPool)
+{
+	Refit(primitiveBounds);
+	if (GetSAHCost() <= rebuildSAHGrowth * m_buildSAHCost)
+		return FALSE;
+
+	Build(primitiveBounds, m_maxLeafPrimitives, m_leafBatchWidth, threadPool);
+	return TRUE;
+}
+
+float LinearBVH::LeafCost(UINT32 count) const
+{
+	// the primitives of a leaf are tested m_leafBatchWidth at a time
+	return INTERSECTION_COST * ((count + m_leafBatchWidth - 1) / m_leafBatchWidth);
+}
+
+void LinearBVH::BoundRange(const vector<BuildPrimitive> &primitives, UINT32 begin, UINT32 end, ThreadPool *threadPool, RangeBounds &out_bounds) const
+{
+	ReduceRange(begin, end, threadPool, out_bounds,
+		[&](UINT32 chunkBegin, UINT32 chunkEnd, RangeBounds &bounds)
+		{
+			for (UINT32 i = chunkBegin; i < chunkEnd; i++)
+			{
+				bounds.m_bounds = CombineAABB(bounds.m_bounds, primitives[i].m_bounds);
+				bounds.m_centroidBounds = GrowAABB(bounds.m_centroidBounds, primitives[i].m_centroid);
+			}
+		},
+		[](RangeBounds &bounds, const RangeBounds &other)
+		{
+			bounds.m_bounds = CombineAABB(bounds.m_bounds, other.m_bounds);
+			bounds.m_centroidBounds = CombineAABB(bounds.m_centroidBounds, other.m_centroidBounds);
+		});
+}
+
+void LinearBVH::BinRange(const vector<BuildPrimitive> &primitives, UINT32 begin, UINT32 end, ThreadPool *threadPool, const AABB &centroidBounds, BuildBins &out_bins) const
+{
+	// axes without extent are left empty
+	float binScales[3];
+	for (UINT32 a = 0; a < 3; a++)
+	{
+		float extent = centroidBounds.m_max[a] - centroidBounds.m_min[a];
+		binScales[a] = extent > 0.0f ? SAH_BIN_COUNT / extent : 0.0f;
+	}
+
+	// min, max and counts do not depend on the order, merged chunks give the bins of a single pass
+	ReduceRange(begin, end, threadPool, out_bins,
+		[&](UINT32 chunkBegin, UINT32 chunkEnd, BuildBins &bins)
+		{
+			for (UINT32 a = 0; a < 3; a++)
+			{
+				if (binScales[a] == 0.0f)
+					continue;
+				SAHBin *axisBins = bins.m_bins[a];
+				float binScale = binScales[a];
+				float binMin = centroidBounds.m_min[a];
+				for (UINT32 i = chunkBegin; i < chunkEnd; i++)
+				{
+					UINT32 b = min(SAH_BIN_COUNT - 1, (UINT32)((primitives[i].m_centroid[a] - binMin) * binScale));
+					axisBins[b].m_count++;
+					axisBins[b].m_bounds = CombineAABB(axisBins[b].m_bounds, primitives[i].m_bounds);
+				}
+			}
+		},
+		[](BuildBins &bins, const BuildBins &other)
+		{
+			for (UINT32 a = 0; a < 3; a++)
+			{
+				for (UINT32 b = 0; b < SAH_BIN_COUNT; b++)
+				{
+					bins.m_bins[a][b].m_count += other.m_bins[a][b].m_count;
+					bins.m_bins[a][b].m_bounds = CombineAABB(bins.m_bins[a][b].m_bounds, other.m_bins[a][b].m_bounds);
+				}
+			}
+		});
+}
+
+UINT32 LinearBVH::BuildRecursive(vector<LinearBVHNode> &nodes, vector<BuildPrimitive> &primitives, UINT32 begin, UINT32 end, UINT32 depth, BuildContext *context) const
+{
+	UINT32 nodeIndex = (UINT32)nodes.size();
+	nodes.emplace_back();
+
+	UINT32 count = end - begin;
+	if (context && count <= context->m_taskPrimitives)
+	{
+		// left to a task, SpliceSubtrees puts its nodes here
+		LinearBVHNode &node = nodes[nodeIndex];
+		node.m_primitiveCount = 0;
+		node.m_pad = 1;
+		node.m_secondChildOffset = (UINT32)context->m_tasks.size();
+		context->m_tasks.emplace_back();
+		BuildTask &task = context->m_tasks.back();
+		task.m_begin = begin;
+		task.m_end = end;
+		task.m_depth = depth;
+		return nodeIndex;
+	}
+
+	ThreadPool *threadPool = context ? context->m_threadPool : nullptr;
+	RangeBounds rangeBounds;
+	BoundRange(primitives, begin, end, threadPool, rangeBounds);
+	const AABB &bounds = rangeBounds.m_bounds;
+	const AABB &centroidBounds = rangeBounds.m_centroidBounds;
+
+	UINT32 mid = begin;
+	UINT32 axis = 0;
+	Vec3 centroidExtent = centroidBounds.m_max - centroidBounds.m_min;
+	if (centroidExtent.y() > centroidExtent[axis])
+		axis = 1;
+	if (centroidExtent.z() > centroidExtent[axis])
+		axis = 2;
+
+	BOOL makeLeaf = (count == 1);
+	if (!makeLeaf && centroidExtent[axis] <= 0.0f)
+	{
+		// all centroids at the same place, nothing to split on
+		if (count <= 0xFFFF)
+			makeLeaf = TRUE;
+		else
+			mid = begin + count / 2;
+	}
+	else if (!makeLeaf && depth >= SAH_MAX_DEPTH)
+	{
+		mid = begin + count / 2;
+		nth_element(primitives.begin() + begin, primitives.begin() + mid, primitives.begin() + end,
+			[axis](const BuildPrimitive &a, const BuildPrimitive &b) { return a.m_centroid[axis] < b.m_centroid[axis]; });
+	}
+	else if (!makeLeaf)
+	{
+		// binned SAH, every axis with some extent is evaluated
+		BuildBins bins;
+		BinRange(primitives, begin, end, threadPool, centroidBounds, bins);
+
+		float bestCost = FLT_MAX;
+		UINT32 bestAxis = axis;
+		UINT32 bestSplit = 0;
+		for (UINT32 a = 0; a < 3; a++)
+		{
+			if (centroidExtent[a] <= 0.0f)
+				continue;
+
+			// sweep from the right to get the right side areas, then from the left to evaluate every split
+			const SAHBin *axisBins = bins.m_bins[a];
+			float rightAreas[SAH_BIN_COUNT];
+			UINT32 rightCounts[SAH_BIN_COUNT];
+			AABB rightBounds = EmptyAABB();
+			UINT32 rightCount = 0;
+			for (UINT32 b = SAH_BIN_COUNT - 1; b > 0; b--)
+			{
+				rightBounds = CombineAABB(rightBounds, axisBins[b].m_bounds);
+				rightCount += axisBins[b].m_count;
+				rightAreas[b] = rightCount > 0 ? rightBounds.SurfaceArea() : 0.0f;
+				rightCounts[b] = rightCount;
+			}
+
+			AABB leftBounds = EmptyAABB();
+			UINT32 leftCount = 0;
+			for (UINT32 b = 0; b < SAH_BIN_COUNT - 1; b++)
+			{
+				leftBounds = CombineAABB(leftBounds, axisBins[b].m_bounds);
+				leftCount += axisBins[b].m_count;
+				if (leftCount == 0 || rightCounts[b + 1] == 0)
+					continue;
+				float cost = leftCount * leftBounds.SurfaceArea() + rightCounts[b + 1] * rightAreas[b + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = a;
+					bestSplit = b;
+				}
+			}
+		}
+
+		float area = bounds.SurfaceArea();
+		float splitCost = TRAVERSAL_COST + INTERSECTION_COST * (area > 0.0f ? bestCost / area : count) / m_leafBatchWidth;
+		float leafCost = LeafCost(count);
+		if (count <= m_maxLeafPrimitives && leafCost <= splitCost)
+		{
+			makeLeaf = TRUE;
+		}
+		else
+		{
+			// in place, the two halves of the range are the two children
+			axis = bestAxis;
+			float binScale = SAH_BIN_COUNT / centroidExtent[axis];
+			float binMin = centroidBounds.m_min[axis];
+			auto split = partition(primitives.begin() + begin, primitives.begin() + end,
+				[=](const BuildPrimitive &p) { return min(SAH_BIN_COUNT - 1, (UINT32)((p.m_centroid[axis] - binMin) * binScale)) <= bestSplit; });
+			mid = (UINT32)(split - primitives.begin());
+			if (mid == begin || mid == end)
+			{
+				// can only happen with float rounding on huge primitive counts
+				mid = begin + count / 2;
+				nth_element(primitives.begin() + begin, primitives.begin() + mid, primitives.begin() + end,
+					[axis](const BuildPrimitive &a, const BuildPrimitive &b) { return a.m_centroid[axis] < b.m_centroid[axis]; });
+			}
+		}
+	}
+
+	LinearBVHNode &node = nodes[nodeIndex];
+	for (UINT32 i = 0; i < 3; i++)
+	{
+		node.m_min[i] = bounds.m_min[i];
+		node.m_max[i] = bounds.m_max[i];
+	}
+	node.m_pad = 0;
+
+	if (makeLeaf)
+	{
+		node.m_primitivesOffset = begin;
+		node.m_primitiveCount = (UINT16)count;
+		node.m_axis = 0;
+	}
+	else
+	{
+		node.m_primitiveCount = 0;
+		node.m_axis = (UINT8)axis;
+
+		// the first child directly follows its parent, nodes may be reallocated meanwhile
+		BuildRecursive(nodes, primitives, begin, mid, depth + 1, context);
+		UINT32 secondChild = BuildRecursive(nodes, primitives, mid, end, depth + 1, context);
+		nodes[nodeIndex].m_secondChildOffset = secondChild;
+	}
+
+	return nodeIndex;
+}
+
+UINT32 LinearBVH::SpliceSubtrees(const vector<LinearBVHNode> &topNodes, UINT32 topIndex, const vector<BuildTask> &tasks)
+{
+	UINT32 nodeIndex = (UINT32)m_nodes.size();
+	const LinearBVHNode &topNode = topNodes[topIndex];
+	if (topNode.m_primitiveCount == 0 && topNode.m_pad == 1)
+	{
+		// the subtree keeps its depth first order, only its offsets move
+		for (LinearBVHNode node : tasks[topNode.m_secondChildOffset].m_nodes)
+		{
+			if (node.m_primitiveCount == 0)
+				node.m_secondChildOffset += nodeIndex;
+			m_nodes.push_back(node);
+		}
+		return nodeIndex;
+	}
+
+	m_nodes.push_back(topNode);
+	if (topNode.m_primitiveCount == 0)
+	{
+		SpliceSubtrees(topNodes, topIndex + 1, tasks);
+		UINT32 secondChild = SpliceSubtrees(topNodes, topNode.m_secondChildOffset, tasks);
+		m_nodes[nodeIndex].m_secondChildOffset = secondChild;
+	}
+	return nodeIndex;
+}
+
+AABB LinearBVH::BoundingBox() const
+{
+	if (m_nodes.empty())
+		return EmptyAABB();
+
+	const LinearBVHNode &root = m_nodes[0];
+	return AABB(Vec3(root.m_min[0], root.m_min[1], root.m_min[2]), Vec3(root.m_max[0], root.m_max[1], root.m_max[2]));
+}
+
+UINT32 LinearBVH::GetLeafCount() const
+{
+	UINT32 leafCount = 0;
+	for (const LinearBVHNode &node : m_nodes)
+	{
+		if (node.m_primitiveCount > 0)
+			leafCount++;
+	}
+	return leafCount;
+}
+
+UINT32 LinearBVH::GetMaxDepth() const
+{
+	return m_nodes.empty() ? 0 : GetMaxDepthRecursive(0);
+}
+
+UINT32 LinearBVH::GetMaxDepthRecursive(UINT32 nodeIndex) const
+{
+	const LinearBVHNode &node = m_nodes[nodeIndex];
+	if (node.m_primitiveCount > 0)
+		return 1;
+	return 1 + max(GetMaxDepthRecursive(nodeIndex + 1), GetMaxDepthRecursive(node.m_secondChildOffset));
+}
+
+float LinearBVH::GetSAHCost() const
+{
+	if (m_nodes.empty())
+		return 0.0f;
+
+	float rootArea = BoundingBox().SurfaceArea();
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float cost = 0.0f;
+	for (const LinearBVHNode &node : m_nodes)
+	{
+		AABB box(Vec3(node.m_min[0], node.m_min[1], node.m_min[2]), Vec3(node.m_max[0], node.m_max[1], node.m_max[2]));
+		float probability = box.SurfaceArea() / rootArea;
+		cost += probability * (node.m_primitiveCount > 0 ? LeafCost(node.m_primitiveCount) : TRAVERSAL_COST);
+	}
+	return cost;
+}
\ No newline at end of file
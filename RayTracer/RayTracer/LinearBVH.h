@@ -0,0 +1,465 @@
+#pragma once
+
+#include "Vec3.h"
+#include "AABB.h"
+#include "Ray.h"
+#include "RayPacket.h"
+
+class ThreadPool;
+
+// 32 bytes, two nodes per cache line.
+// Nodes are stored depth first: the first child of an interior node is always the next node in the array,
+// only the offset of the second one is kept.
+struct LinearBVHNode
+{
+	float							m_min[3];
+	union
+	{
+		UINT32						m_primitivesOffset;		// leaf
+		UINT32						m_secondChildOffset;	// interior
+	};
+	float							m_max[3];
+	UINT16							m_primitiveCount;		// 0 for interior nodes
+	UINT8							m_axis;					// split axis of interior nodes
+	UINT8							m_pad;
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode is expected to be 32 bytes");
+
+struct BVHTraversalStats
+{
+	UINT64							m_rayCount{ 0 };
+	UINT64							m_nodesVisited{ 0 };
+	UINT64							m_leafTests{ 0 };
+	// packet traversal, a node or a leaf primitive tested for the whole packet counts once
+	UINT64							m_packetCount{ 0 };
+	UINT64							m_packetNodesVisited{ 0 };
+	UINT64							m_packetLeafTests{ 0 };
+	UINT64							m_fallbackRays{ 0 };	// lanes finished as single rays after the packet diverged
+
+	void							Accumulate(const BVHTraversalStats &other)
+	{
+		m_rayCount += other.m_rayCount;
+		m_nodesVisited += other.m_nodesVisited;
+		m_leafTests += other.m_leafTests;
+		m_packetCount += other.m_packetCount;
+		m_packetNodesVisited += other.m_packetNodesVisited;
+		m_packetLeafTests += other.m_packetLeafTests;
+		m_fallbackRays += other.m_fallbackRays;
+	}
+
+	// for a query going through several structures, the rays and packets are only counted by the first one
+	void							AccumulateNodes(const BVHTraversalStats &other)
+	{
+		m_nodesVisited += other.m_nodesVisited;
+		m_leafTests += other.m_leafTests;
+		m_packetNodesVisited += other.m_packetNodesVisited;
+		m_packetLeafTests += other.m_packetLeafTests;
+	}
+};
+
+// Bounding volume hierarchy over arbitrary primitives, built with a binned surface area heuristic
+// and flattened into a single array. Primitives are only known by their bounding boxes,
+// the leaf intersection is supplied by the caller at traversal time.
+class LinearBVH
+{
+public:
+	static const UINT32				SAH_BIN_COUNT = 16;
+	static const UINT32				MAX_LEAF_PRIMITIVES = 4;
+	static const UINT32				MAX_TRAVERSAL_DEPTH = 64;
+	static const UINT32				PARALLEL_BUILD_PRIMITIVES = 16 * 1024;	// smaller ranges are not worth a dispatch
+
+	LinearBVH() = default;
+	~LinearBVH() = default;
+
+	// leafBatchWidth, for callers testing several primitives of a leaf at once, makes the SAH count a batch as one test.
+	// With a thread pool, the top levels are binned by all its threads and the subtrees below are built as tasks,
+	// the tree is the same as the one built on the calling thread alone.
+	void							Build(const std::vector<AABB> &primitiveBounds, UINT32 maxLeafPrimitives = MAX_LEAF_PRIMITIVES, UINT32 leafBatchWidth = 1, ThreadPool *threadPool = nullptr);
+	void							Clear();
+
+	// Recomputes the node boxes bottom-up from new bounds of the same primitives, the topology is kept. O(n)
+	void							Refit(const std::vector<AABB> &primitiveBounds);
+	// Refit, unless the SAH cost would then be more than rebuildSAHGrowth times the one of the last Build,
+	// in which case the tree is built again with the same parameters, and threadPool as in Build. Returns TRUE when rebuilt, the primitive order changed then.
+	BOOL							RefitOrRebuild(const std::vector<AABB> &primitiveBounds, float rebuildSAHGrowth, ThreadPool *threadPool = nullptr);
+
+	// Closest hit traversal, the nearer child is visited first.
+	// leafHit(primitiveIndex, t_min, t_max) returns TRUE on hit and shrinks t_max to the hit distance.
+	template<typename LeafHitFunc>
+	BOOL							Hit(const Ray &r, float t_min, float &t_max, LeafHitFunc &&leafHit, BVHTraversalStats *stats = nullptr) const;
+
+	// Closest hit traversal of a packet, the active lanes share the node tests.
+	// leafPacket(primitiveIndex, laneMask) tests a primitive for the given lanes and shrinks their m_tMax on hit.
+	// Once fewer than minActiveLanes lanes enter a node, each of them finishes the subtree as a single ray,
+	// with leafHit(lane, primitiveIndex, t_min, t_max) as in Hit.
+	template<UINT32 N, typename LeafPacketFunc, typename LeafHitFunc>
+	void							HitPacket(RayPacket<N> &packet, float t_min, LeafPacketFunc &&leafPacket, LeafHitFunc &&leafHit, UINT32 minActiveLanes, BVHTraversalStats *stats = nullptr) const;
+
+	// Any hit traversal for shadow and visibility rays, stops at the first leaf that reports something in [t_min, t_max].
+	// leafOccluded(primitiveIndex, t_min, t_max) returns TRUE when the primitive blocks the segment.
+	template<typename LeafOccludedFunc>
+	BOOL							Occluded(const Ray &r, float t_min, float t_max, LeafOccludedFunc &&leafOccluded, BVHTraversalStats *stats = nullptr) const;
+
+	// Same traversals, but a leaf is handed over as a whole, as the range [slot, slot + count) of GetPrimitiveIndex,
+	// for callers keeping their primitives in that order:
+	// leafRangeHit(slot, count, t_min, t_max), leafRangeOccluded(slot, count, t_min, t_max),
+	// leafRangePacket(slot, count, laneMask), leafRangeLaneHit(lane, slot, count, t_min, t_max)
+	template<typename LeafRangeHitFunc>
+	BOOL							HitRanges(const Ray &r, float t_min, float &t_max, LeafRangeHitFunc &&leafRangeHit, BVHTraversalStats *stats = nullptr) const;
+	template<typename LeafRangeOccludedFunc>
+	BOOL							OccludedRanges(const Ray &r, float t_min, float t_max, LeafRangeOccludedFunc &&leafRangeOccluded, BVHTraversalStats *stats = nullptr) const;
+	template<UINT32 N, typename LeafRangePacketFunc, typename LeafRangeLaneHitFunc>
+	void							HitPacketRanges(RayPacket<N> &packet, float t_min, LeafRangePacketFunc &&leafRangePacket, LeafRangeLaneHitFunc &&leafRangeLaneHit, UINT32 minActiveLanes, BVHTraversalStats *stats = nullptr) const;
+
+	inline BOOL						IsEmpty() const { return m_nodes.empty(); }
+	inline size_t					GetNodeCount() const { return m_nodes.size(); }
+	inline const LinearBVHNode &	GetNode(size_t index) const { return m_nodes[index]; }
+	inline UINT32					GetPrimitiveIndex(size_t slot) const { return m_primitiveIndices[slot]; }
+	AABB							BoundingBox() const;
+
+	// statistics of the built tree
+	UINT32							GetLeafCount() const;
+	UINT32							GetMaxDepth() const;
+	float							GetSAHCost() const;
+	inline float					GetBuildSAHCost() const { return m_buildSAHCost; }
+
+private:
+	struct BuildPrimitive
+	{
+		AABB						m_bounds;
+		Vec3						m_centroid;
+		UINT32						m_index;
+	};
+
+	struct SAHBin
+	{
+		AABB						m_bounds{ Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+		UINT32						m_count{ 0 };
+	};
+
+	struct RangeBounds
+	{
+		AABB						m_bounds{ Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+		AABB						m_centroidBounds{ Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+	};
+
+	// the primitives of a range binned along every axis of their centroid bounds
+	struct BuildBins
+	{
+		SAHBin						m_bins[3][SAH_BIN_COUNT];
+	};
+
+	// a subtree over [m_begin, m_end) built by one thread, with offsets into its own nodes
+	struct BuildTask
+	{
+		UINT32						m_begin;
+		UINT32						m_end;
+		UINT32						m_depth;
+		std::vector<LinearBVHNode>	m_nodes;
+	};
+
+	struct BuildContext
+	{
+		ThreadPool *				m_threadPool{ nullptr };
+		UINT32						m_taskPrimitives{ 0 };		// ranges up to that size become tasks
+		std::vector<BuildTask>		m_tasks;
+	};
+
+	// the primitives of [begin, end) are partitioned in place, the leaves of a subtree cover its range in order
+	UINT32							BuildRecursive(std::vector<LinearBVHNode> &nodes, std::vector<BuildPrimitive> &primitives, UINT32 begin, UINT32 end, UINT32 depth, BuildContext *context) const;
+	void							BoundRange(const std::vector<BuildPrimitive> &primitives, UINT32 begin, UINT32 end, ThreadPool *threadPool, RangeBounds &out_bounds) const;
+	void							BinRange(const std::vector<BuildPrimitive> &primitives, UINT32 begin, UINT32 end, ThreadPool *threadPool, const AABB &centroidBounds, BuildBins &out_bins) const;
+	UINT32							SpliceSubtrees(const std::vector<LinearBVHNode> &topNodes, UINT32 topIndex, const std::vector<BuildTask> &tasks);
+	UINT32							GetMaxDepthRecursive(UINT32 nodeIndex) const;
+	float							LeafCost(UINT32 count) const;
+
+	template<typename LeafRangeHitFunc>
+	BOOL							HitFrom(UINT32 rootIndex, const Ray &r, float t_min, float &t_max, LeafRangeHitFunc &&leafRangeHit, BVHTraversalStats *stats) const;
+
+	static inline BOOL				IntersectNode(const LinearBVHNode &node, const float org[3], const float invDir[3], float t_min, float t_max)
+	{
+		for (UINT32 axis = 0; axis < 3; axis++)
+		{
+			float t0 = (node.m_min[axis] - org[axis]) * invDir[axis];
+			float t1 = (node.m_max[axis] - org[axis]) * invDir[axis];
+			if (invDir[axis] < 0.0f)
+				std::swap(t0, t1);
+			t1 *= AABB_ROBUST_SCALE;
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+			if (t_max <= t_min)
+				return FALSE;
+		}
+		return TRUE;
+	}
+
+	std::vector<LinearBVHNode>		m_nodes;
+	std::vector<UINT32>				m_primitiveIndices;
+	UINT32							m_maxLeafPrimitives{ MAX_LEAF_PRIMITIVES };
+	UINT32							m_leafBatchWidth{ 1 };
+	float							m_buildSAHCost{ 0.0f };
+};
+
+template<typename LeafHitFunc>
+BOOL LinearBVH::Hit(const Ray &r, float t_min, float &t_max, LeafHitFunc &&leafHit, BVHTraversalStats *stats) const
+{
+	return HitRanges(r, t_min, t_max, [&](UINT32 slot, UINT32 count, float t_min, float &t_max)
+	{
+		BOOL hitAnything = FALSE;
+		for (UINT32 i = 0; i < count; i++)
+		{
+			if (leafHit(m_primitiveIndices[slot + i], t_min, t_max))
+				hitAnything = TRUE;
+		}
+		return hitAnything;
+	}, stats);
+}
+
+template<typename LeafRangeHitFunc>
+BOOL LinearBVH::HitRanges(const Ray &r, float t_min, float &t_max, LeafRangeHitFunc &&leafRangeHit, BVHTraversalStats *stats) const
+{
+	if (m_nodes.empty())
+		return FALSE;
+
+	if (stats)
+		stats->m_rayCount++;
+	return HitFrom(0, r, t_min, t_max, leafRangeHit, stats);
+}
+
+template<typename LeafRangeHitFunc>
+BOOL LinearBVH::HitFrom(UINT32 rootIndex, const Ray &r, float t_min, float &t_max, LeafRangeHitFunc &&leafRangeHit, BVHTraversalStats *stats) const
+{
+	const float org[3] = { r.m_org.x(), r.m_org.y(), r.m_org.z() };
+	const float invDir[3] = { 1.0f / r.m_dir.x(), 1.0f / r.m_dir.y(), 1.0f / r.m_dir.z() };
+	const BOOL dirIsNeg[3] = { invDir[0] < 0.0f, invDir[1] < 0.0f, invDir[2] < 0.0f };
+
+	UINT64 nodesVisited = 0;
+	UINT64 leafTests = 0;
+	BOOL hitAnything = FALSE;
+	UINT32 stack[MAX_TRAVERSAL_DEPTH];
+	UINT32 stackSize = 0;
+	UINT32 current = rootIndex;
+	for (;;)
+	{
+		const LinearBVHNode &node = m_nodes[current];
+		nodesVisited++;
+		if (IntersectNode(node, org, invDir, t_min, t_max))
+		{
+			if (node.m_primitiveCount > 0)
+			{
+				leafTests += node.m_primitiveCount;
+				if (leafRangeHit(node.m_primitivesOffset, node.m_primitiveCount, t_min, t_max))
+					hitAnything = TRUE;
+				if (stackSize == 0)
+					break;
+				current = stack[--stackSize];
+			}
+			else
+			{
+				// the children are ordered along the split axis, so the sign of the direction tells the nearer one
+				assert(stackSize < MAX_TRAVERSAL_DEPTH);
+				if (dirIsNeg[node.m_axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node.m_secondChildOffset;
+				}
+				else
+				{
+					stack[stackSize++] = node.m_secondChildOffset;
+					current = current + 1;
+				}
+			}
+		}
+		else
+		{
+			if (stackSize == 0)
+				break;
+			current = stack[--stackSize];
+		}
+	}
+
+	if (stats)
+	{
+		stats->m_nodesVisited += nodesVisited;
+		stats->m_leafTests += leafTests;
+	}
+	return hitAnything;
+}
+
+template<typename LeafOccludedFunc>
+BOOL LinearBVH::Occluded(const Ray &r, float t_min, float t_max, LeafOccludedFunc &&leafOccluded, BVHTraversalStats *stats) const
+{
+	return OccludedRanges(r, t_min, t_max, [&](UINT32 slot, UINT32 count, float t_min, float t_max)
+	{
+		for (UINT32 i = 0; i < count; i++)
+		{
+			if (leafOccluded(m_primitiveIndices[slot + i], t_min, t_max))
+				return TRUE;
+		}
+		return FALSE;
+	}, stats);
+}
+
+template<typename LeafRangeOccludedFunc>
+BOOL LinearBVH::OccludedRanges(const Ray &r, float t_min, float t_max, LeafRangeOccludedFunc &&leafRangeOccluded, BVHTraversalStats *stats) const
+{
+	if (m_nodes.empty())
+		return FALSE;
+
+	const float org[3] = { r.m_org.x(), r.m_org.y(), r.m_org.z() };
+	const float invDir[3] = { 1.0f / r.m_dir.x(), 1.0f / r.m_dir.y(), 1.0f / r.m_dir.z() };
+	const BOOL dirIsNeg[3] = { invDir[0] < 0.0f, invDir[1] < 0.0f, invDir[2] < 0.0f };
+
+	// t_max never shrinks, the nearer child first is only a guess that the blocker is close to the origin
+	UINT64 nodesVisited = 0;
+	UINT64 leafTests = 0;
+	BOOL occluded = FALSE;
+	UINT32 stack[MAX_TRAVERSAL_DEPTH];
+	UINT32 stackSize = 0;
+	UINT32 current = 0;
+	for (;;)
+	{
+		const LinearBVHNode &node = m_nodes[current];
+		nodesVisited++;
+		if (IntersectNode(node, org, invDir, t_min, t_max))
+		{
+			if (node.m_primitiveCount > 0)
+			{
+				leafTests += node.m_primitiveCount;
+				if (leafRangeOccluded(node.m_primitivesOffset, node.m_primitiveCount, t_min, t_max))
+				{
+					occluded = TRUE;
+					break;
+				}
+				if (stackSize == 0)
+					break;
+				current = stack[--stackSize];
+			}
+			else
+			{
+				assert(stackSize < MAX_TRAVERSAL_DEPTH);
+				if (dirIsNeg[node.m_axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node.m_secondChildOffset;
+				}
+				else
+				{
+					stack[stackSize++] = node.m_secondChildOffset;
+					current = current + 1;
+				}
+			}
+		}
+		else
+		{
+			if (stackSize == 0)
+				break;
+			current = stack[--stackSize];
+		}
+	}
+
+	if (stats)
+	{
+		stats->m_rayCount++;
+		stats->m_nodesVisited += nodesVisited;
+		stats->m_leafTests += leafTests;
+	}
+	return occluded;
+}
+
+template<UINT32 N, typename LeafPacketFunc, typename LeafHitFunc>
+void LinearBVH::HitPacket(RayPacket<N> &packet, float t_min, LeafPacketFunc &&leafPacket, LeafHitFunc &&leafHit, UINT32 minActiveLanes, BVHTraversalStats *stats) const
+{
+	HitPacketRanges(packet, t_min,
+		[&](UINT32 slot, UINT32 count, UINT32 laneMask)
+		{
+			for (UINT32 i = 0; i < count; i++)
+				leafPacket(m_primitiveIndices[slot + i], laneMask);
+		},
+		[&](UINT32 lane, UINT32 slot, UINT32 count, float t_min, float &t_max)
+		{
+			BOOL hitAnything = FALSE;
+			for (UINT32 i = 0; i < count; i++)
+			{
+				if (leafHit(lane, m_primitiveIndices[slot + i], t_min, t_max))
+					hitAnything = TRUE;
+			}
+			return hitAnything;
+		}, minActiveLanes, stats);
+}
+
+template<UINT32 N, typename LeafRangePacketFunc, typename LeafRangeLaneHitFunc>
+void LinearBVH::HitPacketRanges(RayPacket<N> &packet, float t_min, LeafRangePacketFunc &&leafRangePacket, LeafRangeLaneHitFunc &&leafRangeLaneHit, UINT32 minActiveLanes, BVHTraversalStats *stats) const
+{
+	if (m_nodes.empty() || packet.m_activeMask == 0)
+		return;
+
+	UINT64 nodesVisited = 0;
+	UINT64 leafTests = 0;
+	UINT64 fallbackRays = 0;
+	UINT32 stack[MAX_TRAVERSAL_DEPTH];
+	UINT32 maskStack[MAX_TRAVERSAL_DEPTH];
+	UINT32 stackSize = 0;
+	UINT32 current = 0;
+	UINT32 mask = packet.m_activeMask;
+	for (;;)
+	{
+		const LinearBVHNode &node = m_nodes[current];
+		nodesVisited++;
+		mask &= IntersectAABBPacket(packet, node.m_min, node.m_max, t_min);
+		UINT32 activeLanes = PopCount(mask);
+		if (activeLanes > 0 && activeLanes < minActiveLanes)
+		{
+			// the packet diverged, the few remaining rays are cheaper on their own
+			for (UINT32 lanes = mask; lanes; lanes &= lanes - 1)
+			{
+				UINT32 lane = LowestBit(lanes);
+				fallbackRays++;
+				HitFrom(current, packet.GetRay(lane), t_min, packet.m_tMax[lane], [&](UINT32 slot, UINT32 count, float t_min, float &t_max)
+				{
+					return leafRangeLaneHit(lane, slot, count, t_min, t_max);
+				}, stats);
+			}
+		}
+		else if (activeLanes > 0)
+		{
+			if (node.m_primitiveCount > 0)
+			{
+				leafTests += node.m_primitiveCount;
+				leafRangePacket(node.m_primitivesOffset, node.m_primitiveCount, mask);
+			}
+			else
+			{
+				// rays of a coherent packet mostly share their direction signs, the first active lane decides the order for all
+				assert(stackSize < MAX_TRAVERSAL_DEPTH);
+				if (packet.m_dir[node.m_axis][LowestBit(mask)] < 0.0f)
+				{
+					stack[stackSize] = current + 1;
+					current = node.m_secondChildOffset;
+				}
+				else
+				{
+					stack[stackSize] = node.m_secondChildOffset;
+					current = current + 1;
+				}
+				maskStack[stackSize++] = mask;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		stackSize--;
+		current = stack[stackSize];
+		mask = maskStack[stackSize];
+	}
+
+	if (stats)
+	{
+		stats->m_packetCount++;
+		stats->m_rayCount += PopCount(packet.m_activeMask);
+		stats->m_packetNodesVisited += nodesVisited;
+		stats->m_packetLeafTests += leafTests;
+		stats->m_fallbackRays += fallbackRays;
+	}
+}
\ No newline at end of file
@@ -7,8 +7,10 @@
 #include "Optics.h"
 
 #include "SimpleTexture2D.h"
+#if !defined(HEADLESS_RENDERING)
 #include "D3D12Viewer.h"
 #include "D3D12Helper.h"
+#endif
 
 Lambertian::Lambertian(const ITexture2D *albedo)
 	: m_albedo(albedo)
@@ -21,18 +23,44 @@ BOOL Lambertian::Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuatio
 	// For simplicity,  scatter always and attenuate by its reflectance R, 
 	// Or it can scatter with no attenuation but absorb the fraction 1 - R of the rays
 	// Or it could be a mixture of those strategies, like only scatter with some probability p and have attenuation be albedo / p
+	BSDFSample sample;
+	BOOL scattered = Sample(r_in, rec, sample);
+	r_scattered = Ray(rec.m_position, sample.m_direction);
+	attenuation = sample.m_weight;
+	return scattered;
+}
 
-
-	// Scatter a ray back to the air with a random direction from the unit radius sphere that is tangent to the hitpoint
-	// recursively sample the indirect light with absorb half the energy(50% reflectors), until reach the sky light 
-	Vec3 target = rec.m_position + rec.m_normal + Randomizer::RomdomInUnitSphere();
-	r_scattered = Ray(rec.m_position, target - rec.m_position);
-	attenuation = m_albedo->Sample(rec.m_u, rec.m_v);
-	//return TRUE;
+BOOL Lambertian::Sample(const Ray &r_in, const HitRecord &rec, BSDFSample &out_sample) const
+{
+	// the BRDF is albedo / pi, drawn with the density cos / pi the weight is the albedo
+	Vec3 t, b;
+	Optics::TangentFrame(rec.m_normal, t, b);
+	Vec3 local = Randomizer::RandomCosineDirection();
+	out_sample.m_direction = local.x() * t + local.y() * b + local.z() * rec.m_normal;
+	out_sample.m_weight = m_albedo->Sample(rec.m_u, rec.m_v, rec.m_footprint * rec.m_uvDensity);
+	out_sample.m_pdf = local.z() / (float)M_PI;
+	out_sample.m_specular = FALSE;
 	return (dot(r_in.m_dir, rec.m_normal) < 0); // absorb the scatter ray if the incident ray is below the surface
 }
 
+Vec3 Lambertian::Eval(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const
+{
+	float pdf = Pdf(r_in, rec, direction);
+	return (pdf > 0.0f) ? pdf * m_albedo->Sample(rec.m_u, rec.m_v, rec.m_footprint * rec.m_uvDensity) : Vec3(0.0f, 0.0f, 0.0f);
+}
+
+BOOL Lambertian::NeedsUV() const
+{
+	return m_albedo->NeedsUV();
+}
+
+float Lambertian::Pdf(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const
+{
+	float cosine = dot(rec.m_normal, direction) / direction.length();
+	return (cosine > 0.0f) ? cosine / (float)M_PI : 0.0f;
+}
 
+#if !defined(HEADLESS_RENDERING)
 void Lambertian::ApplySRV(D3D12Viewer *viewer) const
 {
 	ID3D12GraphicsCommandList *commandList = viewer->GetGraphicsCommandList();
@@ -88,6 +116,7 @@ void Lambertian::ApplyPSO(D3D12Viewer *viewer)
 	commandList->SetPipelineState(s_pso.m_PSO.Get());
 	commandList->SetGraphicsRootSignature(s_pso.m_RS.Get());
 }
+#endif
 
 
 Metal::Metal(ITexture2D *albedo, float fuzziness)
@@ -97,14 +126,58 @@ Metal::Metal(ITexture2D *albedo, float fuzziness)
 }
 
 BOOL Metal::Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const
+{
+	BSDFSample sample;
+	BOOL scattered = Sample(r_in, rec, sample);
+	r_scattered = Ray(rec.m_position, sample.m_direction);
+	attenuation = sample.m_weight;
+	return scattered;
+}
+
+BOOL Metal::Sample(const Ray &r_in, const HitRecord &rec, BSDFSample &out_sample) const
 {
 	Vec3 r_reflected;
 	Optics::Reflect(normalize(r_in.m_dir), rec.m_normal, r_reflected);
-	r_scattered = Ray(rec.m_position, r_reflected + m_data.fuzziness.x * Randomizer::RomdomInUnitSphere());
-	attenuation = m_albedo->Sample(rec.m_u, rec.m_v);
-	return (dot(r_scattered.m_dir, rec.m_normal) > 0); // absorb the scatter ray if it is below the surface
+	out_sample.m_direction = r_reflected + m_data.fuzziness.x * Randomizer::RomdomInUnitSphere();
+	out_sample.m_weight = m_albedo->Sample(rec.m_u, rec.m_v, rec.m_footprint * rec.m_uvDensity);
+	out_sample.m_specular = IsSpecular();
+	out_sample.m_pdf = out_sample.m_specular ? 1.0f : Pdf(r_in, rec, out_sample.m_direction);
+	return (dot(out_sample.m_direction, rec.m_normal) > 0); // absorb the scatter ray if it is below the surface
 }
 
+Vec3 Metal::Eval(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const
+{
+	// the weight of Sample is the albedo, the BRDF times the cosine is the albedo times the density,
+	// minus the directions below the surface, which are absorbed
+	if (dot(direction, rec.m_normal) <= 0.0f)
+		return Vec3(0.0f, 0.0f, 0.0f);
+	return Pdf(r_in, rec, direction) * m_albedo->Sample(rec.m_u, rec.m_v, rec.m_footprint * rec.m_uvDensity);
+}
+
+BOOL Metal::NeedsUV() const
+{
+	return m_albedo->NeedsUV();
+}
+
+float Metal::Pdf(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const
+{
+	// The points r + p, p uniform in the ball of radius f around the unit mirror direction r, seen from the origin:
+	// along the unit w they fill t in [c - h, c + h], c = dot(w, r), h = sqrt(f^2 - 1 + c^2). Integrating t^2 dt
+	// over the segment divided by the volume of the ball, the density is h (3 c^2 + h^2) / (2 pi f^3). c - h >= 0 as f <= 1.
+	float f = m_data.fuzziness.x;
+	if (f <= 0.0f)
+		return 0.0f;
+	Vec3 r_reflected;
+	Optics::Reflect(normalize(r_in.m_dir), rec.m_normal, r_reflected);
+	float c = dot(r_reflected, direction) / direction.length();
+	float h2 = f * f - 1.0f + c * c;
+	if (c <= 0.0f || h2 <= 0.0f)
+		return 0.0f;
+	float h = sqrtf(h2);
+	return h * (3.0f * c * c + h2) / (2.0f * (float)M_PI * f * f * f);
+}
+
+#if !defined(HEADLESS_RENDERING)
 void Metal::ApplySRV(D3D12Viewer *viewer) const
 {
 	ID3D12GraphicsCommandList *commandList = viewer->GetGraphicsCommandList();
@@ -163,6 +236,7 @@ void Metal::ApplyPSO(D3D12Viewer *viewer)
 	commandList->SetPipelineState(s_pso.m_PSO.Get());
 	commandList->SetGraphicsRootSignature(s_pso.m_RS.Get());
 }
+#endif
 
 Dielectric::Dielectric(float refractiveIndex)
 {
@@ -170,13 +244,20 @@ Dielectric::Dielectric(float refractiveIndex)
 }
 
 BOOL Dielectric::Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const
+{
+	BSDFSample sample;
+	BOOL scattered = Sample(r_in, rec, sample);
+	r_scattered = Ray(rec.m_position, sample.m_direction);
+	attenuation = sample.m_weight;
+	return scattered;
+}
+
+BOOL Dielectric::Sample(const Ray &r_in, const HitRecord &rec, BSDFSample &out_sample) const
 {
 	Vec3 outward_normal;
 	Vec3 uv = normalize(r_in.m_dir);
-	
 
 	float ni_over_nt;
-	attenuation = Vec3(1.0f, 1.0f, 1.0f); // Dielectrics absorb nothing
 	Vec3 r_refracted;
 	float reflect_prob;
 	float cosine;
@@ -204,18 +285,22 @@ BOOL Dielectric::Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuatio
 		reflect_prob = 1.0f;
 	}
 
+	// the lobe is picked with the Fresnel probability, which cancels it out of the weight
+	out_sample.m_weight = Vec3(1.0f, 1.0f, 1.0f); // Dielectrics absorb nothing
+	out_sample.m_specular = TRUE;
 	if (Randomizer::RandomUNorm() < reflect_prob) {
-		Vec3 r_reflected;
-		Optics::Reflect(uv, rec.m_normal, r_reflected);
-		r_scattered = Ray(rec.m_position, r_reflected);
+		Optics::Reflect(uv, rec.m_normal, out_sample.m_direction);
+		out_sample.m_pdf = reflect_prob;
 	}
 	else
 	{
-		r_scattered = Ray(rec.m_position, r_refracted);
+		out_sample.m_direction = r_refracted;
+		out_sample.m_pdf = 1.0f - reflect_prob;
 	}
 	return TRUE;
 }
 
+#if !defined(HEADLESS_RENDERING)
 void Dielectric::ApplyCBV(D3D12Viewer *viewer, D3D12_GPU_DESCRIPTOR_HANDLE illumCbvHandle) const
 {
 	ID3D12GraphicsCommandList *commandList = viewer->GetGraphicsCommandList();
@@ -251,18 +336,20 @@ void Dielectric::ApplyPSO(D3D12Viewer *viewer)
 	commandList->SetPipelineState(s_pso.m_PSO.Get());
 	commandList->SetGraphicsRootSignature(s_pso.m_RS.Get());
 }
+#endif
 
 DiffuseLight::DiffuseLight(const Vec3 intensity)
 {
-	DirectX::XMStoreFloat4(&m_data.intensity, intensity.m_simd);
+	m_data.intensity = XMFLOAT4(intensity.x(), intensity.y(), intensity.z(), 0.0f);
 }
 
 BOOL DiffuseLight::Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const
 {
-	emitted = DirectX::XMLoadFloat4(&m_data.intensity);
+	emitted = Vec3(m_data.intensity.x, m_data.intensity.y, m_data.intensity.z);
 	return FALSE; // no scattering but emitting
 }
 
+#if !defined(HEADLESS_RENDERING)
 void DiffuseLight::ApplyCBV(D3D12Viewer *viewer, D3D12_GPU_DESCRIPTOR_HANDLE illumCbvHandle) const
 {
 	ID3D12GraphicsCommandList *commandList = viewer->GetGraphicsCommandList();
@@ -295,7 +382,9 @@ void DiffuseLight::ApplyPSO(D3D12Viewer *viewer)
 	commandList->SetPipelineState(s_pso.m_PSO.Get());
 	commandList->SetGraphicsRootSignature(s_pso.m_RS.Get());
 }
+#endif
 
+#if !defined(HEADLESS_RENDERING)
 void IMaterial::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &cbvGPUHandle)
 {
 	if (GetID() == MID_DIFFUSE_LIGHT)
@@ -335,3 +424,4 @@ void IMaterial::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &
 		cbvGPUHandle.Offset(handleOffset);
 	}
 }
+#endif
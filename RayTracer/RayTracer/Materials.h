@@ -19,25 +19,52 @@ struct HitRecord;
 class D3D12Viewer;
 class ITexture2D;
 
+#if !defined(HEADLESS_RENDERING)
 struct MaterialD3D12Resources
 {
 	ComPtr<ID3D12Resource>			m_MtlConstantBuffer;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE	m_MtlCbvHandle;
 };
+#endif
+
+// a direction drawn by IMaterial::Sample
+struct BSDFSample
+{
+	Vec3							m_direction;
+	Vec3							m_weight;		// the BSDF times the cosine over the density, what Scatter attenuates by
+	float							m_pdf;			// over the solid angle, or the probability of the lobe picked when m_specular
+	BOOL							m_specular;		// a mirror or a refraction, Eval and Pdf can never find the direction
+};
 
 class IMaterial
 {
 public:
+#if !defined(HEADLESS_RENDERING)
 	MaterialD3D12Resources m_d3dRes;
+#endif
 
 	virtual ~IMaterial() = default;
 	virtual BOOL Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const = 0;
 	virtual MaterialID GetID() const = 0;
 
+	// The BSDF for the strategies of the integrator, directions leave from rec.m_position, not normalized.
+	// Sample draws a direction, FALSE when the path is absorbed. Eval is the BSDF times the cosine toward direction,
+	// Pdf the density Sample draws it with. Both are zero for the specular materials, whose directions are
+	// only found by Sample. Scatter is Sample plus the emission.
+	virtual BOOL Sample(const Ray &r_in, const HitRecord &rec, BSDFSample &out_sample) const { return FALSE; }
+	virtual Vec3 Eval(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const { return Vec3(0.0f, 0.0f, 0.0f); }
+	virtual float Pdf(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const { return 0.0f; }
+	// only Sample finds the directions, the lights are not sampled at such hits
+	virtual BOOL IsSpecular() const { return TRUE; }
+	// TRUE when the texture coordinates of the hits are read, see SphereHitable::BindMaterial
+	virtual BOOL NeedsUV() const { return FALSE; }
+
+#if !defined(HEADLESS_RENDERING)
 	virtual void ApplySRV(D3D12Viewer *viewer) const {}
 	virtual void ApplyCBV(D3D12Viewer *viewer, D3D12_GPU_DESCRIPTOR_HANDLE illumCbvHandle) const {}
 
 	virtual void BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &cbvGPUHandle);
+#endif
 	virtual size_t GetDataSize() const { return 0; }
 	virtual const void * GetDataPtr() const { return nullptr; }
 };
@@ -51,12 +78,21 @@ public:
 	virtual BOOL Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const override;
 	virtual MaterialID GetID() const override { return Lambertian::GetStaticID(); }
 
+	// cosine-weighted around the normal, the weight is the albedo
+	virtual BOOL Sample(const Ray &r_in, const HitRecord &rec, BSDFSample &out_sample) const override;
+	virtual Vec3 Eval(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const override;
+	virtual float Pdf(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const override;
+	virtual BOOL IsSpecular() const override { return FALSE; }
+	virtual BOOL NeedsUV() const override;
+
+#if !defined(HEADLESS_RENDERING)
 	virtual void ApplySRV(D3D12Viewer *viewer) const override;
 	virtual void ApplyCBV(D3D12Viewer *viewer, D3D12_GPU_DESCRIPTOR_HANDLE illumCbvHandle) const override;
 
 	static PipelineState s_pso;
 	static void BuildPSO(D3D12Viewer *viewer, UINT32 lightSourceCount);
 	static void ApplyPSO(D3D12Viewer *viewer);
+#endif
 	static MaterialID GetStaticID() { return MID_LAMBERTIAN; }
 };
 
@@ -71,15 +107,26 @@ public:
 	virtual BOOL Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const override;
 	virtual MaterialID GetID() const override { return Metal::GetStaticID(); }
 
+	// the mirror direction plus a point of the ball of radius fuzziness, the weight is the albedo
+	virtual BOOL Sample(const Ray &r_in, const HitRecord &rec, BSDFSample &out_sample) const override;
+	virtual Vec3 Eval(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const override;
+	virtual float Pdf(const Ray &r_in, const HitRecord &rec, const Vec3 &direction) const override;
+	virtual BOOL IsSpecular() const override { return m_data.fuzziness.x <= 0.0f; }
+	virtual BOOL NeedsUV() const override;
+
+#if !defined(HEADLESS_RENDERING)
 	virtual void ApplySRV(D3D12Viewer *viewer) const override;
 	virtual void ApplyCBV(D3D12Viewer *viewer, D3D12_GPU_DESCRIPTOR_HANDLE illumCbvHandle) const override;
+#endif
 
 	virtual size_t GetDataSize() const override { return sizeof(m_data); }
 	virtual const void * GetDataPtr() const override { return &m_data; }
 
+#if !defined(HEADLESS_RENDERING)
 	static PipelineState s_pso;
 	static void BuildPSO(D3D12Viewer *viewer, UINT32 lightSourceCount);
 	static void ApplyPSO(D3D12Viewer *viewer);
+#endif
 	static MaterialID GetStaticID() { return MID_METAL; }
 };
 
@@ -92,14 +139,21 @@ public:
 	virtual BOOL Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const override;
 	virtual MaterialID GetID() const override { return Dielectric::GetStaticID(); }
 
+	// reflects with the Schlick Fresnel probability, refracts otherwise, both specular
+	virtual BOOL Sample(const Ray &r_in, const HitRecord &rec, BSDFSample &out_sample) const override;
+
+#if !defined(HEADLESS_RENDERING)
 	virtual void ApplyCBV(D3D12Viewer *viewer, D3D12_GPU_DESCRIPTOR_HANDLE illumCbvHandle) const override;
+#endif
 
 	virtual size_t GetDataSize() const override { return sizeof(m_data); }
 	virtual const void * GetDataPtr() const override { return &m_data; }
 
+#if !defined(HEADLESS_RENDERING)
 	static PipelineState s_pso;
 	static void BuildPSO(D3D12Viewer *viewer, UINT32 lightSourceCount);
 	static void ApplyPSO(D3D12Viewer *viewer);
+#endif
 	static MaterialID GetStaticID() { return MID_DIELECTRIC; }
 };
 
@@ -112,13 +166,17 @@ public:
 	virtual BOOL Scatter(const Ray &r_in, const HitRecord &rec, Vec3 &attenuation, Ray &r_scattered, Vec3 &emitted) const override;
 	virtual MaterialID GetID() const override { return DiffuseLight::GetStaticID(); }
 
+#if !defined(HEADLESS_RENDERING)
 	virtual void ApplyCBV(D3D12Viewer *viewer, D3D12_GPU_DESCRIPTOR_HANDLE illumCbvHandle) const override;
+#endif
 
 	virtual size_t GetDataSize() const override { return sizeof(m_data); }
 	virtual const void * GetDataPtr() const override { return &m_data; }
 
+#if !defined(HEADLESS_RENDERING)
 	static PipelineState s_pso;
 	static void BuildPSO(D3D12Viewer *viewer);
 	static void ApplyPSO(D3D12Viewer *viewer);
+#endif
 	static MaterialID GetStaticID() { return MID_DIFFUSE_LIGHT; }
 };
\ No newline at end of file
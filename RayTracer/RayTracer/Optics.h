@@ -22,6 +22,16 @@ public:
 		return ret;
 	}
 
+	// an orthonormal basis (t, b, n) around the unit vector n, Duff et al. "Building an Orthonormal Basis, Revisited"
+	static inline void TangentFrame(const Vec3 &n, Vec3 &t, Vec3 &b)
+	{
+		float sign = copysignf(1.0f, n.z());
+		float a = -1.0f / (sign + n.z());
+		float c = n.x() * n.y() * a;
+		t = Vec3(1.0f + sign * n.x() * n.x() * a, sign * c, -sign * n.x());
+		b = Vec3(c, sign + n.y() * n.y() * a, -n.y());
+	}
+
 	// Schlick's approximation, named after Christophe Schlick, 
 	// is a formula for approximating the contribution of the Fresnel factor in the specular reflection of light from a non-conducting interface (surface) between two media.
 	static inline float Schlick(float cosine, float ref_idx)
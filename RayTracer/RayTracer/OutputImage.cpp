@@ -2,8 +2,10 @@
 #include "OutputImage.h"
 #include "PPMImageMaker.h"
 #include "Vec3.h"
+#if !defined(HEADLESS_RENDERING)
 #include "D3D12Viewer.h"
 #include "D3D12Helper.h"
+#endif
 
 OutputImage::OutputImage(UINT32 width, UINT32 height, const char *name)
 	: m_width(width)
@@ -44,8 +46,6 @@ void OutputImage::RenderAsRainbow()
 			*(baseOffset + 3) = static_cast<UINT32>(a * 255.0f) & 0xFF;
 		}
 	}
-
-	m_isDirty = TRUE;
 }
 
 void OutputImage::RenderAsRed()
@@ -67,9 +67,15 @@ void OutputImage::Render(const Vec3 *pixels, UINT32 pixelCount)
 		assert(checkSize && "unmatching image size and data size");
 	}
 
-	for (UINT32 j = 0; j < m_height; j++)
+	RenderRegion(pixels, 0, 0, m_width, m_height);
+	m_isDirty = TRUE;
+}
+
+void OutputImage::RenderRegion(const Vec3 *pixels, UINT32 x0, UINT32 y0, UINT32 x1, UINT32 y1)
+{
+	for (UINT32 j = y0; j < y1; j++)
 	{
-		for (UINT32 i = 0; i < m_width; i++)
+		for (UINT32 i = x0; i < x1; i++)
 		{
 			UINT32 index = j * m_width + i;
 			Vec3 col = pixels[index];
@@ -83,10 +89,9 @@ void OutputImage::Render(const Vec3 *pixels, UINT32 pixelCount)
 			*(baseOffset + 3) = static_cast<UINT32>(a * 255.0f) & 0xFF;
 		}
 	}
-
-	m_isDirty = TRUE;
 }
 
+#if !defined(HEADLESS_RENDERING)
 void OutputImage::Upload(D3D12Viewer *viewer)
 {
 	ID3D12GraphicsCommandList *commandList = viewer->GetGraphicsCommandList();
@@ -251,9 +256,13 @@ void OutputImage::BuildD3DRes(D3D12Viewer *viewer)
 	viewer->ExecuteCommandList();
 	viewer->WaitForGpu();
 }
+#endif
 
-void OutputImage::Output()
+void OutputImage::Output(const char *outputDir)
 {
 	std::string ppmFileName = m_name + ".ppm";
-	PPMImageMaker::OutputRGBA8ToFile(ppmFileName.c_str(), m_width, m_height, m_data, m_dataSizeInByte);
+	if (outputDir)
+		PPMImageMaker::OutputRGBA8ToFile(ppmFileName.c_str(), m_width, m_height, m_data, m_dataSizeInByte, outputDir);
+	else
+		PPMImageMaker::OutputRGBA8ToFile(ppmFileName.c_str(), m_width, m_height, m_data, m_dataSizeInByte);
 }
\ No newline at end of file
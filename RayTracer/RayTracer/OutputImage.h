@@ -2,7 +2,7 @@
 
 #include "D3D12Defines.h"
 
-struct Vec3;
+#include "Vec3.h"
 class D3D12Viewer;
 
 //RGBA8 bitmap
@@ -15,12 +15,16 @@ public:
 	void										RenderAsRainbow();
 	void										RenderAsRed();
 	void										Render(const Vec3 *pixels, UINT32 pixelCount = 0);
+	// converts only [x0, x1) x [y0, y1) of the full size pixels, disjoint regions can be rendered from different threads
+	void										RenderRegion(const Vec3 *pixels, UINT32 x0, UINT32 y0, UINT32 x1, UINT32 y1);
 
+#if !defined(HEADLESS_RENDERING)
 	void										Upload(D3D12Viewer *viewer);
 	void										Resolve(D3D12Viewer *viewer);
 	void										BuildD3DRes(D3D12Viewer *viewer);
+#endif
 
-	void										Output();
+	void										Output(const char *outputDir = nullptr);
 
 	UINT32										m_width{ 0 };
 	UINT32										m_height{ 0 };
@@ -32,6 +36,7 @@ public:
 	BOOL										m_isDirty{ FALSE };
 
 
+#if !defined(HEADLESS_RENDERING)
 	// for output image resolving
 	PipelineState								m_resolvePipelineState;
 	D3D12_VERTEX_BUFFER_VIEW					m_vertexBufferView;
@@ -39,4 +44,5 @@ public:
 	ComPtr<ID3D12Resource>						m_resolveTargetTexture;
 	ComPtr<ID3D12Resource>						m_resolveTargetTextureUploadHeap;
 	ComPtr<ID3D12DescriptorHeap>				m_resolveTargetTextureSRVHeap;
+#endif
 };
\ No newline at end of file
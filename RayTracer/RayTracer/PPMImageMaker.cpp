@@ -1,12 +1,16 @@
 #include "stdafx.h"
 #include "PPMImageMaker.h"
 
+#if defined(_WIN32)
 #include "shlwapi.h"
 #pragma comment(lib,"shlwapi.lib")
+#else
+#include <sys/stat.h>
+#endif
 
 using namespace std;
 
-void PPMImageMaker::OutputRGBA8ToFile(const char *fileName, UINT32 imageWidth, UINT32 imageHeight, const UINT8 *rgba8PixelData, UINT64 dataSizeInByte)
+void PPMImageMaker::OutputRGBA8ToFile(const char *fileName, UINT32 imageWidth, UINT32 imageHeight, const UINT8 *rgba8PixelData, UINT64 dataSizeInByte, const char *outputDir)
 {
 	cout << "[PPMImageMaker] Save output image to PPM file: " << fileName << " ..." << endl;
 
@@ -18,13 +22,24 @@ void PPMImageMaker::OutputRGBA8ToFile(const char *fileName, UINT32 imageWidth, U
 		assert(checkSize && "unmatching image size and data size");
 	}
 
-	string path = "..\\Assets";
+	string path = outputDir;
+#if defined(_WIN32)
 	if (!PathIsDirectory(path.c_str()))
 	{
 		::CreateDirectory(path.c_str(), NULL);
 	}
 
 	string filePath = path + "\\" + string(fileName);
+#else
+	std::replace(path.begin(), path.end(), '\\', '/');
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+	{
+		mkdir(path.c_str(), 0755);
+	}
+
+	string filePath = path + "/" + string(fileName);
+#endif
 	ofstream ofs(filePath.c_str());
 	assert(ofs && "failed to open file stream");
 
@@ -0,0 +1,90 @@
+#pragma once
+
+// The subset of Win32 types, CRT helpers and DirectXMath storage types the tracing core relies on,
+// so that it can be compiled on non-Windows hosts. Only the headless CPU tracer is available there.
+#if !defined(_WIN32)
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cerrno>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+typedef int						BOOL;
+typedef int8_t					INT8;
+typedef int16_t					INT16;
+typedef int32_t					INT32;
+typedef int64_t					INT64;
+typedef uint8_t					UINT8;
+typedef uint16_t				UINT16;
+typedef uint32_t				UINT32;
+typedef uint64_t				UINT64;
+typedef unsigned int			UINT;
+
+#ifndef TRUE
+#define TRUE					1
+#endif
+#ifndef FALSE
+#define FALSE					0
+#endif
+
+// virtual key codes of the hot keys, the listener is never attached in headless builds
+#define VK_SPACE				0x20
+#define VK_ESCAPE				0x1B
+#define VK_LEFT					0x25
+#define VK_UP					0x26
+#define VK_RIGHT				0x27
+#define VK_DOWN					0x28
+
+#define _countof(a)				(sizeof(a) / sizeof((a)[0]))
+
+using std::min;
+using std::max;
+
+inline int fopen_s(FILE **pFile, const char *fileName, const char *mode)
+{
+	*pFile = fopen(fileName, mode);
+	return (*pFile != nullptr) ? 0 : errno;
+}
+
+template<size_t size>
+inline int sprintf_s(char (&buffer)[size], const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int ret = vsnprintf(buffer, size, format, args);
+	va_end(args);
+	return ret;
+}
+
+// plain storage types, same layout as DirectXMath ones
+struct XMFLOAT2
+{
+	float x, y;
+	XMFLOAT2() = default;
+	XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+};
+
+struct XMFLOAT3
+{
+	float x, y, z;
+	XMFLOAT3() = default;
+	XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+};
+
+struct XMFLOAT4
+{
+	float x, y, z, w;
+	XMFLOAT4() = default;
+	XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+};
+
+struct XMFLOAT4X4
+{
+	float m[4][4];
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include "Randomizer.h"
+#include "RayPacket.h"
+
+UINT64 Randomizer::s_seed = 0;
+const ISampler *Randomizer::s_sampler = nullptr;
+thread_local RandomStream Randomizer::s_stream;
+
+
+namespace
+{
+	// the scalar SinCosQuarter on the lanes, the same operations in the same order
+	inline void SinCosQuarter4(const Float4 &x, Float4 &out_s, Float4 &out_c)
+	{
+		Float4 x2 = x * x;
+		out_s = x * (Float4(1.0f) + x2 * (Float4(-1.0f / 6.0f) + x2 * (Float4(1.0f / 120.0f) + x2 * Float4(-1.0f / 5040.0f))));
+		out_c = Float4(1.0f) + x2 * (Float4(-0.5f) + x2 * (Float4(1.0f / 24.0f) + x2 * (Float4(-1.0f / 720.0f) + x2 * Float4(1.0f / 40320.0f))));
+	}
+
+	inline void ConcentricDisk4(const Float4 &u0, const Float4 &u1, Float4 &out_x, Float4 &out_y)
+	{
+		Float4 zero(0.0f);
+		Float4 a = Float4(2.0f) * u0 - Float4(1.0f);
+		Float4 b = Float4(2.0f) * u1 - Float4(1.0f);
+		Float4 absA = Max(a, zero - a);
+		Float4 absB = Max(b, zero - b);
+		Float4 useA = absB < absA;
+		Float4 r = Select(useA, a, b);
+		// the lanes with r = 0 divide by zero and are replaced
+		Float4 nonZero = Min(r, zero - r) < zero;
+		Float4 q = Select(nonZero, Select(useA, b, a) / r, zero);
+		Float4 s, c;
+		SinCosQuarter4(Float4(0.785398163f) * q, s, c);
+		out_x = r * Select(useA, c, s);
+		out_y = r * Select(useA, s, c);
+	}
+}
+
+void Randomizer::ConcentricDisks(const float *u0, const float *u1, UINT32 count, float *out_x, float *out_y)
+{
+	UINT32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		Float4 x, y;
+		ConcentricDisk4(Float4::LoadUnaligned(u0 + i), Float4::LoadUnaligned(u1 + i), x, y);
+		alignas(16) float lanes[2][4];
+		x.Store(lanes[0]);
+		y.Store(lanes[1]);
+		memcpy(out_x + i, lanes[0], sizeof(lanes[0]));
+		memcpy(out_y + i, lanes[1], sizeof(lanes[1]));
+	}
+	for (; i < count; i++)
+	{
+		Vec3 p = ConcentricDisk(u0[i], u1[i]);
+		out_x[i] = p.x();
+		out_y[i] = p.y();
+	}
+}
+
+void Randomizer::UniformSpheres(const float *u0, const float *u1, UINT32 count, float *out_x, float *out_y, float *out_z)
+{
+	UINT32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		Float4 v0 = Float4::LoadUnaligned(u0 + i);
+		Float4 upper = v0 < Float4(0.5f);
+		Float4 twice = Float4(2.0f) * v0;
+		Float4 x, y;
+		ConcentricDisk4(Select(upper, twice, twice - Float4(1.0f)), Float4::LoadUnaligned(u1 + i), x, y);
+		Float4 r2 = x * x + y * y;
+		Float4 scale = Sqrt(Float4(2.0f) - r2);
+		alignas(16) float lanes[3][4];
+		(x * scale).Store(lanes[0]);
+		(y * scale).Store(lanes[1]);
+		Select(upper, Float4(1.0f) - r2, r2 - Float4(1.0f)).Store(lanes[2]);
+		memcpy(out_x + i, lanes[0], sizeof(lanes[0]));
+		memcpy(out_y + i, lanes[1], sizeof(lanes[1]));
+		memcpy(out_z + i, lanes[2], sizeof(lanes[2]));
+	}
+	for (; i < count; i++)
+	{
+		Vec3 p = UniformSphere(u0[i], u1[i]);
+		out_x[i] = p.x();
+		out_y[i] = p.y();
+		out_z[i] = p.z();
+	}
+}
+
+void Randomizer::CosineHemispheres(const float *u0, const float *u1, UINT32 count, float *out_x, float *out_y, float *out_z)
+{
+	UINT32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		Float4 x, y;
+		ConcentricDisk4(Float4::LoadUnaligned(u0 + i), Float4::LoadUnaligned(u1 + i), x, y);
+		Float4 r2 = x * x + y * y;
+		alignas(16) float lanes[3][4];
+		x.Store(lanes[0]);
+		y.Store(lanes[1]);
+		Sqrt(Max(Float4(1.0f) - r2, Float4(0.0f))).Store(lanes[2]);
+		memcpy(out_x + i, lanes[0], sizeof(lanes[0]));
+		memcpy(out_y + i, lanes[1], sizeof(lanes[1]));
+		memcpy(out_z + i, lanes[2], sizeof(lanes[2]));
+	}
+	for (; i < count; i++)
+	{
+		Vec3 p = CosineHemisphere(u0[i], u1[i]);
+		out_x[i] = p.x();
+		out_y[i] = p.y();
+		out_z[i] = p.z();
+	}
+}
+
+void Randomizer::RandomUNorms(float *out_u, UINT32 count)
+{
+	for (UINT32 i = 0; i < count; i++)
+		out_u[i] = RandomUNorm();
+}
\ No newline at end of file
@@ -1,28 +1,115 @@
 #pragma once
 
 #include "Vec3.h"
+#include "Sampler.h"
 
+// PCG32 (XSH RR), 64-bit state with selectable stream, see http://www.pcg-random.org
+struct PCG32
+{
+	UINT64 m_state{ 0x853c49e6748fea9bULL };
+	UINT64 m_inc{ 0xda3e39cb94b95bdbULL };
+
+	inline void Seed(UINT64 initState, UINT64 stream)
+	{
+		m_state = 0;
+		m_inc = (stream << 1) | 1;
+		Next();
+		m_state += initState;
+		Next();
+	}
+
+	inline UINT32 Next()
+	{
+		UINT64 oldState = m_state;
+		m_state = oldState * 6364136223846793005ULL + m_inc;
+		UINT32 xorShifted = (UINT32)(((oldState >> 18) ^ oldState) >> 27);
+		UINT32 rot = (UINT32)(oldState >> 59);
+		return (xorShifted >> rot) | (xorShifted << ((0u - rot) & 31));
+	}
+};
+
+// what SaveStream() keeps, the generator and the pixel sample being drawn
+struct RandomStream
+{
+	PCG32						m_generator;
+	SampleState					m_sample;
+	BOOL						m_sampling{ FALSE };
+};
+
+// Every thread owns its generator, BeginStream() reseeds it so that the sequence only depends on (seed, streamID),
+// not on which thread runs the work, renders are therefore reproducible with any thread count.
+// Between BeginSample() and EndSample(), the numbers come from the sampler instead, if one is set.
+// Define RANDOMIZER_RANDOM_DEVICE to get the old std::random_device behavior back, for comparison only.
 class Randomizer
 {
 public:
+	// global seed, also reseeds the calling thread, which builds the scene
+	static inline void SetSeed(UINT64 seed)
+	{
+		s_seed = seed;
+		s_stream.m_generator.Seed(SplitMix64(seed), 0);
+	}
+
+	static inline UINT64 GetSeed() { return s_seed; }
+
+	// independent stream for a unit of work, e.g. a pixel of a frame
+	static inline void BeginStream(UINT64 streamID)
+	{
+		s_stream.m_generator.Seed(SplitMix64(s_seed ^ SplitMix64(streamID)), streamID);
+	}
+
+	// stream of the sub-unit index of a unit of work, e.g. a sample of a pixel, the index 0 is the unit's own stream.
+	// The others are hashed over all the 64 bits, so that no index range wraps onto another one
+	static inline UINT64 SubStreamID(UINT64 streamID, UINT32 index)
+	{
+		return index ? SplitMix64(streamID ^ SplitMix64(index)) : streamID;
+	}
+
+	// position of the calling thread's stream, so that one thread can interleave the streams of several pixels
+	static inline RandomStream SaveStream() { return s_stream; }
+	static inline void RestoreStream(const RandomStream &stream) { s_stream = stream; }
+
+	// low discrepancy sampling of the pixels, shared by all the threads and not owned, nullptr for the independent streams
+	static inline void SetSampler(const ISampler *sampler) { s_sampler = sampler; }
+	static inline const ISampler *GetSampler() { return s_sampler; }
+
+	// the next numbers are the dimensions of the sample sampleIndex of the pixel (x, y), from the first one
+	static inline void BeginSample(UINT32 x, UINT32 y, UINT32 sampleIndex)
+	{
+		s_stream.m_sample.m_pixelX = x;
+		s_stream.m_sample.m_pixelY = y;
+		s_stream.m_sample.m_pixelHash = ISampler::Hash(x ^ ISampler::Hash(y));
+		s_stream.m_sample.m_sampleIndex = sampleIndex;
+		s_stream.m_sample.m_dimension = 0;
+		s_stream.m_sampling = (s_sampler != nullptr);
+	}
+
+	static inline void EndSample() { s_stream.m_sampling = FALSE; }
+
+	static inline UINT32 RandomUInt32()
+	{
+#if defined(RANDOMIZER_RANDOM_DEVICE)
+		std::random_device rd;
+		return rd();
+#else
+		if (s_stream.m_sampling)
+			return s_sampler->Sample(s_stream.m_sample, s_stream.m_sample.m_dimension++);
+		return s_stream.m_generator.Next();
+#endif
+	}
+
 	// [min, max)
 	static inline float RandomMinMax(float min, float max)
 	{
-		std::random_device rd;
-		UINT64 _max = (rd.max)();
-		_max += 1;
-		double r = static_cast<double>(rd()) / static_cast<double>(_max); // [0.0f, 1.0f)
-		r = r * (max - min) + min;
-		return static_cast<float>(r);
+		float r = (RandomUInt32() >> 8) * (1.0f / 16777216.0f); // [0.0f, 1.0f), 24 bits fit the mantissa
+		return r * (max - min) + min;
 	}
 
 	// [min, max]
 	static inline float RandomMinMax2(float min, float max)
 	{
-		std::random_device rd;
-		double r = static_cast<double>(rd()) / static_cast<double>((rd.max)()); // [0.0f, 1.0f]
-		r = r * (max - min) + min;
-		return static_cast<float>(r);
+		float r = (RandomUInt32() >> 8) * (1.0f / 16777215.0f); // [0.0f, 1.0f]
+		return r * (max - min) + min;
 	}
 
 	// [0.0f, 1.0f)
@@ -37,23 +124,104 @@ public:
 		return RandomMinMax2(0.0f, 1.0f);
 	}
 
+	// uniform in the unit ball, three numbers
 	static inline Vec3 RomdomInUnitSphere()
 	{
-		Vec3 p;
-		do
-		{
-			p = Vec3(RandomMinMax2(-1.0f, 1.0f), RandomMinMax2(-1.0f, 1.0f), RandomMinMax2(-1.0f, 1.0f));
-		} while (p.squared_length() >= 1.0f);
-		return p;
+		float u0 = RandomUNorm();
+		float u1 = RandomUNorm();
+		float u2 = RandomUNorm();
+		return UniformBall(u0, u1, u2);
 	}
 
+	// uniform in the unit disk of the xy plane, two numbers
 	static inline Vec3 RandomInUnitDisk()
 	{
-		Vec3 p;
-		do
-		{
-			p = Vec3(RandomMinMax2(-1.0f, 1.0f), RandomMinMax2(-1.0f, 1.0f), 0.0f);
-		} while (p.squared_length() >= 1.0f);
-		return p;
+		float u0 = RandomUNorm();
+		float u1 = RandomUNorm();
+		return ConcentricDisk(u0, u1);
 	}
-};
+
+	// uniform on the unit sphere, two numbers
+	static inline Vec3 RandomOnUnitSphere()
+	{
+		float u0 = RandomUNorm();
+		float u1 = RandomUNorm();
+		return UniformSphere(u0, u1);
+	}
+
+	// around +z with a density of cos(theta) / pi, two numbers
+	static inline Vec3 RandomCosineDirection()
+	{
+		float u0 = RandomUNorm();
+		float u1 = RandomUNorm();
+		return CosineHemisphere(u0, u1);
+	}
+
+	// Closed-form mappings of numbers in [0, 1), no rejection loop: a sample always takes the same dimensions,
+	// which keeps the sampler dimensions of the bounces in step, and the branches are selects.
+
+	// Shirley and Chiu's concentric mapping of the square to the unit disk, area preserving, z = 0
+	static inline Vec3 ConcentricDisk(float u0, float u1)
+	{
+		float a = 2.0f * u0 - 1.0f;
+		float b = 2.0f * u1 - 1.0f;
+		BOOL useA = fabsf(a) > fabsf(b);
+		float r = useA ? a : b;
+		float q = (r != 0.0f) ? (useA ? b : a) / r : 0.0f;
+		float s, c;
+		SinCosQuarter(0.785398163f * q, s, c);
+		// the angle is pi / 4 * b / a, or pi / 2 - pi / 4 * a / b
+		return Vec3(r * (useA ? c : s), r * (useA ? s : c), 0.0f);
+	}
+
+	// the upper hemisphere for u0 < 0.5, the lower one above, each lifted from the disk preserving the area
+	static inline Vec3 UniformSphere(float u0, float u1)
+	{
+		BOOL upper = u0 < 0.5f;
+		Vec3 d = ConcentricDisk(upper ? 2.0f * u0 : 2.0f * u0 - 1.0f, u1);
+		float r2 = d.x() * d.x() + d.y() * d.y();
+		float scale = sqrtf(2.0f - r2);
+		return Vec3(d.x() * scale, d.y() * scale, upper ? 1.0f - r2 : r2 - 1.0f);
+	}
+
+	static inline Vec3 UniformBall(float u0, float u1, float u2)
+	{
+		return cbrtf(u2) * UniformSphere(u0, u1);
+	}
+
+	// Malley's method, the disk projected up to the hemisphere
+	static inline Vec3 CosineHemisphere(float u0, float u1)
+	{
+		Vec3 d = ConcentricDisk(u0, u1);
+		float r2 = d.x() * d.x() + d.y() * d.y();
+		return Vec3(d.x(), d.y(), sqrtf(r2 < 1.0f ? 1.0f - r2 : 0.0f));
+	}
+
+	// the same mappings 4 at a time with SSE, from arrays of numbers to arrays of coordinates, any count
+	static void ConcentricDisks(const float *u0, const float *u1, UINT32 count, float *out_x, float *out_y);
+	static void UniformSpheres(const float *u0, const float *u1, UINT32 count, float *out_x, float *out_y, float *out_z);
+	static void CosineHemispheres(const float *u0, const float *u1, UINT32 count, float *out_x, float *out_y, float *out_z);
+	// count numbers of the calling thread's stream, or of its sample
+	static void RandomUNorms(float *out_u, UINT32 count);
+
+private:
+	// sine and cosine of x in [-pi / 4, pi / 4], Taylor polynomials, within 1e-7
+	static inline void SinCosQuarter(float x, float &out_s, float &out_c)
+	{
+		float x2 = x * x;
+		out_s = x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f))));
+		out_c = 1.0f + x2 * (-0.5f + x2 * (1.0f / 24.0f + x2 * (-1.0f / 720.0f + x2 * (1.0f / 40320.0f))));
+	}
+
+	static inline UINT64 SplitMix64(UINT64 x)
+	{
+		x += 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	static UINT64							s_seed;
+	static const ISampler *					s_sampler;
+	static thread_local RandomStream		s_stream;
+};
\ No newline at end of file
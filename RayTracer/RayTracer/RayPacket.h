@@ -0,0 +1,268 @@
+#pragma once
+
+#include "Vec3.h"
+#include "Ray.h"
+
+#if defined(VEC3_HAS_SSE)
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// 4 lanes of floats, SSE when available, plain floats otherwise.
+// Comparisons return a lane mask as a float vector, MoveMask() packs it into the low 4 bits.
+struct alignas(16) Float4
+{
+#if defined(VEC3_HAS_SSE)
+	__m128 m_simd;
+
+	Float4() = default;
+	Float4(__m128 simd) : m_simd(simd) {}
+	explicit Float4(float f) : m_simd(_mm_set1_ps(f)) {}
+
+	static inline Float4 Load(const float *p) { return _mm_load_ps(p); }
+	static inline Float4 LoadUnaligned(const float *p) { return _mm_loadu_ps(p); }
+	inline void Store(float *p) const { _mm_store_ps(p, m_simd); }
+	inline UINT32 MoveMask() const { return (UINT32)_mm_movemask_ps(m_simd); }
+
+	friend inline Float4 operator+(const Float4 &a, const Float4 &b) { return _mm_add_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 operator-(const Float4 &a, const Float4 &b) { return _mm_sub_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 operator*(const Float4 &a, const Float4 &b) { return _mm_mul_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 operator/(const Float4 &a, const Float4 &b) { return _mm_div_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 operator<(const Float4 &a, const Float4 &b) { return _mm_cmplt_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 operator<=(const Float4 &a, const Float4 &b) { return _mm_cmple_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 operator&(const Float4 &a, const Float4 &b) { return _mm_and_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 Min(const Float4 &a, const Float4 &b) { return _mm_min_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 Max(const Float4 &a, const Float4 &b) { return _mm_max_ps(a.m_simd, b.m_simd); }
+	friend inline Float4 Sqrt(const Float4 &a) { return _mm_sqrt_ps(a.m_simd); }
+	// mask ? a : b
+	friend inline Float4 Select(const Float4 &mask, const Float4 &a, const Float4 &b) { return _mm_or_ps(_mm_and_ps(mask.m_simd, a.m_simd), _mm_andnot_ps(mask.m_simd, b.m_simd)); }
+#else
+	float m_e[4];
+
+	Float4() = default;
+	explicit Float4(float f) { m_e[0] = m_e[1] = m_e[2] = m_e[3] = f; }
+
+	static inline Float4 Load(const float *p) { Float4 r; for (UINT32 i = 0; i < 4; i++) r.m_e[i] = p[i]; return r; }
+	static inline Float4 LoadUnaligned(const float *p) { return Load(p); }
+	inline void Store(float *p) const { for (UINT32 i = 0; i < 4; i++) p[i] = m_e[i]; }
+	inline UINT32 MoveMask() const { UINT32 m = 0; for (UINT32 i = 0; i < 4; i++) m |= (AsBits(m_e[i]) >> 31) << i; return m; }
+
+	static inline UINT32 AsBits(float f) { UINT32 u; memcpy(&u, &f, 4); return u; }
+	static inline float FromBits(UINT32 u) { float f; memcpy(&f, &u, 4); return f; }
+	template<typename Op> static inline Float4 Apply(const Float4 &a, const Float4 &b, Op op) { Float4 r; for (UINT32 i = 0; i < 4; i++) r.m_e[i] = op(a.m_e[i], b.m_e[i]); return r; }
+	static inline float Mask(BOOL b) { return FromBits(b ? 0xFFFFFFFFu : 0u); }
+
+	friend inline Float4 operator+(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return x + y; }); }
+	friend inline Float4 operator-(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return x - y; }); }
+	friend inline Float4 operator*(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return x * y; }); }
+	friend inline Float4 operator/(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return x / y; }); }
+	friend inline Float4 operator<(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return Mask(x < y); }); }
+	friend inline Float4 operator<=(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return Mask(x <= y); }); }
+	friend inline Float4 operator&(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return FromBits(AsBits(x) & AsBits(y)); }); }
+	friend inline Float4 Min(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return x < y ? x : y; }); }
+	friend inline Float4 Max(const Float4 &a, const Float4 &b) { return Apply(a, b, [](float x, float y) { return x > y ? x : y; }); }
+	friend inline Float4 Sqrt(const Float4 &a) { Float4 r; for (UINT32 i = 0; i < 4; i++) r.m_e[i] = sqrtf(a.m_e[i]); return r; }
+	friend inline Float4 Select(const Float4 &mask, const Float4 &a, const Float4 &b) { Float4 r; for (UINT32 i = 0; i < 4; i++) r.m_e[i] = AsBits(mask.m_e[i]) ? a.m_e[i] : b.m_e[i]; return r; }
+#endif
+};
+
+// 8 lanes of floats, AVX when the build enables it, two Float4 otherwise. MoveMask() packs the lanes into the low 8 bits.
+// Loads and stores are unaligned.
+struct alignas(32) Float8
+{
+#if defined(__AVX__)
+	__m256 m_simd;
+
+	Float8() = default;
+	Float8(__m256 simd) : m_simd(simd) {}
+	explicit Float8(float f) : m_simd(_mm256_set1_ps(f)) {}
+
+	static inline Float8 Load(const float *p) { return _mm256_loadu_ps(p); }
+	inline void Store(float *p) const { _mm256_storeu_ps(p, m_simd); }
+	inline UINT32 MoveMask() const { return (UINT32)_mm256_movemask_ps(m_simd); }
+
+	friend inline Float8 operator+(const Float8 &a, const Float8 &b) { return _mm256_add_ps(a.m_simd, b.m_simd); }
+	friend inline Float8 operator-(const Float8 &a, const Float8 &b) { return _mm256_sub_ps(a.m_simd, b.m_simd); }
+	friend inline Float8 operator*(const Float8 &a, const Float8 &b) { return _mm256_mul_ps(a.m_simd, b.m_simd); }
+	friend inline Float8 operator/(const Float8 &a, const Float8 &b) { return _mm256_div_ps(a.m_simd, b.m_simd); }
+	friend inline Float8 operator<(const Float8 &a, const Float8 &b) { return _mm256_cmp_ps(a.m_simd, b.m_simd, _CMP_LT_OQ); }
+	friend inline Float8 operator<=(const Float8 &a, const Float8 &b) { return _mm256_cmp_ps(a.m_simd, b.m_simd, _CMP_LE_OQ); }
+	friend inline Float8 operator&(const Float8 &a, const Float8 &b) { return _mm256_and_ps(a.m_simd, b.m_simd); }
+	friend inline Float8 Min(const Float8 &a, const Float8 &b) { return _mm256_min_ps(a.m_simd, b.m_simd); }
+	friend inline Float8 Max(const Float8 &a, const Float8 &b) { return _mm256_max_ps(a.m_simd, b.m_simd); }
+	friend inline Float8 Sqrt(const Float8 &a) { return _mm256_sqrt_ps(a.m_simd); }
+	// mask ? a : b
+	friend inline Float8 Select(const Float8 &mask, const Float8 &a, const Float8 &b) { return _mm256_blendv_ps(b.m_simd, a.m_simd, mask.m_simd); }
+#else
+	Float4 m_lo;
+	Float4 m_hi;
+
+	Float8() = default;
+	Float8(const Float4 &lo, const Float4 &hi) : m_lo(lo), m_hi(hi) {}
+	explicit Float8(float f) : m_lo(f), m_hi(f) {}
+
+	static inline Float8 Load(const float *p) { return Float8(Float4::LoadUnaligned(p), Float4::LoadUnaligned(p + 4)); }
+	inline void Store(float *p) const { alignas(16) float lanes[8]; m_lo.Store(lanes); m_hi.Store(lanes + 4); memcpy(p, lanes, sizeof(lanes)); }
+	inline UINT32 MoveMask() const { return m_lo.MoveMask() | (m_hi.MoveMask() << 4); }
+
+	friend inline Float8 operator+(const Float8 &a, const Float8 &b) { return Float8(a.m_lo + b.m_lo, a.m_hi + b.m_hi); }
+	friend inline Float8 operator-(const Float8 &a, const Float8 &b) { return Float8(a.m_lo - b.m_lo, a.m_hi - b.m_hi); }
+	friend inline Float8 operator*(const Float8 &a, const Float8 &b) { return Float8(a.m_lo * b.m_lo, a.m_hi * b.m_hi); }
+	friend inline Float8 operator/(const Float8 &a, const Float8 &b) { return Float8(a.m_lo / b.m_lo, a.m_hi / b.m_hi); }
+	friend inline Float8 operator<(const Float8 &a, const Float8 &b) { return Float8(a.m_lo < b.m_lo, a.m_hi < b.m_hi); }
+	friend inline Float8 operator<=(const Float8 &a, const Float8 &b) { return Float8(a.m_lo <= b.m_lo, a.m_hi <= b.m_hi); }
+	friend inline Float8 operator&(const Float8 &a, const Float8 &b) { return Float8(a.m_lo & b.m_lo, a.m_hi & b.m_hi); }
+	friend inline Float8 Min(const Float8 &a, const Float8 &b) { return Float8(Min(a.m_lo, b.m_lo), Min(a.m_hi, b.m_hi)); }
+	friend inline Float8 Max(const Float8 &a, const Float8 &b) { return Float8(Max(a.m_lo, b.m_lo), Max(a.m_hi, b.m_hi)); }
+	friend inline Float8 Sqrt(const Float8 &a) { return Float8(Sqrt(a.m_lo), Sqrt(a.m_hi)); }
+	friend inline Float8 Select(const Float8 &mask, const Float8 &a, const Float8 &b) { return Float8(Select(mask.m_lo, a.m_lo, b.m_lo), Select(mask.m_hi, a.m_hi, b.m_hi)); }
+#endif
+};
+
+#define MAX_RAY_PACKET_WIDTH 16
+
+// the exit distance of a slab test is scaled by 1 + 2 * gamma(3), the bound of its rounding error,
+// so that rays through a shared edge or vertex of two primitives cannot miss both boxes
+const float AABB_ROBUST_SCALE = 1.0f + 2.0f * (3.0f * FLT_EPSILON * 0.5f) / (1.0f - 3.0f * FLT_EPSILON * 0.5f);
+
+// lane mask helpers
+inline UINT32 PopCount(UINT32 mask)
+{
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+inline UINT32 LowestBit(UINT32 mask)
+{
+	assert(mask != 0);
+	UINT32 index = 0;
+	while (!(mask & 1))
+	{
+		mask >>= 1;
+		index++;
+	}
+	return index;
+}
+
+// Structure of arrays of N rays, N is a multiple of 4 so that every group of 4 lanes fills one Float4.
+// Lane masks are bit masks, bit k for lane k.
+template<UINT32 N>
+struct RayPacket
+{
+	static_assert(N % 4 == 0 && N <= MAX_RAY_PACKET_WIDTH, "RayPacket width has to be 4, 8 or 16");
+	static const UINT32 WIDTH = N;
+	static const UINT32 GROUP_COUNT = N / 4;
+
+	alignas(16) float			m_org[3][N];
+	alignas(16) float			m_dir[3][N];
+	alignas(16) float			m_invDir[3][N];
+	alignas(16) float			m_tMax[N];
+	UINT32						m_activeMask{ 0 };
+
+	inline void SetRay(UINT32 lane, const Ray &r, float t_max)
+	{
+		for (UINT32 axis = 0; axis < 3; axis++)
+		{
+			m_org[axis][lane] = r.m_org[axis];
+			m_dir[axis][lane] = r.m_dir[axis];
+			m_invDir[axis][lane] = 1.0f / r.m_dir[axis];
+		}
+		m_tMax[lane] = t_max;
+		m_activeMask |= 1u << lane;
+	}
+
+	inline Ray GetRay(UINT32 lane) const
+	{
+		return Ray(Vec3(m_org[0][lane], m_org[1][lane], m_org[2][lane]), Vec3(m_dir[0][lane], m_dir[1][lane], m_dir[2][lane]));
+	}
+};
+
+// lanes of the packet entering the box within [t_min, m_tMax]
+template<UINT32 N>
+inline UINT32 IntersectAABBPacket(const RayPacket<N> &packet, const float boxMin[3], const float boxMax[3], float t_min)
+{
+	UINT32 mask = 0;
+	for (UINT32 g = 0; g < RayPacket<N>::GROUP_COUNT; g++)
+	{
+		UINT32 offset = g * 4;
+		Float4 t0(t_min);
+		Float4 t1 = Float4::Load(packet.m_tMax + offset);
+		for (UINT32 axis = 0; axis < 3; axis++)
+		{
+			Float4 org = Float4::Load(packet.m_org[axis] + offset);
+			Float4 invDir = Float4::Load(packet.m_invDir[axis] + offset);
+			Float4 tNear = (Float4(boxMin[axis]) - org) * invDir;
+			Float4 tFar = (Float4(boxMax[axis]) - org) * invDir;
+			// Min and Max return their second operand on NaN, a ray in the plane of a slab keeps its interval
+			t0 = Max(Min(tNear, tFar), t0);
+			t1 = Min(Max(tNear, tFar) * Float4(AABB_ROBUST_SCALE), t1);
+		}
+		mask |= (t0 < t1).MoveMask() << offset;
+	}
+	return mask;
+}
+
+// The primitive kernels repeat the operations of the scalar Hit in the same order, translation included,
+// so that a lane hits exactly when the scalar test does. out_t gets the hit distance of the hit lanes.
+
+// SphereHitable::Hit under a TranslatedInstance
+template<UINT32 N>
+inline UINT32 IntersectSpherePacket(const RayPacket<N> &packet, const float translation[3], const float center[3], float radius, float t_min, float out_t[N])
+{
+	UINT32 mask = 0;
+	for (UINT32 g = 0; g < RayPacket<N>::GROUP_COUNT; g++)
+	{
+		UINT32 offset = g * 4;
+		Float4 ocx = (Float4::Load(packet.m_org[0] + offset) - Float4(translation[0])) - Float4(center[0]);
+		Float4 ocy = (Float4::Load(packet.m_org[1] + offset) - Float4(translation[1])) - Float4(center[1]);
+		Float4 ocz = (Float4::Load(packet.m_org[2] + offset) - Float4(translation[2])) - Float4(center[2]);
+		Float4 dx = Float4::Load(packet.m_dir[0] + offset);
+		Float4 dy = Float4::Load(packet.m_dir[1] + offset);
+		Float4 dz = Float4::Load(packet.m_dir[2] + offset);
+
+		Float4 a = dx * dx + dy * dy + dz * dz;
+		Float4 b = Float4(2.0f) * (dx * ocx + dy * ocy + dz * ocz);
+		Float4 c = ocx * ocx + ocy * ocy + ocz * ocz - Float4(radius * radius);
+		Float4 discriminant = b * b - Float4(4.0f) * a * c;
+		Float4 hasRoots = Float4(0.0f) < discriminant;
+
+		Float4 sqrtD = Sqrt(Max(discriminant, Float4(0.0f)));
+		Float4 twoA = Float4(2.0f) * a;
+		Float4 tNear = (Float4(0.0f) - b - sqrtD) / twoA;
+		Float4 tFar = (sqrtD - b) / twoA;
+
+		Float4 tMin(t_min);
+		Float4 tMax = Float4::Load(packet.m_tMax + offset);
+		Float4 nearValid = (tMin <= tNear) & (tNear <= tMax);
+		Float4 farValid = (tMin <= tFar) & (tFar <= tMax);
+		Select(nearValid, tNear, tFar).Store(out_t + offset);
+		mask |= (hasRoots & Select(nearValid, nearValid, farValid)).MoveMask() << offset;
+	}
+	return mask;
+}
+
+// AxisAlignedRectHitable::Hit under a TranslatedInstance
+template<UINT32 N>
+inline UINT32 IntersectRectPacket(const RayPacket<N> &packet, const float translation[3], UINT32 aAxis, UINT32 bAxis, UINT32 cAxis, float a0, float a1, float b0, float b1, float c, float t_min, float out_t[N])
+{
+	UINT32 mask = 0;
+	for (UINT32 g = 0; g < RayPacket<N>::GROUP_COUNT; g++)
+	{
+		UINT32 offset = g * 4;
+		Float4 orgC = Float4::Load(packet.m_org[cAxis] + offset) - Float4(translation[cAxis]);
+		Float4 orgA = Float4::Load(packet.m_org[aAxis] + offset) - Float4(translation[aAxis]);
+		Float4 orgB = Float4::Load(packet.m_org[bAxis] + offset) - Float4(translation[bAxis]);
+		Float4 t = (Float4(c) - orgC) / Float4::Load(packet.m_dir[cAxis] + offset);
+		Float4 a = orgA + t * Float4::Load(packet.m_dir[aAxis] + offset);
+		Float4 b = orgB + t * Float4::Load(packet.m_dir[bAxis] + offset);
+		Float4 inside = (Float4(a0) <= a) & (a <= Float4(a1)) & (Float4(b0) <= b) & (b <= Float4(b1));
+		Float4 inRange = (Float4(t_min) <= t) & (t <= Float4::Load(packet.m_tMax + offset));
+		t.Store(out_t + offset);
+		mask |= (inside & inRange).MoveMask() << offset;
+	}
+	return mask;
+}
\ No newline at end of file
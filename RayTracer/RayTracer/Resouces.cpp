@@ -40,6 +40,7 @@ void Resources::Unload()
 	}	
 }
 
+#if !defined(HEADLESS_RENDERING)
 void Resources::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &CPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &GPUHandle)
 {
 	for (auto i = m_textures.begin(); i != m_textures.end(); i++)
@@ -57,6 +58,7 @@ void Resources::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &
 		(*i)->BuildD3DRes(viewer);
 	}
 }
+#endif
 
 Mesh *Resources::GetTheMesh(MeshUniqueID id) const
 {
@@ -175,6 +177,10 @@ void Resources::LoadMaterials()
 	material = new Metal(texture, 0.7f);
 	m_materials.push_back(material);
 
+	// MATERIAL_ID_IMAGE_BASED_CHECKER_DIFFUSE, same texture
+	material = new Lambertian(texture);
+	m_materials.push_back(material);
+
 	// MATERIAL_ID_LIGHTSOURCE_WHITE
 	material = new DiffuseLight(Vec3(4.0f, 4.0f, 4.0f));
 	m_materials.push_back(material);
@@ -29,6 +29,7 @@ enum MaterialUniqueID
 
 	MATERIAL_ID_IMAGE_BASED_GROUND_SOIL,
 	MATERIAL_ID_IMAGE_BASED_METAL_CHECKER,
+	MATERIAL_ID_IMAGE_BASED_CHECKER_DIFFUSE,	// the checker texture of the metal on a Lambertian
 
 	MATERIAL_ID_LIGHTSOURCE_WHITE,
 	MATERIAL_ID_LIGHTSOURCE_BRIGHT,
@@ -53,7 +54,9 @@ public:
 	void									Load();
 	void									Unload();
 
+#if !defined(HEADLESS_RENDERING)
 	void									BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &CPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &GPUHandle);
+#endif
 
 	Mesh *									GetTheMesh(MeshUniqueID id) const;
 	IMaterial *								GetTheMaterial(MaterialUniqueID id) const;
@@ -0,0 +1,176 @@
+#include "stdafx.h"
+#include "Sampler.h"
+#include "Randomizer.h"
+
+using namespace std;
+
+const ISampler::SobolBytes &ISampler::GetSobolBytes()
+{
+	struct Table
+	{
+		SobolBytes m_bytes;
+
+		Table()
+		{
+			// the direction numbers of the polynomial x + 1, every one is the previous one xored with itself shifted by one
+			UINT32 directions[32];
+			directions[0] = 1u << 31;
+			for (UINT32 bit = 1; bit < 32; bit++)
+				directions[bit] = directions[bit - 1] ^ (directions[bit - 1] >> 1);
+			for (UINT32 byte = 0; byte < 4; byte++)
+			{
+				for (UINT32 value = 0; value < 256; value++)
+				{
+					UINT32 result = 0;
+					for (UINT32 bit = 0; bit < 8; bit++)
+					{
+						if (value & (1u << bit))
+							result ^= directions[byte * 8 + bit];
+					}
+					m_bytes[byte][value] = result;
+				}
+			}
+		}
+	};
+	// the initialization of a local static is thread-safe
+	static const Table table;
+	return table.m_bytes;
+}
+
+ISampler *ISampler::Create(SamplerType type, UINT64 seed)
+{
+	switch (type)
+	{
+	case SAMPLER_SOBOL:			return new SobolSampler(seed);
+	case SAMPLER_BLUE_NOISE:	return new BlueNoiseSampler(seed);
+	default:					return nullptr;
+	}
+}
+
+const char *ISampler::GetTypeName(SamplerType type)
+{
+	switch (type)
+	{
+	case SAMPLER_SOBOL:			return "sobol";
+	case SAMPLER_BLUE_NOISE:	return "bluenoise";
+	default:					return "independent";
+	}
+}
+
+UINT32 SobolSampler::Sample(const SampleState &state, UINT32 dimension) const
+{
+	return ScrambledSobol(state.m_sampleIndex, dimension, m_seed ^ state.m_pixelHash);
+}
+
+BlueNoiseSampler::BlueNoiseSampler(UINT64 seed)
+	: m_seed((UINT32)(seed ^ (seed >> 32)))
+{
+	BuildMask();
+}
+
+UINT32 BlueNoiseSampler::Sample(const SampleState &state, UINT32 dimension) const
+{
+	// the shift of the mask is random per dimension, the dimensions of a pixel stay uncorrelated
+	UINT32 shift = Hash(m_seed ^ Hash(dimension + 0x9e3779b9u));
+	UINT32 x = (state.m_pixelX + shift) & (MASK_SIZE - 1);
+	UINT32 y = (state.m_pixelY + (shift >> 16)) & (MASK_SIZE - 1);
+	// adding in fixed point wraps around, the toroidal shift of Cranley-Patterson
+	return ScrambledSobol(state.m_sampleIndex, dimension, m_seed) + m_mask[y * MASK_SIZE + x];
+}
+
+void BlueNoiseSampler::BuildMask()
+{
+	const UINT32 size = MASK_SIZE;
+	const UINT32 count = size * size;
+	const float sigma = 1.5f;
+
+	// gaussian energy of a point over the torus, by offset
+	vector<float> kernel(count);
+	for (UINT32 dy = 0; dy < size; dy++)
+	{
+		for (UINT32 dx = 0; dx < size; dx++)
+		{
+			float x = (float)min(dx, size - dx);
+			float y = (float)min(dy, size - dy);
+			kernel[dy * size + dx] = expf(-(x * x + y * y) / (2.0f * sigma * sigma));
+		}
+	}
+
+	vector<UINT8> pattern(count, 0);
+	vector<float> energy(count, 0.0f);
+	auto splat = [&](UINT32 index, float sign)
+	{
+		UINT32 px = index % size, py = index / size;
+		for (UINT32 y = 0; y < size; y++)
+		{
+			const float *row = &kernel[((y - py) & (size - 1)) * size];
+			for (UINT32 x = 0; x < size; x++)
+				energy[y * size + x] += sign * row[(x - px) & (size - 1)];
+		}
+	};
+	// the point of the most crowded cluster, or the emptiest void
+	auto find = [&](UINT8 value, BOOL tightest)
+	{
+		UINT32 best = UINT_MAX;
+		for (UINT32 i = 0; i < count; i++)
+		{
+			if (pattern[i] == value && (best == UINT_MAX || (tightest ? energy[i] > energy[best] : energy[i] < energy[best])))
+				best = i;
+		}
+		return best;
+	};
+
+	// the initial binary pattern, a tenth of random points, then the tightest points move to the largest voids
+	PCG32 generator;
+	generator.Seed(0x5eed, 1);
+	UINT32 onesCount = 0;
+	while (onesCount < count / 10)
+	{
+		UINT32 index = generator.Next() % count;
+		if (!pattern[index])
+		{
+			pattern[index] = 1;
+			splat(index, 1.0f);
+			onesCount++;
+		}
+	}
+	for (;;)
+	{
+		UINT32 cluster = find(1, TRUE);
+		pattern[cluster] = 0;
+		splat(cluster, -1.0f);
+		UINT32 largestVoid = find(0, FALSE);
+		pattern[largestVoid] = 1;
+		splat(largestVoid, 1.0f);
+		if (largestVoid == cluster)
+			break;
+	}
+
+	// ranks below the prototype, removing the tightest clusters
+	vector<UINT32> ranks(count);
+	vector<UINT8> prototype = pattern;
+	vector<float> prototypeEnergy = energy;
+	for (UINT32 rank = onesCount; rank-- > 0;)
+	{
+		UINT32 cluster = find(1, TRUE);
+		pattern[cluster] = 0;
+		splat(cluster, -1.0f);
+		ranks[cluster] = rank;
+	}
+
+	// and above, filling the largest voids, the tightest cluster of the zeros past the half is the same point
+	pattern = prototype;
+	energy = prototypeEnergy;
+	for (UINT32 rank = onesCount; rank < count; rank++)
+	{
+		UINT32 largestVoid = find(0, FALSE);
+		pattern[largestVoid] = 1;
+		splat(largestVoid, 1.0f);
+		ranks[largestVoid] = rank;
+	}
+
+	// the centers of count equal strata
+	m_mask.resize(count);
+	for (UINT32 i = 0; i < count; i++)
+		m_mask[i] = (UINT32)(((UINT64)ranks[i] << 32) / count + (0x80000000u / count));
+}
\ No newline at end of file
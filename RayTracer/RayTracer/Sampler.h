@@ -0,0 +1,136 @@
+#pragma once
+
+enum SamplerType
+{
+	SAMPLER_INDEPENDENT = 0,	// the PCG32 streams of the pixels, plain Monte Carlo
+	SAMPLER_SOBOL,				// Owen-scrambled Sobol points, scrambled differently in every pixel
+	SAMPLER_BLUE_NOISE,			// the same scrambled Sobol points in every pixel, shifted by a blue-noise mask per dimension
+};
+
+// the pixel sample being traced, and how many of its dimensions were drawn
+struct SampleState
+{
+	UINT32							m_pixelX;
+	UINT32							m_pixelY;
+	UINT32							m_pixelHash;		// of the coordinates, the samplers seed their pixels with it
+	UINT32							m_sampleIndex;		// in the pixel, over all the passes
+	UINT32							m_dimension;		// the next one
+};
+
+// Low discrepancy points for the samples of a pixel. While a sample is active, see Randomizer::BeginSample,
+// every random number drawn is the next dimension of its point: the pixel jitter, the lens, then the bounces.
+// The consecutive dimensions (2k, 2k + 1) are a scrambled (0, 2)-sequence over the sample indices of a pixel,
+// any power of two of samples is stratified in each of these 2D projections.
+class ISampler
+{
+public:
+	virtual ~ISampler() = default;
+
+	// [0, 1) in 0.32 fixed point, like Randomizer::RandomUInt32
+	virtual UINT32					Sample(const SampleState &state, UINT32 dimension) const = 0;
+	virtual SamplerType				GetType() const = 0;
+
+	// nullptr for SAMPLER_INDEPENDENT, the points only depend on the seed
+	static ISampler *				Create(SamplerType type, UINT64 seed);
+	static const char *				GetTypeName(SamplerType type);
+
+protected:
+	ISampler() : m_sobolBytes(GetSobolBytes()) {}
+
+	static inline UINT32 ReverseBits(UINT32 x)
+	{
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+public:
+	static inline UINT32 Hash(UINT32 x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		return x ^ (x >> 16);
+	}
+
+protected:
+	// the random permutation of Laine and Karras, the lower bits only depend on the ones below
+	static inline UINT32 LaineKarrasPermutation(UINT32 x, UINT32 seed)
+	{
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		return x ^ (x * 0x8d22f6e6u);
+	}
+
+	// Owen scrambling of the bits of x from the top down, Burley's "Practical Hash-based Owen Scrambling"
+	static inline UINT32 NestedUniformScramble(UINT32 x, UINT32 seed)
+	{
+		return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+	}
+
+	// the second Sobol dimension, the x + 1 polynomial one, a byte of the index at a time.
+	// The first one is van der Corput, the index with its bits reversed.
+	inline UINT32 Sobol1(UINT32 index) const
+	{
+		return m_sobolBytes[0][index & 0xff] ^ m_sobolBytes[1][(index >> 8) & 0xff] ^ m_sobolBytes[2][(index >> 16) & 0xff] ^ m_sobolBytes[3][index >> 24];
+	}
+
+	// the (2k, 2k + 1) dimensions of the sample index, the pairs are decorrelated by shuffling the index per pair
+	inline UINT32 ScrambledSobol(UINT32 sampleIndex, UINT32 dimension, UINT32 seed) const
+	{
+		UINT32 pairSeed = Hash(seed ^ ((dimension >> 1) * 0x9e3779b9u));
+		UINT32 index = NestedUniformScramble(sampleIndex, pairSeed);
+		UINT32 valueSeed = pairSeed * 0x2c1b3c6du + (dimension & 1);
+		// van der Corput reverses the bits of the index, the scrambling reverses them back first
+		if ((dimension & 1) == 0)
+			return ReverseBits(LaineKarrasPermutation(index, valueSeed));
+		return NestedUniformScramble(Sobol1(index), valueSeed);
+	}
+
+private:
+	typedef UINT32					SobolBytes[4][256];
+
+	// the second dimension of the bits of every byte of the index, shared by all the samplers,
+	// built once by the first sampler constructed, whichever thread does it
+	static const SobolBytes &		GetSobolBytes();
+
+	const UINT32					(*m_sobolBytes)[256];
+};
+
+class SobolSampler : public ISampler
+{
+public:
+	SobolSampler(UINT64 seed) : m_seed((UINT32)(seed ^ (seed >> 32))) {}
+
+	virtual UINT32					Sample(const SampleState &state, UINT32 dimension) const override;
+	virtual SamplerType				GetType() const override { return SAMPLER_SOBOL; }
+
+private:
+	UINT32							m_seed;
+};
+
+// Blue-noise dithered sampling, after Georgiev and Fajardo: the points are the same in every pixel, each dimension
+// is toroidally shifted by a blue-noise mask, moved around per dimension. At low sample counts the error
+// of neighbouring pixels is anti-correlated, high frequency noise instead of white noise.
+class BlueNoiseSampler : public ISampler
+{
+public:
+	static const UINT32				MASK_SIZE = 64;
+
+	BlueNoiseSampler(UINT64 seed);
+
+	virtual UINT32					Sample(const SampleState &state, UINT32 dimension) const override;
+	virtual SamplerType				GetType() const override { return SAMPLER_BLUE_NOISE; }
+
+private:
+	// void-and-cluster, Ulichney's "The void-and-cluster method for dither array generation"
+	void							BuildMask();
+
+	UINT32							m_seed;
+	std::vector<UINT32>				m_mask;				// MASK_SIZE x MASK_SIZE shifts in 0.32 fixed point
+};
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "stdafx.h"
+#include "SceneArena.h"
+#include "Hitables.h"
+#include "SimpleObject.h"
+
+using namespace std;
+
+void *SceneArena::Allocate(size_t size, size_t alignment, SceneArenaCategory category)
+{
+	// new[] aligns to 16 bytes, enough for the SSE vectors
+	assert(alignment <= 16 && (alignment & (alignment - 1)) == 0);
+
+	Block *block = m_blocks.empty() ? nullptr : &m_blocks.back();
+	size_t offset = block ? (block->m_used + alignment - 1) & ~(alignment - 1) : 0;
+	if (block == nullptr || offset + size > block->m_size)
+	{
+		// a huge allocation gets a block of its own
+		size_t blockSize = max(BLOCK_SIZE, size);
+		m_blocks.push_back({ new UINT8[blockSize], blockSize, 0 });
+		block = &m_blocks.back();
+		offset = 0;
+	}
+
+	block->m_used = offset + size;
+	m_bytesUsed[category] += size;
+	m_allocationCounts[category]++;
+	return block->m_data + offset;
+}
+
+void SceneArena::Reset()
+{
+	for (auto i = m_destructors.rbegin(); i != m_destructors.rend(); ++i)
+		i->m_destroy(i->m_object);
+	m_destructors.clear();
+
+	for (Block &block : m_blocks)
+		delete[] block.m_data;
+	m_blocks.clear();
+
+	for (UINT32 i = 0; i < SCENE_ARENA_CATEGORY_COUNT; i++)
+	{
+		m_bytesUsed[i] = 0;
+		m_allocationCounts[i] = 0;
+	}
+}
+
+size_t SceneArena::GetBytesReserved() const
+{
+	size_t bytes = 0;
+	for (const Block &block : m_blocks)
+		bytes += block.m_size;
+	return bytes;
+}
+
+const char *SceneArena::GetCategoryName(SceneArenaCategory category)
+{
+	static const char *names[SCENE_ARENA_CATEGORY_COUNT] = { "objects", "hitables", "bvh nodes" };
+	return names[category];
+}
+
+void SceneArena::MarkInArena(IHitable *hitable)
+{
+	hitable->m_inSceneArena = TRUE;
+}
+
+void SceneArena::MarkInArena(Object *object)
+{
+	object->m_inSceneArena = TRUE;
+}
+
+BOOL SceneArena::IsInArena(const IHitable *hitable)
+{
+	return hitable->m_inSceneArena;
+}
+
+BOOL SceneArena::IsInArena(const Object *object)
+{
+	return object->m_inSceneArena;
+}
\ No newline at end of file
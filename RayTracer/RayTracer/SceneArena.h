@@ -0,0 +1,97 @@
+#pragma once
+
+#include <type_traits>
+
+class IHitable;
+class Object;
+
+enum SceneArenaCategory
+{
+	SCENE_ARENA_OBJECTS = 0,		// the objects of the world
+	SCENE_ARENA_HITABLES,			// their hitable chains and the shared geometries
+	SCENE_ARENA_BVH_NODES,			// SimpleObjectBVHNode
+	SCENE_ARENA_CATEGORY_COUNT,
+};
+
+// Bump allocator for what a world builds. Objects, hitables and tree nodes are placed one after the other
+// in large blocks, in the order they are built, instead of all over the heap.
+// Nothing is freed on its own: Reset runs the destructors in reverse order, then releases every block at once.
+// IHitable and Object know when they live in an arena, their owners leave them to it, see Delete.
+class SceneArena
+{
+public:
+	static const size_t				BLOCK_SIZE = 256 * 1024;
+
+	SceneArena() = default;
+	~SceneArena() { Reset(); }
+	SceneArena(const SceneArena &) = delete;
+	SceneArena &operator=(const SceneArena &) = delete;
+
+	// on the heap when arena is nullptr
+	template<typename T, typename... Args>
+	static T *						New(SceneArena *arena, SceneArenaCategory category, Args&&... args);
+	// for owners of parts allocated either way, only the ones on the heap are deleted
+	template<typename T>
+	static void						Delete(T *object);
+
+	void *							Allocate(size_t size, size_t alignment, SceneArenaCategory category);
+	void							Reset();
+
+	inline size_t					GetBytesUsed(SceneArenaCategory category) const { return m_bytesUsed[category]; }
+	inline UINT32					GetAllocationCount(SceneArenaCategory category) const { return m_allocationCounts[category]; }
+	size_t							GetBytesReserved() const;
+	static const char *				GetCategoryName(SceneArenaCategory category);
+
+private:
+	struct Block
+	{
+		UINT8 *						m_data;
+		size_t						m_size;
+		size_t						m_used;
+	};
+
+	struct Destructor
+	{
+		void *						m_object;
+		void						(*m_destroy)(void *object);
+	};
+
+	template<typename T>
+	static void						Destroy(void *object) { static_cast<T *>(object)->~T(); }
+
+	template<typename T>
+	void							AddDestructor(T *object, std::true_type) {}
+	template<typename T>
+	void							AddDestructor(T *object, std::false_type) { m_destructors.push_back({ object, &Destroy<T> }); }
+
+	static void						MarkInArena(IHitable *hitable);
+	static void						MarkInArena(Object *object);
+	static void						MarkInArena(void *) {}
+	static BOOL						IsInArena(const IHitable *hitable);
+	static BOOL						IsInArena(const Object *object);
+
+	std::vector<Block>				m_blocks;
+	std::vector<Destructor>			m_destructors;
+	size_t							m_bytesUsed[SCENE_ARENA_CATEGORY_COUNT]{ 0 };
+	UINT32							m_allocationCounts[SCENE_ARENA_CATEGORY_COUNT]{ 0 };
+};
+
+template<typename T, typename... Args>
+T *SceneArena::New(SceneArena *arena, SceneArenaCategory category, Args&&... args)
+{
+	if (arena == nullptr)
+		return new T(std::forward<Args>(args)...);
+
+	T *object = new (arena->Allocate(sizeof(T), alignof(T), category)) T(std::forward<Args>(args)...);
+	MarkInArena(object);
+	// registered once constructed, so that an owner is always destroyed before the parts it built
+	arena->AddDestructor(object, std::is_trivially_destructible<T>());
+	return object;
+}
+
+template<typename T>
+void SceneArena::Delete(T *object)
+{
+	if (object && !IsInArena(object))
+		delete object;
+}
\ No newline at end of file
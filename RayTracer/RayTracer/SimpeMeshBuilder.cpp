@@ -106,24 +106,23 @@ void SimpeMeshBuilder::BuildTorusMesh(BuildMeshMode const eMode, SimpleMesh *des
 		for (UINT32 o = 0; o < outerVertices; ++o)
 		{
 			const float outerTheta = o * 2 * (float)M_PI / (outerVertices - 1);
-			const XMMATRIX outerToWorld = DirectX::XMMatrixRotationZ(outerTheta) * DirectX::XMMatrixTranslation(outerRadius, 0, 0);
+			const float outerSin = sinf(outerTheta);
+			const float outerCos = cosf(outerTheta);
 			for (UINT32 i = 0; i < innerVertices; ++i)
 			{
 				const float innerTheta = i * 2 * (float)M_PI / (innerVertices - 1);
-				const XMMATRIX innerToOuter = DirectX::XMMatrixRotationY(innerTheta) * DirectX::XMMatrixTranslation(innerRadius, 0, 0);
-				const XMMATRIX localToWorld = outerToWorld * innerToOuter;
-
-				// outV->m_position = localToWorld * XMVECTOR(0, 0, 0, 1);
-				XMVECTOR v = DirectX::XMVectorSet(0, 0, 0, 1);
-				DirectX::XMStoreFloat3(&outV->m_position, DirectX::XMVector4Transform(v, localToWorld));
-				
-				//outV->m_normal = localToWorld * XMVECTOR(1, 0, 0, 0);
-				v = DirectX::XMVectorSet(1, 0, 0, 0);
-				DirectX::XMStoreFloat3(&outV->m_normal, DirectX::XMVector4Transform(v, localToWorld));
-
-				//outV->m_tangent = localToWorld * XMVECTOR(0, 1, 0, 0);
-				v = DirectX::XMVectorSet(0, 1, 0, 0);
-				DirectX::XMStoreFloat4(&outV->m_tangent, DirectX::XMVector4Transform(v, localToWorld));
+				const float innerSin = sinf(innerTheta);
+				const float innerCos = cosf(innerTheta);
+
+				// localToWorld = RotationZ(outerTheta) * Translation(outerRadius, 0, 0) * RotationY(innerTheta) * Translation(innerRadius, 0, 0), row vectors
+				// outV->m_position = (0, 0, 0, 1) * localToWorld;
+				outV->m_position = XMFLOAT3(outerRadius * innerCos + innerRadius, 0.0f, -outerRadius * innerSin);
+
+				// outV->m_normal = (1, 0, 0, 0) * localToWorld;
+				outV->m_normal = XMFLOAT3(outerCos * innerCos, outerSin, -outerCos * innerSin);
+
+				// outV->m_tangent = (0, 1, 0, 0) * localToWorld;
+				outV->m_tangent = XMFLOAT4(-outerSin * innerCos, outerCos, outerSin * innerSin, 0.0f);
 
 				outV->m_texture = XMFLOAT2((float)o * textureScale.x, (float)i * textureScale.y);
 				++outV;
@@ -17,6 +17,9 @@ SimpleCamera::SimpleCamera(const World *world, InputListener *inputListener, flo
 	, m_inputListener(inputListener)
 	, m_aspectRatio(aspectRatio)
 {
+	if (!m_inputListener)
+		return; // headless, no hot keys
+
 	m_inputListener->RegisterKey('H');
 	m_inputListener->RegisterKey('W');
 	m_inputListener->RegisterKey('A');
@@ -61,6 +64,9 @@ Ray SimpleCamera::GetRay(float u, float v) const
 
 void SimpleCamera::OnUpdate(float elapsedSeconds)
 {
+	if (!m_inputListener)
+		return;
+
 	if (m_inputListener->WhenReleaseKey(VK_ESCAPE))
 	{
 		Reset();
@@ -190,14 +196,16 @@ void SimpleCamera::InternalUpdate()
 	m_viewVertical = -2.0f * viewHalfHeight * m_v;
 }
 
+#if !defined(HEADLESS_RENDERING)
 XMMATRIX SimpleCamera::GetViewMatrix() const
 {
-	return DirectX::XMMatrixLookAtRH(m_origin.m_simd, m_focus.m_simd, m_v.m_simd);
+	return DirectX::XMMatrixLookAtRH(ToXMVECTOR(m_origin), ToXMVECTOR(m_focus), ToXMVECTOR(m_v));
 }
 XMMATRIX SimpleCamera::GetProjectionMatrix() const
 {
 	return DirectX::XMMatrixPerspectiveFovRH(m_fov * (float)M_PI / 180.0f, m_aspectRatio, m_nearPlane, m_farPlane);
 }
+#endif
 
 BOOL SimpleCamera::AutoFocus(const Vec3 &lookDir)
 {
@@ -205,7 +213,7 @@ BOOL SimpleCamera::AutoFocus(const Vec3 &lookDir)
 	Ray r(m_origin, lookDir);
 	float nearest = 0.01f;
 	float cloestSoFar = FLT_MAX;
-	if (m_world->GetObjectBVHTree()->Hit(r, nearest, cloestSoFar, rec))
+	if (m_world->Hit(r, nearest, cloestSoFar, rec))
 	{
 		m_focus = rec.m_position;
 	}
@@ -20,10 +20,15 @@ public:
 												float radiansPerSecond);
 
 	Ray								GetRay(float u, float v) const;
+	inline const Vec3 &				GetOrigin() const { return m_origin; }
+	// angle between the rays of two neighbour pixels, for an image of imageHeight pixels
+	inline float					GetPixelSpread(UINT32 imageHeight) const { return 2.0f * tanf(m_fov * (float)M_PI / 360.0f) / (float)imageHeight; }
 	void							OnUpdate(float elapsedSeconds);
 
+#if !defined(HEADLESS_RENDERING)
 	XMMATRIX						GetViewMatrix() const;
 	XMMATRIX						GetProjectionMatrix() const;
+#endif
 
 	void							HelpInfo();
 
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "SimpleMesh.h"
+#if !defined(HEADLESS_RENDERING)
 #include "D3D12Viewer.h"
 #include "D3D12Helper.h"
 
@@ -51,4 +52,4 @@ void Mesh::BuildD3DRes(D3D12Viewer *viewer)
 	viewer->ExecuteCommandList();
 	viewer->WaitForGpu();
 }
-
+#endif
@@ -17,6 +17,7 @@ enum PrimitiveType
 	kPrimitiveTypeTriStrip,
 };
 
+#if !defined(HEADLESS_RENDERING)
 struct MeshD3D12Resources
 {
 	ComPtr<ID3D12Resource>			m_vertexBufferHeap;
@@ -24,6 +25,7 @@ struct MeshD3D12Resources
 	ComPtr<ID3D12Resource>			m_indexBufferHeap;
 	D3D12_INDEX_BUFFER_VIEW			m_indexBufferView;
 };
+#endif
 
 class Mesh
 {
@@ -41,7 +43,9 @@ public:
 
 	PrimitiveType m_primitiveType;
 
+#if !defined(HEADLESS_RENDERING)
 	MeshD3D12Resources m_d3dRes;
+#endif
 
 	Mesh()
 		: m_vertexBuffer(0)
@@ -58,7 +62,9 @@ public:
 
 	virtual ~Mesh() = default;
 
+#if !defined(HEADLESS_RENDERING)
 	virtual void BuildD3DRes(D3D12Viewer *viewer);
+#endif
 };
 
 // The Simple Mesh
@@ -73,14 +79,16 @@ struct SimpleMeshVertex
 class SimpleMesh : public Mesh
 {
 public:
+#if !defined(HEADLESS_RENDERING)
 	static D3D12_INPUT_ELEMENT_DESC D3DVertexDeclaration[];
 	static UINT32 D3DVertexDeclarationElementCount;
+#endif
 
 	virtual ~SimpleMesh() override
 	{
 		if (m_vertexBuffer)
-			delete m_vertexBuffer;
+			delete[] (UINT8 *)m_vertexBuffer;
 		if (m_indexBuffer)
-			delete m_indexBuffer;
+			delete[] (UINT8 *)m_indexBuffer;
 	}
 };
\ No newline at end of file
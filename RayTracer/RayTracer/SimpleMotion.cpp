@@ -1,10 +1,11 @@
 #include "stdafx.h"
 #include "SimpleMotion.h"
 
-SimpleMotionPingpong::SimpleMotionPingpong(const Vec3 &initDir, float acc, float m_minSpeed,float maxSpeed)
+SimpleMotionPingpong::SimpleMotionPingpong(const Vec3 &initDir, float acc, float minSpeed, float maxSpeed)
 	: m_acceleration(acc)
+	, m_speed(minSpeed)
 	, m_maxSpeed(maxSpeed)
-	, m_speed(m_minSpeed)
+	, m_minSpeed(minSpeed)
 {
 	m_direction = normalize(initDir);
 }
@@ -12,7 +12,7 @@ public:
 class SimpleMotionPingpong : public IMotion
 {
 public:
-	SimpleMotionPingpong(const Vec3 &initDir, float acc, float m_minSpeed, float maxSpeed);
+	SimpleMotionPingpong(const Vec3 &initDir, float acc, float minSpeed, float maxSpeed);
 	virtual Vec3 Move(const Vec3 &position, float elapsedSeconds) override;
 
 	Vec3 m_direction;
@@ -1,28 +1,46 @@
 #include "stdafx.h"
 #include "SimpleObject.h"
 #include "Hitables.h"
+#include "TriangleMeshHitable.h"
 #include "SimpleMesh.h"
+#if !defined(HEADLESS_RENDERING)
 #include "D3D12Viewer.h"
 #include "D3D12Helper.h"
+#endif
 #include "SimpleCamera.h"
 #include "Materials.h"
 #include "World.h"
 #include "Randomizer.h"
 #include "LightSources.h"
+#include "SimpleMotion.h"
+#include "SceneArena.h"
 #include "std_cbuffer.h"
 
 using namespace std;
 
+namespace
+{
+	// the parts of an object live in the arena of its world, if any
+	SceneArena *ArenaOf(World *world)
+	{
+		return world ? world->GetSceneArena() : nullptr;
+	}
+}
+
 Object::~Object()
 {
-	if (m_hitable)
+	SceneArena::Delete(m_hitable);
+	m_hitable = nullptr;
+
+	if (m_motion)
 	{
-		delete m_hitable;
-		m_hitable = nullptr;
+		delete m_motion;
+		m_motion = nullptr;
 	}
 }
 
 
+#if !defined(HEADLESS_RENDERING)
 void Object::Update(SimpleCamera *camera, float elapsedSeconds)
 {
 	// update constants
@@ -34,8 +52,8 @@ void Object::Update(SimpleCamera *camera, float elapsedSeconds)
 	XMMATRIX mv;
 	GeometryConstants geoConstants;
 
-	trans = DirectX::XMMatrixTranslationFromVector(m_translation.m_simd);
-	scale = DirectX::XMMatrixScalingFromVector(m_scaling.m_simd);
+	trans = DirectX::XMMatrixTranslationFromVector(ToXMVECTOR(m_translation));
+	scale = DirectX::XMMatrixScalingFromVector(ToXMVECTOR(m_scaling));
 	rotateX = DirectX::XMMatrixRotationX(m_rotation.x());
 	rotateY = DirectX::XMMatrixRotationY(m_rotation.y());
 	rotateZ = DirectX::XMMatrixRotationZ(m_rotation.z());
@@ -64,6 +82,7 @@ void Object::Render(D3D12Viewer *viewer, UINT32 mid) const
 		commandList->DrawIndexedInstanced(m_mesh->m_indexCount, 1, 0, 0, 0);
 	}
 }
+#endif
 
 AABB Object::BoundingBox() const
 {
@@ -72,16 +91,48 @@ AABB Object::BoundingBox() const
 
 BOOL Object::Hit(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const
 {
-	BOOL hitMe = FALSE;
-	if (m_hitable->Hit(r, t_min, t_max, out_rec))
-	{
-		t_max = out_rec.m_time;
-		hitMe = TRUE;
-	}
+	const Object *closest = Intersect(r, t_min, t_max, out_rec);
+	if (!closest)
+		return FALSE;
+
+	closest->ComputeAttributes(r, out_rec);
+	return TRUE;
+}
+
+const Object *Object::Intersect(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const
+{
+	if (!m_hitable->Intersect(r, t_min, t_max, out_rec))
+		return nullptr;
+
+	t_max = out_rec.m_time;
+	return this;
+}
+
+void Object::ComputeAttributes(const Ray &r, HitRecord &io_rec) const
+{
+	m_hitable->ComputeAttributes(r, io_rec);
+	io_rec.m_hitObject = this;
+}
 
-	return hitMe;
+BOOL Object::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	return m_hitable->Occluded(r, t_min, t_max);
 }
 
+BOOL Object::Animate(float elapsedSeconds)
+{
+	if (!m_motion)
+		return FALSE;
+
+	// every object keeps its translation at the top of its hitable
+	TranslatedInstance *translated = dynamic_cast<TranslatedInstance *>(m_hitable);
+	assert(translated && "Only translated objects can be animated");
+	m_translation = m_motion->Move(m_translation, elapsedSeconds);
+	translated->m_offset = m_translation;
+	return TRUE;
+}
+
+#if !defined(HEADLESS_RENDERING)
 void Object::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &cbvGPUHandle)
 {
 	ID3D12Device *device = viewer->GetDevice();
@@ -125,6 +176,7 @@ void Object::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbv
 		}
 	}
 }
+#endif
 
 SimpleObjectSphere::SimpleObjectSphere(const Vec3 &center, float radius, Mesh *mesh, IMaterial *material, World *world)
 {
@@ -133,7 +185,8 @@ SimpleObjectSphere::SimpleObjectSphere(const Vec3 &center, float radius, Mesh *m
 	m_rotation = Vec3(0.0f, 0.0f, 0.0f); // no rotation for sphere
 	m_mesh = mesh;
 	m_material = material;
-	m_hitable = new TranslatedInstance(new SphereHitable(Vec3(0.0f, 0.0f, 0.0f),radius), m_translation);
+	SceneArena *arena = ArenaOf(world);
+	m_hitable = SceneArena::New<TranslatedInstance>(arena, SCENE_ARENA_HITABLES, SceneArena::New<SphereHitable>(arena, SCENE_ARENA_HITABLES, Vec3(0.0f, 0.0f, 0.0f), radius), m_translation);
 	m_hitable->BindMaterial(material);
 	m_world = world;
 }
@@ -148,6 +201,7 @@ SimpleObjectRect::SimpleObjectRect(SimpleObjectRectAlignAxes axes, const Vec3 &c
 	m_mesh = mesh;
 	m_material = material;
 	m_world = world;
+	SceneArena *arena = ArenaOf(world);
 
 	UINT aAxisIndex, bAxisIndex;
 	switch (m_alignAxes)
@@ -170,11 +224,11 @@ SimpleObjectRect::SimpleObjectRect(SimpleObjectRectAlignAxes axes, const Vec3 &c
 	half.set(aAxisIndex, width / 2.0f);
 	half.set(bAxisIndex, height / 2.0f);
 
-	m_hitable = new TranslatedInstance(
-		new RotatedInstance(
-			new RotatedInstance(
-				new RotatedInstance(
-					new AxisAlignedRectHitable(aAxisIndex, bAxisIndex, -half[aAxisIndex], half[aAxisIndex], -half[bAxisIndex], half[bAxisIndex], 0.0f, m_reverseFace),
+	m_hitable = SceneArena::New<TranslatedInstance>(arena, SCENE_ARENA_HITABLES,
+		SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+			SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+				SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+					SceneArena::New<AxisAlignedRectHitable>(arena, SCENE_ARENA_HITABLES, aAxisIndex, bAxisIndex, -half[aAxisIndex], half[aAxisIndex], -half[bAxisIndex], half[bAxisIndex], 0.0f, m_reverseFace),
 					m_rotation[0], 0),
 				m_rotation[1], 1),
 			m_rotation[2], 2),
@@ -183,6 +237,7 @@ SimpleObjectRect::SimpleObjectRect(SimpleObjectRectAlignAxes axes, const Vec3 &c
 	m_hitable->BindMaterial(material);
 }
 
+#if !defined(HEADLESS_RENDERING)
 void SimpleObjectRect::Update(SimpleCamera *camera, float elapsedSeconds)
 {
 	XMMATRIX scale;
@@ -229,8 +284,8 @@ void SimpleObjectRect::Update(SimpleCamera *camera, float elapsedSeconds)
 		break;
 	}
 
-	trans = DirectX::XMMatrixTranslationFromVector(m_translation.m_simd);
-	scale = DirectX::XMMatrixScalingFromVector(m_scaling.m_simd);
+	trans = DirectX::XMMatrixTranslationFromVector(ToXMVECTOR(m_translation));
+	scale = DirectX::XMMatrixScalingFromVector(ToXMVECTOR(m_scaling));
 
 	rotateX = DirectX::XMMatrixRotationX(m_rotation.x());
 	rotateY = DirectX::XMMatrixRotationY(m_rotation.y());
@@ -245,6 +300,7 @@ void SimpleObjectRect::Update(SimpleCamera *camera, float elapsedSeconds)
 	memcpy(m_d3dRes.m_pGeoConstants + m_d3dRes.m_GeoConstantBufferSize * m_world->GetFrameIndex(), &geoConstants, sizeof(GeometryConstants));
 
 }
+#endif
 
 SimpleObjectCube::SimpleObjectCube(const Vec3 &center, const Vec3 &rotation, const Vec3 &size, Mesh *mesh, IMaterial *material, World *world)
 {
@@ -254,22 +310,23 @@ SimpleObjectCube::SimpleObjectCube(const Vec3 &center, const Vec3 &rotation, con
 	m_mesh = mesh;
 	m_material = material;
 	m_world = world;
+	SceneArena *arena = ArenaOf(world);
 
 	Vec3 _min = -size * 0.5f;
 	Vec3 _max = size * 0.5f;
 
-	m_faceList[0] = new AxisAlignedRectHitable(0, 2, _min.x(), _max.x(), _min.z(), _max.z(), _max.y(), FALSE); // up
-	m_faceList[1] = new AxisAlignedRectHitable(0, 2, _min.x(), _max.x(), _min.z(), _max.z(), _min.y(), TRUE); // down
-	m_faceList[2] = new AxisAlignedRectHitable(0, 1, _min.x(), _max.x(), _min.y(), _max.y(), _max.z(), FALSE); // front
-	m_faceList[3] = new AxisAlignedRectHitable(0, 1, _min.x(), _max.x(), _min.y(), _max.y(), _min.z(), TRUE); // back
-	m_faceList[4] = new AxisAlignedRectHitable(2, 1, _min.z(), _max.z(), _min.y(), _max.y(), _max.x(), FALSE); // right
-	m_faceList[5] = new AxisAlignedRectHitable(2, 1, _min.z(), _max.z(), _min.y(), _max.y(), _min.x(), TRUE); // left
-
-	m_hitable = new TranslatedInstance(
-		new RotatedInstance(
-			new RotatedInstance(
-				new RotatedInstance(
-					new HitableCombo(&m_faceList[0], 6), 
+	m_faceList[0] = SceneArena::New<AxisAlignedRectHitable>(arena, SCENE_ARENA_HITABLES, 0, 2, _min.x(), _max.x(), _min.z(), _max.z(), _max.y(), FALSE); // up
+	m_faceList[1] = SceneArena::New<AxisAlignedRectHitable>(arena, SCENE_ARENA_HITABLES, 0, 2, _min.x(), _max.x(), _min.z(), _max.z(), _min.y(), TRUE); // down
+	m_faceList[2] = SceneArena::New<AxisAlignedRectHitable>(arena, SCENE_ARENA_HITABLES, 0, 1, _min.x(), _max.x(), _min.y(), _max.y(), _max.z(), FALSE); // front
+	m_faceList[3] = SceneArena::New<AxisAlignedRectHitable>(arena, SCENE_ARENA_HITABLES, 0, 1, _min.x(), _max.x(), _min.y(), _max.y(), _min.z(), TRUE); // back
+	m_faceList[4] = SceneArena::New<AxisAlignedRectHitable>(arena, SCENE_ARENA_HITABLES, 2, 1, _min.z(), _max.z(), _min.y(), _max.y(), _max.x(), FALSE); // right
+	m_faceList[5] = SceneArena::New<AxisAlignedRectHitable>(arena, SCENE_ARENA_HITABLES, 2, 1, _min.z(), _max.z(), _min.y(), _max.y(), _min.x(), TRUE); // left
+
+	m_hitable = SceneArena::New<TranslatedInstance>(arena, SCENE_ARENA_HITABLES,
+		SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+			SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+				SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+					SceneArena::New<HitableCombo>(arena, SCENE_ARENA_HITABLES, &m_faceList[0], 6), 
 					m_rotation[0], 0),
 				m_rotation[1], 1),
 			m_rotation[2], 2),
@@ -282,37 +339,66 @@ SimpleObjectCube::~SimpleObjectCube()
 {
 	for (UINT32 i = 0; i < 6; ++i)
 	{
-		if (m_faceList[i])
-		{
-			delete m_faceList[i];
-			m_faceList[i] = nullptr;
-		}
+		SceneArena::Delete(m_faceList[i]);
+		m_faceList[i] = nullptr;
 	}
 }
 
-SimpleObjectBVHNode::SimpleObjectBVHNode(std::vector<Object *> objects)
+SimpleObjectMesh::SimpleObjectMesh(const Vec3 &center, const Vec3 &rotation, float scale, Mesh *mesh, IMaterial *material, World *world)
+{
+	m_translation = center;
+	m_scaling = Vec3(scale, scale, scale);
+	m_rotation = rotation;
+	m_mesh = mesh;
+	m_material = material;
+	m_world = world;
+	SceneArena *arena = ArenaOf(world);
+
+	m_hitable = SceneArena::New<TranslatedInstance>(arena, SCENE_ARENA_HITABLES,
+		SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+			SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+				SceneArena::New<RotatedInstance>(arena, SCENE_ARENA_HITABLES,
+					SceneArena::New<TriangleMeshHitable>(arena, SCENE_ARENA_HITABLES, mesh, scale, world ? world->GetThreadPool() : nullptr),
+					m_rotation[0], 0),
+				m_rotation[1], 1),
+			m_rotation[2], 2),
+		m_translation);
+
+	m_hitable->BindMaterial(material);
+}
+
+SimpleObjectBVHNode::SimpleObjectBVHNode(const std::vector<Object *> &objects, SceneArena *arena)
 {
 	assert(!objects.empty());
 
-	// sort objects with order
+	// one copy for the whole tree, every node then works on its own range of it
+	vector<Object *> sortedObjects(objects);
+	Build(sortedObjects.data(), sortedObjects.size(), arena);
+}
+
+SimpleObjectBVHNode::SimpleObjectBVHNode(Object **objects, size_t count, SceneArena *arena)
+{
+	Build(objects, count, arena);
+}
+
+void SimpleObjectBVHNode::Build(Object **objects, size_t count, SceneArena *arena)
+{
+	assert(count > 0);
+
+	// only the median along a random axis is needed, not the whole order
 	UINT32 axis = UINT32(3 * Randomizer::RandomUNorm());
-	if (axis == 0)
-		sort(objects.begin(), objects.end(), [](Object * a, Object * b) { return b->m_translation.x() < a->m_translation.x(); });
-	else if(axis == 1)
-		sort(objects.begin(), objects.end(), [](Object * a, Object * b) { return b->m_translation.y() < a->m_translation.y(); });
-	else
-		sort(objects.begin(), objects.end(), [](Object * a, Object * b) { return b->m_translation.z() < a->m_translation.z(); });
+	size_t halfsize = count > 2 ? static_cast<size_t>(count * 0.5f) : 1;
+	nth_element(objects, objects + halfsize, objects + count, [axis](Object * a, Object * b) { return b->m_translation[axis] < a->m_translation[axis]; });
 
 	// divide into two
-	vector<Object *>::size_type fullsize = objects.size();
-	if (fullsize == 1)
+	if (count == 1)
 	{
 		leftChild = objects[0];
 		rightChild = nullptr;
 
 		m_bindingBox = leftChild->BoundingBox();
 	}
-	else if (fullsize == 2)
+	else if (count == 2)
 	{
 		leftChild = objects[0];
 		rightChild = objects[1];
@@ -320,46 +406,25 @@ SimpleObjectBVHNode::SimpleObjectBVHNode(std::vector<Object *> objects)
 		// generate binding box by combine 2 children's
 		m_bindingBox = CombineAABB(leftChild->BoundingBox(), rightChild->BoundingBox());
 	}
-	else if (fullsize > 2)
+	else
 	{
-		vector<Object *>::size_type halfsize = static_cast<vector<Object *>::size_type>(fullsize * 0.5f);
-		vector<Object *> leftObjects;
-		vector<Object *> rightObjects;
-
-		for (auto i = 0; i < fullsize; ++i)
-		{
-			if (i < halfsize)
-				leftObjects.push_back(objects[i]);
-			else
-				rightObjects.push_back(objects[i]);
-		}
-		leftChild = new SimpleObjectBVHNode(leftObjects);
-		rightChild = new SimpleObjectBVHNode(rightObjects);
+		leftChild = SceneArena::New<SimpleObjectBVHNode>(arena, SCENE_ARENA_BVH_NODES, objects, halfsize, arena);
+		rightChild = SceneArena::New<SimpleObjectBVHNode>(arena, SCENE_ARENA_BVH_NODES, objects + halfsize, count - halfsize, arena);
 
 		// generate binding box by combine 2 children's
 		m_bindingBox = CombineAABB(leftChild->BoundingBox(), rightChild->BoundingBox());
 	}
-	else
-	{
-		assert(FALSE);
-	}
 }
 
 SimpleObjectBVHNode::~SimpleObjectBVHNode()
 {
-	if (leftChild)
-	{
-		delete leftChild;
-		leftChild = nullptr;
-	}
-
-	if (rightChild)
-	{
-		delete rightChild;
-		rightChild = nullptr;
-	}
+	SceneArena::Delete(leftChild);
+	leftChild = nullptr;
+	SceneArena::Delete(rightChild);
+	rightChild = nullptr;
 }
 
+#if !defined(HEADLESS_RENDERING)
 void SimpleObjectBVHNode::Update(SimpleCamera *camera, float elapsedSeconds)
 {
 	if (leftChild)
@@ -385,24 +450,35 @@ void SimpleObjectBVHNode::Render(D3D12Viewer *viewer, UINT32 mid) const
 		rightChild->Render(viewer, mid);
 	}
 }
+#endif
 
-BOOL SimpleObjectBVHNode::Hit(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const
+const Object *SimpleObjectBVHNode::Intersect(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const
 {
-	BOOL hitMe = FALSE;
+	const Object *closest = nullptr;
 	if (m_bindingBox.Hit(r, t_min, t_max))
 	{
 		if (leftChild) 
 		{
-			hitMe |= leftChild->Hit(r, t_min, t_max, out_rec);
+			if (const Object *hit = leftChild->Intersect(r, t_min, t_max, out_rec))
+				closest = hit;
 		}
 
 		if (rightChild)
 		{
-			hitMe |= rightChild->Hit(r, t_min, t_max, out_rec);
+			if (const Object *hit = rightChild->Intersect(r, t_min, t_max, out_rec))
+				closest = hit;
 		}
 	}
 
-	return hitMe;
+	return closest;
+}
+
+BOOL SimpleObjectBVHNode::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	if (!m_bindingBox.Hit(r, t_min, t_max))
+		return FALSE;
+
+	return (leftChild && leftChild->Occluded(r, t_min, t_max)) || (rightChild && rightChild->Occluded(r, t_min, t_max));
 }
 
 AABB SimpleObjectBVHNode::BoundingBox() const
@@ -410,6 +486,19 @@ AABB SimpleObjectBVHNode::BoundingBox() const
 	return m_bindingBox;
 }
 
+void SimpleObjectBVHNode::Refit()
+{
+	SimpleObjectBVHNode *leftNode = dynamic_cast<SimpleObjectBVHNode *>(leftChild);
+	SimpleObjectBVHNode *rightNode = dynamic_cast<SimpleObjectBVHNode *>(rightChild);
+	if (leftNode)
+		leftNode->Refit();
+	if (rightNode)
+		rightNode->Refit();
+
+	m_bindingBox = rightChild ? CombineAABB(leftChild->BoundingBox(), rightChild->BoundingBox()) : leftChild->BoundingBox();
+}
+
+#if !defined(HEADLESS_RENDERING)
 void SimpleObjectBVHNode::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &cbvGPUHandle)
 {
 	if (leftChild)
@@ -422,4 +511,5 @@ void SimpleObjectBVHNode::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTO
 		rightChild->BuildD3DRes(viewer, cbvCPUHandle, cbvGPUHandle);
 	}
 }
+#endif
 
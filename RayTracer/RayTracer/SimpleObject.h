@@ -6,11 +6,14 @@
 class Mesh;
 class IHitable;
 class IMaterial;
+class IMotion;
 class D3D12Viewer;
 class SimpleCamera;
 class World;
+class SceneArena;
 struct HitRecord;
 
+#if !defined(HEADLESS_RENDERING)
 struct ObjectD3D12Resources
 {
 	UINT8 *							m_pGeoConstants;
@@ -23,12 +26,14 @@ struct ObjectD3D12Resources
 		delete[] m_GeoCbvHandles; 
 	}
 };
+#endif
 
 class Object
 {
 public:
 	virtual ~Object();
 	World *						m_world{ nullptr };
+	BOOL						m_inSceneArena{ FALSE };	// destroyed by its SceneArena, not by its owner
 
 	Vec3						m_translation;
 	Vec3						m_scaling;
@@ -38,14 +43,27 @@ public:
 	Mesh *						m_mesh{ nullptr };
 	IHitable *					m_hitable{ nullptr };
 	IMaterial *					m_material{ nullptr };
+	IMotion *					m_motion{ nullptr };		// owned, moves m_translation when animated
 
+#if !defined(HEADLESS_RENDERING)
 	ObjectD3D12Resources		m_d3dRes;
 
 	virtual void				Update(SimpleCamera *camera, float elapsedSeconds);
 	virtual void				Render(D3D12Viewer *viewer, UINT32 mid) const;
+#endif
 	virtual AABB				BoundingBox() const;
-	virtual BOOL				Hit(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const;
+	// closest hit with all its attributes, Intersect then ComputeAttributes of the object hit
+	BOOL						Hit(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const;
+	// the object hit, nullptr when there is none, t_max becomes its distance, see IHitable::Intersect
+	virtual const Object *		Intersect(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const;
+	void						ComputeAttributes(const Ray &r, HitRecord &io_rec) const;
+	// anything in [t_min, t_max], see IHitable::Occluded
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const;
+	// moves the object along m_motion, FALSE when it has none
+	BOOL						Animate(float elapsedSeconds);
+#if !defined(HEADLESS_RENDERING)
 	virtual void				BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &cbvGPUHandle);
+#endif
 };
 
 class SimpleObjectSphere : public Object
@@ -66,7 +84,9 @@ class SimpleObjectRect : public Object
 public:
 	SimpleObjectRect(SimpleObjectRectAlignAxes axes, const Vec3 &center, const Vec3 &rotation, float width, float height, BOOL reverseFace, Mesh *mesh, IMaterial *material, World *world);
 
+#if !defined(HEADLESS_RENDERING)
 	virtual void				Update(SimpleCamera *camera, float elapsedSeconds) override;
+#endif
 
 	SimpleObjectRectAlignAxes	m_alignAxes;
 	BOOL						m_reverseFace;
@@ -81,21 +101,43 @@ public:
 	IHitable *					m_faceList[6];
 };
 
+// triangle mesh of the CPU tracer, the same mesh the D3D12 viewer draws
+class SimpleObjectMesh : public Object
+{
+public:
+	SimpleObjectMesh(const Vec3 &center, const Vec3 &rotation, float scale, Mesh *mesh, IMaterial *material, World *world);
+};
+
 // TODO more
 
 class SimpleObjectBVHNode : public Object
 {
 public:
-	SimpleObjectBVHNode(std::vector<Object *> objects);
+	// the nodes are allocated in arena when there is one
+	SimpleObjectBVHNode(const std::vector<Object *> &objects, SceneArena *arena = nullptr);
 	virtual ~SimpleObjectBVHNode() override;
 
+#if !defined(HEADLESS_RENDERING)
 	virtual void				Update(SimpleCamera *camera, float elapsedSeconds) override;
 	virtual void				Render(D3D12Viewer *viewer, UINT32 mid) const override;
-	virtual BOOL				Hit(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const override;
+#endif
+	virtual const Object *		Intersect(const Ray &r, float &t_min, float &t_max, HitRecord &out_rec) const override;
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const override;
 	virtual AABB				BoundingBox() const override;
+	// binding boxes recomputed bottom-up once the objects moved, the split stays the same
+	void						Refit();
+#if !defined(HEADLESS_RENDERING)
 	virtual void				BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &cbvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &cbvGPUHandle) override;
+#endif
 
 	AABB m_bindingBox;
 	Object *leftChild{ nullptr };
 	Object *rightChild{ nullptr };
+
+private:
+	friend class SceneArena;
+
+	// objects is reordered in place, the children split it in two halves
+	SimpleObjectBVHNode(Object **objects, size_t count, SceneArena *arena);
+	void						Build(Object **objects, size_t count, SceneArena *arena);
 };
\ No newline at end of file
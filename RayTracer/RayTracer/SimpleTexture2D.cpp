@@ -1,12 +1,15 @@
 #include "stdafx.h"
 #include "SimpleTexture2D.h"
 
+#if !defined(HEADLESS_RENDERING)
 #include "D3D12Viewer.h"
 #include "D3D12Helper.h"
+#endif
 
 #include "FileIO.h"
 #include "tga_reader.h"
 
+#if !defined(HEADLESS_RENDERING)
 void SimpleTexture2D::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &srvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &srvGPUHandle)
 {
 	ID3D12Device *device = viewer->GetDevice();
@@ -73,6 +76,7 @@ void SimpleTexture2D::BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HA
 	viewer->ExecuteCommandList();
 	viewer->WaitForGpu();
 }
+#endif
 
 SimpleTexture2D_SingleColor::SimpleTexture2D_SingleColor(const Vec3 &col)
 	: m_color(col)
@@ -110,12 +114,22 @@ SimpleTexture2D_SingleColor::~SimpleTexture2D_SingleColor()
 SimpleTexture2D_TGAImage::SimpleTexture2D_TGAImage(const char *filePath)
 {
 	FileIO _file(filePath);
+	if (!_file.IsExist())
+	{
+		// missing asset, fall back to a 1x1 magenta texture instead of stopping the whole render
+		std::cout << "[SimpleTexture2D] Failed to open " << filePath << std::endl;
+		m_width = m_height = 1;
+		m_pixelData = new UINT8[4]{ 0xFF, 0x00, 0xFF, 0xFF };
+		m_pyramid.Build(m_pixelData, m_width, m_height);
+		return;
+	}
 	_file.Load();
 	
 	m_width = tgaGetWidth(_file.GetBuffer());
 	m_height = tgaGetHeight(_file.GetBuffer());
 
 	m_pixelData = (UINT8 *)tgaRead(_file.GetBuffer(), TGA_READER_ABGR);
+	m_pyramid.Build(m_pixelData, m_width, m_height);
 }
 
 SimpleTexture2D_TGAImage::~SimpleTexture2D_TGAImage()
@@ -129,19 +143,10 @@ SimpleTexture2D_TGAImage::~SimpleTexture2D_TGAImage()
 
 Vec3 SimpleTexture2D_TGAImage::Sample(float u, float v) const
 {
-	UINT32 i = UINT32(u * m_width);
-	UINT32 j = UINT32((1.0f - v) * m_height - 0.001f);
-
-	if (i < 0) i = 0;
-	if (j < 0) j = 0;
-	if (i > m_width - 1) i = m_width - 1;
-	if (j > m_height - 1) j = m_height - 1;
-
-	UINT32 index =  j * m_width + i;
-
-	float r = m_pixelData[index * 4] / 255.0f;
-	float g = m_pixelData[index * 4 + 1] / 255.0f;
-	float b = m_pixelData[index * 4 + 2] / 255.0f;
-
-	return Vec3(r, g, b);
+	return m_pyramid.SampleBilinear(u, v, 0);
 }
+
+Vec3 SimpleTexture2D_TGAImage::Sample(float u, float v, float footprint) const
+{
+	return m_pyramid.SampleTrilinear(u, v, footprint);
+}
\ No newline at end of file
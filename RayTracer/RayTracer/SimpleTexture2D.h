@@ -1,30 +1,41 @@
 #pragma once
 
 #include "Vec3.h"
+#include "TexturePyramid.h"
 
 class D3D12Viewer;
 
+#if !defined(HEADLESS_RENDERING)
 struct Texture2DD3D12Resources
 {
 	ComPtr<ID3D12Resource>			m_texture;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE	m_SRVHandle;
 };
+#endif
 
 class ITexture2D
 {
 public:
 	virtual ~ITexture2D() = default;
 	virtual Vec3 Sample(float u, float v) const = 0;
+	// footprint is the width of the area seen by the lookup in texture coordinates, for the filtered textures
+	virtual Vec3 Sample(float u, float v, float footprint) const { return Sample(u, v); }
+	// FALSE when Sample ignores the coordinates, the hits can skip computing them
+	virtual BOOL NeedsUV() const { return TRUE; }
+#if !defined(HEADLESS_RENDERING)
 	virtual void BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &srvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &srvGPUHandle) = 0;
 
 	Texture2DD3D12Resources m_d3dRes;
+#endif
 };
 
 
 class SimpleTexture2D : public ITexture2D
 {
 public:
+#if !defined(HEADLESS_RENDERING)
 	virtual void BuildD3DRes(D3D12Viewer *viewer, CD3DX12_CPU_DESCRIPTOR_HANDLE &srvCPUHandle, CD3DX12_GPU_DESCRIPTOR_HANDLE &srvGPUHandle) override;
+#endif
 
 	UINT32 m_width{ 0 };
 	UINT32 m_height{ 0 };
@@ -37,6 +48,7 @@ public:
 	SimpleTexture2D_SingleColor(const Vec3 &col);
 	virtual ~SimpleTexture2D_SingleColor() override;
 	virtual Vec3 Sample(float u, float v) const override { return m_color; }
+	virtual BOOL NeedsUV() const override { return FALSE; }
 	Vec3 m_color;
 };
 
@@ -45,5 +57,11 @@ class SimpleTexture2D_TGAImage : public SimpleTexture2D
 public:
 	SimpleTexture2D_TGAImage(const char *filePath);
 	virtual ~SimpleTexture2D_TGAImage() override;
+	// bilinear from the first level
 	virtual Vec3 Sample(float u, float v) const override;
+	// trilinear from the levels matching the footprint
+	virtual Vec3 Sample(float u, float v, float footprint) const override;
+
+	// float texels and mip levels of m_pixelData for the CPU lookups, m_pixelData is kept for the viewer
+	TexturePyramid m_pyramid;
 };
\ No newline at end of file
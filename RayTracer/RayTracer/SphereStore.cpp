@@ -0,0 +1,156 @@
+#include "stdafx.h"
+#include "SphereStore.h"
+
+using namespace std;
+
+UINT32 SphereStore::AddSphere(const Vec3 &center, float radius, const AABB &bounds, IMaterial *material, UINT32 objectIndex)
+{
+	UINT32 materialIndex = (UINT32)(find(m_materials.begin(), m_materials.end(), material) - m_materials.begin());
+	if (materialIndex == m_materials.size())
+		m_materials.push_back(material);
+
+	m_added.push_back({ center, radius, materialIndex, objectIndex });
+	m_bounds.push_back(bounds);
+	return (UINT32)m_added.size() - 1;
+}
+
+void SphereStore::Build(ThreadPool *threadPool)
+{
+	// one batch per leaf
+	m_bvh.Build(m_bounds, BATCH_WIDTH, BATCH_WIDTH, threadPool);
+	FillSlots();
+}
+
+void SphereStore::FillSlots()
+{
+	size_t count = m_added.size();
+	size_t paddedCount = count > 0 ? count + BATCH_WIDTH - 1 : 0;
+	m_centerX.assign(paddedCount, 0.0f);
+	m_centerY.assign(paddedCount, 0.0f);
+	m_centerZ.assign(paddedCount, 0.0f);
+	m_radii.assign(paddedCount, 0.0f);
+	m_materialIndices.resize(count);
+	m_objectIndices.resize(count);
+	m_slots.resize(count);
+	for (size_t slot = 0; slot < count; slot++)
+	{
+		UINT32 index = m_bvh.GetPrimitiveIndex(slot);
+		const AddedSphere &sphere = m_added[index];
+		m_centerX[slot] = sphere.m_center.x();
+		m_centerY[slot] = sphere.m_center.y();
+		m_centerZ[slot] = sphere.m_center.z();
+		m_radii[slot] = sphere.m_radius;
+		m_materialIndices[slot] = sphere.m_materialIndex;
+		m_objectIndices[slot] = sphere.m_objectIndex;
+		m_slots[index] = (UINT32)slot;
+	}
+}
+
+void SphereStore::MoveSphere(UINT32 index, const Vec3 &center, const AABB &bounds)
+{
+	m_added[index].m_center = center;
+	m_bounds[index] = bounds;
+	UINT32 slot = m_slots[index];
+	m_centerX[slot] = center.x();
+	m_centerY[slot] = center.y();
+	m_centerZ[slot] = center.z();
+}
+
+BOOL SphereStore::Refit(float rebuildSAHGrowth, ThreadPool *threadPool)
+{
+	if (!m_bvh.RefitOrRebuild(m_bounds, rebuildSAHGrowth, threadPool))
+		return FALSE;
+	FillSlots();
+	return TRUE;
+}
+
+void SphereStore::Clear()
+{
+	m_added.clear();
+	m_bounds.clear();
+	m_slots.clear();
+	m_centerX.clear();
+	m_centerY.clear();
+	m_centerZ.clear();
+	m_radii.clear();
+	m_materialIndices.clear();
+	m_objectIndices.clear();
+	m_materials.clear();
+	m_bvh.Clear();
+}
+
+BOOL SphereStore::Hit(const Ray &r, float t_min, float &t_max, UINT32 &out_sphere, BVHTraversalStats *stats) const
+{
+	return m_bvh.HitRanges(r, t_min, t_max, [&](UINT32 slot, UINT32 count, float t_min, float &t_max)
+	{
+		return HitRange(r, slot, count, t_min, t_max, out_sphere);
+	}, stats);
+}
+
+BOOL SphereStore::Occluded(const Ray &r, float t_min, float t_max, BVHTraversalStats *stats) const
+{
+	// a leaf is a few batches, the closest of them costs the same as the first
+	return m_bvh.OccludedRanges(r, t_min, t_max, [&](UINT32 slot, UINT32 count, float t_min, float t_max)
+	{
+		UINT32 sphere;
+		return HitRange(r, slot, count, t_min, t_max, sphere);
+	}, stats);
+}
+
+BOOL SphereStore::HitRange(const Ray &r, UINT32 begin, UINT32 count, float t_min, float &t_max, UINT32 &out_sphere) const
+{
+	// the terms of SphereHitable::Hit that only depend on the ray
+	float a = dot(r.m_dir, r.m_dir);
+	Float8 orgX(r.m_org.x());
+	Float8 orgY(r.m_org.y());
+	Float8 orgZ(r.m_org.z());
+	Float8 dirX(r.m_dir.x());
+	Float8 dirY(r.m_dir.y());
+	Float8 dirZ(r.m_dir.z());
+	Float8 fourA(4 * a);
+	Float8 twoA(2.0f * a);
+	Float8 zero(0.0f);
+	Float8 tMin(t_min);
+
+	BOOL hitAnything = FALSE;
+	UINT32 end = begin + count;
+	for (UINT32 batch = begin; batch < end; batch += BATCH_WIDTH)
+	{
+		Float8 ocx = orgX - Float8::Load(&m_centerX[batch]);
+		Float8 ocy = orgY - Float8::Load(&m_centerY[batch]);
+		Float8 ocz = orgZ - Float8::Load(&m_centerZ[batch]);
+		Float8 radius = Float8::Load(&m_radii[batch]);
+
+		Float8 b = Float8(2.0f) * (dirX * ocx + dirY * ocy + dirZ * ocz);
+		Float8 c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+		Float8 discriminant = b * b - fourA * c;
+		Float8 hasRoots = zero < discriminant;
+
+		Float8 sqrtD = Sqrt(Max(discriminant, zero));
+		Float8 tNear = (zero - b - sqrtD) / twoA;
+		Float8 tFar = (sqrtD - b) / twoA;
+
+		// against the t_max of the batch start, the lanes are then taken in order as the scalar tests would be
+		Float8 tMax(t_max);
+		Float8 nearValid = (tMin <= tNear) & (tNear <= tMax);
+		Float8 farValid = (tMin <= tFar) & (tFar <= tMax);
+		UINT32 laneCount = min(BATCH_WIDTH, end - batch);
+		UINT32 mask = (hasRoots & Select(nearValid, nearValid, farValid)).MoveMask() & ((1u << laneCount) - 1);
+		if (mask == 0)
+			continue;
+
+		float t[BATCH_WIDTH];
+		Select(nearValid, tNear, tFar).Store(t);
+		for (UINT32 lanes = mask; lanes; lanes &= lanes - 1)
+		{
+			UINT32 lane = LowestBit(lanes);
+			if (t[lane] <= t_max)
+			{
+				t_max = t[lane];
+				out_sphere = batch + lane;
+				hitAnything = TRUE;
+			}
+		}
+	}
+	return hitAnything;
+}
\ No newline at end of file
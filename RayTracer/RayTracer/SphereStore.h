@@ -0,0 +1,101 @@
+#pragma once
+
+#include "LinearBVH.h"
+
+class IMaterial;
+
+// Spheres as a structure of arrays, reordered to the leaf order of their own BVH so that a leaf is a contiguous
+// range of the arrays, intersected BATCH_WIDTH spheres at a time.
+// The batch test repeats SphereHitable::Hit under a TranslatedInstance operation for operation,
+// the closest sphere and its distance are the ones the objects report.
+class SphereStore
+{
+public:
+	static const UINT32				BATCH_WIDTH = 8;
+
+	SphereStore() = default;
+	~SphereStore() = default;
+
+	// bounds are the ones of the object, so that the store culls exactly like a BVH over the objects.
+	// Returns the index of the sphere in the order it was added, which MoveSphere takes.
+	UINT32							AddSphere(const Vec3 &center, float radius, const AABB &bounds, IMaterial *material, UINT32 objectIndex);
+	// the BVH is built by the threads of threadPool if any, see LinearBVH::Build
+	void							Build(ThreadPool *threadPool = nullptr);
+	void							Clear();
+
+	// animation, the spheres are moved first, then the BVH is refit once, TRUE when it was rebuilt, see LinearBVH::RefitOrRebuild
+	void							MoveSphere(UINT32 index, const Vec3 &center, const AABB &bounds);
+	BOOL							Refit(float rebuildSAHGrowth, ThreadPool *threadPool = nullptr);
+
+	// closest sphere, t_max shrinks to its distance and out_sphere gets its index in the store
+	BOOL							Hit(const Ray &r, float t_min, float &t_max, UINT32 &out_sphere, BVHTraversalStats *stats = nullptr) const;
+	// any sphere in [t_min, t_max]
+	BOOL							Occluded(const Ray &r, float t_min, float t_max, BVHTraversalStats *stats = nullptr) const;
+	// closest sphere of every active lane, m_tMax shrinks and onHit(lane, sphere) is called on every closer hit
+	template<UINT32 N, typename OnHitFunc>
+	void							HitPacket(RayPacket<N> &packet, float t_min, OnHitFunc &&onHit, UINT32 minActiveLanes, BVHTraversalStats *stats = nullptr) const;
+
+	inline BOOL						IsEmpty() const { return m_radii.empty(); }
+	inline UINT32					GetSphereCount() const { return (UINT32)m_objectIndices.size(); }
+	inline UINT32					GetObjectIndex(UINT32 sphere) const { return m_objectIndices[sphere]; }
+	inline IMaterial *				GetMaterial(UINT32 sphere) const { return m_materials[m_materialIndices[sphere]]; }
+	inline const LinearBVH &		GetBVH() const { return m_bvh; }
+
+private:
+	struct AddedSphere
+	{
+		Vec3						m_center;
+		float						m_radius;
+		UINT32						m_materialIndex;
+		UINT32						m_objectIndex;
+	};
+
+	// the per slot arrays from m_added, in the leaf order of the BVH
+	void							FillSlots();
+	BOOL							HitRange(const Ray &r, UINT32 begin, UINT32 count, float t_min, float &t_max, UINT32 &out_sphere) const;
+
+	std::vector<AddedSphere>		m_added;					// in the order of AddSphere, kept for the refits and rebuilds
+	std::vector<AABB>				m_bounds;					// and their bounds
+	std::vector<UINT32>				m_slots;					// slot of every added sphere
+
+	// BATCH_WIDTH - 1 padding spheres at the end, so that the last batch can always be loaded whole
+	std::vector<float>				m_centerX;
+	std::vector<float>				m_centerY;
+	std::vector<float>				m_centerZ;
+	std::vector<float>				m_radii;
+	std::vector<UINT32>				m_materialIndices;
+	std::vector<UINT32>				m_objectIndices;
+	std::vector<IMaterial *>		m_materials;
+	LinearBVH						m_bvh;
+};
+
+template<UINT32 N, typename OnHitFunc>
+void SphereStore::HitPacket(RayPacket<N> &packet, float t_min, OnHitFunc &&onHit, UINT32 minActiveLanes, BVHTraversalStats *stats) const
+{
+	// coherent lanes test one sphere at a time across the packet, the lanes left alone a batch of spheres at a time
+	const float zero[3] = { 0.0f, 0.0f, 0.0f };
+	alignas(16) float t[N];
+	m_bvh.HitPacketRanges(packet, t_min,
+		[&](UINT32 slot, UINT32 count, UINT32 laneMask)
+		{
+			for (UINT32 sphere = slot; sphere < slot + count; sphere++)
+			{
+				const float center[3] = { m_centerX[sphere], m_centerY[sphere], m_centerZ[sphere] };
+				UINT32 mask = IntersectSpherePacket(packet, center, zero, m_radii[sphere], t_min, t) & laneMask;
+				for (UINT32 lanes = mask; lanes; lanes &= lanes - 1)
+				{
+					UINT32 lane = LowestBit(lanes);
+					packet.m_tMax[lane] = t[lane];
+					onHit(lane, sphere);
+				}
+			}
+		},
+		[&](UINT32 lane, UINT32 slot, UINT32 count, float t_min, float &t_max)
+		{
+			UINT32 sphere;
+			if (!HitRange(packet.GetRay(lane), slot, count, t_min, t_max, sphere))
+				return FALSE;
+			onHit(lane, sphere);
+			return TRUE;
+		}, minActiveLanes, stats);
+}
\ No newline at end of file
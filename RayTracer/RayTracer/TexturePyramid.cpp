@@ -0,0 +1,172 @@
+#include "stdafx.h"
+#include "TexturePyramid.h"
+#include "RayPacket.h"
+
+using namespace std;
+
+void TexturePyramid::Build(const UINT8 *rgba, UINT32 width, UINT32 height)
+{
+	assert(width > 0 && height > 0 && "Empty texture");
+
+	// the levels and where they start, a texture of 1x1 has a single level
+	m_levels.clear();
+	m_columnIndices.clear();
+	m_rowIndices.clear();
+	size_t texelCount = 0;
+	for (UINT32 w = width, h = height; ; w = (w > 1) ? w / 2 : 1, h = (h > 1) ? h / 2 : 1)
+	{
+		Level level;
+		level.m_width = w;
+		level.m_height = h;
+		level.m_tilesPerRow = (w + TILE_SIZE - 1) >> TILE_SHIFT;
+		level.m_offset = texelCount;
+		level.m_columnStart = (UINT32)m_columnIndices.size();
+		level.m_rowStart = (UINT32)m_rowIndices.size();
+		for (UINT32 x = 0; x < w; x++)
+			m_columnIndices.push_back((UINT32)ColumnIndex(x));
+		for (UINT32 y = 0; y < h; y++)
+			m_rowIndices.push_back((UINT32)RowIndex(level, y));
+		texelCount += ((size_t)level.m_tilesPerRow * ((h + TILE_SIZE - 1) >> TILE_SHIFT)) << (2 * TILE_SHIFT);
+		m_levels.push_back(level);
+		if (w == 1 && h == 1)
+			break;
+	}
+	// a cache line more, for the alignment
+	const size_t lineFloats = CACHE_LINE_SIZE / sizeof(float);
+	assert(texelCount <= UINT_MAX && "Texture too large for the index tables");
+	m_texels.assign(texelCount * 4 + lineFloats - 1, 0.0f);
+	size_t misalignment = ((uintptr_t)m_texels.data() / sizeof(float)) % lineFloats;
+	m_base = m_texels.data() + (misalignment ? lineFloats - misalignment : 0);
+
+	const Level &first = m_levels[0];
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			const UINT8 *source = rgba + ((size_t)y * width + x) * 4;
+			float *texel = Texel(first, x, y);
+			for (UINT32 c = 0; c < 4; c++)
+				texel[c] = source[c] / 255.0f;
+		}
+	}
+
+	// every level is the box filter of the previous one, 2 texels per texel along an even size and 3 along an odd one
+	for (UINT32 l = 1; l < m_levels.size(); l++)
+	{
+		const Level &previous = m_levels[l - 1];
+		const Level &level = m_levels[l];
+		for (UINT32 y = 0; y < level.m_height; y++)
+		{
+			UINT32 rows[3];
+			float rowWeights[3];
+			UINT32 rowCount = DownsampleTaps(y, previous.m_height, rows, rowWeights);
+			for (UINT32 x = 0; x < level.m_width; x++)
+			{
+				UINT32 columns[3];
+				float columnWeights[3];
+				UINT32 columnCount = DownsampleTaps(x, previous.m_width, columns, columnWeights);
+				float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				for (UINT32 j = 0; j < rowCount; j++)
+				{
+					for (UINT32 i = 0; i < columnCount; i++)
+					{
+						const float *source = Texel(previous, columns[i], rows[j]);
+						float weight = rowWeights[j] * columnWeights[i];
+						for (UINT32 c = 0; c < 4; c++)
+							sum[c] += weight * source[c];
+					}
+				}
+				float *texel = Texel(level, x, y);
+				for (UINT32 c = 0; c < 4; c++)
+					texel[c] = sum[c];
+			}
+		}
+	}
+}
+
+UINT32 TexturePyramid::DownsampleTaps(UINT32 x, UINT32 previousSize, UINT32 out_taps[3], float out_weights[3])
+{
+	if (previousSize == 1)
+	{
+		out_taps[0] = 0;
+		out_weights[0] = 1.0f;
+		return 1;
+	}
+
+	out_taps[0] = 2 * x;
+	out_taps[1] = 2 * x + 1;
+	if ((previousSize & 1) == 0)
+	{
+		out_weights[0] = 0.5f;
+		out_weights[1] = 0.5f;
+		return 2;
+	}
+
+	// the n texels of the level cover the 2n + 1 of the previous one, texel x covers [x (2n + 1) / n, (x + 1) (2n + 1) / n),
+	// which overlaps 2x, 2x + 1 and 2x + 2 by these weights (the polyphase box filter of odd sizes)
+	UINT32 n = previousSize / 2;
+	float scale = 1.0f / (float)previousSize;
+	out_taps[2] = 2 * x + 2;
+	out_weights[0] = (float)(n - x) * scale;
+	out_weights[1] = (float)n * scale;
+	out_weights[2] = (float)(x + 1) * scale;
+	return 3;
+}
+
+Vec3 TexturePyramid::SampleNearest(float u, float v) const
+{
+	const Level &level = m_levels[0];
+	u -= floorf(u);
+	v -= floorf(v);
+	UINT32 x = min((UINT32)(u * level.m_width), level.m_width - 1);
+	UINT32 y = min((UINT32)((1.0f - v) * level.m_height), level.m_height - 1);
+	const float *texel = Texel(level, x, y);
+	return Vec3(texel[0], texel[1], texel[2]);
+}
+
+Vec3 TexturePyramid::SampleBilinear(float u, float v, UINT32 levelIndex) const
+{
+	const Level &level = m_levels[levelIndex];
+
+	// the centers of the texels are at half texels, the neighbours wrap around
+	u -= floorf(u);
+	v -= floorf(v);
+	float x = u * level.m_width - 0.5f;
+	float y = (1.0f - v) * level.m_height - 0.5f;
+	float fx = floorf(x);
+	float fy = floorf(y);
+	float tx = x - fx;
+	float ty = y - fy;
+	UINT32 x0 = (fx < 0.0f) ? level.m_width - 1 : min((UINT32)fx, level.m_width - 1);
+	UINT32 y0 = (fy < 0.0f) ? level.m_height - 1 : min((UINT32)fy, level.m_height - 1);
+	UINT32 x1 = (x0 + 1 < level.m_width) ? x0 + 1 : 0;
+	UINT32 y1 = (y0 + 1 < level.m_height) ? y0 + 1 : 0;
+
+	const UINT32 *columns = &m_columnIndices[level.m_columnStart];
+	const UINT32 *rows = &m_rowIndices[level.m_rowStart];
+	size_t column0 = columns[x0];
+	size_t column1 = columns[x1];
+	size_t row0 = rows[y0];
+	size_t row1 = rows[y1];
+	Float4 top = Float4::Load(Texel(row0 + column0)) * Float4(1.0f - tx) + Float4::Load(Texel(row0 + column1)) * Float4(tx);
+	Float4 bottom = Float4::Load(Texel(row1 + column0)) * Float4(1.0f - tx) + Float4::Load(Texel(row1 + column1)) * Float4(tx);
+	alignas(16) float result[4];
+	(top * Float4(1.0f - ty) + bottom * Float4(ty)).Store(result);
+	return Vec3(result[0], result[1], result[2]);
+}
+
+Vec3 TexturePyramid::SampleTrilinear(float u, float v, float footprint) const
+{
+	const Level &first = m_levels[0];
+	float lod = (footprint > 0.0f) ? log2f(footprint * (float)max(first.m_width, first.m_height)) : 0.0f;
+	if (lod <= 0.0f)
+		return SampleBilinear(u, v, 0);
+
+	UINT32 last = GetLevelCount() - 1;
+	if (lod >= (float)last)
+		return SampleBilinear(u, v, last);
+
+	UINT32 level = (UINT32)lod;
+	float t = lod - (float)level;
+	return (1.0f - t) * SampleBilinear(u, v, level) + t * SampleBilinear(u, v, level + 1);
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Vec3.h"
+
+// The texels of an RGBA8 image converted to floats once, and its mip levels down to 1x1, for the CPU tracer.
+// Every level is stored in tiles of TILE_SIZE x TILE_SIZE texels, the tiles row by row and the texels of a tile
+// in Morton order, so that the 4 texels of a bilinear lookup are mostly in the same tile, and the lookups of nearby
+// rays in the same few cache lines whatever the orientation of the surface, not only along the rows of the texture.
+// The incoherent rays are expected to look up the smaller levels. The coordinates wrap around, like the sampler of the viewer.
+// The texels start on a cache line, a 2x2 quad of the Morton order is then a single line.
+class TexturePyramid
+{
+public:
+	static const UINT32				TILE_SHIFT = 3;
+	static const UINT32				TILE_SIZE = 1 << TILE_SHIFT;
+	static const UINT32				CACHE_LINE_SIZE = 64;
+
+	TexturePyramid() = default;
+	// m_base points into m_texels
+	TexturePyramid(const TexturePyramid &) = delete;
+	TexturePyramid &operator=(const TexturePyramid &) = delete;
+
+	// rgba is row by row from the top, v = 1 is the top row
+	void							Build(const UINT8 *rgba, UINT32 width, UINT32 height);
+
+	inline UINT32					GetLevelCount() const { return (UINT32)m_levels.size(); }
+	inline UINT32					GetWidth(UINT32 level) const { return m_levels[level].m_width; }
+	inline UINT32					GetHeight(UINT32 level) const { return m_levels[level].m_height; }
+	inline size_t					GetMemorySize() const { return m_texels.size() * sizeof(float); }
+
+	Vec3							SampleNearest(float u, float v) const;
+	Vec3							SampleBilinear(float u, float v, UINT32 level) const;
+	// footprint is the width of the area to filter in texture coordinates, the level of detail is its log2 in texels
+	// of the first level, blended between the two nearest levels. 0 is a bilinear lookup of the first level
+	Vec3							SampleTrilinear(float u, float v, float footprint) const;
+
+private:
+	struct Level
+	{
+		UINT32						m_width;
+		UINT32						m_height;
+		UINT32						m_tilesPerRow;
+		size_t						m_offset;		// of its first texel in m_texels, in texels
+		UINT32						m_columnStart;	// of its ColumnIndex of x = 0 in m_columnIndices
+		UINT32						m_rowStart;		// of its RowIndex of y = 0 in m_rowIndices
+	};
+
+	// the texels of the previous level and their weights for the texel x of a level along one axis, returns how many
+	static UINT32					DownsampleTaps(UINT32 x, UINT32 previousSize, UINT32 out_taps[3], float out_weights[3]);
+
+	// the 3 bits of x spread to the even bits
+	static inline UINT32 SpreadBits(UINT32 x)
+	{
+		x = (x | (x << 2)) & 0x33u;
+		return (x | (x << 1)) & 0x55u;
+	}
+
+	// the index of the texel (x, y) is the sum of a part from x and a part from y, the 4 texels of a bilinear lookup
+	// only need 2 of each. Both are tabulated by Build, a lookup costs as little as the row by row y * width + x
+	static inline size_t ColumnIndex(UINT32 x)
+	{
+		return ((size_t)(x >> TILE_SHIFT) << (2 * TILE_SHIFT)) | SpreadBits(x & (TILE_SIZE - 1));
+	}
+
+	static inline size_t RowIndex(const Level &level, UINT32 y)
+	{
+		return level.m_offset + (((size_t)(y >> TILE_SHIFT) * level.m_tilesPerRow) << (2 * TILE_SHIFT)) + (SpreadBits(y & (TILE_SIZE - 1)) << 1);
+	}
+
+	inline const float *Texel(size_t index) const { return m_base + index * 4; }
+
+	inline const float *Texel(const Level &level, UINT32 x, UINT32 y) const
+	{
+		return Texel((size_t)m_rowIndices[level.m_rowStart + y] + m_columnIndices[level.m_columnStart + x]);
+	}
+
+	inline float *Texel(const Level &level, UINT32 x, UINT32 y)
+	{
+		return const_cast<float *>(static_cast<const TexturePyramid *>(this)->Texel(level, x, y));
+	}
+
+	std::vector<Level>				m_levels;
+	std::vector<float>				m_texels;		// RGBA, the alpha is kept for the 16 bytes per texel
+	float *							m_base{ nullptr };	// the first texel, aligned on CACHE_LINE_SIZE in m_texels
+	std::vector<UINT32>				m_columnIndices;	// ColumnIndex of every x of every level
+	std::vector<UINT32>				m_rowIndices;		// RowIndex of every y of every level
+};
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(UINT32 threadCount)
+{
+	if (threadCount == 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+
+	for (UINT32 i = 0; i < threadCount; i++)
+		m_queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+
+	// thread 0 is the one calling Dispatch
+	for (UINT32 i = 1; i < threadCount; i++)
+		m_threads.push_back(thread(&ThreadPool::WorkerMain, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = TRUE;
+	}
+	m_wakeCondition.notify_all();
+
+	for (thread &t : m_threads)
+		t.join();
+}
+
+void ThreadPool::Dispatch(UINT32 taskCount, const TaskFunc &func, BOOL allowStealing)
+{
+	auto start = chrono::steady_clock::now();
+
+	// contiguous ranges, so that each thread starts on neighbouring tasks
+	UINT32 threadCount = GetThreadCount();
+	for (UINT32 t = 0; t < threadCount; t++)
+	{
+		WorkQueue &queue = *m_queues[t];
+		lock_guard<mutex> lock(queue.m_mutex);
+		queue.m_tasks.clear();
+		queue.m_stats = ThreadStats();
+		UINT32 begin = (UINT32)((UINT64)taskCount * t / threadCount);
+		UINT32 end = (UINT32)((UINT64)taskCount * (t + 1) / threadCount);
+		for (UINT32 i = begin; i < end; i++)
+			queue.m_tasks.push_back(i);
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_func = &func;
+		m_allowStealing = allowStealing;
+		m_activeWorkers = threadCount - 1;
+		m_dispatchIndex++;
+	}
+	m_wakeCondition.notify_all();
+
+	RunTasks(0);
+
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_doneCondition.wait(lock, [this] { return m_activeWorkers == 0; });
+		m_func = nullptr;
+	}
+
+	m_dispatchSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void ThreadPool::WorkerMain(UINT32 threadIndex)
+{
+	UINT64 lastDispatchIndex = 0;
+	for (;;)
+	{
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [&] { return m_quit || m_dispatchIndex != lastDispatchIndex; });
+			if (m_quit)
+				return;
+			lastDispatchIndex = m_dispatchIndex;
+		}
+
+		RunTasks(threadIndex);
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if (--m_activeWorkers == 0)
+				m_doneCondition.notify_all();
+		}
+	}
+}
+
+void ThreadPool::RunTasks(UINT32 threadIndex)
+{
+	// no task is added during a dispatch, so once every queue is empty the thread is done
+	ThreadStats &stats = m_queues[threadIndex]->m_stats;
+	UINT32 taskIndex;
+	while (PopTask(threadIndex, taskIndex) || (m_allowStealing && StealTask(threadIndex, taskIndex)))
+	{
+		auto start = chrono::steady_clock::now();
+		(*m_func)(taskIndex, threadIndex);
+		stats.m_busySeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		stats.m_taskCount++;
+	}
+}
+
+BOOL ThreadPool::PopTask(UINT32 threadIndex, UINT32 &out_taskIndex)
+{
+	WorkQueue &queue = *m_queues[threadIndex];
+	lock_guard<mutex> lock(queue.m_mutex);
+	if (queue.m_tasks.empty())
+		return FALSE;
+
+	out_taskIndex = queue.m_tasks.front();
+	queue.m_tasks.pop_front();
+	return TRUE;
+}
+
+BOOL ThreadPool::StealTask(UINT32 threadIndex, UINT32 &out_taskIndex)
+{
+	UINT32 threadCount = GetThreadCount();
+	for (UINT32 n = 1; n < threadCount; n++)
+	{
+		// the victim's last task is the farthest from what it is working on
+		WorkQueue &victim = *m_queues[(threadIndex + n) % threadCount];
+		lock_guard<mutex> lock(victim.m_mutex);
+		if (!victim.m_tasks.empty())
+		{
+			out_taskIndex = victim.m_tasks.back();
+			victim.m_tasks.pop_back();
+			m_queues[threadIndex]->m_stats.m_stealCount++;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
\ No newline at end of file
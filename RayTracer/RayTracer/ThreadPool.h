@@ -0,0 +1,55 @@
+#pragma once
+
+// Fixed set of worker threads with one task queue per thread.
+// A dispatch hands every thread a contiguous range of task indices, a thread that runs out of work
+// steals from the back of the other queues, so that long tasks do not leave cores idle.
+// The calling thread takes part in the dispatch as thread 0.
+class ThreadPool
+{
+public:
+	typedef std::function<void(UINT32 taskIndex, UINT32 threadIndex)> TaskFunc;
+
+	struct ThreadStats
+	{
+		double						m_busySeconds{ 0.0 };	// time spent inside tasks
+		UINT32						m_taskCount{ 0 };
+		UINT32						m_stealCount{ 0 };
+	};
+
+	explicit ThreadPool(UINT32 threadCount = 0);			// 0 for one thread per hardware thread
+	~ThreadPool();
+
+	// blocks until every task is done
+	void							Dispatch(UINT32 taskCount, const TaskFunc &func, BOOL allowStealing = TRUE);
+
+	inline UINT32					GetThreadCount() const { return (UINT32)m_queues.size(); }
+	// statistics of the last dispatch
+	inline const ThreadStats &		GetThreadStats(UINT32 threadIndex) const { return m_queues[threadIndex]->m_stats; }
+	inline double					GetDispatchSeconds() const { return m_dispatchSeconds; }
+
+private:
+	struct WorkQueue
+	{
+		std::mutex					m_mutex;
+		std::deque<UINT32>			m_tasks;
+		ThreadStats					m_stats;
+	};
+
+	void							WorkerMain(UINT32 threadIndex);
+	void							RunTasks(UINT32 threadIndex);
+	BOOL							PopTask(UINT32 threadIndex, UINT32 &out_taskIndex);
+	BOOL							StealTask(UINT32 threadIndex, UINT32 &out_taskIndex);
+
+	std::vector<std::unique_ptr<WorkQueue>>	m_queues;
+	std::vector<std::thread>		m_threads;
+
+	std::mutex						m_mutex;
+	std::condition_variable			m_wakeCondition;
+	std::condition_variable			m_doneCondition;
+	const TaskFunc *				m_func{ nullptr };
+	UINT64							m_dispatchIndex{ 0 };
+	UINT32							m_activeWorkers{ 0 };
+	BOOL							m_allowStealing{ TRUE };
+	BOOL							m_quit{ FALSE };
+	double							m_dispatchSeconds{ 0.0 };
+};
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include "TileScheduler.h"
+
+using namespace std;
+
+void TileScheduler::GenerateTiles(UINT32 width, UINT32 height, UINT32 tileWidth, UINT32 tileHeight, TileOrder order, vector<Tile> &out_tiles)
+{
+	assert(tileWidth > 0 && tileHeight > 0);
+	UINT32 tilesX = (width + tileWidth - 1) / tileWidth;
+	UINT32 tilesY = (height + tileHeight - 1) / tileHeight;
+
+	// the curves are defined on a power of two square grid, the tiles outside of the image are skipped
+	UINT32 n = 1;
+	while (n < tilesX || n < tilesY)
+		n <<= 1;
+
+	vector<pair<UINT32, Tile>> keyedTiles;
+	keyedTiles.reserve(tilesX * tilesY);
+	for (UINT32 ty = 0; ty < tilesY; ty++)
+	{
+		for (UINT32 tx = 0; tx < tilesX; tx++)
+		{
+			Tile tile;
+			tile.m_x0 = tx * tileWidth;
+			tile.m_y0 = ty * tileHeight;
+			tile.m_x1 = min(width, tile.m_x0 + tileWidth);
+			tile.m_y1 = min(height, tile.m_y0 + tileHeight);
+
+			UINT32 key = ty * tilesX + tx;
+			if (order == TILE_ORDER_MORTON)
+				key = MortonCode(tx, ty);
+			else if (order == TILE_ORDER_HILBERT)
+				key = HilbertCode(tx, ty, n);
+			keyedTiles.push_back(make_pair(key, tile));
+		}
+	}
+	sort(keyedTiles.begin(), keyedTiles.end(), [](const pair<UINT32, Tile> &a, const pair<UINT32, Tile> &b) { return a.first < b.first; });
+
+	out_tiles.clear();
+	out_tiles.reserve(keyedTiles.size());
+	for (const auto &keyedTile : keyedTiles)
+		out_tiles.push_back(keyedTile.second);
+}
+
+const char * TileScheduler::GetOrderName(TileOrder order)
+{
+	switch (order)
+	{
+	case TILE_ORDER_SCANLINE:	return "scanline";
+	case TILE_ORDER_MORTON:		return "morton";
+	case TILE_ORDER_HILBERT:	return "hilbert";
+	default:					return "unknown";
+	}
+}
+
+UINT32 TileScheduler::MortonCode(UINT32 x, UINT32 y)
+{
+	// interleave the lower 16 bits of x and y
+	auto spread = [](UINT32 v)
+	{
+		v &= 0x0000FFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	};
+	return spread(x) | (spread(y) << 1);
+}
+
+UINT32 TileScheduler::HilbertCode(UINT32 x, UINT32 y, UINT32 n)
+{
+	UINT32 d = 0;
+	for (UINT32 s = n / 2; s > 0; s /= 2)
+	{
+		UINT32 rx = (x & s) > 0;
+		UINT32 ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+
+		// rotate the quadrant
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			swap(x, y);
+		}
+	}
+	return d;
+}
\ No newline at end of file
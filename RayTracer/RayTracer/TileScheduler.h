@@ -0,0 +1,30 @@
+#pragma once
+
+enum TileOrder
+{
+	TILE_ORDER_SCANLINE = 0,
+	TILE_ORDER_MORTON,
+	TILE_ORDER_HILBERT,
+};
+
+// [m_x0, m_x1) x [m_y0, m_y1) in pixels
+struct Tile
+{
+	UINT32							m_x0;
+	UINT32							m_y0;
+	UINT32							m_x1;
+	UINT32							m_y1;
+};
+
+// Splits an image into tiles, ordered along a space filling curve
+// so that consecutive tiles, and therefore the ones a thread picks up, stay close on screen.
+class TileScheduler
+{
+public:
+	static void						GenerateTiles(UINT32 width, UINT32 height, UINT32 tileWidth, UINT32 tileHeight, TileOrder order, std::vector<Tile> &out_tiles);
+	static const char *				GetOrderName(TileOrder order);
+
+private:
+	static UINT32					MortonCode(UINT32 x, UINT32 y);
+	static UINT32					HilbertCode(UINT32 x, UINT32 y, UINT32 n);
+};
\ No newline at end of file
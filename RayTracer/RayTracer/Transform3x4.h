@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Vec3.h"
+#include "AABB.h"
+
+// Affine transform as 3 rows of 4 floats, the 3x3 linear part and the translation in the last column.
+// Points are column vectors: p' = M * p.
+struct Transform3x4
+{
+	float						m_rows[3][4];
+
+	static Transform3x4			Identity();
+	static Transform3x4			Translation(const Vec3 &offset);
+	static Transform3x4			Scaling(const Vec3 &scale);
+	// the rotation of RotatedInstance, right handed, around the x (0), y (1) or z (2) axis
+	static Transform3x4			Rotation(float angle, UINT32 axis);
+	// T * Rz * Ry * Rx * S, the order of the objects and of the viewer
+	static Transform3x4			FromTranslationRotationScaling(const Vec3 &translation, const Vec3 &rotation, const Vec3 &scaling);
+
+	Transform3x4				operator*(const Transform3x4 &other) const;
+	Transform3x4				Inverse() const;
+
+	inline Vec3					TransformPoint(const Vec3 &p) const
+	{
+		return Vec3(
+			m_rows[0][0] * p.x() + m_rows[0][1] * p.y() + m_rows[0][2] * p.z() + m_rows[0][3],
+			m_rows[1][0] * p.x() + m_rows[1][1] * p.y() + m_rows[1][2] * p.z() + m_rows[1][3],
+			m_rows[2][0] * p.x() + m_rows[2][1] * p.y() + m_rows[2][2] * p.z() + m_rows[2][3]);
+	}
+
+	inline Vec3					TransformVector(const Vec3 &v) const
+	{
+		return Vec3(
+			m_rows[0][0] * v.x() + m_rows[0][1] * v.y() + m_rows[0][2] * v.z(),
+			m_rows[1][0] * v.x() + m_rows[1][1] * v.y() + m_rows[1][2] * v.z(),
+			m_rows[2][0] * v.x() + m_rows[2][1] * v.y() + m_rows[2][2] * v.z());
+	}
+
+	// normals go through the transposed inverse, so this is called on the inverse transform, the result is not normalized
+	inline Vec3					TransformNormalByInverse(const Vec3 &n) const
+	{
+		return Vec3(
+			m_rows[0][0] * n.x() + m_rows[1][0] * n.y() + m_rows[2][0] * n.z(),
+			m_rows[0][1] * n.x() + m_rows[1][1] * n.y() + m_rows[2][1] * n.z(),
+			m_rows[0][2] * n.x() + m_rows[1][2] * n.y() + m_rows[2][2] * n.z());
+	}
+
+	// the box around the transformed box, from its center and half extent (Arvo)
+	AABB						TransformAABB(const AABB &box) const;
+};
+
+inline Transform3x4 Transform3x4::Identity()
+{
+	return Scaling(Vec3(1.0f, 1.0f, 1.0f));
+}
+
+inline Transform3x4 Transform3x4::Translation(const Vec3 &offset)
+{
+	Transform3x4 transform = Identity();
+	for (UINT32 row = 0; row < 3; row++)
+		transform.m_rows[row][3] = offset[row];
+	return transform;
+}
+
+inline Transform3x4 Transform3x4::Scaling(const Vec3 &scale)
+{
+	Transform3x4 transform;
+	for (UINT32 row = 0; row < 3; row++)
+	{
+		for (UINT32 column = 0; column < 4; column++)
+			transform.m_rows[row][column] = (row == column) ? scale[row] : 0.0f;
+	}
+	return transform;
+}
+
+inline Transform3x4 Transform3x4::Rotation(float angle, UINT32 axis)
+{
+	assert(axis < 3);
+	float sinTheta = sinf(angle);
+	float cosTheta = cosf(angle);
+	UINT32 a = (axis + 1) % 3;
+	UINT32 b = (axis + 2) % 3;
+
+	Transform3x4 transform = Identity();
+	transform.m_rows[a][a] = cosTheta;
+	transform.m_rows[a][b] = -sinTheta;
+	transform.m_rows[b][a] = sinTheta;
+	transform.m_rows[b][b] = cosTheta;
+	return transform;
+}
+
+inline Transform3x4 Transform3x4::FromTranslationRotationScaling(const Vec3 &translation, const Vec3 &rotation, const Vec3 &scaling)
+{
+	return Translation(translation) * Rotation(rotation[2], 2) * Rotation(rotation[1], 1) * Rotation(rotation[0], 0) * Scaling(scaling);
+}
+
+inline Transform3x4 Transform3x4::operator*(const Transform3x4 &other) const
+{
+	Transform3x4 transform;
+	for (UINT32 row = 0; row < 3; row++)
+	{
+		for (UINT32 column = 0; column < 4; column++)
+		{
+			transform.m_rows[row][column] = m_rows[row][0] * other.m_rows[0][column] + m_rows[row][1] * other.m_rows[1][column] + m_rows[row][2] * other.m_rows[2][column];
+			if (column == 3)
+				transform.m_rows[row][column] += m_rows[row][3];
+		}
+	}
+	return transform;
+}
+
+inline Transform3x4 Transform3x4::Inverse() const
+{
+	// the linear part by its adjugate, then the translation moved back through it
+	const float (&m)[3][4] = m_rows;
+	float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+		- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+		+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	assert(det != 0.0f && "Transform is not invertible");
+	float invDet = 1.0f / det;
+
+	Transform3x4 inverse;
+	inverse.m_rows[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * invDet;
+	inverse.m_rows[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+	inverse.m_rows[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+	inverse.m_rows[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * invDet;
+	inverse.m_rows[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+	inverse.m_rows[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+	inverse.m_rows[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * invDet;
+	inverse.m_rows[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+	inverse.m_rows[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+	for (UINT32 row = 0; row < 3; row++)
+		inverse.m_rows[row][3] = -(inverse.m_rows[row][0] * m[0][3] + inverse.m_rows[row][1] * m[1][3] + inverse.m_rows[row][2] * m[2][3]);
+	return inverse;
+}
+
+inline AABB Transform3x4::TransformAABB(const AABB &box) const
+{
+	Vec3 center = 0.5f * (box.m_min + box.m_max);
+	Vec3 halfExtent = 0.5f * (box.m_max - box.m_min);
+	Vec3 newCenter = TransformPoint(center);
+	Vec3 newHalfExtent(
+		fabsf(m_rows[0][0]) * halfExtent.x() + fabsf(m_rows[0][1]) * halfExtent.y() + fabsf(m_rows[0][2]) * halfExtent.z(),
+		fabsf(m_rows[1][0]) * halfExtent.x() + fabsf(m_rows[1][1]) * halfExtent.y() + fabsf(m_rows[1][2]) * halfExtent.z(),
+		fabsf(m_rows[2][0]) * halfExtent.x() + fabsf(m_rows[2][1]) * halfExtent.y() + fabsf(m_rows[2][2]) * halfExtent.z());
+	return AABB(newCenter - newHalfExtent, newCenter + newHalfExtent);
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "stdafx.h"
+#include "TriangleMeshHitable.h"
+#include "SimpleMesh.h"
+#include "Ray.h"
+
+using namespace std;
+
+TriangleMeshHitable::TriangleMeshHitable(const Mesh *mesh, float scale, ThreadPool *threadPool)
+{
+	assert(mesh->m_vertexStride == sizeof(SimpleMeshVertex) && mesh->m_primitiveType == kPrimitiveTypeTriList);
+
+	const SimpleMeshVertex *vertices = static_cast<const SimpleMeshVertex *>(mesh->m_vertexBuffer);
+	m_positions.resize(mesh->m_vertexCount);
+	m_normals.resize(mesh->m_vertexCount);
+	m_texCoords.resize(mesh->m_vertexCount);
+	for (UINT32 i = 0; i < mesh->m_vertexCount; i++)
+	{
+		const SimpleMeshVertex &vertex = vertices[i];
+		m_positions[i] = Vec3(vertex.m_position.x, vertex.m_position.y, vertex.m_position.z) * scale;
+		m_normals[i] = Vec3(vertex.m_normal.x, vertex.m_normal.y, vertex.m_normal.z);
+		m_texCoords[i] = { vertex.m_texture.x, vertex.m_texture.y };
+	}
+
+	m_indices.resize(mesh->m_indexCount);
+	for (UINT32 i = 0; i < mesh->m_indexCount; i++)
+	{
+		if (mesh->m_indexType == kIndexSize16)
+			m_indices[i] = static_cast<const UINT16 *>(mesh->m_indexBuffer)[i];
+		else
+			m_indices[i] = static_cast<const UINT32 *>(mesh->m_indexBuffer)[i];
+	}
+
+	vector<AABB> triangleBounds(GetTriangleCount());
+	for (UINT32 triangle = 0; triangle < GetTriangleCount(); triangle++)
+	{
+		const Vec3 &v0 = m_positions[m_indices[triangle * 3 + 0]];
+		const Vec3 &v1 = m_positions[m_indices[triangle * 3 + 1]];
+		const Vec3 &v2 = m_positions[m_indices[triangle * 3 + 2]];
+		triangleBounds[triangle] = CombineAABB(AABB(v0, v0), CombineAABB(AABB(v1, v1), AABB(v2, v2)));
+	}
+	m_bvh.Build(triangleBounds, LinearBVH::MAX_LEAF_PRIMITIVES, 1, threadPool);
+	m_boundingBox = m_bvh.BoundingBox();
+}
+
+TriangleMeshHitable::WatertightRay TriangleMeshHitable::SetupRay(const Ray &r)
+{
+	WatertightRay ray;
+	ray.m_org = r.m_org;
+
+	// z is the dominant axis of the direction, x and y are swapped to keep the winding when it points down
+	Vec3 absDir(fabsf(r.m_dir.x()), fabsf(r.m_dir.y()), fabsf(r.m_dir.z()));
+	ray.m_kz = absDir.x() > absDir.y() ? (absDir.x() > absDir.z() ? 0 : 2) : (absDir.y() > absDir.z() ? 1 : 2);
+	ray.m_kx = (ray.m_kz + 1) % 3;
+	ray.m_ky = (ray.m_kx + 1) % 3;
+	if (r.m_dir[ray.m_kz] < 0.0f)
+		swap(ray.m_kx, ray.m_ky);
+
+	ray.m_sx = r.m_dir[ray.m_kx] / r.m_dir[ray.m_kz];
+	ray.m_sy = r.m_dir[ray.m_ky] / r.m_dir[ray.m_kz];
+	ray.m_sz = 1.0f / r.m_dir[ray.m_kz];
+	return ray;
+}
+
+BOOL TriangleMeshHitable::IntersectTriangle(const WatertightRay &ray, UINT32 triangle, float t_min, float t_max, float &out_t, float out_barycentrics[3]) const
+{
+	Vec3 a = m_positions[m_indices[triangle * 3 + 0]] - ray.m_org;
+	Vec3 b = m_positions[m_indices[triangle * 3 + 1]] - ray.m_org;
+	Vec3 c = m_positions[m_indices[triangle * 3 + 2]] - ray.m_org;
+
+	float ax = a[ray.m_kx] - ray.m_sx * a[ray.m_kz];
+	float ay = a[ray.m_ky] - ray.m_sy * a[ray.m_kz];
+	float bx = b[ray.m_kx] - ray.m_sx * b[ray.m_kz];
+	float by = b[ray.m_ky] - ray.m_sy * b[ray.m_kz];
+	float cx = c[ray.m_kx] - ray.m_sx * c[ray.m_kz];
+	float cy = c[ray.m_ky] - ray.m_sy * c[ray.m_kz];
+
+	// scaled barycentrics, the edge functions of the sheared triangle
+	float u = cx * by - cy * bx;
+	float v = ax * cy - ay * cx;
+	float w = bx * ay - by * ax;
+	if (u == 0.0f || v == 0.0f || w == 0.0f)
+	{
+		// the ray goes through an edge or a vertex, the sign has to be exact
+		u = (float)((double)cx * (double)by - (double)cy * (double)bx);
+		v = (float)((double)ax * (double)cy - (double)ay * (double)cx);
+		w = (float)((double)bx * (double)ay - (double)by * (double)ax);
+	}
+
+	if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+		return FALSE;
+
+	float det = u + v + w;
+	if (det == 0.0f)
+		return FALSE;
+
+	float az = ray.m_sz * a[ray.m_kz];
+	float bz = ray.m_sz * b[ray.m_kz];
+	float cz = ray.m_sz * c[ray.m_kz];
+	float invDet = 1.0f / det;
+	float t = (u * az + v * bz + w * cz) * invDet;
+	if (t < t_min || t > t_max)
+		return FALSE;
+
+	out_t = t;
+	out_barycentrics[0] = u * invDet;
+	out_barycentrics[1] = v * invDet;
+	out_barycentrics[2] = w * invDet;
+	return TRUE;
+}
+
+BOOL TriangleMeshHitable::Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+{
+	WatertightRay ray = SetupRay(r);
+	return m_bvh.Hit(r, t_min, t_max, [&](UINT32 triangle, float t_min, float &t_max)
+	{
+		float t;
+		float barycentrics[3];
+		if (!IntersectTriangle(ray, triangle, t_min, t_max, t, barycentrics))
+			return FALSE;
+		t_max = t;
+		out_rec.m_time = t;
+		out_rec.m_primitiveID = triangle;
+		out_rec.m_b1 = barycentrics[1];
+		out_rec.m_b2 = barycentrics[2];
+		return TRUE;
+	});
+}
+
+void TriangleMeshHitable::ComputeAttributes(const Ray &r, HitRecord &io_rec) const
+{
+	const UINT32 *indices = &m_indices[io_rec.m_primitiveID * 3];
+	float b0 = 1.0f - io_rec.m_b1 - io_rec.m_b2;
+	float b1 = io_rec.m_b1;
+	float b2 = io_rec.m_b2;
+	io_rec.m_position = r.PointAt(io_rec.m_time);
+	io_rec.m_normal = normalize(b0 * m_normals[indices[0]] + b1 * m_normals[indices[1]] + b2 * m_normals[indices[2]]);
+	io_rec.m_u = b0 * m_texCoords[indices[0]].m_u + b1 * m_texCoords[indices[1]].m_u + b2 * m_texCoords[indices[2]].m_u;
+	io_rec.m_v = b0 * m_texCoords[indices[0]].m_v + b1 * m_texCoords[indices[1]].m_v + b2 * m_texCoords[indices[2]].m_v;
+	// square root of the ratio of the areas of the triangle in texture space and in object space
+	const TexCoord &t0 = m_texCoords[indices[0]];
+	float du1 = m_texCoords[indices[1]].m_u - t0.m_u, dv1 = m_texCoords[indices[1]].m_v - t0.m_v;
+	float du2 = m_texCoords[indices[2]].m_u - t0.m_u, dv2 = m_texCoords[indices[2]].m_v - t0.m_v;
+	float worldArea = cross(m_positions[indices[1]] - m_positions[indices[0]], m_positions[indices[2]] - m_positions[indices[0]]).length();
+	io_rec.m_uvDensity = (worldArea > 0.0f) ? sqrtf(fabsf(du1 * dv2 - du2 * dv1) / worldArea) : 0.0f;
+	io_rec.m_hitMaterial = m_material;
+}
+
+BOOL TriangleMeshHitable::Occluded(const Ray &r, float t_min, float t_max) const
+{
+	WatertightRay ray = SetupRay(r);
+	return m_bvh.Occluded(r, t_min, t_max, [&](UINT32 triangle, float t_min, float t_max)
+	{
+		float t;
+		float barycentrics[3];
+		return IntersectTriangle(ray, triangle, t_min, t_max, t, barycentrics);
+	});
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Hitables.h"
+#include "LinearBVH.h"
+
+class Mesh;
+
+// Triangle list of a SimpleMesh, with its own LinearBVH over the triangles.
+// The ray/triangle test is the watertight one of Woop, Benthin and Wald, rays through shared edges and vertices
+// cannot slip between the triangles of a closed mesh. Normals and UVs are interpolated from the vertices.
+class TriangleMeshHitable : public IHitable
+{
+public:
+	// the positions are scaled at build time, the mesh buffers are copied and can be released afterwards.
+	// The BVH is built by the threads of threadPool if any, see LinearBVH::Build
+	TriangleMeshHitable(const Mesh *mesh, float scale = 1.0f, ThreadPool *threadPool = nullptr);
+	// the closest triangle and its barycentrics, interpolated in ComputeAttributes
+	virtual BOOL				Intersect(const Ray &r, float t_min, float t_max, HitRecord &out_rec) const override;
+	virtual void				ComputeAttributes(const Ray &r, HitRecord &io_rec) const override;
+	// stops at the first triangle found, nothing is interpolated
+	virtual BOOL				Occluded(const Ray &r, float t_min, float t_max) const override;
+	virtual AABB				BoundingBox() const override { return m_boundingBox; }
+
+	inline UINT32				GetTriangleCount() const { return (UINT32)m_indices.size() / 3; }
+	inline const LinearBVH &	GetBVH() const { return m_bvh; }
+	// bytes of the vertex and index copies and of the BVH
+	inline size_t				GetMemorySize() const
+	{
+		return m_positions.size() * (sizeof(Vec3) * 2 + sizeof(TexCoord)) + m_indices.size() * sizeof(UINT32)
+			+ m_bvh.GetNodeCount() * sizeof(LinearBVHNode) + GetTriangleCount() * sizeof(UINT32);
+	}
+
+private:
+	struct TexCoord
+	{
+		float					m_u;
+		float					m_v;
+	};
+
+	// the ray sheared so that it points down +z from the origin, computed once per ray
+	struct WatertightRay
+	{
+		Vec3					m_org;
+		UINT32					m_kx, m_ky, m_kz;
+		float					m_sx, m_sy, m_sz;
+	};
+
+	static WatertightRay		SetupRay(const Ray &r);
+	// out_barycentrics are the weights of the three vertices
+	BOOL						IntersectTriangle(const WatertightRay &ray, UINT32 triangle, float t_min, float t_max, float &out_t, float out_barycentrics[3]) const;
+
+	std::vector<Vec3>			m_positions;
+	std::vector<Vec3>			m_normals;
+	std::vector<TexCoord>		m_texCoords;
+	std::vector<UINT32>			m_indices;		// 3 per triangle
+	LinearBVH					m_bvh;
+	AABB						m_boundingBox;
+};
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "stdafx.h"
+#include "TwoLevelBVH.h"
+#include "Hitables.h"
+
+using namespace std;
+
+UINT32 TwoLevelBVH::AddGeometry(const IHitable *geometry)
+{
+	m_geometries.push_back(geometry);
+	return (UINT32)m_geometries.size() - 1;
+}
+
+UINT32 TwoLevelBVH::AddMaterial(IMaterial *material)
+{
+	auto found = find(m_materials.begin(), m_materials.end(), material);
+	if (found != m_materials.end())
+		return (UINT32)(found - m_materials.begin());
+	m_materials.push_back(material);
+	return (UINT32)m_materials.size() - 1;
+}
+
+UINT32 TwoLevelBVH::AddInstance(UINT32 geometryIndex, const Transform3x4 &objectToWorld, UINT32 materialIndex, UINT32 userIndex)
+{
+	assert(geometryIndex < m_geometries.size() && materialIndex < m_materials.size());
+	BVHInstance instance;
+	instance.m_worldToObject = objectToWorld.Inverse();
+	instance.m_geometryIndex = geometryIndex;
+	instance.m_materialIndex = materialIndex;
+	instance.m_userIndex = userIndex;
+	instance.m_pad = 0;
+	m_instanceSlots.push_back((UINT32)m_instances.size());
+	m_instances.push_back(instance);
+	m_instanceBounds.push_back(objectToWorld.TransformAABB(m_geometries[geometryIndex]->BoundingBox()));
+	return (UINT32)m_instanceBounds.size() - 1;
+}
+
+void TwoLevelBVH::Build(ThreadPool *threadPool)
+{
+	m_tlas.Build(m_instanceBounds, LinearBVH::MAX_LEAF_PRIMITIVES, 1, threadPool);
+	ReorderToLeaves();
+}
+
+void TwoLevelBVH::ReorderToLeaves()
+{
+	// the leaves become contiguous ranges of instances
+	vector<BVHInstance> instances(m_instances.size());
+	for (size_t slot = 0; slot < m_instances.size(); slot++)
+		instances[slot] = m_instances[m_instanceSlots[m_tlas.GetPrimitiveIndex(slot)]];
+	for (size_t slot = 0; slot < m_instances.size(); slot++)
+		m_instanceSlots[m_tlas.GetPrimitiveIndex(slot)] = (UINT32)slot;
+	m_instances.swap(instances);
+}
+
+void TwoLevelBVH::SetInstanceTransform(UINT32 instanceID, const Transform3x4 &objectToWorld)
+{
+	BVHInstance &instance = m_instances[m_instanceSlots[instanceID]];
+	instance.m_worldToObject = objectToWorld.Inverse();
+	m_instanceBounds[instanceID] = objectToWorld.TransformAABB(m_geometries[instance.m_geometryIndex]->BoundingBox());
+}
+
+BOOL TwoLevelBVH::Refit(float rebuildSAHGrowth, ThreadPool *threadPool)
+{
+	if (!m_tlas.RefitOrRebuild(m_instanceBounds, rebuildSAHGrowth, threadPool))
+		return FALSE;
+	ReorderToLeaves();
+	return TRUE;
+}
+
+void TwoLevelBVH::Clear()
+{
+	m_geometries.clear();
+	m_materials.clear();
+	m_instances.clear();
+	m_instanceBounds.clear();
+	m_instanceSlots.clear();
+	m_tlas.Clear();
+}
+
+Ray TwoLevelBVH::ToObjectSpace(const BVHInstance &instance, const Ray &r) const
+{
+	// the direction is not normalized, so the distances along the ray are the same in both spaces
+	return Ray(instance.m_worldToObject.TransformPoint(r.m_org), instance.m_worldToObject.TransformVector(r.m_dir));
+}
+
+void TwoLevelBVH::ComputeAttributes(const BVHInstance &instance, const Ray &r, HitRecord &io_rec) const
+{
+	Ray objectRay = ToObjectSpace(instance, r);
+	m_geometries[instance.m_geometryIndex]->ComputeAttributes(objectRay, io_rec);
+	// the scale of the instance along the ray, the density is per object unit
+	io_rec.m_uvDensity *= objectRay.m_dir.length() / r.m_dir.length();
+	io_rec.m_position = r.PointAt(io_rec.m_time);
+	io_rec.m_normal = normalize(instance.m_worldToObject.TransformNormalByInverse(io_rec.m_normal));
+	io_rec.m_hitMaterial = m_materials[instance.m_materialIndex];
+}
+
+BOOL TwoLevelBVH::Hit(const Ray &r, float t_min, float &t_max, HitRecord &out_rec, BVHTraversalStats *stats, UINT32 *out_userIndex) const
+{
+	UINT32 closestInstance = 0;
+	BOOL hit = m_tlas.HitRanges(r, t_min, t_max, [&](UINT32 slot, UINT32 count, float t_min, float &t_max)
+	{
+		BOOL hitRange = FALSE;
+		for (UINT32 instance = slot; instance < slot + count; instance++)
+		{
+			const BVHInstance &bvhInstance = m_instances[instance];
+			if (m_geometries[bvhInstance.m_geometryIndex]->Intersect(ToObjectSpace(bvhInstance, r), t_min, t_max, out_rec))
+			{
+				t_max = out_rec.m_time;
+				closestInstance = instance;
+				hitRange = TRUE;
+			}
+		}
+		return hitRange;
+	}, stats);
+	if (!hit)
+		return FALSE;
+
+	// the attributes are evaluated once, for the closest instance only
+	ComputeAttributes(m_instances[closestInstance], r, out_rec);
+	if (out_userIndex)
+		*out_userIndex = m_instances[closestInstance].m_userIndex;
+	return TRUE;
+}
+
+BOOL TwoLevelBVH::HitInstance(UINT32 instanceIndex, const Ray &r, float t_min, float t_max, HitRecord &out_rec) const
+{
+	const BVHInstance &instance = m_instances[instanceIndex];
+	if (!m_geometries[instance.m_geometryIndex]->Intersect(ToObjectSpace(instance, r), t_min, t_max, out_rec))
+		return FALSE;
+
+	ComputeAttributes(instance, r, out_rec);
+	return TRUE;
+}
+
+BOOL TwoLevelBVH::Occluded(const Ray &r, float t_min, float t_max, BVHTraversalStats *stats) const
+{
+	return m_tlas.OccludedRanges(r, t_min, t_max, [&](UINT32 slot, UINT32 count, float t_min, float t_max)
+	{
+		for (UINT32 i = slot; i < slot + count; i++)
+		{
+			const BVHInstance &instance = m_instances[i];
+			if (m_geometries[instance.m_geometryIndex]->Occluded(ToObjectSpace(instance, r), t_min, t_max))
+				return TRUE;
+		}
+		return FALSE;
+	}, stats);
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "LinearBVH.h"
+#include "Transform3x4.h"
+
+class IHitable;
+class IMaterial;
+struct HitRecord;
+
+// 64 bytes, one cache line.
+// Only the world to object transform is kept, the hit position is taken on the world ray
+// and the normal goes through the transposed inverse, which is the transposed world to object transform.
+struct BVHInstance
+{
+	Transform3x4					m_worldToObject;
+	UINT32							m_geometryIndex;
+	UINT32							m_materialIndex;
+	UINT32							m_userIndex;		// whatever the caller wants to find the instance back with
+	UINT32							m_pad;
+};
+static_assert(sizeof(BVHInstance) == 64, "BVHInstance is expected to be 64 bytes");
+
+// Two-level acceleration structure.
+// The bottom level is any hitable in its object space, typically with its own BVH like TriangleMeshHitable,
+// added once and shared by all its instances. The top level is a LinearBVH over the world bounds of the instances,
+// so the memory grows with the unique geometry and by one BVHInstance per placement.
+// Geometries and materials are not owned.
+class TwoLevelBVH
+{
+public:
+	TwoLevelBVH() = default;
+	~TwoLevelBVH() = default;
+
+	UINT32							AddGeometry(const IHitable *geometry);
+	UINT32							AddMaterial(IMaterial *material);
+	// returns the id of the instance, its index in the order it was added
+	UINT32							AddInstance(UINT32 geometryIndex, const Transform3x4 &objectToWorld, UINT32 materialIndex, UINT32 userIndex = 0);
+	// builds the top level, by the threads of threadPool if any, the instances are reordered to the leaf order of the BVH
+	void							Build(ThreadPool *threadPool = nullptr);
+	void							Clear();
+
+	// animation, the instances are moved first, then the top level is refit once, TRUE when it was rebuilt, see LinearBVH::RefitOrRebuild
+	void							SetInstanceTransform(UINT32 instanceID, const Transform3x4 &objectToWorld);
+	BOOL							Refit(float rebuildSAHGrowth, ThreadPool *threadPool = nullptr);
+
+	// closest hit, the record is in world space and carries the material of the instance, out_userIndex the user index of the instance
+	BOOL							Hit(const Ray &r, float t_min, float &t_max, HitRecord &out_rec, BVHTraversalStats *stats = nullptr, UINT32 *out_userIndex = nullptr) const;
+	// any instance in [t_min, t_max], no record
+	BOOL							Occluded(const Ray &r, float t_min, float t_max, BVHTraversalStats *stats = nullptr) const;
+	// the ray goes through a single instance, no top level, instances are indexed in the leaf order
+	BOOL							HitInstance(UINT32 instanceIndex, const Ray &r, float t_min, float t_max, HitRecord &out_rec) const;
+
+	inline BOOL						IsEmpty() const { return m_instances.empty(); }
+	inline UINT32					GetGeometryCount() const { return (UINT32)m_geometries.size(); }
+	inline UINT32					GetInstanceCount() const { return (UINT32)m_instances.size(); }
+	inline const BVHInstance &		GetInstance(UINT32 instanceIndex) const { return m_instances[instanceIndex]; }
+	inline const AABB &				GetInstanceBounds(UINT32 instanceIndex) const { return m_instanceBounds[m_tlas.GetPrimitiveIndex(instanceIndex)]; }
+	inline const LinearBVH &		GetTLAS() const { return m_tlas; }
+	// bytes of the instances and of the top level, the geometries are not counted
+	inline size_t					GetMemorySize() const { return m_instances.size() * (sizeof(BVHInstance) + sizeof(AABB) + sizeof(UINT32) * 2) + m_tlas.GetNodeCount() * sizeof(LinearBVHNode); }
+
+private:
+	// the ray in the space of the geometry
+	Ray								ToObjectSpace(const BVHInstance &instance, const Ray &r) const;
+	// the attributes of a hit found by Intersect on the geometry, brought back to world space
+	void							ComputeAttributes(const BVHInstance &instance, const Ray &r, HitRecord &io_rec) const;
+	void							ReorderToLeaves();
+
+	std::vector<const IHitable *>	m_geometries;
+	std::vector<IMaterial *>		m_materials;
+	std::vector<BVHInstance>		m_instances;
+	std::vector<AABB>				m_instanceBounds;	// world space, by instance id
+	std::vector<UINT32>				m_instanceSlots;	// position in m_instances of every instance id
+	LinearBVH						m_tlas;
+};
\ No newline at end of file
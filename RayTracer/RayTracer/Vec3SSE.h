@@ -0,0 +1,131 @@
+#pragma once
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+// Vec3 backend on raw SSE intrinsics, w lane is kept as 0.
+// Reductions like dot and length stay in xmm registers and only the lane 0 is read back,
+// instead of storing the vector out and loading single float as XMVectorGetX does.
+// dpps is not used for the dot products, its latency made the whole backend slower than scalar.
+struct alignas(16) Vec3SSE
+{
+	union
+	{
+		__m128 m_simd;
+		float m_e[4];
+	};
+
+	Vec3SSE() = default;
+	Vec3SSE(float e0, float e1, float e2) { m_simd = _mm_set_ps(0.f, e2, e1, e0); }
+	Vec3SSE(__m128 simd) : m_simd(simd) {}
+
+	inline const float x() const { return _mm_cvtss_f32(m_simd); }
+	inline const float y() const { return _mm_cvtss_f32(_mm_shuffle_ps(m_simd, m_simd, _MM_SHUFFLE(1, 1, 1, 1))); }
+	inline const float z() const { return _mm_cvtss_f32(_mm_movehl_ps(m_simd, m_simd)); }
+	inline const float r() const { return x(); }
+	inline const float g() const { return y(); }
+	inline const float b() const { return z(); }
+
+	inline const Vec3SSE& operator+() const { return *this; }
+	inline const Vec3SSE operator-() const { return _mm_xor_ps(m_simd, _mm_set1_ps(-0.f)); }
+	inline const float operator[](size_t index) const { return m_e[index]; }
+	inline void set(size_t index, float f) { m_e[index] = f; }
+
+	inline Vec3SSE& operator+=(const Vec3SSE &v2) { m_simd = _mm_add_ps(m_simd, v2.m_simd); return *this; }
+	inline Vec3SSE& operator-=(const Vec3SSE &v2) { m_simd = _mm_sub_ps(m_simd, v2.m_simd); return *this; }
+	inline Vec3SSE& operator*=(const Vec3SSE &v2) { m_simd = _mm_mul_ps(m_simd, v2.m_simd); return *this; }
+	inline Vec3SSE& operator/=(const Vec3SSE &v2) { m_simd = _mm_div_ps(m_simd, v2.m_simd); return *this; }
+	inline Vec3SSE& operator*=(const float f) { m_simd = _mm_mul_ps(m_simd, _mm_set1_ps(f)); return *this; }
+	inline Vec3SSE& operator/=(const float f) { m_simd = _mm_mul_ps(m_simd, _mm_set1_ps(1.f / f)); return *this; }
+
+	// dot product of xyz, the result is in lane 0
+	static inline __m128 Dot3(__m128 v1, __m128 v2)
+	{
+		__m128 m = _mm_mul_ps(v1, v2);
+		__m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_movehl_ps(m, m);
+		return _mm_add_ss(_mm_add_ss(m, y), z);
+	}
+
+	// dot product of xyz, the result is in all 4 lanes
+	static inline __m128 Dot3Splat(__m128 v1, __m128 v2)
+	{
+		__m128 d = Dot3(v1, v2);
+		return _mm_shuffle_ps(d, d, _MM_SHUFFLE(0, 0, 0, 0));
+	}
+
+	inline const float length() const { return _mm_cvtss_f32(_mm_sqrt_ss(Dot3(m_simd, m_simd))); }
+	inline const float squared_length() const { return _mm_cvtss_f32(Dot3(m_simd, m_simd)); }
+	inline void normalize() { m_simd = _mm_div_ps(m_simd, _mm_sqrt_ps(Dot3Splat(m_simd, m_simd))); }
+	inline void zero() { m_simd = _mm_setzero_ps(); }
+	inline void clamp(const Vec3SSE &min, const Vec3SSE &max) { m_simd = _mm_min_ps(_mm_max_ps(m_simd, min.m_simd), max.m_simd); }
+};
+
+inline std::istream& operator>>(std::istream &is, Vec3SSE &v)
+{
+	float e0, e1, e2;
+	is >> e0 >> e1 >> e2;
+	v = Vec3SSE(e0, e1, e2);
+	return is;
+}
+
+inline std::ostream& operator<<(std::ostream &os, const Vec3SSE &v)
+{
+	os << "[" << v.x() << "," << v.y() << "," << v.z() << "]";
+	return os;
+}
+
+inline Vec3SSE operator+(const Vec3SSE &v1, const Vec3SSE &v2)
+{
+	return _mm_add_ps(v1.m_simd, v2.m_simd);
+}
+
+inline Vec3SSE operator-(const Vec3SSE &v1, const Vec3SSE &v2)
+{
+	return _mm_sub_ps(v1.m_simd, v2.m_simd);
+}
+
+inline Vec3SSE operator*(const Vec3SSE &v1, const Vec3SSE &v2)
+{
+	return _mm_mul_ps(v1.m_simd, v2.m_simd);
+}
+
+inline Vec3SSE operator/(const Vec3SSE &v1, const Vec3SSE &v2)
+{
+	return _mm_div_ps(v1.m_simd, v2.m_simd);
+}
+
+inline Vec3SSE operator*(float f, const Vec3SSE &v)
+{
+	return _mm_mul_ps(v.m_simd, _mm_set1_ps(f));
+}
+
+inline Vec3SSE operator*(const Vec3SSE &v, float f)
+{
+	return _mm_mul_ps(v.m_simd, _mm_set1_ps(f));
+}
+
+inline Vec3SSE operator/(const Vec3SSE &v, float f)
+{
+	return _mm_mul_ps(v.m_simd, _mm_set1_ps(1.f / f));
+}
+
+inline float dot(const Vec3SSE &v1, const Vec3SSE &v2)
+{
+	return _mm_cvtss_f32(Vec3SSE::Dot3(v1.m_simd, v2.m_simd));
+}
+
+inline Vec3SSE cross(const Vec3SSE &v1, const Vec3SSE &v2)
+{
+	// (y1 * z2 - z1 * y2, z1 * x2 - x1 * z2, x1 * y2 - y1 * x2)
+	__m128 a = _mm_shuffle_ps(v1.m_simd, v1.m_simd, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b = _mm_shuffle_ps(v2.m_simd, v2.m_simd, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 c = _mm_shuffle_ps(v1.m_simd, v1.m_simd, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 d = _mm_shuffle_ps(v2.m_simd, v2.m_simd, _MM_SHUFFLE(3, 0, 2, 1));
+	return _mm_sub_ps(_mm_mul_ps(a, b), _mm_mul_ps(c, d));
+}
+
+inline Vec3SSE normalize(const Vec3SSE &v)
+{
+	return _mm_div_ps(v.m_simd, _mm_sqrt_ps(Vec3SSE::Dot3Splat(v.m_simd, v.m_simd)));
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+// Vec3 backend on plain floats, the fallback for hosts without SSE
+struct Vec3Scalar
+{
+	float m_e[3];
+
+	Vec3Scalar() = default;
+	Vec3Scalar(float e0, float e1, float e2) { m_e[0] = e0; m_e[1] = e1; m_e[2] = e2; }
+
+	inline const float x() const { return m_e[0]; }
+	inline const float y() const { return m_e[1]; }
+	inline const float z() const { return m_e[2]; }
+	inline const float r() const { return m_e[0]; }
+	inline const float g() const { return m_e[1]; }
+	inline const float b() const { return m_e[2]; }
+
+	inline const Vec3Scalar& operator+() const { return *this; }
+	inline const Vec3Scalar operator-() const { return Vec3Scalar(-m_e[0], -m_e[1], -m_e[2]); }
+	inline const float operator[](size_t index) const { return m_e[index]; }
+	inline void set(size_t index, float f) { m_e[index] = f; }
+
+	inline Vec3Scalar& operator+=(const Vec3Scalar &v2) { m_e[0] += v2.m_e[0]; m_e[1] += v2.m_e[1]; m_e[2] += v2.m_e[2]; return *this; }
+	inline Vec3Scalar& operator-=(const Vec3Scalar &v2) { m_e[0] -= v2.m_e[0]; m_e[1] -= v2.m_e[1]; m_e[2] -= v2.m_e[2]; return *this; }
+	inline Vec3Scalar& operator*=(const Vec3Scalar &v2) { m_e[0] *= v2.m_e[0]; m_e[1] *= v2.m_e[1]; m_e[2] *= v2.m_e[2]; return *this; }
+	inline Vec3Scalar& operator/=(const Vec3Scalar &v2) { m_e[0] /= v2.m_e[0]; m_e[1] /= v2.m_e[1]; m_e[2] /= v2.m_e[2]; return *this; }
+	inline Vec3Scalar& operator*=(const float f) { m_e[0] *= f; m_e[1] *= f; m_e[2] *= f; return *this; }
+	inline Vec3Scalar& operator/=(const float f) { return *this *= (1.f / f); }
+
+	inline const float length() const { return sqrtf(squared_length()); }
+	inline const float squared_length() const { return m_e[0] * m_e[0] + m_e[1] * m_e[1] + m_e[2] * m_e[2]; }
+	inline void normalize() { *this /= length(); }
+	inline void zero() { m_e[0] = m_e[1] = m_e[2] = 0.f; }
+	inline void clamp(const Vec3Scalar &min, const Vec3Scalar &max)
+	{
+		for (UINT32 i = 0; i < 3; i++)
+			m_e[i] = (m_e[i] < min.m_e[i]) ? min.m_e[i] : ((m_e[i] > max.m_e[i]) ? max.m_e[i] : m_e[i]);
+	}
+};
+
+inline std::istream& operator>>(std::istream &is, Vec3Scalar &v)
+{
+	is >> v.m_e[0] >> v.m_e[1] >> v.m_e[2];
+	return is;
+}
+
+inline std::ostream& operator<<(std::ostream &os, const Vec3Scalar &v)
+{
+	os << "[" << v.m_e[0] << "," << v.m_e[1] << "," << v.m_e[2] << "]";
+	return os;
+}
+
+inline Vec3Scalar operator+(const Vec3Scalar &v1, const Vec3Scalar &v2)
+{
+	return Vec3Scalar(v1.m_e[0] + v2.m_e[0], v1.m_e[1] + v2.m_e[1], v1.m_e[2] + v2.m_e[2]);
+}
+
+inline Vec3Scalar operator-(const Vec3Scalar &v1, const Vec3Scalar &v2)
+{
+	return Vec3Scalar(v1.m_e[0] - v2.m_e[0], v1.m_e[1] - v2.m_e[1], v1.m_e[2] - v2.m_e[2]);
+}
+
+inline Vec3Scalar operator*(const Vec3Scalar &v1, const Vec3Scalar &v2)
+{
+	return Vec3Scalar(v1.m_e[0] * v2.m_e[0], v1.m_e[1] * v2.m_e[1], v1.m_e[2] * v2.m_e[2]);
+}
+
+inline Vec3Scalar operator/(const Vec3Scalar &v1, const Vec3Scalar &v2)
+{
+	return Vec3Scalar(v1.m_e[0] / v2.m_e[0], v1.m_e[1] / v2.m_e[1], v1.m_e[2] / v2.m_e[2]);
+}
+
+inline Vec3Scalar operator*(float f, const Vec3Scalar &v)
+{
+	return Vec3Scalar(v.m_e[0] * f, v.m_e[1] * f, v.m_e[2] * f);
+}
+
+inline Vec3Scalar operator*(const Vec3Scalar &v, float f)
+{
+	return Vec3Scalar(v.m_e[0] * f, v.m_e[1] * f, v.m_e[2] * f);
+}
+
+inline Vec3Scalar operator/(const Vec3Scalar &v, float f)
+{
+	return v * (1.f / f);
+}
+
+inline float dot(const Vec3Scalar &v1, const Vec3Scalar &v2)
+{
+	return v1.m_e[0] * v2.m_e[0] + v1.m_e[1] * v2.m_e[1] + v1.m_e[2] * v2.m_e[2];
+}
+
+inline Vec3Scalar cross(const Vec3Scalar &v1, const Vec3Scalar &v2)
+{
+	return Vec3Scalar(
+		v1.m_e[1] * v2.m_e[2] - v1.m_e[2] * v2.m_e[1],
+		v1.m_e[2] * v2.m_e[0] - v1.m_e[0] * v2.m_e[2],
+		v1.m_e[0] * v2.m_e[1] - v1.m_e[1] * v2.m_e[0]);
+}
+
+inline Vec3Scalar normalize(const Vec3Scalar &v)
+{
+	return v / v.length();
+}
@@ -2,19 +2,25 @@
 #include "World.h"
 #include "SimpleObject.h"
 #include "Hitables.h"
+#include "TriangleMeshHitable.h"
 #include "Randomizer.h"
+#if !defined(HEADLESS_RENDERING)
 #include "D3D12Viewer.h"
 #include "D3D12Helper.h"
+#endif
 #include "SimpleCamera.h"
 #include "LightSources.h"
 #include "Resouces.h"
 #include "Materials.h"
+#include "Ray.h"
+#include "SimpleMotion.h"
 
 using namespace std;
 
-void World::ConstructWorld(WorldID wid, SimpleCamera *camera)
+void World::ConstructWorld(WorldID wid, SimpleCamera *camera, ThreadPool *threadPool)
 {
 	cout << "[World] ConstructWorld" << endl;
+	m_threadPool = threadPool;
 	m_resources = new Resources();
 	m_resources->Load();
 
@@ -23,14 +29,15 @@ void World::ConstructWorld(WorldID wid, SimpleCamera *camera)
 	switch (wid)
 	{
 	case WORLD_ID_RANDOM_SPHERES:
+	case WORLD_ID_BOUNCING_SPHERES:
 	{
 		// ground
-		objects.push_back(new SimpleObjectSphere(Vec3(0.0f, -1000.0f, -0.0f), 1000.0f, m_resources->GetTheMesh(MESH_ID_HIGH_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN0), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.0f, -1000.0f, -0.0f), 1000.0f, m_resources->GetTheMesh(MESH_ID_HIGH_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN0), this));
 
 		// bigger spheres
-		objects.push_back(new SimpleObjectSphere(Vec3(-4.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN1), this));
-		objects.push_back(new SimpleObjectSphere(Vec3(0.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_DIELECTRIC), this));
-		objects.push_back(new SimpleObjectSphere(Vec3(4.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_METAL), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(-4.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN1), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_DIELECTRIC), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(4.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_METAL), this));
 
 		// random smaller spheres
 #if 1
@@ -54,7 +61,13 @@ void World::ConstructWorld(WorldID wid, SimpleCamera *camera)
 						materialID = (MaterialUniqueID)(UINT32)(MATERIAL_ID_RANDOM_METAL_START + Randomizer::RandomUNorm() * MATERIAL_ID_RANDOM_METAL_COUNT);
 					}
 
-					objects.push_back(new SimpleObjectSphere(center, 0.2f, m_resources->GetTheMesh(MESH_ID_LOW_POLYGON_SPHERE), m_resources->GetTheMaterial(materialID), this));
+					objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, center, 0.2f, m_resources->GetTheMesh(MESH_ID_LOW_POLYGON_SPHERE), m_resources->GetTheMaterial(materialID), this));
+					if (wid == WORLD_ID_BOUNCING_SPHERES)
+					{
+						// up and down at their own pace, not drawn from the Randomizer so that the scene is the same as the random one
+						float pace = (float)(((a + 11) * 7 + (b + 11) * 3) % 10) / 10.0f;
+						objects.back()->m_motion = new SimpleMotionPingpong(Vec3(0.0f, 1.0f, 0.0f), 3.0f + 2.0f * pace, 0.0f, 1.5f + pace);
+					}
 				}
 			}
 		}
@@ -66,35 +79,103 @@ void World::ConstructWorld(WorldID wid, SimpleCamera *camera)
 		break;
 	}
 
+	case WORLD_ID_MANY_LIGHTS:
+	{
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.0f, -1000.0f, -0.0f), 1000.0f, m_resources->GetTheMesh(MESH_ID_HIGH_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN0), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(-4.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN1), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_DIELECTRIC), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(4.0f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_METAL), this));
+
+		// small red, green and blue lights floating low over a wide ground, away from the big spheres,
+		// a shading point is mostly lit by the few lights next to it
+		const MaterialUniqueID lightMaterials[] = { MATERIAL_ID_LIGHTSOURCE_RED, MATERIAL_ID_LIGHTSOURCE_GREEN, MATERIAL_ID_LIGHTSOURCE_BLUE };
+		UINT32 lightCount = 0;
+		while (lightCount < MANY_LIGHTS_COUNT)
+		{
+			Vec3 center(80.0f * Randomizer::RandomUNorm() - 40.0f, 0.05f + 0.95f * Randomizer::RandomUNorm(), 80.0f * Randomizer::RandomUNorm() - 40.0f);
+			MaterialUniqueID materialID = lightMaterials[(UINT32)(Randomizer::RandomUNorm() * 3.0f) % 3];
+			if ((center - Vec3(-4.0f, 1.0f, 0.0f)).length() < 1.1f || (center - Vec3(0.0f, 1.0f, 0.0f)).length() < 1.1f || (center - Vec3(4.0f, 1.0f, 0.0f)).length() < 1.1f)
+				continue;
+
+			objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, center, 0.02f, m_resources->GetTheMesh(MESH_ID_LOW_POLYGON_SPHERE), m_resources->GetTheMaterial(materialID), this));
+			lightCount++;
+		}
+
+		// no depth of field, the lights out of focus would cover the image
+		m_lightSources = new LightSources(this, objects, Vec3(0.0f, 0.0f, 0.0f));
+		camera->Initialize(Vec3(11.0f, 2.0f, 3.0f), Vec3(0.0f, 0.6f, 0.0f), 20.0f, 1.0f, 10000.0f, 0.0f, 10.0f, 1.0f);
+
+		break;
+	}
+
+	case WORLD_ID_TEXTURED:
+	{
+		// ground of 2x2 tiles, each with the whole texture, far enough to be minified many times toward the horizon
+		const int halfTileCount = 12;
+		const float tileSize = 2.0f;
+		for (int a = -halfTileCount; a < halfTileCount; a++)
+		{
+			for (int b = -halfTileCount; b < halfTileCount; b++)
+			{
+				Vec3 center((a + 0.5f) * tileSize, 0.0f, (b + 0.5f) * tileSize);
+				objects.push_back(SceneArena::New<SimpleObjectRect>(GetSceneArena(), SCENE_ARENA_OBJECTS, XZ_RECT, center, Vec3(0.0f, 0.0f, 0.0f), tileSize, tileSize, FALSE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_IMAGE_BASED_CHECKER_DIFFUSE), this));
+			}
+		}
+
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(-2.2f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_IMAGE_BASED_CHECKER_DIFFUSE), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.0f, 1.0f, -1.5f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_DIELECTRIC), this));
+		objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(2.2f, 1.0f, 0.0f), 1.0f, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_IMAGE_BASED_METAL_CHECKER), this));
+
+		m_lightSources = new LightSources(this, objects, Vec3(0.85f, 0.9f, 1.0f));
+		camera->Initialize(Vec3(0.0f, 1.2f, 9.0f), Vec3(0.0f, 0.6f, 0.0f), 30.0f, 1.0f, 10000.0f, 0.0f, 10.0f, 1.0f);
+
+		break;
+	}
+
 	case WORLD_ID_CORNELL_BOX:
+	case WORLD_ID_CORNELL_BOX_MESHES:
 	{
 		// light on the top
-		objects.push_back(new SimpleObjectRect(XZ_RECT, Vec3(0.0f, 0.99f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 0.65f, 0.65f, TRUE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LIGHTSOURCE_BRIGHT), this));
+		objects.push_back(SceneArena::New<SimpleObjectRect>(GetSceneArena(), SCENE_ARENA_OBJECTS, XZ_RECT, Vec3(0.0f, 0.99f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 0.65f, 0.65f, TRUE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LIGHTSOURCE_BRIGHT), this));
 
 		// red wall at the right
-		objects.push_back(new SimpleObjectRect(ZY_RECT, Vec3(1.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, TRUE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN4), this));
+		objects.push_back(SceneArena::New<SimpleObjectRect>(GetSceneArena(), SCENE_ARENA_OBJECTS, ZY_RECT, Vec3(1.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, TRUE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN4), this));
 		// green wall at the left
-		objects.push_back(new SimpleObjectRect(ZY_RECT, Vec3(-1.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, FALSE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN2), this));
+		objects.push_back(SceneArena::New<SimpleObjectRect>(GetSceneArena(), SCENE_ARENA_OBJECTS, ZY_RECT, Vec3(-1.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, FALSE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN2), this));
 		// white floor, background and ceiling
-		objects.push_back(new SimpleObjectRect(XY_RECT, Vec3(0.0f, 0.0f, -1.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, FALSE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
-		objects.push_back(new SimpleObjectRect(XZ_RECT, Vec3(0.0f, 1.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, TRUE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
-		objects.push_back(new SimpleObjectRect(XZ_RECT, Vec3(0.0f, -1.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, FALSE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
+		objects.push_back(SceneArena::New<SimpleObjectRect>(GetSceneArena(), SCENE_ARENA_OBJECTS, XY_RECT, Vec3(0.0f, 0.0f, -1.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, FALSE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
+		objects.push_back(SceneArena::New<SimpleObjectRect>(GetSceneArena(), SCENE_ARENA_OBJECTS, XZ_RECT, Vec3(0.0f, 1.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, TRUE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
+		objects.push_back(SceneArena::New<SimpleObjectRect>(GetSceneArena(), SCENE_ARENA_OBJECTS, XZ_RECT, Vec3(0.0f, -1.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), 2.0f, 2.0f, FALSE, m_resources->GetTheMesh(MESH_ID_QUAD), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
+
+		if (wid == WORLD_ID_CORNELL_BOX_MESHES)
+		{
+			// the same scene with the triangle meshes of the viewer in place of the analytic shapes
+			float r = 0.32f;
+			objects.push_back(SceneArena::New<SimpleObjectMesh>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(-0.38f, -1.0f + r, -0.35f), Vec3(0.0f, 0.0f, 0.0f), r, m_resources->GetTheMesh(MESH_ID_HIGH_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_CORNELL_BALL1), this));
+			objects.push_back(SceneArena::New<SimpleObjectMesh>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.0f, -1.0f + r, 0.50f), Vec3(0.0f, 0.0f, 0.0f), r, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_DIELECTRIC), this));
+			float side = 0.5f;
+			objects.push_back(SceneArena::New<SimpleObjectMesh>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.38f, -1.0f + side * 0.5f, -0.35f), Vec3(0.0f, 0.4f, 0.0f), side, m_resources->GetTheMesh(MESH_ID_CUBE), m_resources->GetTheMaterial(MATERIAL_ID_METAL), this));
 
+			camera->Initialize(Vec3(0.0f, 0.64f, 4.63f), Vec3(0.0f, -0.26f, -1.0f), 30.0f, 1.0f, 10000.0f, 0.0f, 10.0f, 1.0f);
+		}
+		else
+		{
 #if 0
-		float height = 1.2f;
-		objects.push_back(new SimpleObjectCube(Vec3(-0.3f, -1.0f + height * 0.5f, -0.4f), Vec3(0.0f, 0.3f, 0.0f), Vec3(0.6f, height, 0.6f), m_resources->GetTheMesh(MESH_ID_CUBE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
-		height = 0.6f;
-		objects.push_back(new SimpleObjectCube(Vec3(0.32f, -1.0f + height * 0.5f, 0.4f), Vec3(0.0f, -0.3f, 0.0f), Vec3(height, height, height), m_resources->GetTheMesh(MESH_ID_CUBE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
+			float height = 1.2f;
+			objects.push_back(SceneArena::New<SimpleObjectCube>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(-0.3f, -1.0f + height * 0.5f, -0.4f), Vec3(0.0f, 0.3f, 0.0f), Vec3(0.6f, height, 0.6f), m_resources->GetTheMesh(MESH_ID_CUBE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
+			height = 0.6f;
+			objects.push_back(SceneArena::New<SimpleObjectCube>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.32f, -1.0f + height * 0.5f, 0.4f), Vec3(0.0f, -0.3f, 0.0f), Vec3(height, height, height), m_resources->GetTheMesh(MESH_ID_CUBE), m_resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN3), this));
 	
-		camera->Initialize(Vec3(0.0f, 0.0f, 4.0f), Vec3(0.0f, 0.0f, 0.0f), 40.0f, 1.0f, 10000.0f, 0.0f, 10.0f, 1.0f);
+			camera->Initialize(Vec3(0.0f, 0.0f, 4.0f), Vec3(0.0f, 0.0f, 0.0f), 40.0f, 1.0f, 10000.0f, 0.0f, 10.0f, 1.0f);
 #else
-		float r = 0.32f;
-		objects.push_back(new SimpleObjectSphere(Vec3(-0.38f, -1.0f + r, -0.35f), r, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_CORNELL_BALL1), this));
-		objects.push_back(new SimpleObjectSphere(Vec3(0.0f, -1.0f + r, 0.50f), r, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_DIELECTRIC), this));
-		objects.push_back(new SimpleObjectSphere(Vec3(0.38f, -1.0f + r, -0.35f), r, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_CORNELL_BALL2), this));
+			float r = 0.32f;
+			objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(-0.38f, -1.0f + r, -0.35f), r, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_CORNELL_BALL1), this));
+			objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.0f, -1.0f + r, 0.50f), r, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_DIELECTRIC), this));
+			objects.push_back(SceneArena::New<SimpleObjectSphere>(GetSceneArena(), SCENE_ARENA_OBJECTS, Vec3(0.38f, -1.0f + r, -0.35f), r, m_resources->GetTheMesh(MESH_ID_MEDIUM_POLYGON_SPHERE), m_resources->GetTheMaterial(MATERIAL_ID_CORNELL_BALL2), this));
 
-		camera->Initialize(Vec3(0.0f, 0.64f, 4.63f), Vec3(0.0f, -0.26f, -1.0f), 30.0f, 1.0f, 10000.0f, 0.0f, 10.0f, 1.0f);
+			camera->Initialize(Vec3(0.0f, 0.64f, 4.63f), Vec3(0.0f, -0.26f, -1.0f), 30.0f, 1.0f, 10000.0f, 0.0f, 10.0f, 1.0f);
 #endif
+		}
 
 		m_lightSources = new LightSources(this, objects, Vec3(0.0f, 0.0f, 0.0f));
 
@@ -106,19 +187,518 @@ void World::ConstructWorld(WorldID wid, SimpleCamera *camera)
 	}
 
 	m_objectsCount = objects.size();
-	m_objectBVHTree = new SimpleObjectBVHNode(objects);
+	m_objects = objects;
+
+	// the other structures are only for the comparisons of the benchmarks, built when they select them
+	BuildAccelerationStructure(m_accelerationStructure);
+#if !defined(HEADLESS_RENDERING)
+	// the viewer updates and draws the objects through the tree
+	BuildAccelerationStructure(ACCELERATION_OBJECT_TREE);
+#endif
+
+	if (m_sceneArenaEnabled)
+	{
+		cout << "[World] SceneArena: " << m_sceneArena.GetBytesReserved() / 1024 << " KB reserved";
+		for (UINT32 i = 0; i < SCENE_ARENA_CATEGORY_COUNT; i++)
+		{
+			SceneArenaCategory category = (SceneArenaCategory)i;
+			cout << ", " << SceneArena::GetCategoryName(category) << " " << m_sceneArena.GetBytesUsed(category) << " bytes in " << m_sceneArena.GetAllocationCount(category);
+		}
+		cout << endl;
+	}
+}
+
+void World::SetAccelerationStructure(AccelerationStructure accel)
+{
+	m_accelerationStructure = accel;
+	if (!m_objects.empty())
+		BuildAccelerationStructure(accel);
+}
+
+void World::BuildAccelerationStructure(AccelerationStructure accel)
+{
+	assert(!m_objects.empty());
+	if (IsBuilt(accel))
+		return;
+
+	if (accel != ACCELERATION_OBJECT_TREE && m_packetPrimitives.empty())
+		BuildPacketPrimitives();
+
+	switch (accel)
+	{
+	case ACCELERATION_LINEAR_BVH:
+		BuildSphereStore();
+		break;
+
+	case ACCELERATION_OBJECT_BVH:
+	{
+		vector<AABB> objectBounds;
+		objectBounds.reserve(m_objects.size());
+		for (Object *object : m_objects)
+			objectBounds.push_back(object->BoundingBox());
+		m_objectBVH.Build(objectBounds, LinearBVH::MAX_LEAF_PRIMITIVES, 1, m_threadPool);
+		cout << "[World] LinearBVH: " << m_objectBVH.GetNodeCount() << " nodes, " << m_objectBVH.GetLeafCount() << " leaves, depth " << m_objectBVH.GetMaxDepth() << ", SAH cost " << m_objectBVH.GetSAHCost() << endl;
+		break;
+	}
+
+	case ACCELERATION_OBJECT_TREE:
+		// from now on the tree owns the objects
+		m_objectBVHTree = SceneArena::New<SimpleObjectBVHNode>(GetSceneArena(), SCENE_ARENA_BVH_NODES, m_objects, GetSceneArena());
+		break;
+
+	case ACCELERATION_TWO_LEVEL:
+		BuildTwoLevelBVH();
+		break;
+
+	default:
+		assert(false);
+		break;
+	}
+	m_builtStructures |= 1u << accel;
+}
+
+BOOL World::Hit(const Ray &r, float t_min, float &t_max, HitRecord &out_rec, BVHTraversalStats *stats) const
+{
+	if (m_accelerationStructure == ACCELERATION_OBJECT_TREE)
+		return m_objectBVHTree->Hit(r, t_min, t_max, out_rec);
+
+	if (m_accelerationStructure == ACCELERATION_TWO_LEVEL)
+	{
+		UINT32 objectIndex;
+		if (!m_twoLevelBVH.Hit(r, t_min, t_max, out_rec, stats, &objectIndex))
+			return FALSE;
+		out_rec.m_hitObject = m_objects[objectIndex];
+		return TRUE;
+	}
+
+	// the attributes are only evaluated for the closest object, once the traversal is over
+	const Object *closestObject = nullptr;
+	if (m_accelerationStructure == ACCELERATION_OBJECT_BVH)
+	{
+		if (!m_objectBVH.Hit(r, t_min, t_max, [&](UINT32 primitiveIndex, float t_min, float &t_max)
+		{
+			const Object *hit = m_objects[primitiveIndex]->Intersect(r, t_min, t_max, out_rec);
+			if (hit)
+				closestObject = hit;
+			return hit != nullptr;
+		}, stats))
+			return FALSE;
+
+		closestObject->ComputeAttributes(r, out_rec);
+		return TRUE;
+	}
+
+	// the store only tells the closest sphere, the other objects are tested against its distance
+	UINT32 sphere = 0;
+	float closest = t_max;
+	BOOL hitSphere = m_sphereStore.Hit(r, t_min, closest, sphere, stats);
+
+	BVHTraversalStats otherStats;
+	BOOL hitOther = m_otherObjectBVH.Hit(r, t_min, closest, [&](UINT32 primitiveIndex, float t_min, float &t_max)
+	{
+		const Object *hit = m_objects[m_otherObjects[primitiveIndex]]->Intersect(r, t_min, t_max, out_rec);
+		if (hit)
+			closestObject = hit;
+		return hit != nullptr;
+	}, stats ? &otherStats : nullptr);
+	if (stats)
+	{
+		if (m_sphereStore.IsEmpty())
+			stats->m_rayCount += otherStats.m_rayCount;
+		stats->AccumulateNodes(otherStats);
+	}
+
+	if (hitOther)
+	{
+		closestObject->ComputeAttributes(r, out_rec);
+		t_max = closest;
+		return TRUE;
+	}
+	if (!hitSphere)
+		return FALSE;
+
+	// the record of the sphere, from the scalar test of its object
+	return m_objects[m_sphereStore.GetObjectIndex(sphere)]->Hit(r, t_min, t_max, out_rec);
+}
+
+BOOL World::Occluded(const Ray &r, float t_min, float t_max, BVHTraversalStats *stats) const
+{
+	if (m_accelerationStructure == ACCELERATION_OBJECT_TREE)
+		return m_objectBVHTree->Occluded(r, t_min, t_max);
+
+	if (m_accelerationStructure == ACCELERATION_TWO_LEVEL)
+		return m_twoLevelBVH.Occluded(r, t_min, t_max, stats);
+
+	if (m_accelerationStructure == ACCELERATION_OBJECT_BVH)
+	{
+		return m_objectBVH.Occluded(r, t_min, t_max, [&](UINT32 primitiveIndex, float t_min, float t_max)
+		{
+			return m_objects[primitiveIndex]->Occluded(r, t_min, t_max);
+		}, stats);
+	}
+
+	if (m_sphereStore.Occluded(r, t_min, t_max, stats))
+		return TRUE;
+
+	BVHTraversalStats otherStats;
+	BOOL occluded = m_otherObjectBVH.Occluded(r, t_min, t_max, [&](UINT32 primitiveIndex, float t_min, float t_max)
+	{
+		return m_objects[m_otherObjects[primitiveIndex]]->Occluded(r, t_min, t_max);
+	}, stats ? &otherStats : nullptr);
+	if (stats)
+	{
+		if (m_sphereStore.IsEmpty())
+			stats->m_rayCount += otherStats.m_rayCount;
+		stats->AccumulateNodes(otherStats);
+	}
+	return occluded;
+}
+
+template<UINT32 N>
+UINT32 World::HitPacket(RayPacket<N> &packet, float t_min, HitRecord *out_recs, BVHTraversalStats *stats) const
+{
+	UINT32 hitMask = 0;
+	if (m_accelerationStructure == ACCELERATION_OBJECT_TREE || m_accelerationStructure == ACCELERATION_TWO_LEVEL)
+	{
+		for (UINT32 lanes = packet.m_activeMask; lanes; lanes &= lanes - 1)
+		{
+			UINT32 lane = LowestBit(lanes);
+			if (Hit(packet.GetRay(lane), t_min, packet.m_tMax[lane], out_recs[lane], stats))
+				hitMask |= 1u << lane;
+		}
+		return hitMask;
+	}
+
+	// the kernels only tell the closest object of a lane, its record is filled by the scalar test at the end,
+	// unless the lane was last hit by a scalar test already, then only its attributes are left
+	float originalTMax[N];
+	memcpy(originalTMax, packet.m_tMax, sizeof(originalTMax));
+	UINT32 hitObjects[N];
+	UINT32 recordMask = 0;
+	alignas(16) float t[N];
+
+	auto recordHit = [&](UINT32 lane, UINT32 primitiveIndex, BOOL recorded)
+	{
+		hitObjects[lane] = primitiveIndex;
+		hitMask |= 1u << lane;
+		recordMask = recorded ? (recordMask | (1u << lane)) : (recordMask & ~(1u << lane));
+	};
+
+	auto leafHit = [&](UINT32 lane, UINT32 primitiveIndex, float t_min, float &t_max)
+	{
+		if (!m_objects[primitiveIndex]->Intersect(packet.GetRay(lane), t_min, t_max, out_recs[lane]))
+			return FALSE;
+		recordHit(lane, primitiveIndex, TRUE);
+		return TRUE;
+	};
+
+	auto leafPacket = [&](UINT32 primitiveIndex, UINT32 laneMask)
+	{
+		const PacketPrimitive &primitive = m_packetPrimitives[primitiveIndex];
+		UINT32 mask;
+		switch (primitive.m_type)
+		{
+		case PACKET_PRIMITIVE_SPHERE:
+			mask = IntersectSpherePacket(packet, primitive.m_translation, primitive.m_center, primitive.m_radius, t_min, t);
+			break;
+		case PACKET_PRIMITIVE_RECT:
+			mask = IntersectRectPacket(packet, primitive.m_translation, primitive.m_aAxis, primitive.m_bAxis, primitive.m_cAxis, primitive.m_a0, primitive.m_a1, primitive.m_b0, primitive.m_b1, primitive.m_c, t_min, t);
+			break;
+		default:
+			for (UINT32 lanes = laneMask; lanes; lanes &= lanes - 1)
+			{
+				UINT32 lane = LowestBit(lanes);
+				leafHit(lane, primitiveIndex, t_min, packet.m_tMax[lane]);
+			}
+			return;
+		}
+
+		for (UINT32 lanes = mask & laneMask; lanes; lanes &= lanes - 1)
+		{
+			UINT32 lane = LowestBit(lanes);
+			packet.m_tMax[lane] = t[lane];
+			recordHit(lane, primitiveIndex, FALSE);
+		}
+	};
+
+	// below a quarter of the lanes, never below 2, the packet is not worth keeping together
+	UINT32 minActiveLanes = max(2u, N / 4);
+	if (m_accelerationStructure == ACCELERATION_OBJECT_BVH)
+	{
+		m_objectBVH.HitPacket(packet, t_min, leafPacket, leafHit, minActiveLanes, stats);
+	}
+	else
+	{
+		m_sphereStore.HitPacket(packet, t_min, [&](UINT32 lane, UINT32 sphere)
+		{
+			recordHit(lane, m_sphereStore.GetObjectIndex(sphere), FALSE);
+		}, minActiveLanes, stats);
+
+		BVHTraversalStats otherStats;
+		m_otherObjectBVH.HitPacket(packet, t_min,
+			[&](UINT32 primitiveIndex, UINT32 laneMask) { leafPacket(m_otherObjects[primitiveIndex], laneMask); },
+			[&](UINT32 lane, UINT32 primitiveIndex, float t_min, float &t_max) { return leafHit(lane, m_otherObjects[primitiveIndex], t_min, t_max); },
+			minActiveLanes, stats ? &otherStats : nullptr);
+		if (stats)
+		{
+			if (m_sphereStore.IsEmpty())
+			{
+				stats->m_rayCount += otherStats.m_rayCount;
+				stats->m_packetCount += otherStats.m_packetCount;
+			}
+			stats->AccumulateNodes(otherStats);
+			stats->m_fallbackRays += otherStats.m_fallbackRays;
+		}
+	}
+
+	for (UINT32 lanes = hitMask & recordMask; lanes; lanes &= lanes - 1)
+	{
+		UINT32 lane = LowestBit(lanes);
+		m_objects[hitObjects[lane]]->ComputeAttributes(packet.GetRay(lane), out_recs[lane]);
+	}
+
+	for (UINT32 lanes = hitMask & ~recordMask; lanes; lanes &= lanes - 1)
+	{
+		UINT32 lane = LowestBit(lanes);
+		Ray r = packet.GetRay(lane);
+		float laneTMin = t_min;
+		float laneTMax = originalTMax[lane];
+		if (!m_objects[hitObjects[lane]]->Hit(r, laneTMin, laneTMax, out_recs[lane]))
+		{
+			// the kernel and the scalar test are expected to agree, if they ever do not, the scalar query decides
+			laneTMax = originalTMax[lane];
+			if (!Hit(r, t_min, laneTMax, out_recs[lane]))
+				hitMask &= ~(1u << lane);
+		}
+		packet.m_tMax[lane] = laneTMax;
+	}
+	return hitMask;
+}
+
+template UINT32 World::HitPacket<4>(RayPacket<4> &packet, float t_min, HitRecord *out_recs, BVHTraversalStats *stats) const;
+template UINT32 World::HitPacket<8>(RayPacket<8> &packet, float t_min, HitRecord *out_recs, BVHTraversalStats *stats) const;
+template UINT32 World::HitPacket<16>(RayPacket<16> &packet, float t_min, HitRecord *out_recs, BVHTraversalStats *stats) const;
+
+void World::BuildPacketPrimitives()
+{
+	m_packetPrimitives.assign(m_objects.size(), PacketPrimitive());
+	UINT32 packetPrimitiveCount = 0;
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		// the kernels repeat the math of exactly one translation, rotations are only skipped when they are identities
+		const TranslatedInstance *translated = dynamic_cast<const TranslatedInstance *>(m_objects[i]->m_hitable);
+		if (!translated)
+			continue;
+
+		const IHitable *hitable = translated->m_hitable;
+		while (const RotatedInstance *rotated = dynamic_cast<const RotatedInstance *>(hitable))
+		{
+			if (rotated->m_sinTheta != 0.0f || rotated->m_cosTheta != 1.0f)
+			{
+				hitable = nullptr;
+				break;
+			}
+			hitable = rotated->m_hitable;
+		}
+
+		PacketPrimitive &primitive = m_packetPrimitives[i];
+		for (UINT32 axis = 0; axis < 3; axis++)
+			primitive.m_translation[axis] = translated->m_offset[axis];
+
+		if (const SphereHitable *sphere = dynamic_cast<const SphereHitable *>(hitable))
+		{
+			primitive.m_type = PACKET_PRIMITIVE_SPHERE;
+			for (UINT32 axis = 0; axis < 3; axis++)
+				primitive.m_center[axis] = sphere->m_center[axis];
+			primitive.m_radius = sphere->m_radius;
+		}
+		else if (const AxisAlignedRectHitable *rect = dynamic_cast<const AxisAlignedRectHitable *>(hitable))
+		{
+			primitive.m_type = PACKET_PRIMITIVE_RECT;
+			primitive.m_aAxis = rect->m_aAxisIndex;
+			primitive.m_bAxis = rect->m_bAxisIndex;
+			primitive.m_cAxis = rect->m_cAxisIndex;
+			primitive.m_a0 = rect->m_a0;
+			primitive.m_a1 = rect->m_a1;
+			primitive.m_b0 = rect->m_b0;
+			primitive.m_b1 = rect->m_b1;
+			primitive.m_c = rect->m_c;
+		}
+
+		if (primitive.m_type != PACKET_PRIMITIVE_NONE)
+			packetPrimitiveCount++;
+	}
+	cout << "[World] Packet primitives: " << packetPrimitiveCount << " of " << m_objects.size() << " objects" << endl;
+}
+
+BOOL World::IsStoreSphere(size_t objectIndex) const
+{
+	// spheres centered on their translation, as SimpleObjectSphere makes them
+	const PacketPrimitive &primitive = m_packetPrimitives[objectIndex];
+	return primitive.m_type == PACKET_PRIMITIVE_SPHERE && primitive.m_center[0] == 0.0f && primitive.m_center[1] == 0.0f && primitive.m_center[2] == 0.0f;
+}
+
+void World::BuildSphereStore()
+{
+	m_sphereStore.Clear();
+	m_otherObjects.clear();
+	m_objectSpheres.assign(m_objects.size(), UINT32_MAX);
+	vector<AABB> otherBounds;
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		if (IsStoreSphere(i))
+		{
+			const PacketPrimitive &primitive = m_packetPrimitives[i];
+			Vec3 center(primitive.m_translation[0], primitive.m_translation[1], primitive.m_translation[2]);
+			m_objectSpheres[i] = m_sphereStore.AddSphere(center, primitive.m_radius, m_objects[i]->BoundingBox(), m_objects[i]->m_material, (UINT32)i);
+		}
+		else
+		{
+			m_otherObjects.push_back((UINT32)i);
+			otherBounds.push_back(m_objects[i]->BoundingBox());
+		}
+	}
+	m_sphereStore.Build(m_threadPool);
+	m_otherObjectBVH.Build(otherBounds, LinearBVH::MAX_LEAF_PRIMITIVES, 1, m_threadPool);
+
+	const LinearBVH &sphereBVH = m_sphereStore.GetBVH();
+	cout << "[World] SphereStore: " << m_sphereStore.GetSphereCount() << " spheres, " << sphereBVH.GetNodeCount() << " nodes, " << sphereBVH.GetLeafCount() << " leaves, depth " << sphereBVH.GetMaxDepth() << ", SAH cost " << sphereBVH.GetSAHCost()
+		<< ", other objects: " << m_otherObjects.size() << endl;
+}
+
+void World::BuildTwoLevelBVH()
+{
+	// the analytic spheres are instances of a single unit sphere and the meshes share one bottom level per Mesh,
+	// the other objects are their own geometry under an identity transform, see GetInstanceTransform
+	m_twoLevelBVH.Clear();
+	m_objectInstances.resize(m_objects.size());
+	UINT32 unitSphereGeometry = UINT32_MAX;
+	map<const Mesh *, UINT32> meshGeometries;
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		Object *object = m_objects[i];
+		UINT32 geometry;
+		if (IsStoreSphere(i))
+		{
+			if (unitSphereGeometry == UINT32_MAX)
+			{
+				m_sharedGeometries.push_back(SceneArena::New<SphereHitable>(GetSceneArena(), SCENE_ARENA_HITABLES, Vec3(0.0f, 0.0f, 0.0f), 1.0f));
+				unitSphereGeometry = m_twoLevelBVH.AddGeometry(m_sharedGeometries.back());
+			}
+			geometry = unitSphereGeometry;
+		}
+		else if (dynamic_cast<const SimpleObjectMesh *>(object))
+		{
+			auto found = meshGeometries.find(object->m_mesh);
+			if (found == meshGeometries.end())
+			{
+				m_sharedGeometries.push_back(SceneArena::New<TriangleMeshHitable>(GetSceneArena(), SCENE_ARENA_HITABLES, object->m_mesh, 1.0f, m_threadPool));
+				found = meshGeometries.emplace(object->m_mesh, m_twoLevelBVH.AddGeometry(m_sharedGeometries.back())).first;
+			}
+			geometry = found->second;
+		}
+		else
+		{
+			geometry = m_twoLevelBVH.AddGeometry(object->m_hitable);
+		}
+		m_objectInstances[i] = m_twoLevelBVH.AddInstance(geometry, GetInstanceTransform(i), m_twoLevelBVH.AddMaterial(object->m_material), (UINT32)i);
+	}
+	m_twoLevelBVH.Build(m_threadPool);
+
+	const LinearBVH &tlas = m_twoLevelBVH.GetTLAS();
+	cout << "[World] TwoLevelBVH: " << m_twoLevelBVH.GetInstanceCount() << " instances of " << m_twoLevelBVH.GetGeometryCount() << " geometries, "
+		<< tlas.GetNodeCount() << " nodes, depth " << tlas.GetMaxDepth() << ", SAH cost " << tlas.GetSAHCost() << endl;
 }
 
+Transform3x4 World::GetInstanceTransform(size_t objectIndex) const
+{
+	const Object *object = m_objects[objectIndex];
+	if (IsStoreSphere(objectIndex))
+	{
+		float radius = m_packetPrimitives[objectIndex].m_radius;
+		return Transform3x4::Translation(object->m_translation) * Transform3x4::Scaling(Vec3(radius, radius, radius));
+	}
+	if (dynamic_cast<const SimpleObjectMesh *>(object))
+		return Transform3x4::FromTranslationRotationScaling(object->m_translation, object->m_rotation, object->m_scaling);
+	return Transform3x4::Identity();
+}
+
+UINT32 World::Animate(float elapsedSeconds)
+{
+	vector<AABB> objectBounds(m_objects.size());
+	BOOL moved = FALSE;
+	for (size_t i = 0; i < m_objects.size(); i++)
+	{
+		Object *object = m_objects[i];
+		if (object->Animate(elapsedSeconds))
+		{
+			// the copies of the translation kept by the packet kernels and the structures
+			moved = TRUE;
+			if (!m_packetPrimitives.empty())
+			{
+				for (UINT32 axis = 0; axis < 3; axis++)
+					m_packetPrimitives[i].m_translation[axis] = object->m_translation[axis];
+			}
+			if (IsBuilt(ACCELERATION_LINEAR_BVH) && m_objectSpheres[i] != UINT32_MAX)
+				m_sphereStore.MoveSphere(m_objectSpheres[i], object->m_translation, object->BoundingBox());
+			if (IsBuilt(ACCELERATION_TWO_LEVEL))
+				m_twoLevelBVH.SetInstanceTransform(m_objectInstances[i], GetInstanceTransform(i));
+		}
+		objectBounds[i] = object->BoundingBox();
+	}
+	if (!moved)
+		return 0;
+
+	// only the structures built so far, the ones of the selected accelerator unless a benchmark built others
+	UINT32 rebuiltCount = 0;
+	if (IsBuilt(ACCELERATION_LINEAR_BVH))
+	{
+		vector<AABB> otherBounds(m_otherObjects.size());
+		for (size_t i = 0; i < m_otherObjects.size(); i++)
+			otherBounds[i] = objectBounds[m_otherObjects[i]];
+		rebuiltCount += m_sphereStore.Refit(m_rebuildSAHGrowth, m_threadPool);
+		rebuiltCount += m_otherObjectBVH.RefitOrRebuild(otherBounds, m_rebuildSAHGrowth, m_threadPool);
+	}
+	if (IsBuilt(ACCELERATION_OBJECT_BVH))
+		rebuiltCount += m_objectBVH.RefitOrRebuild(objectBounds, m_rebuildSAHGrowth, m_threadPool);
+	if (IsBuilt(ACCELERATION_TWO_LEVEL))
+		rebuiltCount += m_twoLevelBVH.Refit(m_rebuildSAHGrowth, m_threadPool);
+	// the tree is only kept for comparison, it is never rebuilt
+	if (IsBuilt(ACCELERATION_OBJECT_TREE))
+		m_objectBVHTree->Refit();
+	return rebuiltCount;
+}
 
 void World::DeconstructWorld()
 {
 	cout << "[World] DeconstructWorld" << endl;
 
+	m_objectBVH.Clear();
+	m_packetPrimitives.clear();
+	m_sphereStore.Clear();
+	m_otherObjectBVH.Clear();
+	m_otherObjects.clear();
+	m_objectSpheres.clear();
+	m_twoLevelBVH.Clear();
+	m_objectInstances.clear();
+	for (IHitable *geometry : m_sharedGeometries)
+		SceneArena::Delete(geometry);
+	m_sharedGeometries.clear();
+	// the tree deletes the objects it owns
 	if (m_objectBVHTree)
 	{
-		delete m_objectBVHTree;
+		SceneArena::Delete(m_objectBVHTree);
 		m_objectBVHTree = nullptr;
 	}
+	else
+	{
+		for (Object *object : m_objects)
+			SceneArena::Delete(object);
+	}
+	m_objects.clear();
+	m_builtStructures = 0;
+	m_sceneArena.Reset();
+	m_threadPool = nullptr;
 
 	if (m_lightSources)
 	{
@@ -134,10 +714,12 @@ void World::DeconstructWorld()
 	}
 }
 
+#if !defined(HEADLESS_RENDERING)
 void World::OnUpdate(SimpleCamera *camera, float elapsedSeconds)
 {
 	m_CurrentCbvIndex = (m_CurrentCbvIndex + 1) % D3D12Viewer::FrameCount;
 
+	Animate(elapsedSeconds);
 	m_lightSources->Update(camera, elapsedSeconds);
 	m_objectBVHTree->Update(camera, elapsedSeconds);
 }
@@ -194,4 +776,5 @@ void World::BuildD3DRes(D3D12Viewer *viewer)
 	Lambertian::BuildPSO(viewer, m_lightSources->GetLightSourceCount());
 	Metal::BuildPSO(viewer, m_lightSources->GetLightSourceCount());
 	Dielectric::BuildPSO(viewer, m_lightSources->GetLightSourceCount());
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -1,15 +1,58 @@
 #pragma once
 
+#include "LinearBVH.h"
+#include "SphereStore.h"
+#include "TwoLevelBVH.h"
+#include "SceneArena.h"
+
 class Resources;
 class D3D12Viewer;
 class SimpleCamera;
 class SimpleObjectBVHNode;
 class LightSources;
+class ThreadPool;
+class Object;
+class IHitable;
+class Ray;
+struct HitRecord;
+
+#define MANY_LIGHTS_COUNT 10000		// lights of WORLD_ID_MANY_LIGHTS
 
 enum WorldID
 {
 	WORLD_ID_RANDOM_SPHERES = 0,
 	WORLD_ID_CORNELL_BOX,
+	WORLD_ID_CORNELL_BOX_MESHES,	// the Cornell box with triangle meshes
+	WORLD_ID_BOUNCING_SPHERES,		// the random spheres, the small ones bouncing when animated
+	WORLD_ID_MANY_LIGHTS,			// the big spheres of the random ones at night, under thousands of small colored lights
+	WORLD_ID_TEXTURED,				// checker plate textured spheres on a wide tiled ground, seen at grazing angles for the texture filtering
+};
+
+// the structure used for the ray queries of the CPU tracer
+enum AccelerationStructure
+{
+	ACCELERATION_LINEAR_BVH = 0,	// flattened SAH BVHs, the spheres in a SphereStore, the other objects in their own
+	ACCELERATION_OBJECT_BVH,		// a single flattened SAH BVH over all the objects
+	ACCELERATION_OBJECT_TREE,		// SimpleObjectBVHNode, kept for comparison
+	ACCELERATION_TWO_LEVEL,			// a TwoLevelBVH, instances of shared bottom level geometries
+};
+
+// the hitables the packet kernels know, everything else is tested one lane at a time
+enum PacketPrimitiveType
+{
+	PACKET_PRIMITIVE_NONE = 0,
+	PACKET_PRIMITIVE_SPHERE,		// SphereHitable under a TranslatedInstance
+	PACKET_PRIMITIVE_RECT,			// AxisAlignedRectHitable under a TranslatedInstance and identity rotations
+};
+
+struct PacketPrimitive
+{
+	PacketPrimitiveType						m_type{ PACKET_PRIMITIVE_NONE };
+	float									m_translation[3];
+	float									m_center[3];				// sphere
+	float									m_radius;
+	UINT32									m_aAxis, m_bAxis, m_cAxis;	// rect
+	float									m_a0, m_a1, m_b0, m_b1, m_c;
 };
 
 class World
@@ -18,27 +61,87 @@ public:
 	World() = default;
 	~World() = default;
 
-	void									ConstructWorld(WorldID wid, SimpleCamera *camera);
+	// the structures and the meshes are built by the threads of threadPool if any, and so are the rebuilds of Animate,
+	// not owned, it has to live as long as the world is animated or builds the structures of another accelerator
+	void									ConstructWorld(WorldID wid, SimpleCamera *camera, ThreadPool *threadPool = nullptr);
 	void									DeconstructWorld();
 
+	// moves the objects having a motion, then refits the acceleration structures built so far, returns how many were rebuilt instead
+	UINT32									Animate(float elapsedSeconds);
+	// a refit structure is rebuilt once its SAH cost grew past that many times the one of its last build,
+	// 0 rebuilds on every Animate, FLT_MAX never does
+	inline void								SetRebuildSAHGrowth(float growth) { m_rebuildSAHGrowth = growth; }
+
+	// the objects, their hitables and the SimpleObjectBVHNode tree are allocated in the scene arena,
+	// or one by one on the heap when disabled, to be set before ConstructWorld
+	inline void								SetSceneArenaEnabled(BOOL enabled) { m_sceneArenaEnabled = enabled; }
+	inline SceneArena *						GetSceneArena() { return m_sceneArenaEnabled ? &m_sceneArena : nullptr; }
+	inline ThreadPool *						GetThreadPool() const { return m_threadPool; }
+
+#if !defined(HEADLESS_RENDERING)
 	void									OnUpdate(SimpleCamera *camera, float elapsedSeconds);
 	void									OnRender(D3D12Viewer *viewer) const;
 
 	void									BuildD3DRes(D3D12Viewer *viewer);
+#endif
+	// empty, or nullptr for the tree, until BuildAccelerationStructure of their accelerator
 	SimpleObjectBVHNode	*					GetObjectBVHTree() const { return m_objectBVHTree; }
+	const LinearBVH &						GetObjectBVH() const { return m_objectBVH; }
+	const SphereStore &						GetSphereStore() const { return m_sphereStore; }
+	const LinearBVH &						GetOtherObjectBVH() const { return m_otherObjectBVH; }
+	const TwoLevelBVH &						GetTwoLevelBVH() const { return m_twoLevelBVH; }
+	const std::vector<Object *> &			GetObjects() const { return m_objects; }
+
+	// closest hit against the whole scene
+	BOOL									Hit(const Ray &r, float t_min, float &t_max, HitRecord &out_rec, BVHTraversalStats *stats = nullptr) const;
+	// any hit in [t_min, t_max], for shadow and visibility rays, much cheaper than Hit: no closest hit, no record
+	BOOL									Occluded(const Ray &r, float t_min, float t_max, BVHTraversalStats *stats = nullptr) const;
+	// closest hit of every active lane, the records and m_tMax of the lanes are the same as with Hit, returns the mask of the lanes that hit
+	template<UINT32 N>
+	UINT32									HitPacket(RayPacket<N> &packet, float t_min, HitRecord *out_recs, BVHTraversalStats *stats = nullptr) const;
+	// ConstructWorld only builds the structures of the selected one, selecting another one once the world is built builds it
+	void									SetAccelerationStructure(AccelerationStructure accel);
+	// the structures of accel without selecting it, e.g. for the getters above, nothing if they are built already
+	void									BuildAccelerationStructure(AccelerationStructure accel);
+	inline AccelerationStructure			GetAccelerationStructure() const { return m_accelerationStructure; }
 
 	inline UINT32							GetFrameIndex() const { return m_CurrentCbvIndex; }
 	inline LightSources *					GetLightSources() const { return m_lightSources; }
 
 private:
+	inline BOOL								IsBuilt(AccelerationStructure accel) const { return (m_builtStructures & (1u << accel)) != 0; }
+	BOOL									IsStoreSphere(size_t objectIndex) const;
+	void									BuildPacketPrimitives();
+	void									BuildSphereStore();
+	void									BuildTwoLevelBVH();
+	Transform3x4							GetInstanceTransform(size_t objectIndex) const;
+
 	Resources *								m_resources;
 
 	// TODO : Do we need a separate render ?
 	// sort by materials to avoid pipeline state switching
 	SimpleObjectBVHNode	*					m_objectBVHTree{ nullptr };
 	size_t									m_objectsCount{ 0 };
+	std::vector<Object *>					m_objects;					// owned by m_objectBVHTree once built, or by m_sceneArena
+	LinearBVH								m_objectBVH;
+	std::vector<PacketPrimitive>			m_packetPrimitives;			// one per object, built with any structure but the tree
+	SphereStore								m_sphereStore;				// the spheres the packet kernels know, centered on their translation
+	LinearBVH								m_otherObjectBVH;			// and the rest of the objects
+	std::vector<UINT32>						m_otherObjects;				// object index of every primitive of m_otherObjectBVH
+	std::vector<UINT32>						m_objectSpheres;			// index in m_sphereStore of every object, UINT32_MAX for the other objects
+	TwoLevelBVH								m_twoLevelBVH;				// the user index of an instance is its object index
+	std::vector<IHitable *>					m_sharedGeometries;			// the bottom levels shared by several instances, owned, or in m_sceneArena
+	std::vector<UINT32>						m_objectInstances;			// instance id of every object in m_twoLevelBVH
+	float									m_rebuildSAHGrowth{ 1.5f };
+	SceneArena								m_sceneArena;				// everything is released at once by DeconstructWorld
+	BOOL									m_sceneArenaEnabled{ TRUE };
+	AccelerationStructure					m_accelerationStructure{ ACCELERATION_LINEAR_BVH };
+	UINT32									m_builtStructures{ 0 };		// bit (1 << accel) of every acceleration structure built
 	LightSources *							m_lightSources;
+	ThreadPool *							m_threadPool{ nullptr };	// the one of ConstructWorld, not owned
 
+#if !defined(HEADLESS_RENDERING)
 	ComPtr<ID3D12DescriptorHeap>			m_SRVHeap;
+#endif
 	UINT32									m_CurrentCbvIndex;
 };
\ No newline at end of file
@@ -0,0 +1,2531 @@
+#include "stdafx.h"
+#include "Benchmarks.h"
+#include "RayTracerCLI.h"
+
+#include "OutputImage.h"
+#include "HomemadeRayTracer.h"
+#include "SimpleCamera.h"
+#include "SimpleObject.h"
+#include "World.h"
+#include "Ray.h"
+#include "Randomizer.h"
+#include "Hitables.h"
+#include "LinearBVH.h"
+#include "ThreadPool.h"
+#include "RayPacket.h"
+#include "TriangleMeshHitable.h"
+#include "SimpleMesh.h"
+#include "Resouces.h"
+#include "TwoLevelBVH.h"
+#include "SceneArena.h"
+#include "LightSources.h"
+#include "Materials.h"
+#include "SimpleTexture2D.h"
+#include "Optics.h"
+#include "FastMath.h"
+
+using namespace std;
+
+const Benchmarks::Entry Benchmarks::s_entries[] =
+{
+	{ "vec3",		"Vec3 backends on the random-spheres scene",		&Benchmarks::Vec3Backends },
+	{ "random",		"Randomizer generators and samples/sec on the random-spheres scene, e.g. with --spp 100",	&Benchmarks::RandomGenerators },
+	{ "mappings",	"Rejection vs closed-form disk and ball samples, numbers drawn per point, then the scalar vs SSE batch disk, sphere and cosine mappings",	&Benchmarks::SampleMappings },
+	{ "bsdf",		"Sample vs Eval and Pdf of every material, the density and the BSDF integrated, then the variance of the diffuse sampling strategies under a sky",	&Benchmarks::MaterialSampling },
+	{ "sphereuv",	"std vs approximated atan2/asin sphere coordinates, error and throughput, then closest hits on the random-spheres scene with lazy vs always computed coordinates",	&Benchmarks::SphereUVs },
+	{ "texture",	"RGBA8 nearest vs float rows vs tiled pyramid lookups of the checker plate texture, coherent and incoherent, then the textured world without and with texture LOD, e.g. with --spp 4",	&Benchmarks::TextureFiltering },
+	{ "tiles",		"Row vs tile scheduling, with per-thread busy time, e.g. with --spp 16",	&Benchmarks::TileScheduling },
+	{ "integrator",	"Recursive vs iterative vs wavefront integrator, rays/sec and error against a reference, e.g. with --spp 16",	&Benchmarks::Integrators },
+	{ "bvh",		"SimpleObjectBVHNode vs LinearBVH vs SoA sphere store traversal statistics and rays/sec on both worlds",	&Benchmarks::BVHTraversal },
+	{ "packet",		"Single rays vs 4/8/16-wide camera ray packets, queries and 1-SPP render time on both worlds",	&Benchmarks::Packets },
+	{ "mesh",		"Triangle mesh vs analytic sphere on the 200x200 high polygon sphere, BLAS build, rays/sec and watertightness",	&Benchmarks::TriangleMeshes },
+	{ "instances",	"Two-level BVH, build time and memory of 100k mesh instances, then against the sphere store on the random-spheres scene",	&Benchmarks::Instances },
+	{ "refit",		"Rebuild every frame vs refit only vs refit with SAH triggered rebuilds, bouncing spheres and a cloud flying apart",	&Benchmarks::Refits },
+	{ "build",		"SimpleObjectBVHNode vs LinearBVH build time over 1M spheres, the LinearBVH on 1, 2, 4... threads up to --threads",	&Benchmarks::Builds },
+	{ "arena",		"Heap vs scene arena, load and teardown time and SimpleObjectBVHNode rays/sec over 200k spheres, with a fresh and a fragmented heap",	&Benchmarks::SceneArenas },
+	{ "occlusion",	"Closest hit vs any-hit shadow rays toward the lights, rays/sec and agreement on every structure, e.g. with --frames 4",	&Benchmarks::Occlusions },
+	{ "attributes",	"Eager vs deferred hit attributes, candidate hits per ray and rays/sec through dense sphere clouds",	&Benchmarks::HitAttributes },
+	{ "nee",		"BSDF sampling only vs next event estimation with MIS, error against a reference at 1x, 2x and 4x --spp, e.g. with --spp 4",	&Benchmarks::LightSampling },
+	{ "lightbvh",	"Light picked by power vs by the light BVH on the many-lights world, selection cost, agreement of the PMF and error, e.g. with --spp 4",	&Benchmarks::LightBVHs },
+	{ "adaptive",	"Uniform vs adaptive sampling, samples, rays and error against a reference at the same max SPP, e.g. with --spp 64 --min-spp 8",	&Benchmarks::AdaptiveSampling },
+	{ "sampler",	"Independent vs Sobol vs blue-noise sampler, error against a reference at 1x, 2x and 4x --spp, e.g. with --spp 4",	&Benchmarks::Samplers },
+};
+
+BOOL Benchmarks::Run(const CommandLineOptions &options)
+{
+	for (const Entry &entry : s_entries)
+	{
+		if (options.m_benchmark == entry.m_name)
+		{
+			cout << "[Benchmark] " << entry.m_description << endl;
+			return entry.m_func(options);
+		}
+	}
+
+	cerr << "[Benchmark] Unknown benchmark: " << options.m_benchmark << endl;
+	return FALSE;
+}
+
+void Benchmarks::PrintList()
+{
+	for (const Entry &entry : s_entries)
+	{
+		printf("                                %-10s %s\n", entry.m_name, entry.m_description);
+	}
+}
+
+namespace
+{
+	double SecondsSince(const chrono::steady_clock::time_point &start)
+	{
+		return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	void CollectObjects(const Object *node, vector<const Object *> &out_objects)
+	{
+		const SimpleObjectBVHNode *bvhNode = dynamic_cast<const SimpleObjectBVHNode *>(node);
+		if (bvhNode)
+		{
+			if (bvhNode->leftChild)
+				CollectObjects(bvhNode->leftChild, out_objects);
+			if (bvhNode->rightChild)
+				CollectObjects(bvhNode->rightChild, out_objects);
+		}
+		else
+		{
+			out_objects.push_back(node);
+		}
+	}
+
+	// same walk as SimpleObjectBVHNode::Intersect, counting the visited nodes and the object tests
+	const Object *IntersectObjectTreeWithStats(const Object *node, const Ray &r, float &t_min, float &t_max, HitRecord &out_rec, BVHTraversalStats &stats)
+	{
+		const SimpleObjectBVHNode *bvhNode = dynamic_cast<const SimpleObjectBVHNode *>(node);
+		if (!bvhNode)
+		{
+			stats.m_leafTests++;
+			return node->Intersect(r, t_min, t_max, out_rec);
+		}
+
+		stats.m_nodesVisited++;
+		const Object *closest = nullptr;
+		if (bvhNode->m_bindingBox.Hit(r, t_min, t_max))
+		{
+			if (bvhNode->leftChild)
+			{
+				if (const Object *hit = IntersectObjectTreeWithStats(bvhNode->leftChild, r, t_min, t_max, out_rec, stats))
+					closest = hit;
+			}
+			if (bvhNode->rightChild)
+			{
+				if (const Object *hit = IntersectObjectTreeWithStats(bvhNode->rightChild, r, t_min, t_max, out_rec, stats))
+					closest = hit;
+			}
+		}
+		return closest;
+	}
+
+	BOOL HitObjectTreeWithStats(const Object *node, const Ray &r, float &t_min, float &t_max, HitRecord &out_rec, BVHTraversalStats &stats)
+	{
+		const Object *closest = IntersectObjectTreeWithStats(node, r, t_min, t_max, out_rec, stats);
+		if (!closest)
+			return FALSE;
+		closest->ComputeAttributes(r, out_rec);
+		return TRUE;
+	}
+
+	// the walk before the attributes were deferred, every object closer than the previous ones gets its full record
+	BOOL HitObjectTreeEager(const Object *node, const Ray &r, float &t_min, float &t_max, HitRecord &out_rec, UINT64 &io_candidateHits)
+	{
+		const SimpleObjectBVHNode *bvhNode = dynamic_cast<const SimpleObjectBVHNode *>(node);
+		if (!bvhNode)
+		{
+			if (!node->m_hitable->Hit(r, t_min, t_max, out_rec))
+				return FALSE;
+			t_max = out_rec.m_time;
+			io_candidateHits++;
+			return TRUE;
+		}
+
+		BOOL hitMe = FALSE;
+		if (bvhNode->m_bindingBox.Hit(r, t_min, t_max))
+		{
+			if (bvhNode->leftChild)
+				hitMe |= HitObjectTreeEager(bvhNode->leftChild, r, t_min, t_max, out_rec, io_candidateHits);
+			if (bvhNode->rightChild)
+				hitMe |= HitObjectTreeEager(bvhNode->rightChild, r, t_min, t_max, out_rec, io_candidateHits);
+		}
+		return hitMe;
+	}
+
+	UINT32 CountObjectTreeNodes(const Object *node, UINT32 depth, UINT32 &out_maxDepth)
+	{
+		const SimpleObjectBVHNode *bvhNode = dynamic_cast<const SimpleObjectBVHNode *>(node);
+		if (!bvhNode)
+			return 0;
+
+		out_maxDepth = max(out_maxDepth, depth + 1);
+		UINT32 count = 1;
+		if (bvhNode->leftChild)
+			count += CountObjectTreeNodes(bvhNode->leftChild, depth + 1, out_maxDepth);
+		if (bvhNode->rightChild)
+			count += CountObjectTreeNodes(bvhNode->rightChild, depth + 1, out_maxDepth);
+		return count;
+	}
+
+	void ReportTraversal(const char *worldName, const char *rayName, const char *accelName, const BVHTraversalStats &stats, double seconds, UINT64 rayCount)
+	{
+		printf("[Benchmark] %-8s %-7s %-7s %8.2lf nodes/ray %8.2lf leaf tests/ray %10.3lf Mrays/s\n", worldName, rayName, accelName,
+			(double)stats.m_nodesVisited / stats.m_rayCount, (double)stats.m_leafTests / stats.m_rayCount, rayCount / seconds * 1e-6);
+	}
+
+	// closest hits of the camera rays, gathered in 2x2, 4x2 or 4x4 pixel blocks like the tracer does,
+	// the distances are compared against the single ray ones
+	template<UINT32 N>
+	double HitCameraPackets(const World *world, const vector<Ray> &rays, const vector<float> &reference, UINT32 width, UINT32 height, UINT32 repeat, BVHTraversalStats &out_stats, UINT64 &out_mismatches)
+	{
+		const UINT32 blockWidth = (N == 4) ? 2 : 4;
+		const UINT32 blockHeight = N / blockWidth;
+		HitRecord recs[N];
+		out_mismatches = 0;
+
+		auto start = chrono::steady_clock::now();
+		for (UINT32 n = 0; n < repeat; n++)
+		{
+			BVHTraversalStats *stats = (n == 0) ? &out_stats : nullptr;
+			for (UINT32 y = 0; y < height; y += blockHeight)
+			{
+				for (UINT32 x = 0; x < width; x += blockWidth)
+				{
+					RayPacket<N> packet{};
+					for (UINT32 lane = 0; lane < N; lane++)
+					{
+						UINT32 i = x + lane % blockWidth;
+						UINT32 j = y + lane / blockWidth;
+						if (i < width && j < height)
+							packet.SetRay(lane, rays[j * width + i], FLT_MAX);
+					}
+
+					UINT32 hitMask = world->HitPacket(packet, 0.001f, recs, stats);
+					if (n > 0)
+						continue;
+
+					for (UINT32 lanes = packet.m_activeMask; lanes; lanes &= lanes - 1)
+					{
+						UINT32 lane = LowestBit(lanes);
+						float t = ((hitMask >> lane) & 1) ? recs[lane].m_time : FLT_MAX;
+						if (t != reference[(y + lane / blockWidth) * width + x + lane % blockWidth])
+							out_mismatches++;
+					}
+				}
+			}
+		}
+		return SecondsSince(start);
+	}
+
+	// mean squared error of the displayed colors
+	double ImageMSE(const OutputImage *image, const OutputImage *reference)
+	{
+		double sum = 0.0;
+		UINT64 pixelCount = (UINT64)image->m_width * image->m_height;
+		for (UINT64 p = 0; p < pixelCount; p++)
+		{
+			for (UINT32 c = 0; c < 3; c++)
+			{
+				double d = (image->m_data[p * 4 + c] - reference->m_data[p * 4 + c]) / 255.0;
+				sum += d * d;
+			}
+		}
+		return sum / (pixelCount * 3);
+	}
+
+	// luminance of the mean linear radiance of the last render, the displayed colors are biased by the clamp and the gamma
+	double MeanLuminance(const HomemadeRayTracer *hmRayTracer)
+	{
+		Vec3 mean = hmRayTracer->GetMeanRadiance();
+		return 0.2126 * mean.r() + 0.7152 * mean.g() + 0.0722 * mean.b();
+	}
+
+	// brute force closest hit against every sphere of the scene and a bit of shading-like math,
+	// written against the common Vec3 API so that each backend runs exactly the same code
+	template<typename V>
+	double TraceSpheres(const vector<XMFLOAT4> &spheres, const vector<XMFLOAT3> &orgs, const vector<XMFLOAT3> &dirs, UINT32 repeat, float &out_checksum)
+	{
+		const V minColor(0.0f, 0.0f, 0.0f);
+		const V maxColor(1.0f, 1.0f, 1.0f);
+		float checksum = 0.0f;
+
+		auto start = chrono::steady_clock::now();
+		for (UINT32 n = 0; n < repeat; n++)
+		{
+			for (size_t i = 0; i < orgs.size(); i++)
+			{
+				V org(orgs[i].x, orgs[i].y, orgs[i].z);
+				V dir(dirs[i].x, dirs[i].y, dirs[i].z);
+				float a = dot(dir, dir);
+				float closest = FLT_MAX;
+				size_t hitIndex = spheres.size();
+				for (size_t s = 0; s < spheres.size(); s++)
+				{
+					V oc = org - V(spheres[s].x, spheres[s].y, spheres[s].z);
+					float b = dot(dir, oc);
+					float c = dot(oc, oc) - spheres[s].w * spheres[s].w;
+					float discriminant = b * b - a * c;
+					if (discriminant > 0.0f)
+					{
+						float t = (-b - sqrtf(discriminant)) / a;
+						if (t > 0.001f && t < closest)
+						{
+							closest = t;
+							hitIndex = s;
+						}
+					}
+				}
+
+				if (hitIndex < spheres.size())
+				{
+					const XMFLOAT4 &sphere = spheres[hitIndex];
+					V position = org + closest * dir;
+					V normal = normalize(position - V(sphere.x, sphere.y, sphere.z));
+					V reflected = dir - 2.0f * dot(dir, normal) * normal;
+					V tangent = cross(normal, reflected);
+					V color = 0.5f * (normal + maxColor);
+					color.clamp(minColor, maxColor);
+					checksum += color.x() + color.y() + color.z() + tangent.length() * 0.001f + reflected[1] * 0.001f;
+				}
+			}
+		}
+		double seconds = SecondsSince(start);
+
+		out_checksum = checksum;
+		return seconds;
+	}
+
+	// the rejection samplers the Randomizer had before the closed-form mappings, the number of draws varies
+	Vec3 RomdomInUnitSphereRejection(UINT32 &inout_draws)
+	{
+		Vec3 p;
+		do
+		{
+			p = Vec3(Randomizer::RandomMinMax2(-1.0f, 1.0f), Randomizer::RandomMinMax2(-1.0f, 1.0f), Randomizer::RandomMinMax2(-1.0f, 1.0f));
+			inout_draws += 3;
+		} while (p.squared_length() >= 1.0f);
+		return p;
+	}
+
+	Vec3 RandomInUnitDiskRejection(UINT32 &inout_draws)
+	{
+		Vec3 p;
+		do
+		{
+			p = Vec3(Randomizer::RandomMinMax2(-1.0f, 1.0f), Randomizer::RandomMinMax2(-1.0f, 1.0f), 0.0f);
+			inout_draws += 2;
+		} while (p.squared_length() >= 1.0f);
+		return p;
+	}
+
+	// a sky with a sun, for the variance of the diffuse strategies
+	float SkyRadiance(const Vec3 &direction)
+	{
+		const Vec3 sun = normalize(Vec3(0.6f, 0.5f, 0.3f));
+		float c = dot(normalize(direction), sun);
+		float c2 = c * c;
+		float c4 = c2 * c2;
+		return 0.2f + ((c > 0.0f) ? 30.0f * c4 * c4 * c4 : 0.0f);
+	}
+
+	template<typename V>
+	void ReportVec3Backend(const char *name, const vector<XMFLOAT4> &spheres, const vector<XMFLOAT3> &orgs, const vector<XMFLOAT3> &dirs, UINT32 repeat)
+	{
+		float checksum = 0.0f;
+		double seconds = TraceSpheres<V>(spheres, orgs, dirs, repeat, checksum);
+		double rays = (double)orgs.size() * repeat;
+		printf("[Benchmark] %-8s %8.3lfs %10.3lf Mrays/s %12.3lf Mtests/s  checksum %.3f\n", name, seconds, rays / seconds * 1e-6, rays * spheres.size() / seconds * 1e-6, checksum);
+	}
+
+	// SimpleTexture2D_TGAImage::Sample before the pyramid, nearest texel of the RGBA8 rows converted on every lookup
+	Vec3 SampleNearestRGBA8(const SimpleTexture2D *texture, float u, float v)
+	{
+		UINT32 i = UINT32(u * texture->m_width);
+		UINT32 j = UINT32((1.0f - v) * texture->m_height - 0.001f);
+		if (i > texture->m_width - 1) i = texture->m_width - 1;
+		if (j > texture->m_height - 1) j = texture->m_height - 1;
+		const UINT8 *texel = texture->m_pixelData + ((size_t)j * texture->m_width + i) * 4;
+		return Vec3(texel[0] / 255.0f, texel[1] / 255.0f, texel[2] / 255.0f);
+	}
+
+	// the same bilinear lookup as TexturePyramid::SampleBilinear, from float RGBA rows instead of the tiles
+	Vec3 SampleBilinearRows(const vector<float> &rows, UINT32 width, UINT32 height, float u, float v)
+	{
+		u -= floorf(u);
+		v -= floorf(v);
+		float x = u * width - 0.5f;
+		float y = (1.0f - v) * height - 0.5f;
+		float fx = floorf(x);
+		float fy = floorf(y);
+		float tx = x - fx;
+		float ty = y - fy;
+		UINT32 x0 = (fx < 0.0f) ? width - 1 : min((UINT32)fx, width - 1);
+		UINT32 y0 = (fy < 0.0f) ? height - 1 : min((UINT32)fy, height - 1);
+		UINT32 x1 = (x0 + 1 < width) ? x0 + 1 : 0;
+		UINT32 y1 = (y0 + 1 < height) ? y0 + 1 : 0;
+		const float *t00 = &rows[((size_t)y0 * width + x0) * 4];
+		const float *t10 = &rows[((size_t)y0 * width + x1) * 4];
+		const float *t01 = &rows[((size_t)y1 * width + x0) * 4];
+		const float *t11 = &rows[((size_t)y1 * width + x1) * 4];
+		Float4 top = Float4::LoadUnaligned(t00) * Float4(1.0f - tx) + Float4::LoadUnaligned(t10) * Float4(tx);
+		Float4 bottom = Float4::LoadUnaligned(t01) * Float4(1.0f - tx) + Float4::LoadUnaligned(t11) * Float4(tx);
+		alignas(16) float result[4];
+		(top * Float4(1.0f - ty) + bottom * Float4(ty)).Store(result);
+		return Vec3(result[0], result[1], result[2]);
+	}
+}
+
+BOOL Benchmarks::Vec3Backends(const CommandLineOptions &options)
+{
+	OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	World *world = new World();
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+	world->ConstructWorld(WORLD_ID_RANDOM_SPHERES, camera);
+	world->BuildAccelerationStructure(ACCELERATION_OBJECT_TREE);
+
+	// the spheres of the scene and one camera ray per pixel
+	vector<const Object *> objects;
+	CollectObjects(world->GetObjectBVHTree(), objects);
+	vector<XMFLOAT4> spheres;
+	for (const Object *object : objects)
+	{
+		if (dynamic_cast<const SimpleObjectSphere *>(object))
+			spheres.push_back(XMFLOAT4(object->m_translation.x(), object->m_translation.y(), object->m_translation.z(), object->m_scaling.x()));
+	}
+
+	vector<XMFLOAT3> orgs;
+	vector<XMFLOAT3> dirs;
+	for (UINT32 j = 0; j < options.m_height; j++)
+	{
+		for (UINT32 i = 0; i < options.m_width; i++)
+		{
+			Ray r = camera->GetRay(float(i) / float(options.m_width), float(j) / float(options.m_height));
+			orgs.push_back(XMFLOAT3(r.m_org.x(), r.m_org.y(), r.m_org.z()));
+			dirs.push_back(XMFLOAT3(r.m_dir.x(), r.m_dir.y(), r.m_dir.z()));
+		}
+	}
+	printf("[Benchmark] %zu spheres, %zu rays x %u frame(s)\n", spheres.size(), orgs.size(), options.m_frameCount);
+
+	// every backend compiled into this binary, single thread
+#if defined(VEC3_HAS_DXMATH)
+	ReportVec3Backend<Vec3DXMath>("DXMath", spheres, orgs, dirs, options.m_frameCount);
+#endif
+#if defined(VEC3_HAS_SSE)
+	ReportVec3Backend<Vec3SSE>("SSE", spheres, orgs, dirs, options.m_frameCount);
+#endif
+	ReportVec3Backend<Vec3Scalar>("Scalar", spheres, orgs, dirs, options.m_frameCount);
+
+	// the whole tracer with the selected backend
+	HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+	hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel);
+	hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+	UINT64 samples = (UINT64)options.m_width * (UINT64)options.m_height * (UINT64)hmRayTracer->GetSamplePerPixel();
+	for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+	{
+		auto start = chrono::steady_clock::now();
+		hmRayTracer->TraceRay(camera, outputImage);
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] HomemadeRayTracer (%s) frame %u: %.3lfs, %.3lf Msamples/s\n", VEC3_BACKEND_NAME, frame, seconds, samples / seconds * 1e-6);
+	}
+
+	delete hmRayTracer;
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete outputImage;
+	return TRUE;
+}
+
+
+BOOL Benchmarks::RandomGenerators(const CommandLineOptions &options)
+{
+	// raw generators, single thread
+	const UINT32 count = 1 << 22;
+	float sum = 0.0f;
+	{
+		std::random_device rd;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+			sum += (rd() >> 8) * (1.0f / 16777216.0f);
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] std::random_device %10.3lf Mfloats/s\n", count / seconds * 1e-6);
+	}
+	{
+		PCG32 pcg;
+		pcg.Seed(options.m_seed, 0);
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+			sum += (pcg.Next() >> 8) * (1.0f / 16777216.0f);
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] PCG32              %10.3lf Mfloats/s  (%.1f)\n", count / seconds * 1e-6, sum);
+	}
+
+	// the tracer, rendered with one thread and then with all of them, both images have to match
+	OutputImage *outputImages[2];
+	World *world = new World();
+	outputImages[0] = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	outputImages[1] = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImages[0]->m_aspectRatio);
+	world->ConstructWorld(WORLD_ID_RANDOM_SPHERES, camera);
+
+	UINT32 threadCounts[2] = { 1, options.m_threadCount ? options.m_threadCount : max(1u, thread::hardware_concurrency()) };
+	UINT64 samples = (UINT64)options.m_width * (UINT64)options.m_height * (UINT64)options.m_samplePerPixel;
+	for (UINT32 n = 0; n < 2; n++)
+	{
+		// a fresh tracer each time, so that the frame index and therefore the streams are the same
+		HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImages[n], world);
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel);
+		hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+		hmRayTracer->SetThreadCount(threadCounts[n]);
+
+		auto start = chrono::steady_clock::now();
+		hmRayTracer->TraceRay(camera, outputImages[n]);
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] %s, %u thread(s): %.3lfs, %.3lf Msamples/s\n",
+#if defined(RANDOMIZER_RANDOM_DEVICE)
+			"std::random_device",
+#else
+			"PCG32",
+#endif
+			threadCounts[n], seconds, samples / seconds * 1e-6);
+		delete hmRayTracer;
+	}
+
+	BOOL identical = (memcmp(outputImages[0]->m_data, outputImages[1]->m_data, (size_t)outputImages[0]->m_dataSizeInByte) == 0);
+	printf("[Benchmark] Images with 1 and %u thread(s) are %s\n", threadCounts[1], identical ? "identical" : "different");
+
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete outputImages[0];
+	delete outputImages[1];
+	return TRUE;
+}
+
+BOOL Benchmarks::SampleMappings(const CommandLineOptions &options)
+{
+	const UINT32 count = 1 << 20;
+	Randomizer::SetSeed(options.m_seed);
+
+	// drawing the numbers and mapping them, the rejection loops against the closed-form mappings
+	{
+		UINT32 draws = 0;
+		float sum = 0.0f;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+			sum += RomdomInUnitSphereRejection(draws).squared_length();
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] ball, rejection    %10.3lf Mpoints/s  %.2f numbers/point  mean r^2 %.4f (3/5)\n", count / seconds * 1e-6, (float)draws / count, sum / count);
+	}
+	{
+		float sum = 0.0f;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+			sum += Randomizer::RomdomInUnitSphere().squared_length();
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] ball, closed-form  %10.3lf Mpoints/s  3.00 numbers/point  mean r^2 %.4f (3/5)\n", count / seconds * 1e-6, sum / count);
+	}
+	{
+		UINT32 draws = 0;
+		float sum = 0.0f;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+			sum += RandomInUnitDiskRejection(draws).squared_length();
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] disk, rejection    %10.3lf Mpoints/s  %.2f numbers/point  mean r^2 %.4f (1/2)\n", count / seconds * 1e-6, (float)draws / count, sum / count);
+	}
+	{
+		float sum = 0.0f;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+			sum += Randomizer::RandomInUnitDisk().squared_length();
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] disk, closed-form  %10.3lf Mpoints/s  2.00 numbers/point  mean r^2 %.4f (1/2)\n", count / seconds * 1e-6, sum / count);
+	}
+
+	// the mappings alone over the same numbers, one at a time against the SSE batches
+	vector<float> u0(count), u1(count);
+	Randomizer::RandomUNorms(u0.data(), count);
+	Randomizer::RandomUNorms(u1.data(), count);
+	vector<float> scalar[3], batch[3];
+	for (UINT32 c = 0; c < 3; c++)
+	{
+		scalar[c].resize(count);
+		batch[c].resize(count);
+	}
+	const char *names[3] = { "disk", "sphere", "cosine" };
+	BOOL allMatch = TRUE;
+	for (UINT32 m = 0; m < 3; m++)
+	{
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+		{
+			Vec3 p = (m == 0) ? Randomizer::ConcentricDisk(u0[i], u1[i]) : (m == 1) ? Randomizer::UniformSphere(u0[i], u1[i]) : Randomizer::CosineHemisphere(u0[i], u1[i]);
+			scalar[0][i] = p.x();
+			scalar[1][i] = p.y();
+			scalar[2][i] = p.z();
+		}
+		double scalarSeconds = SecondsSince(start);
+
+		start = chrono::steady_clock::now();
+		if (m == 0)
+			Randomizer::ConcentricDisks(u0.data(), u1.data(), count, batch[0].data(), batch[1].data());
+		else if (m == 1)
+			Randomizer::UniformSpheres(u0.data(), u1.data(), count, batch[0].data(), batch[1].data(), batch[2].data());
+		else
+			Randomizer::CosineHemispheres(u0.data(), u1.data(), count, batch[0].data(), batch[1].data(), batch[2].data());
+		double batchSeconds = SecondsSince(start);
+
+		// the batches have no z for the disk. The components are compared squared, with their sign: z = sqrt(1 - r^2)
+		// of the cosine mapping turns a rounding difference of r^2, e.g. of a fused multiply-add, into 1e-5 near r = 1
+		UINT32 components = (m == 0) ? 2 : 3;
+		float maxDifference = 0.0f;
+		float maxSquareDifference = 0.0f;
+		double lengthSum = 0.0, zSum = 0.0;
+		for (UINT32 i = 0; i < count; i++)
+		{
+			for (UINT32 c = 0; c < components; c++)
+			{
+				float s = scalar[c][i], b = batch[c][i];
+				maxDifference = max(maxDifference, fabsf(s - b));
+				maxSquareDifference = max(maxSquareDifference, fabsf(s * fabsf(s) - b * fabsf(b)));
+			}
+			float x = batch[0][i], y = batch[1][i], z = (m == 0) ? 0.0f : batch[2][i];
+			lengthSum += sqrt((double)(x * x + y * y + z * z));
+			zSum += z;
+		}
+		allMatch &= (maxSquareDifference < 1e-6f);
+		printf("[Benchmark] %-6s scalar %10.3lf Mpoints/s  batch %10.3lf Mpoints/s  max difference %g, of the squares %g  mean |p| %.4f  mean z %.4f\n",
+			names[m], count / scalarSeconds * 1e-6, count / batchSeconds * 1e-6, maxDifference, maxSquareDifference, lengthSum / count, zSum / count);
+	}
+	printf("[Benchmark] Scalar and batch mappings %s (expected mean |p| 2/3, 1, 1 and mean z 0, 0, 2/3)\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::MaterialSampling(const CommandLineOptions &options)
+{
+	const UINT32 count = 1 << 20;
+	Randomizer::SetSeed(options.m_seed);
+	const Vec3 albedo(0.8f, 0.6f, 0.4f);
+	SimpleTexture2D_SingleColor texture(albedo);
+	Lambertian lambertian(&texture);
+	Metal metals[3] = { Metal(&texture, 0.2f), Metal(&texture, 0.5f), Metal(&texture, 1.0f) };
+	Dielectric dielectric(1.5f);
+	struct Config
+	{
+		const char *	m_name;
+		const IMaterial *m_material;
+	};
+	const Config configs[] = { { "lambertian", &lambertian }, { "metal 0.2", &metals[0] }, { "metal 0.5", &metals[1] }, { "metal 1.0", &metals[2] }, { "dielectric", &dielectric } };
+
+	// a hit on a tilted surface, the incident ray at 60 degrees from the normal
+	HitRecord rec = {};
+	rec.m_normal = normalize(Vec3(0.2f, 1.0f, -0.1f));
+	Vec3 t, b;
+	Optics::TangentFrame(rec.m_normal, t, b);
+	Ray r_in(Vec3(0.0f, 0.0f, 0.0f), 0.866f * t - 0.5f * rec.m_normal);
+
+	// Sample has to agree with Pdf and Eval, and both have to integrate to what Sample returns:
+	// the density to 1 over the sphere, the BSDF times the cosine to the mean weight of the paths not absorbed
+	BOOL allAgree = TRUE;
+	for (const Config &config : configs)
+	{
+		double weightSum = 0.0, maxPdfError = 0.0, maxWeightError = 0.0;
+		UINT32 specularCount = 0;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < count; i++)
+		{
+			rec.m_hitMaterial = const_cast<IMaterial *>(config.m_material);
+			BSDFSample sample;
+			if (!config.m_material->Sample(r_in, rec, sample))
+				continue;
+			weightSum += sample.m_weight.x();
+			if (sample.m_specular)
+			{
+				specularCount++;
+				continue;
+			}
+			float pdf = config.m_material->Pdf(r_in, rec, sample.m_direction);
+			Vec3 eval = config.m_material->Eval(r_in, rec, sample.m_direction);
+			maxPdfError = max(maxPdfError, (double)fabsf(pdf - sample.m_pdf) / sample.m_pdf);
+			maxWeightError = max(maxWeightError, (double)fabsf(eval.x() / pdf - sample.m_weight.x()) / sample.m_weight.x());
+		}
+		double seconds = SecondsSince(start);
+
+		double pdfIntegral = 0.0, evalIntegral = 0.0;
+		for (UINT32 i = 0; i < count; i++)
+		{
+			Vec3 direction = Randomizer::RandomOnUnitSphere();
+			pdfIntegral += config.m_material->Pdf(r_in, rec, direction);
+			evalIntegral += config.m_material->Eval(r_in, rec, direction).x();
+		}
+		pdfIntegral *= 4.0 * M_PI / count;
+		evalIntegral *= 4.0 * M_PI / count;
+		double meanWeight = weightSum / count;
+
+		BOOL agree = (specularCount == count) || (maxPdfError < 1e-3 && maxWeightError < 1e-3 && fabs(pdfIntegral - 1.0) < 0.02 && fabs(evalIntegral - meanWeight) < 0.02);
+		allAgree &= agree;
+		printf("[Benchmark] %-10s %8.3lf Msamples/s  specular %5.1f%%  max pdf error %.2e  max weight error %.2e  pdf integral %.4lf  BSDF cos integral %.4lf (mean weight %.4lf)  %s\n",
+			config.m_name, count / seconds * 1e-6, 100.0 * specularCount / count, maxPdfError, maxWeightError,
+			pdfIntegral, evalIntegral, meanWeight, agree ? "ok" : "MISMATCH");
+	}
+
+	// the radiance reflected by the diffuse surface under the sky, one sample per estimate: drawn uniformly over the hemisphere,
+	// as the Lambertian scattered before (normal plus a point of the ball, weighted by the BRDF for it to converge to the same),
+	// and cosine-weighted. Eval / Pdf is the weight of each
+	rec.m_hitMaterial = &lambertian;
+	const char *strategyNames[3] = { "uniform", "normal + ball", "cosine" };
+	double means[3], variances[3];
+	for (UINT32 strategy = 0; strategy < 3; strategy++)
+	{
+		double sum = 0.0, sumSquared = 0.0;
+		for (UINT32 i = 0; i < count; i++)
+		{
+			Vec3 direction;
+			float pdf;
+			if (strategy == 0)
+			{
+				direction = Randomizer::RandomOnUnitSphere();
+				if (dot(direction, rec.m_normal) < 0.0f)
+					direction = -direction;
+				pdf = 0.5f / (float)M_PI;
+			}
+			else if (strategy == 1)
+			{
+				direction = rec.m_normal + Randomizer::RomdomInUnitSphere();
+				float cosine = dot(rec.m_normal, direction) / direction.length();
+				pdf = 2.0f * cosine * cosine * cosine / (float)M_PI;
+			}
+			else
+			{
+				BSDFSample sample;
+				lambertian.Sample(r_in, rec, sample);
+				direction = sample.m_direction;
+				pdf = sample.m_pdf;
+			}
+			double estimate = (pdf > 0.0f) ? lambertian.Eval(r_in, rec, direction).x() * SkyRadiance(direction) / pdf : 0.0;
+			sum += estimate;
+			sumSquared += estimate * estimate;
+		}
+		means[strategy] = sum / count;
+		variances[strategy] = sumSquared / count - means[strategy] * means[strategy];
+		printf("[Benchmark] lambertian, %-14s mean %.4lf  variance %.4lf\n", strategyNames[strategy], means[strategy], variances[strategy]);
+	}
+	printf("[Benchmark] variance against cosine-weighted: uniform %.2lfx, normal + ball %.2lfx\n", variances[0] / variances[2], variances[1] / variances[2]);
+	return allAgree;
+}
+
+BOOL Benchmarks::SphereUVs(const CommandLineOptions &options)
+{
+	// the coordinates of random unit normals, std::atan2 and std::asin against the approximations, one at a time and 4 at a time
+	const UINT32 count = 1 << 20;
+	Randomizer::SetSeed(options.m_seed);
+	vector<float> nx(count), ny(count), nz(count), u[3], v[3];
+	for (UINT32 i = 0; i < count; i++)
+	{
+		Vec3 n = Randomizer::RandomOnUnitSphere();
+		nx[i] = n.x();
+		ny[i] = n.y();
+		nz[i] = n.z();
+	}
+	double seconds[3];
+	for (UINT32 m = 0; m < 3; m++)
+	{
+		u[m].resize(count);
+		v[m].resize(count);
+		auto start = chrono::steady_clock::now();
+		if (m == 0)
+		{
+			// the coordinates as SphereHitable::CalculateUV had them
+			for (UINT32 i = 0; i < count; i++)
+			{
+				u[m][i] = 1.0f - (atan2f(nz[i], nx[i]) + (float)M_PI) / (2.0f * (float)M_PI);
+				v[m][i] = (asinf(ny[i]) + (float)M_PI / 2.0f) / (float)M_PI;
+			}
+		}
+		else if (m == 1)
+		{
+			for (UINT32 i = 0; i < count; i++)
+			{
+				u[m][i] = 1.0f - (FastMath::Atan2(nz[i], nx[i]) + (float)M_PI) / (2.0f * (float)M_PI);
+				v[m][i] = (FastMath::Asin(ny[i]) + (float)M_PI / 2.0f) / (float)M_PI;
+			}
+		}
+		else
+			SphereHitable::CalculateUVs(nx.data(), ny.data(), nz.data(), count, u[m].data(), v[m].data());
+		seconds[m] = SecondsSince(start);
+	}
+	float maxErrorU = 0.0f, maxErrorV = 0.0f, maxDifference = 0.0f;
+	for (UINT32 i = 0; i < count; i++)
+	{
+		// u wraps around at the seam, where atan2 of -0 and +0 differ
+		float du = fabsf(u[1][i] - u[0][i]);
+		maxErrorU = max(maxErrorU, min(du, 1.0f - du));
+		maxErrorV = max(maxErrorV, fabsf(v[1][i] - v[0][i]));
+		maxDifference = max(maxDifference, max(fabsf(u[2][i] - u[1][i]), fabsf(v[2][i] - v[1][i])));
+	}
+	printf("[Benchmark] std::atan2/asin %10.3lf Muvs/s\n", count / seconds[0] * 1e-6);
+	printf("[Benchmark] FastMath        %10.3lf Muvs/s  max error u %.2e v %.2e, %.4f texels of a 4096 texture\n",
+		count / seconds[1] * 1e-6, maxErrorU, maxErrorV, 4096.0f * max(maxErrorU, maxErrorV));
+	printf("[Benchmark] FastMath Float4 %10.3lf Muvs/s  max difference to the scalar %g\n", count / seconds[2] * 1e-6, maxDifference);
+
+	// the normals of the hits are (p - c) / r, not renormalized, at the poles |y| comes out a few ulps above 1.
+	// 4 at a time and the scalar tail, v has to be exactly at the pole, not NaN
+	const UINT32 poleCount = 18;
+	float poleX[poleCount], poleY[poleCount], poleZ[poleCount], poleU[poleCount], poleV[poleCount];
+	for (UINT32 i = 0; i < poleCount; i++)
+	{
+		poleX[i] = poleZ[i] = 0.0f;
+		poleY[i] = ((i & 1) ? -1.0f : 1.0f) * (1.0f + (i / 2) * FLT_EPSILON);
+	}
+	SphereHitable::CalculateUVs(poleX, poleY, poleZ, poleCount, poleU, poleV);
+	float maxPoleError = 0.0f;
+	for (UINT32 i = 0; i < poleCount; i++)
+	{
+		float error = fabsf(poleV[i] - ((poleY[i] > 0.0f) ? 1.0f : 0.0f));
+		// NaN fails every comparison
+		maxPoleError = (error <= maxPoleError) ? maxPoleError : error;
+		maxPoleError = (poleU[i] == poleU[i]) ? maxPoleError : FLT_MAX;
+	}
+	printf("[Benchmark] FastMath poles  |y| up to 1 + %u ulps, max error v %.2e\n", poleCount / 2 - 1, maxPoleError);
+
+	// the closest hits of the random-spheres scene, the spheres skip the coordinates their texture does not read,
+	// then all compute them, bound to no material
+	OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	World *world = new World();
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+	world->ConstructWorld(WORLD_ID_RANDOM_SPHERES, camera);
+	UINT32 uvCount = 0;
+	for (const Object *object : world->GetObjects())
+		uvCount += (object->m_material && object->m_material->NeedsUV()) ? 1 : 0;
+	printf("[Benchmark] random   %zu objects, %u with a material that reads the texture coordinates\n", world->GetObjects().size(), uvCount);
+
+	// one camera ray per pixel, and one diffuse bounce from every camera hit
+	vector<Ray> rays;
+	for (UINT32 j = 0; j < options.m_height; j++)
+	{
+		for (UINT32 i = 0; i < options.m_width; i++)
+		{
+			Ray r = camera->GetRay(float(i) / float(options.m_width), float(j) / float(options.m_height));
+			rays.push_back(r);
+			HitRecord rec;
+			float t_max = FLT_MAX;
+			if (world->Hit(r, 0.001f, t_max, rec))
+				rays.push_back(Ray(rec.m_position, rec.m_normal + Randomizer::RandomOnUnitSphere()));
+		}
+	}
+
+	const UINT32 repeat = 8;
+	const char *passNames[2] = { "lazy", "always" };
+	float checksums[2];
+	for (UINT32 pass = 0; pass < 2; pass++)
+	{
+		if (pass == 1)
+		{
+			for (Object *object : world->GetObjects())
+				object->m_hitable->BindMaterial(nullptr);
+		}
+		float checksum = 0.0f;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 k = 0; k < repeat; k++)
+		{
+			for (const Ray &r : rays)
+			{
+				HitRecord rec;
+				float t_max = FLT_MAX;
+				if (world->Hit(r, 0.001f, t_max, rec))
+					checksum += rec.m_time;
+			}
+		}
+		double passSeconds = SecondsSince(start);
+		checksums[pass] = checksum;
+		printf("[Benchmark] random   UV %-8s %8.3lfs %10.3lf Mrays/s  checksum %.3f\n", passNames[pass], passSeconds, (double)rays.size() * repeat / passSeconds * 1e-6, checksum);
+	}
+	for (Object *object : world->GetObjects())
+		object->m_hitable->BindMaterial(object->m_material);
+
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete outputImage;
+	return maxDifference < 1e-6f && maxPoleError < 1e-6f && checksums[0] == checksums[1];
+}
+
+BOOL Benchmarks::TextureFiltering(const CommandLineOptions &options)
+{
+	SimpleTexture2D_TGAImage *texture = new SimpleTexture2D_TGAImage("..\\Assets\\pro_metal_checker_plate_001_c.tga");
+	if (texture->m_width <= 1)
+	{
+		delete texture;
+		return FALSE;
+	}
+	const TexturePyramid &pyramid = texture->m_pyramid;
+	UINT32 width = texture->m_width;
+	UINT32 height = texture->m_height;
+	printf("[Benchmark] texture  %ux%u, RGBA8 %zu KB, float rows %zu KB, tiled pyramid of %u levels %zu KB\n",
+		width, height, (size_t)width * height * 4 / 1024, (size_t)width * height * 16 / 1024, pyramid.GetLevelCount(), pyramid.GetMemorySize() / 1024);
+
+	vector<float> rows((size_t)width * height * 4);
+	for (size_t i = 0; i < rows.size(); i++)
+		rows[i] = texture->m_pixelData[i] / 255.0f;
+
+	// coherent: windows of 64 x 64 pixels a row at a time, one texel per pixel, on a surface turned by 60 degrees from
+	// the rows of the texture, like the camera rays. incoherent: anywhere on the texture, like the bounces, with the
+	// footprint of a surface seen from 8 texels per pixel
+	const UINT32 count = 1 << 20;
+	const float cosAngle = 0.5f;
+	const float sinAngle = 0.8660254f;
+	Randomizer::SetSeed(options.m_seed);
+	vector<float> us[2], vs[2];
+	for (UINT32 c = 0; c < 2; c++)
+	{
+		us[c].resize(count);
+		vs[c].resize(count);
+	}
+	for (UINT32 i = 0; i < count; i++)
+	{
+		UINT32 window = i >> 12;
+		float x = (i & 63) + Randomizer::RandomUNorm();
+		float y = ((i >> 6) & 63) + Randomizer::RandomUNorm();
+		us[0][i] = ((window % 16) * 64 + cosAngle * x - sinAngle * y) / width;
+		vs[0][i] = ((window / 16) * 64 + sinAngle * x + cosAngle * y) / height;
+		us[1][i] = Randomizer::RandomUNorm();
+		vs[1][i] = Randomizer::RandomUNorm();
+	}
+	const float footprints[2] = { 1.0f / width, 8.0f / width };
+	const char *caseNames[2] = { "coherent", "incoherent" };
+	const char *methodNames[5] = { "RGBA8 nearest", "pyramid nearest", "rows bilinear", "tiled bilinear", "tiled trilinear" };
+
+	float maxDifference = 0.0f;
+	for (UINT32 c = 0; c < 2; c++)
+	{
+		vector<Vec3> results[5];
+		for (UINT32 m = 0; m < 5; m++)
+		{
+			results[m].resize(count);
+			const float *u = us[c].data();
+			const float *v = vs[c].data();
+			auto start = chrono::steady_clock::now();
+			switch (m)
+			{
+			case 0:	for (UINT32 i = 0; i < count; i++) results[m][i] = SampleNearestRGBA8(texture, u[i], v[i]); break;
+			case 1:	for (UINT32 i = 0; i < count; i++) results[m][i] = pyramid.SampleNearest(u[i], v[i]); break;
+			case 2:	for (UINT32 i = 0; i < count; i++) results[m][i] = SampleBilinearRows(rows, width, height, u[i], v[i]); break;
+			case 3:	for (UINT32 i = 0; i < count; i++) results[m][i] = pyramid.SampleBilinear(u[i], v[i], 0); break;
+			case 4:	for (UINT32 i = 0; i < count; i++) results[m][i] = pyramid.SampleTrilinear(u[i], v[i], footprints[c]); break;
+			}
+			double seconds = SecondsSince(start);
+			Vec3 sum(0.0f, 0.0f, 0.0f);
+			for (UINT32 i = 0; i < count; i++)
+				sum += results[m][i];
+			printf("[Benchmark] %-10s %-16s %10.3lf Mlookups/s  mean %.4f\n", caseNames[c], methodNames[m], count / seconds * 1e-6, (sum.r() + sum.g() + sum.b()) / (3.0f * count));
+		}
+		// the tiles only change where the texels are
+		for (UINT32 i = 0; i < count; i++)
+		{
+			Vec3 d = results[3][i] - results[2][i];
+			maxDifference = max(maxDifference, max(fabsf(d.r()), max(fabsf(d.g()), fabsf(d.b()))));
+		}
+	}
+	printf("[Benchmark] max difference of the tiled bilinear lookups to the rows %g\n", maxDifference);
+	delete texture;
+
+	// the textured world against a reference without texture LOD, the pixel integral of the full resolution texture,
+	// with the first level only and with the footprint of the pixels
+	const UINT32 sppScales[] = { 1, 2, 4 };
+	const UINT32 referenceScale = 32;
+	OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	OutputImage *referenceImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	World *world = new World();
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+	world->ConstructWorld(WORLD_ID_TEXTURED, camera);
+
+	HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+	hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+	hmRayTracer->SetRussianRouletteDepth(options.m_russianRouletteDepth);
+	hmRayTracer->SetThreadCount(options.m_threadCount);
+	hmRayTracer->SetTextureLod(FALSE);
+	hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * referenceScale);
+	hmRayTracer->TraceRay(camera, referenceImage);
+
+	for (UINT32 lod = 0; lod < 2; lod++)
+	{
+		hmRayTracer->SetTextureLod(lod == 1);
+		for (UINT32 k = 0; k < _countof(sppScales); k++)
+		{
+			hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * sppScales[k]);
+			auto start = chrono::steady_clock::now();
+			hmRayTracer->TraceRay(camera, outputImage);
+			double seconds = SecondsSince(start);
+			double mse = ImageMSE(outputImage, referenceImage);
+			printf("[Benchmark] textured %-12s %4u spp %8.3lfs %10.3lf Mrays/s  RMSE %.5lf  MSE x time %.6lf\n",
+				lod ? "trilinear" : "bilinear", hmRayTracer->GetSamplePerPixel(), seconds, hmRayTracer->GetLastPassRayCount() / seconds * 1e-6, sqrt(mse), mse * seconds);
+		}
+	}
+
+	delete hmRayTracer;
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete referenceImage;
+	delete outputImage;
+	return maxDifference < 1e-6f;
+}
+
+BOOL Benchmarks::BVHTraversal(const CommandLineOptions &options)
+{
+	const WorldID worldIDs[] = { WORLD_ID_RANDOM_SPHERES, WORLD_ID_CORNELL_BOX };
+	const char *worldNames[] = { "random", "cornell" };
+	BOOL allMatch = TRUE;
+
+	for (UINT32 w = 0; w < _countof(worldIDs); w++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(worldIDs[w], camera);
+		world->BuildAccelerationStructure(ACCELERATION_OBJECT_TREE);
+		world->BuildAccelerationStructure(ACCELERATION_OBJECT_BVH);
+
+		UINT32 treeMaxDepth = 0;
+		UINT32 treeNodeCount = CountObjectTreeNodes(world->GetObjectBVHTree(), 0, treeMaxDepth);
+		const LinearBVH &bvh = world->GetObjectBVH();
+		printf("[Benchmark] %-8s %zu objects, SimpleObjectBVHNode: %u nodes, depth %u, LinearBVH: %zu nodes (%zu bytes), %u leaves, depth %u, SAH cost %.2f\n",
+			worldNames[w], world->GetObjects().size(), treeNodeCount, treeMaxDepth, bvh.GetNodeCount(), bvh.GetNodeCount() * sizeof(LinearBVHNode), bvh.GetLeafCount(), bvh.GetMaxDepth(), bvh.GetSAHCost());
+		const SphereStore &sphereStore = world->GetSphereStore();
+		const LinearBVH &sphereBVH = sphereStore.GetBVH();
+		const LinearBVH &otherBVH = world->GetOtherObjectBVH();
+		printf("[Benchmark] %-8s SphereStore: %u spheres, %zu nodes, %u leaves, depth %u, SAH cost %.2f, other objects LinearBVH: %zu nodes, SAH cost %.2f\n",
+			worldNames[w], sphereStore.GetSphereCount(), sphereBVH.GetNodeCount(), sphereBVH.GetLeafCount(), sphereBVH.GetMaxDepth(), sphereBVH.GetSAHCost(), otherBVH.GetNodeCount(), otherBVH.GetSAHCost());
+
+		// one camera ray per pixel, and one diffuse bounce from every camera hit
+		vector<Ray> rays[2];
+		for (UINT32 j = 0; j < options.m_height; j++)
+		{
+			for (UINT32 i = 0; i < options.m_width; i++)
+			{
+				Ray r = camera->GetRay(float(i) / float(options.m_width), float(j) / float(options.m_height));
+				rays[0].push_back(r);
+
+				HitRecord rec;
+				float t_max = FLT_MAX;
+				if (world->Hit(r, 0.001f, t_max, rec))
+					rays[1].push_back(Ray(rec.m_position, rec.m_normal + Randomizer::RomdomInUnitSphere()));
+			}
+		}
+
+		const char *rayNames[] = { "camera", "bounce" };
+		for (UINT32 n = 0; n < 2; n++)
+		{
+			const vector<Ray> &batch = rays[n];
+			if (batch.empty())
+				continue;
+
+			// statistics, and the closest hits of every structure have to agree with the tree
+			const AccelerationStructure accels[3] = { ACCELERATION_OBJECT_TREE, ACCELERATION_OBJECT_BVH, ACCELERATION_LINEAR_BVH };
+			const char *accelNames[3] = { "tree", "bvh", "spheres" };
+			BVHTraversalStats stats[3];
+			UINT64 mismatches = 0;
+			for (const Ray &r : batch)
+			{
+				HitRecord treeRec;
+				float treeMin = 0.001f;
+				float treeMax = FLT_MAX;
+				BOOL treeHit = HitObjectTreeWithStats(world->GetObjectBVHTree(), r, treeMin, treeMax, treeRec, stats[0]);
+				stats[0].m_rayCount++;
+
+				for (UINT32 a = 1; a < 3; a++)
+				{
+					world->SetAccelerationStructure(accels[a]);
+					HitRecord bvhRec;
+					float bvhMax = FLT_MAX;
+					BOOL bvhHit = world->Hit(r, 0.001f, bvhMax, bvhRec, &stats[a]);
+					if (treeHit != bvhHit || (treeHit && (treeMax != bvhMax || treeRec.m_hitMaterial != bvhRec.m_hitMaterial)))
+						mismatches++;
+				}
+			}
+
+			// timing, single thread
+			double seconds[3];
+			for (UINT32 a = 0; a < 3; a++)
+			{
+				world->SetAccelerationStructure(accels[a]);
+				auto start = chrono::steady_clock::now();
+				for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+				{
+					for (const Ray &r : batch)
+					{
+						HitRecord rec;
+						float t_max = FLT_MAX;
+						world->Hit(r, 0.001f, t_max, rec);
+					}
+				}
+				seconds[a] = SecondsSince(start);
+			}
+			world->SetAccelerationStructure(ACCELERATION_LINEAR_BVH);
+
+			UINT64 rayCount = (UINT64)batch.size() * options.m_frameCount;
+			for (UINT32 a = 0; a < 3; a++)
+				ReportTraversal(worldNames[w], rayNames[n], accelNames[a], stats[a], seconds[a], rayCount);
+			if (mismatches > 0)
+			{
+				printf("[Benchmark] %-8s %-7s %llu closest hits differ from the tree over %zu rays\n", worldNames[w], rayNames[n], (unsigned long long)mismatches, batch.size());
+				allMatch = FALSE;
+			}
+		}
+
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete outputImage;
+	}
+
+	printf("[Benchmark] Closest hits %s\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::TileScheduling(const CommandLineOptions &options)
+{
+	struct Config
+	{
+		const char *	m_name;
+		UINT32			m_tileWidth;		// 0 for full rows
+		UINT32			m_tileHeight;
+		TileOrder		m_order;
+		BOOL			m_workStealing;
+		BOOL			m_printThreads;
+	};
+	// the first one is what the omp static schedule over rows used to do
+	const Config configs[] =
+	{
+		{ "rows, static",			0,	1,	TILE_ORDER_SCANLINE,	FALSE,	TRUE },
+		{ "rows, stealing",			0,	1,	TILE_ORDER_SCANLINE,	TRUE,	FALSE },
+		{ "32x32 scanline",			32,	32,	TILE_ORDER_SCANLINE,	TRUE,	FALSE },
+		{ "32x32 morton",			32,	32,	TILE_ORDER_MORTON,		TRUE,	FALSE },
+		{ "32x32 hilbert",			32,	32,	TILE_ORDER_HILBERT,		TRUE,	TRUE },
+		{ "16x16 hilbert",			16,	16,	TILE_ORDER_HILBERT,		TRUE,	FALSE },
+	};
+
+	OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	World *world = new World();
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+	world->ConstructWorld(options.m_worldID, camera);
+
+	HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+	hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel);
+	hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+	hmRayTracer->SetThreadCount(options.m_threadCount);
+
+	UINT64 samples = (UINT64)options.m_width * (UINT64)options.m_height * (UINT64)hmRayTracer->GetSamplePerPixel();
+	for (const Config &config : configs)
+	{
+		hmRayTracer->SetTileSize(config.m_tileWidth ? config.m_tileWidth : options.m_width, config.m_tileHeight);
+		hmRayTracer->SetTileOrder(config.m_order);
+		hmRayTracer->SetWorkStealing(config.m_workStealing);
+
+		double bestSeconds = DBL_MAX;
+		double imbalance = 0.0;
+		for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+		{
+			auto start = chrono::steady_clock::now();
+			hmRayTracer->TraceRay(camera, outputImage);
+			double seconds = SecondsSince(start);
+			if (seconds < bestSeconds)
+			{
+				// max over mean busy time, 1.0 when every thread worked as long as the others
+				const ThreadPool *pool = hmRayTracer->GetThreadPool();
+				double maxBusy = 0.0, totalBusy = 0.0;
+				for (UINT32 t = 0; t < pool->GetThreadCount(); t++)
+				{
+					maxBusy = max(maxBusy, pool->GetThreadStats(t).m_busySeconds);
+					totalBusy += pool->GetThreadStats(t).m_busySeconds;
+				}
+				imbalance = maxBusy * pool->GetThreadCount() / totalBusy;
+				bestSeconds = seconds;
+			}
+		}
+
+		if (config.m_printThreads)
+			hmRayTracer->PrintThreadStats();
+		printf("[Benchmark] %-16s %8.3lfs %10.3lf Msamples/s  busy max/avg %.3lf\n", config.m_name, bestSeconds, samples / bestSeconds * 1e-6, imbalance);
+	}
+
+	delete hmRayTracer;
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete outputImage;
+	return TRUE;
+}
+
+BOOL Benchmarks::Integrators(const CommandLineOptions &options)
+{
+	struct Config
+	{
+		const char *	m_name;
+		IntegratorType	m_integrator;
+		UINT32			m_russianRouletteDepth;
+	};
+	const Config configs[] =
+	{
+		{ "recursive",			INTEGRATOR_RECURSIVE,	0 },
+		{ "iterative",			INTEGRATOR_ITERATIVE,	UINT_MAX },
+		{ "iterative, rr 3",	INTEGRATOR_ITERATIVE,	3 },
+		{ "iterative, rr 5",	INTEGRATOR_ITERATIVE,	5 },
+		{ "wavefront, rr 5",	INTEGRATOR_WAVEFRONT,	5 },
+	};
+	const UINT32 referenceScale = 8;
+
+	const WorldID worldIDs[] = { WORLD_ID_CORNELL_BOX, WORLD_ID_RANDOM_SPHERES };
+	const char *worldNames[] = { "cornell", "random" };
+	for (UINT32 w = 0; w < _countof(worldIDs); w++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		OutputImage *referenceImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(worldIDs[w], camera);
+
+		HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+		hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+		hmRayTracer->SetThreadCount(options.m_threadCount);
+
+		// the reference, with many more samples and no roulette
+		hmRayTracer->SetIntegrator(INTEGRATOR_ITERATIVE);
+		hmRayTracer->SetRussianRouletteDepth(UINT_MAX);
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * referenceScale);
+		hmRayTracer->TraceRay(camera, referenceImage);
+
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel);
+		UINT64 samples = (UINT64)options.m_width * (UINT64)options.m_height * (UINT64)hmRayTracer->GetSamplePerPixel();
+		for (const Config &config : configs)
+		{
+			hmRayTracer->SetIntegrator(config.m_integrator);
+			hmRayTracer->SetRussianRouletteDepth(config.m_russianRouletteDepth);
+
+			auto start = chrono::steady_clock::now();
+			hmRayTracer->TraceRay(camera, outputImage);
+			double seconds = SecondsSince(start);
+
+			// error times time, lower is better
+			double mse = ImageMSE(outputImage, referenceImage);
+			printf("[Benchmark] %-8s %-16s %8.3lfs %8.3lf Msamples/s %8.3lf Mrays/s %6.2lf rays/sample  MSE %.6lf  relative error %.4f  MSE x time %.6lf\n",
+				worldNames[w], config.m_name, seconds, samples / seconds * 1e-6, hmRayTracer->GetLastPassRayCount() / seconds * 1e-6,
+				(double)hmRayTracer->GetLastPassRayCount() / samples, mse, hmRayTracer->EstimateRelativeError(), mse * seconds);
+		}
+
+		delete hmRayTracer;
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete referenceImage;
+		delete outputImage;
+	}
+
+	// the wavefront paths of the samples past the first have their own streams, 512 spp must not repeat 256 spp:
+	// a fresh tracer each time, so that the frame index and therefore the streams are the same
+	const UINT32 streamSPPs[] = { 256, 512 };
+	OutputImage *streamImages[2];
+	World *world = new World();
+	streamImages[0] = new OutputImage(16, 16, options.m_outputName.c_str());
+	streamImages[1] = new OutputImage(16, 16, options.m_outputName.c_str());
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, streamImages[0]->m_aspectRatio);
+	world->ConstructWorld(WORLD_ID_CORNELL_BOX, camera);
+	for (UINT32 n = 0; n < 2; n++)
+	{
+		HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, streamImages[n], world);
+		hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+		hmRayTracer->SetThreadCount(1);
+		hmRayTracer->SetIntegrator(INTEGRATOR_WAVEFRONT);
+		hmRayTracer->SetSamplePerPixel(streamSPPs[n]);
+		hmRayTracer->TraceRay(camera, streamImages[n]);
+		delete hmRayTracer;
+	}
+	BOOL identical = (memcmp(streamImages[0]->m_data, streamImages[1]->m_data, (size_t)streamImages[0]->m_dataSizeInByte) == 0);
+	printf("[Benchmark] cornell 16x16 wavefront at %u and %u spp: %s\n", streamSPPs[0], streamSPPs[1], identical ? "identical, the sample streams repeat" : "different");
+
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete streamImages[0];
+	delete streamImages[1];
+	return !identical;
+}
+
+BOOL Benchmarks::Packets(const CommandLineOptions &options)
+{
+	const WorldID worldIDs[] = { WORLD_ID_RANDOM_SPHERES, WORLD_ID_CORNELL_BOX };
+	const char *worldNames[] = { "random", "cornell" };
+	const UINT32 packetWidths[] = { 1, 4, 8, 16 };
+	BOOL allMatch = TRUE;
+
+	for (UINT32 w = 0; w < _countof(worldIDs); w++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		OutputImage *referenceImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(worldIDs[w], camera);
+
+		// camera ray queries only, single thread
+		vector<Ray> rays;
+		vector<float> reference;
+		for (UINT32 j = 0; j < options.m_height; j++)
+		{
+			for (UINT32 i = 0; i < options.m_width; i++)
+			{
+				Ray r = camera->GetRay(float(i) / float(options.m_width), float(j) / float(options.m_height));
+				HitRecord rec;
+				float t_max = FLT_MAX;
+				rays.push_back(r);
+				reference.push_back(world->Hit(r, 0.001f, t_max, rec) ? rec.m_time : FLT_MAX);
+			}
+		}
+
+		for (UINT32 packetWidth : packetWidths)
+		{
+			BVHTraversalStats stats;
+			UINT64 mismatches = 0;
+			double seconds = 0.0;
+			switch (packetWidth)
+			{
+			case 1:
+			{
+				auto start = chrono::steady_clock::now();
+				for (UINT32 n = 0; n < options.m_frameCount; n++)
+				{
+					for (const Ray &r : rays)
+					{
+						HitRecord rec;
+						float t_max = FLT_MAX;
+						world->Hit(r, 0.001f, t_max, rec, (n == 0) ? &stats : nullptr);
+					}
+				}
+				seconds = SecondsSince(start);
+				break;
+			}
+			case 4:		seconds = HitCameraPackets<4>(world, rays, reference, options.m_width, options.m_height, options.m_frameCount, stats, mismatches); break;
+			case 8:		seconds = HitCameraPackets<8>(world, rays, reference, options.m_width, options.m_height, options.m_frameCount, stats, mismatches); break;
+			default:	seconds = HitCameraPackets<16>(world, rays, reference, options.m_width, options.m_height, options.m_frameCount, stats, mismatches); break;
+			}
+
+			UINT64 rayCount = (UINT64)rays.size() * options.m_frameCount;
+			if (packetWidth == 1)
+			{
+				printf("[Benchmark] %-8s camera  single    %8.2lf nodes/ray %8.2lf leaf tests/ray                                      %10.3lf Mrays/s\n",
+					worldNames[w], (double)stats.m_nodesVisited / stats.m_rayCount, (double)stats.m_leafTests / stats.m_rayCount, rayCount / seconds * 1e-6);
+			}
+			else
+			{
+				// per ray costs, a packet node test counts once for all of its lanes
+				printf("[Benchmark] %-8s camera  packet %2u %8.2lf nodes/ray %8.2lf leaf tests/ray %6.2lf%% fallback rays %6.2lf single nodes/ray %10.3lf Mrays/s\n",
+					worldNames[w], packetWidth, (double)stats.m_packetNodesVisited / stats.m_rayCount, (double)stats.m_packetLeafTests / stats.m_rayCount,
+					stats.m_fallbackRays * 100.0 / stats.m_rayCount, (double)stats.m_nodesVisited / stats.m_rayCount, rayCount / seconds * 1e-6);
+				if (mismatches > 0)
+				{
+					printf("[Benchmark] %-8s packet %u: %llu of %zu closest hits differ\n", worldNames[w], packetWidth, (unsigned long long)mismatches, rays.size());
+					allMatch = FALSE;
+				}
+			}
+		}
+
+		// the whole 1-SPP preview, the image has to be the one of single rays.
+		// A new tracer per width, so that every run starts from the same frame index and random streams.
+		double singleSeconds = 0.0;
+		for (UINT32 packetWidth : packetWidths)
+		{
+			OutputImage *image = (packetWidth == 1) ? referenceImage : outputImage;
+			HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, image, world);
+			hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel);
+			hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+			hmRayTracer->SetThreadCount(options.m_threadCount);
+			hmRayTracer->SetPacketWidth(packetWidth);
+
+			auto start = chrono::steady_clock::now();
+			hmRayTracer->TraceRay(camera, image);
+			double seconds = SecondsSince(start);
+			if (packetWidth == 1)
+				singleSeconds = seconds;
+
+			double mse = (packetWidth == 1) ? 0.0 : ImageMSE(outputImage, referenceImage);
+			printf("[Benchmark] %-8s render  width %2u %8.3lfs %6.2lfx  MSE against single rays %.6lf\n", worldNames[w], packetWidth, seconds, singleSeconds / seconds, mse);
+			if (mse != 0.0)
+				allMatch = FALSE;
+			delete hmRayTracer;
+		}
+
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete referenceImage;
+		delete outputImage;
+	}
+
+	printf("[Benchmark] Packet results %s\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::TriangleMeshes(const CommandLineOptions &options)
+{
+	Resources *resources = new Resources();
+	resources->Load();
+	const Mesh *mesh = resources->GetTheMesh(MESH_ID_HIGH_POLYGON_SPHERE);
+
+	auto start = chrono::steady_clock::now();
+	TriangleMeshHitable *meshHitable = new TriangleMeshHitable(mesh);
+	double buildSeconds = SecondsSince(start);
+	const LinearBVH &bvh = meshHitable->GetBVH();
+	printf("[Benchmark] high polygon sphere: %u triangles, BLAS built in %.3lfs, %zu nodes, %u leaves, depth %u, SAH cost %.2f\n",
+		meshHitable->GetTriangleCount(), buildSeconds, bvh.GetNodeCount(), bvh.GetLeafCount(), bvh.GetMaxDepth(), bvh.GetSAHCost());
+
+	// from outside toward random points of the unit ball, the analytic sphere the mesh approximates as reference
+	SphereHitable sphereHitable(Vec3(0.0f, 0.0f, 0.0f), 1.0f);
+	UINT32 rayCount = options.m_width * options.m_height;
+	vector<Ray> rays;
+	rays.reserve(rayCount);
+	for (UINT32 i = 0; i < rayCount; i++)
+	{
+		Vec3 org = 3.0f * normalize(Randomizer::RomdomInUnitSphere() + Vec3(0.0f, 0.0f, 1e-6f));
+		rays.push_back(Ray(org, Randomizer::RomdomInUnitSphere() - org));
+	}
+
+	UINT64 meshHits = 0;
+	UINT64 sphereHits = 0;
+	UINT64 bothHits = 0;
+	double distanceError = 0.0;
+	double normalError = 0.0;
+	for (const Ray &r : rays)
+	{
+		HitRecord meshRec;
+		HitRecord sphereRec;
+		BOOL meshHit = meshHitable->Hit(r, 0.001f, FLT_MAX, meshRec);
+		BOOL sphereHit = sphereHitable.Hit(r, 0.001f, FLT_MAX, sphereRec);
+		meshHits += meshHit;
+		sphereHits += sphereHit;
+		if (meshHit && sphereHit)
+		{
+			bothHits++;
+			distanceError += fabs((meshRec.m_position - sphereRec.m_position).length());
+			normalError += 1.0 - dot(meshRec.m_normal, sphereRec.m_normal);
+		}
+	}
+	printf("[Benchmark] %llu rays, mesh hits %llu, sphere hits %llu, mean position error %.6lf, mean normal 1 - cos %.3e\n", (unsigned long long)rays.size(),
+		(unsigned long long)meshHits, (unsigned long long)sphereHits, distanceError / max(bothHits, (UINT64)1), normalError / max(bothHits, (UINT64)1));
+
+	// timing, single thread
+	const IHitable *hitables[2] = { meshHitable, &sphereHitable };
+	const char *hitableNames[2] = { "mesh", "sphere" };
+	for (UINT32 h = 0; h < 2; h++)
+	{
+		start = chrono::steady_clock::now();
+		for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+		{
+			for (const Ray &r : rays)
+			{
+				HitRecord rec;
+				hitables[h]->Hit(r, 0.001f, FLT_MAX, rec);
+			}
+		}
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] %-6s %10.3lf Mrays/s\n", hitableNames[h], (UINT64)rays.size() * options.m_frameCount / seconds * 1e-6);
+	}
+
+	// a ray starting inside the closed mesh can only leave through a crack: rays from the center through every vertex,
+	// so exactly along the shared edges, then from random inner points
+	const SimpleMeshVertex *vertices = static_cast<const SimpleMeshVertex *>(mesh->m_vertexBuffer);
+	UINT64 escaped = 0;
+	UINT64 insideRayCount = 0;
+	for (UINT32 i = 0; i < mesh->m_vertexCount; i++)
+	{
+		HitRecord rec;
+		Vec3 position(vertices[i].m_position.x, vertices[i].m_position.y, vertices[i].m_position.z);
+		escaped += !meshHitable->Hit(Ray(Vec3(0.0f, 0.0f, 0.0f), position), 0.0f, FLT_MAX, rec);
+		insideRayCount++;
+	}
+	for (UINT32 i = 0; i < rayCount; i++)
+	{
+		HitRecord rec;
+		Ray r(0.9f * Randomizer::RomdomInUnitSphere(), Randomizer::RomdomInUnitSphere() + Vec3(0.0f, 0.0f, 1e-6f));
+		escaped += !meshHitable->Hit(r, 0.0f, FLT_MAX, rec);
+		insideRayCount++;
+	}
+	printf("[Benchmark] watertight: %llu of %llu rays from inside escaped\n", (unsigned long long)escaped, (unsigned long long)insideRayCount);
+
+	delete meshHitable;
+	resources->Unload();
+	delete resources;
+	return escaped == 0;
+}
+
+BOOL Benchmarks::Instances(const CommandLineOptions &options)
+{
+	const UINT32 INSTANCE_COUNT = 100000;
+	Resources *resources = new Resources();
+	resources->Load();
+
+	// one bottom level per mesh, built once
+	const MeshUniqueID meshIDs[] = { MESH_ID_HIGH_POLYGON_SPHERE, MESH_ID_MEDIUM_POLYGON_SPHERE, MESH_ID_LOW_POLYGON_SPHERE, MESH_ID_CUBE };
+	vector<TriangleMeshHitable *> meshes;
+	size_t blasBytes = 0;
+	auto start = chrono::steady_clock::now();
+	for (MeshUniqueID meshID : meshIDs)
+	{
+		meshes.push_back(new TriangleMeshHitable(resources->GetTheMesh(meshID)));
+		blasBytes += meshes.back()->GetMemorySize();
+	}
+	double blasSeconds = SecondsSince(start);
+
+	// random placements in a 200 units wide slab, uniform scales from 0.2 to 1
+	vector<Transform3x4> transforms(INSTANCE_COUNT);
+	vector<UINT32> geometries(INSTANCE_COUNT);
+	size_t flattenedBytes = 0;
+	for (UINT32 i = 0; i < INSTANCE_COUNT; i++)
+	{
+		Vec3 translation(200.0f * Randomizer::RandomUNorm() - 100.0f, 10.0f * Randomizer::RandomUNorm(), 200.0f * Randomizer::RandomUNorm() - 100.0f);
+		Vec3 rotation(6.2831853f * Randomizer::RandomUNorm(), 6.2831853f * Randomizer::RandomUNorm(), 6.2831853f * Randomizer::RandomUNorm());
+		float scale = 0.2f + 0.8f * Randomizer::RandomUNorm();
+		transforms[i] = Transform3x4::FromTranslationRotationScaling(translation, rotation, Vec3(scale, scale, scale));
+		geometries[i] = min((UINT32)(Randomizer::RandomUNorm() * meshes.size()), (UINT32)meshes.size() - 1);
+		flattenedBytes += meshes[geometries[i]]->GetMemorySize();
+	}
+
+	TwoLevelBVH twoLevelBVH;
+	start = chrono::steady_clock::now();
+	for (TriangleMeshHitable *mesh : meshes)
+		twoLevelBVH.AddGeometry(mesh);
+	UINT32 material = twoLevelBVH.AddMaterial(resources->GetTheMaterial(MATERIAL_ID_LAMBERTIAN0));
+	for (UINT32 i = 0; i < INSTANCE_COUNT; i++)
+		twoLevelBVH.AddInstance(geometries[i], transforms[i], material, i);
+	twoLevelBVH.Build();
+	double tlasSeconds = SecondsSince(start);
+
+	const LinearBVH &tlas = twoLevelBVH.GetTLAS();
+	printf("[Benchmark] %zu BLAS built in %.3lfs, %.2lf MB\n", meshes.size(), blasSeconds, blasBytes / (1024.0 * 1024.0));
+	printf("[Benchmark] %u instances, TLAS built in %.3lfs, %zu nodes, depth %u, SAH cost %.2f, %.2lf MB, %.2lf MB with a copy of the geometry per instance\n",
+		twoLevelBVH.GetInstanceCount(), tlasSeconds, tlas.GetNodeCount(), tlas.GetMaxDepth(), tlas.GetSAHCost(), twoLevelBVH.GetMemorySize() / (1024.0 * 1024.0), flattenedBytes / (1024.0 * 1024.0));
+
+	// from above the slab toward random points of the ground, the closest hits have to be the ones of a brute force loop
+	UINT32 rayCount = options.m_width * options.m_height;
+	vector<Ray> rays;
+	rays.reserve(rayCount);
+	for (UINT32 i = 0; i < rayCount; i++)
+	{
+		Vec3 org(200.0f * Randomizer::RandomUNorm() - 100.0f, 50.0f, 200.0f * Randomizer::RandomUNorm() - 100.0f);
+		Vec3 target(200.0f * Randomizer::RandomUNorm() - 100.0f, 0.0f, 200.0f * Randomizer::RandomUNorm() - 100.0f);
+		rays.push_back(Ray(org, target - org));
+	}
+
+	UINT64 mismatches = 0;
+	UINT64 hits = 0;
+	const UINT32 bruteForceRayCount = min(rayCount, 1000u);
+	for (UINT32 i = 0; i < bruteForceRayCount; i++)
+	{
+		const Ray &r = rays[i];
+		HitRecord rec;
+		float t_max = FLT_MAX;
+		BOOL hit = twoLevelBVH.Hit(r, 0.001f, t_max, rec);
+		hits += hit;
+
+		float bruteMax = FLT_MAX;
+		BOOL bruteHit = FALSE;
+		for (UINT32 instance = 0; instance < twoLevelBVH.GetInstanceCount(); instance++)
+		{
+			HitRecord bruteRec;
+			if (twoLevelBVH.GetInstanceBounds(instance).Hit(r, 0.001f, bruteMax) && twoLevelBVH.HitInstance(instance, r, 0.001f, bruteMax, bruteRec))
+			{
+				bruteMax = bruteRec.m_time;
+				bruteHit = TRUE;
+			}
+		}
+		if (hit != bruteHit || (hit && t_max != bruteMax))
+			mismatches++;
+	}
+	printf("[Benchmark] %u rays against a brute force loop: %llu hits, %llu closest hits differ\n", bruteForceRayCount, (unsigned long long)hits, (unsigned long long)mismatches);
+
+	// timing, single thread
+	BVHTraversalStats stats;
+	start = chrono::steady_clock::now();
+	for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+	{
+		for (const Ray &r : rays)
+		{
+			HitRecord rec;
+			float t_max = FLT_MAX;
+			twoLevelBVH.Hit(r, 0.001f, t_max, rec, (frame == 0) ? &stats : nullptr);
+		}
+	}
+	ReportTraversal("instances", "slab", "tlas", stats, SecondsSince(start), (UINT64)rays.size() * options.m_frameCount);
+
+	for (TriangleMeshHitable *mesh : meshes)
+		delete mesh;
+	resources->Unload();
+	delete resources;
+
+	// the random-spheres scene as instances of one unit sphere, against the sphere store, up to the float rounding of the transforms
+	OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	World *world = new World();
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+	world->ConstructWorld(WORLD_ID_RANDOM_SPHERES, camera);
+
+	vector<Ray> cameraRays;
+	for (UINT32 j = 0; j < options.m_height; j++)
+	{
+		for (UINT32 i = 0; i < options.m_width; i++)
+			cameraRays.push_back(camera->GetRay(float(i) / float(options.m_width), float(j) / float(options.m_height)));
+	}
+
+	UINT64 worldMismatches = 0;
+	double maxRelativeError = 0.0;
+	for (const Ray &r : cameraRays)
+	{
+		HitRecord storeRec;
+		HitRecord instanceRec;
+		float storeMax = FLT_MAX;
+		float instanceMax = FLT_MAX;
+		world->SetAccelerationStructure(ACCELERATION_LINEAR_BVH);
+		BOOL storeHit = world->Hit(r, 0.001f, storeMax, storeRec);
+		world->SetAccelerationStructure(ACCELERATION_TWO_LEVEL);
+		BOOL instanceHit = world->Hit(r, 0.001f, instanceMax, instanceRec);
+		if (storeHit != instanceHit || (storeHit && storeRec.m_hitMaterial != instanceRec.m_hitMaterial))
+			worldMismatches++;
+		else if (storeHit)
+			maxRelativeError = max(maxRelativeError, (double)fabsf(storeMax - instanceMax) / storeMax);
+	}
+
+	const AccelerationStructure accels[2] = { ACCELERATION_LINEAR_BVH, ACCELERATION_TWO_LEVEL };
+	const char *accelNames[2] = { "spheres", "instances" };
+	for (UINT32 a = 0; a < 2; a++)
+	{
+		world->SetAccelerationStructure(accels[a]);
+		BVHTraversalStats worldStats;
+		start = chrono::steady_clock::now();
+		for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+		{
+			for (const Ray &r : cameraRays)
+			{
+				HitRecord rec;
+				float t_max = FLT_MAX;
+				world->Hit(r, 0.001f, t_max, rec, (frame == 0) ? &worldStats : nullptr);
+			}
+		}
+		ReportTraversal("random", "camera", accelNames[a], worldStats, SecondsSince(start), (UINT64)cameraRays.size() * options.m_frameCount);
+	}
+	printf("[Benchmark] random   %llu of %zu camera rays hit another object, max relative distance error %.3e\n", (unsigned long long)worldMismatches, cameraRays.size(), maxRelativeError);
+
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete outputImage;
+
+	// a few grazing rays may flip with the rounding of the transforms, not more
+	return mismatches == 0 && worldMismatches * 1000 <= cameraRays.size();
+}
+
+BOOL Benchmarks::Refits(const CommandLineOptions &options)
+{
+	// 30 frames per second, at least a few seconds of animation
+	const float frameTime = 1.0f / 30.0f;
+	const UINT32 frameCount = max(options.m_frameCount, 90u);
+	const float rebuildSAHGrowths[3] = { 0.0f, FLT_MAX, 1.5f };
+	const char *policyNames[3] = { "rebuild", "refit", "refit+sah" };
+	BOOL allMatch = TRUE;
+
+	// the bouncing spheres, every structure of the world, checked against the refit tree
+	for (UINT32 p = 0; p < 3; p++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(WORLD_ID_BOUNCING_SPHERES, camera);
+		world->SetRebuildSAHGrowth(rebuildSAHGrowths[p]);
+
+		vector<Ray> rays;
+		for (UINT32 j = 0; j < options.m_height; j++)
+		{
+			for (UINT32 i = 0; i < options.m_width; i++)
+				rays.push_back(camera->GetRay(float(i) / float(options.m_width), float(j) / float(options.m_height)));
+		}
+
+		double animateSeconds = 0.0;
+		double traceSeconds = 0.0;
+		UINT32 rebuiltCount = 0;
+		UINT64 mismatches = 0;
+		for (UINT32 frame = 0; frame < frameCount; frame++)
+		{
+			auto start = chrono::steady_clock::now();
+			rebuiltCount += world->Animate(frameTime);
+			animateSeconds += SecondsSince(start);
+
+			world->SetAccelerationStructure(ACCELERATION_LINEAR_BVH);
+			start = chrono::steady_clock::now();
+			for (const Ray &r : rays)
+			{
+				HitRecord rec;
+				float t_max = FLT_MAX;
+				world->Hit(r, 0.001f, t_max, rec);
+			}
+			traceSeconds += SecondsSince(start);
+
+			if (frame % 10 != 0)
+				continue;
+			for (size_t i = 0; i < rays.size(); i += 7)
+			{
+				const AccelerationStructure accels[3] = { ACCELERATION_OBJECT_TREE, ACCELERATION_OBJECT_BVH, ACCELERATION_LINEAR_BVH };
+				float t[3];
+				IMaterial *materials[3];
+				for (UINT32 a = 0; a < 3; a++)
+				{
+					world->SetAccelerationStructure(accels[a]);
+					HitRecord rec;
+					t[a] = FLT_MAX;
+					materials[a] = world->Hit(rays[i], 0.001f, t[a], rec) ? rec.m_hitMaterial : nullptr;
+				}
+				if (t[1] != t[0] || t[2] != t[0] || materials[1] != materials[0] || materials[2] != materials[0])
+					mismatches++;
+			}
+		}
+
+		printf("[Benchmark] bouncing %-9s %u frames, animate %7.3lf ms/frame, %4u rebuilds, camera rays %7.3lf Mrays/s\n",
+			policyNames[p], frameCount, animateSeconds / frameCount * 1e3, rebuiltCount, (double)rays.size() * frameCount / traceSeconds * 1e-6);
+		if (mismatches > 0)
+		{
+			printf("[Benchmark] bouncing %-9s %llu closest hits differ from the tree\n", policyNames[p], (unsigned long long)mismatches);
+			allMatch = FALSE;
+		}
+
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete outputImage;
+	}
+
+	// the ground sphere makes the SAH cost of the bouncing spheres blind to what happens above it,
+	// a cloud of spheres flying apart in every direction shows the refit trees degrading
+	const UINT32 SPHERE_COUNT = 20000;
+	const float radius = 0.1f;
+	vector<Vec3> startCenters(SPHERE_COUNT);
+	vector<Vec3> velocities(SPHERE_COUNT);
+	for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+	{
+		startCenters[i] = 10.0f * Randomizer::RomdomInUnitSphere();
+		velocities[i] = 3.0f * Randomizer::RomdomInUnitSphere();
+	}
+	vector<Ray> rays;
+	for (UINT32 i = 0; i < options.m_width * options.m_height; i++)
+	{
+		Vec3 org = 30.0f * normalize(Randomizer::RomdomInUnitSphere() + Vec3(0.0f, 0.0f, 1e-6f));
+		rays.push_back(Ray(org, 10.0f * Randomizer::RomdomInUnitSphere() - org));
+	}
+
+	Vec3 extent(radius, radius, radius);
+	for (UINT32 p = 0; p < 3; p++)
+	{
+		SphereStore store;
+		for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+			store.AddSphere(startCenters[i], radius, AABB(startCenters[i] - extent, startCenters[i] + extent), nullptr, i);
+		store.Build();
+
+		double animateSeconds = 0.0;
+		double traceSeconds = 0.0;
+		UINT64 tracedRays = 0;
+		UINT32 rebuiltCount = 0;
+		for (UINT32 frame = 1; frame <= frameCount; frame++)
+		{
+			auto start = chrono::steady_clock::now();
+			for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+			{
+				Vec3 center = startCenters[i] + (frame * frameTime) * velocities[i];
+				store.MoveSphere(i, center, AABB(center - extent, center + extent));
+			}
+			rebuiltCount += store.Refit(rebuildSAHGrowths[p]);
+			animateSeconds += SecondsSince(start);
+
+			if (frame % 10 != 0)
+				continue;
+			start = chrono::steady_clock::now();
+			for (const Ray &r : rays)
+			{
+				UINT32 sphere;
+				float t_max = FLT_MAX;
+				store.Hit(r, 0.001f, t_max, sphere);
+			}
+			traceSeconds += SecondsSince(start);
+			tracedRays += rays.size();
+		}
+
+		const LinearBVH &bvh = store.GetBVH();
+		printf("[Benchmark] cloud    %-9s %u spheres, update %7.3lf ms/frame, %4u rebuilds, SAH cost %.2f (%.2f when built), %7.3lf Mrays/s\n",
+			policyNames[p], SPHERE_COUNT, animateSeconds / frameCount * 1e3, rebuiltCount, bvh.GetSAHCost(), bvh.GetBuildSAHCost(), tracedRays / traceSeconds * 1e-6);
+	}
+
+	printf("[Benchmark] Closest hits %s\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::Builds(const CommandLineOptions &options)
+{
+	// spheres of mixed sizes scattered in a cube, dense enough for deep trees
+	const UINT32 SPHERE_COUNT = 1000000;
+	vector<Vec3> centers(SPHERE_COUNT);
+	vector<float> radii(SPHERE_COUNT);
+	vector<AABB> bounds(SPHERE_COUNT);
+	for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+	{
+		centers[i] = Vec3(200.0f * Randomizer::RandomUNorm() - 100.0f, 200.0f * Randomizer::RandomUNorm() - 100.0f, 200.0f * Randomizer::RandomUNorm() - 100.0f);
+		radii[i] = 0.05f + 0.45f * Randomizer::RandomUNorm() * Randomizer::RandomUNorm();
+		Vec3 extent(radii[i], radii[i], radii[i]);
+		bounds[i] = AABB(centers[i] - extent, centers[i] + extent);
+	}
+
+	{
+		vector<Object *> objects(SPHERE_COUNT);
+		for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+			objects[i] = new SimpleObjectSphere(centers[i], radii[i], nullptr, nullptr, nullptr);
+		auto start = chrono::steady_clock::now();
+		SimpleObjectBVHNode *tree = new SimpleObjectBVHNode(objects);
+		double seconds = SecondsSince(start);
+		printf("[Benchmark] SimpleObjectBVHNode    %u spheres, build %8.3lf ms\n", SPHERE_COUNT, seconds * 1e3);
+		// the tree owns the objects
+		delete tree;
+	}
+
+	LinearBVH serialBVH;
+	auto start = chrono::steady_clock::now();
+	serialBVH.Build(bounds);
+	double serialSeconds = SecondsSince(start);
+	printf("[Benchmark] LinearBVH serial       %u spheres, build %8.3lf ms, %zu nodes, SAH cost %.2f\n", SPHERE_COUNT, serialSeconds * 1e3, serialBVH.GetNodeCount(), serialBVH.GetSAHCost());
+
+	// the parallel builds have to give the very same tree
+	BOOL allMatch = TRUE;
+	UINT32 maxThreadCount = options.m_threadCount > 0 ? options.m_threadCount : max(1u, thread::hardware_concurrency());
+	for (UINT32 threadCount = 1; ; threadCount = min(threadCount * 2, maxThreadCount))
+	{
+		ThreadPool pool(threadCount);
+		LinearBVH bvh;
+		start = chrono::steady_clock::now();
+		bvh.Build(bounds, LinearBVH::MAX_LEAF_PRIMITIVES, 1, &pool);
+		double seconds = SecondsSince(start);
+
+		BOOL match = bvh.GetNodeCount() == serialBVH.GetNodeCount();
+		for (size_t i = 0; match && i < bvh.GetNodeCount(); i++)
+			match = memcmp(&bvh.GetNode(i), &serialBVH.GetNode(i), sizeof(LinearBVHNode)) == 0;
+		for (size_t i = 0; match && i < SPHERE_COUNT; i++)
+			match = bvh.GetPrimitiveIndex(i) == serialBVH.GetPrimitiveIndex(i);
+		allMatch = allMatch && match;
+
+		printf("[Benchmark] LinearBVH %3u thread(s) %u spheres, build %8.3lf ms, speedup %.2fx, %s\n",
+			threadCount, SPHERE_COUNT, seconds * 1e3, serialSeconds / seconds, match ? "same tree" : "TREE DIFFERS");
+		if (threadCount == maxThreadCount)
+			break;
+	}
+
+	printf("[Benchmark] %u hardware thread(s), trees %s\n", thread::hardware_concurrency(), allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::SceneArenas(const CommandLineOptions &options)
+{
+	const UINT32 SPHERE_COUNT = 200000;
+	vector<Vec3> centers(SPHERE_COUNT);
+	for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+		centers[i] = Vec3(100.0f * Randomizer::RandomUNorm() - 50.0f, 100.0f * Randomizer::RandomUNorm() - 50.0f, 100.0f * Randomizer::RandomUNorm() - 50.0f);
+	vector<Ray> rays;
+	for (UINT32 i = 0; i < options.m_width * options.m_height; i++)
+	{
+		Vec3 org = 100.0f * normalize(Randomizer::RomdomInUnitSphere() + Vec3(0.0f, 0.0f, 1e-6f));
+		rays.push_back(Ray(org, 40.0f * Randomizer::RomdomInUnitSphere() - org));
+	}
+
+	// a heap that has been in use for a while, with holes of every size between the blocks still alive
+	vector<void *> survivors;
+	auto fragmentHeap = [&survivors]()
+	{
+		vector<void *> blocks;
+		for (UINT32 i = 0; i < 2 * SPHERE_COUNT; i++)
+			blocks.push_back(malloc(16 + (Randomizer::RandomUInt32() % 16) * 16));
+		for (UINT32 i = 0; i < (UINT32)blocks.size(); i++)
+		{
+			if (Randomizer::RandomUInt32() % 2)
+				free(blocks[i]);
+			else
+				survivors.push_back(blocks[i]);
+		}
+	};
+
+	const char *modeNames[4] = { "heap", "arena", "heap fragmented", "arena fragmented" };
+	UINT64 hitCounts[4] = { 0 };
+	for (UINT32 mode = 0; mode < 4; mode++)
+	{
+		BOOL useArena = (mode % 2) == 1;
+		if (mode >= 2)
+			fragmentHeap();
+
+		World world;
+		world.SetSceneArenaEnabled(useArena);
+		SceneArena *arena = world.GetSceneArena();
+
+		// the tree draws its split axes, same seed for the same tree
+		Randomizer::SetSeed(1);
+		auto start = chrono::steady_clock::now();
+		vector<Object *> objects(SPHERE_COUNT);
+		for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+			objects[i] = SceneArena::New<SimpleObjectSphere>(arena, SCENE_ARENA_OBJECTS, centers[i], 0.2f, nullptr, nullptr, &world);
+		SimpleObjectBVHNode *tree = SceneArena::New<SimpleObjectBVHNode>(arena, SCENE_ARENA_BVH_NODES, objects, arena);
+		double loadSeconds = SecondsSince(start);
+
+		start = chrono::steady_clock::now();
+		for (const Ray &r : rays)
+		{
+			HitRecord rec;
+			float t_min = 0.001f;
+			float t_max = FLT_MAX;
+			if (tree->Hit(r, t_min, t_max, rec))
+				hitCounts[mode]++;
+		}
+		double traceSeconds = SecondsSince(start);
+
+		start = chrono::steady_clock::now();
+		SceneArena::Delete(tree);
+		if (arena)
+			arena->Reset();
+		// on the heap, the tree deleted the objects and they deleted their hitables
+		double teardownSeconds = SecondsSince(start);
+
+		printf("[Benchmark] %-16s %u spheres, load %8.3lf ms, teardown %8.3lf ms, tree %7.3lf Mrays/s\n",
+			modeNames[mode], SPHERE_COUNT, loadSeconds * 1e3, teardownSeconds * 1e3, rays.size() / traceSeconds * 1e-6);
+	}
+
+	// bytes per category, from a scene built again
+	{
+		World world;
+		SceneArena *arena = world.GetSceneArena();
+		vector<Object *> objects(SPHERE_COUNT);
+		for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+			objects[i] = SceneArena::New<SimpleObjectSphere>(arena, SCENE_ARENA_OBJECTS, centers[i], 0.2f, nullptr, nullptr, &world);
+		SceneArena::New<SimpleObjectBVHNode>(arena, SCENE_ARENA_BVH_NODES, objects, arena);
+		for (UINT32 i = 0; i < SCENE_ARENA_CATEGORY_COUNT; i++)
+		{
+			SceneArenaCategory category = (SceneArenaCategory)i;
+			printf("[Benchmark] arena %-10s %10zu bytes, %7u allocations\n", SceneArena::GetCategoryName(category), arena->GetBytesUsed(category), arena->GetAllocationCount(category));
+		}
+		printf("[Benchmark] arena reserved   %10zu bytes\n", arena->GetBytesReserved());
+		arena->Reset();
+	}
+
+	for (void *block : survivors)
+		free(block);
+
+	BOOL allMatch = hitCounts[1] == hitCounts[0] && hitCounts[2] == hitCounts[0] && hitCounts[3] == hitCounts[0];
+	printf("[Benchmark] Hit counts %s\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::Occlusions(const CommandLineOptions &options)
+{
+	// the shadow rays go from the camera hits to points on an area light, the random spheres get one high above them
+	const WorldID worldIDs[] = { WORLD_ID_RANDOM_SPHERES, WORLD_ID_CORNELL_BOX, WORLD_ID_CORNELL_BOX_MESHES };
+	const char *worldNames[] = { "random", "cornell", "meshes" };
+	const Vec3 lightCenters[] = { Vec3(0.0f, 20.0f, 0.0f), Vec3(0.0f, 0.98f, 0.0f), Vec3(0.0f, 0.98f, 0.0f) };
+	const float lightHalfSizes[] = { 5.0f, 0.3f, 0.3f };
+	const AccelerationStructure accels[4] = { ACCELERATION_OBJECT_TREE, ACCELERATION_OBJECT_BVH, ACCELERATION_LINEAR_BVH, ACCELERATION_TWO_LEVEL };
+	const char *accelNames[4] = { "tree", "bvh", "spheres", "2level" };
+	// the rays stop just before the light
+	const float shadowMin = 0.001f;
+	const float shadowMax = 0.999f;
+	BOOL allMatch = TRUE;
+
+	for (UINT32 w = 0; w < _countof(worldIDs); w++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(worldIDs[w], camera);
+
+		// the direction is not normalized, the light is at t = 1
+		vector<Ray> rays;
+		for (UINT32 j = 0; j < options.m_height; j++)
+		{
+			for (UINT32 i = 0; i < options.m_width; i++)
+			{
+				Ray r = camera->GetRay(float(i) / float(options.m_width), float(j) / float(options.m_height));
+				HitRecord rec;
+				float t_max = FLT_MAX;
+				if (!world->Hit(r, 0.001f, t_max, rec))
+					continue;
+
+				Vec3 target = lightCenters[w] + Vec3(Randomizer::RandomMinMax(-lightHalfSizes[w], lightHalfSizes[w]), 0.0f, Randomizer::RandomMinMax(-lightHalfSizes[w], lightHalfSizes[w]));
+				rays.push_back(Ray(rec.m_position, target - rec.m_position));
+			}
+		}
+
+		for (UINT32 a = 0; a < 4; a++)
+		{
+			world->SetAccelerationStructure(accels[a]);
+
+			// Occluded has to say TRUE exactly when Hit finds something in the segment
+			UINT64 mismatches = 0;
+			UINT64 occludedCount = 0;
+			BVHTraversalStats hitStats;
+			BVHTraversalStats occludedStats;
+			for (const Ray &r : rays)
+			{
+				HitRecord rec;
+				float t_max = shadowMax;
+				BOOL hit = world->Hit(r, shadowMin, t_max, rec, &hitStats);
+				BOOL occluded = world->Occluded(r, shadowMin, shadowMax, &occludedStats);
+				if (hit != occluded)
+					mismatches++;
+				if (occluded)
+					occludedCount++;
+			}
+
+			// timing, single thread
+			auto start = chrono::steady_clock::now();
+			for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+			{
+				for (const Ray &r : rays)
+				{
+					HitRecord rec;
+					float t_max = shadowMax;
+					world->Hit(r, shadowMin, t_max, rec);
+				}
+			}
+			double hitSeconds = SecondsSince(start);
+
+			start = chrono::steady_clock::now();
+			for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+			{
+				for (const Ray &r : rays)
+					world->Occluded(r, shadowMin, shadowMax);
+			}
+			double occludedSeconds = SecondsSince(start);
+
+			// the tree counts nothing
+			UINT64 rayCount = (UINT64)rays.size() * options.m_frameCount;
+			if (hitStats.m_rayCount > 0 && occludedStats.m_rayCount > 0)
+			{
+				printf("[Benchmark] %-8s %-7s %5.1lf%% occluded, Hit %8.2lf nodes/ray %10.3lf Mrays/s, Occluded %8.2lf nodes/ray %10.3lf Mrays/s, x%.2lf\n",
+					worldNames[w], accelNames[a], 100.0 * occludedCount / max<size_t>(rays.size(), 1),
+					(double)hitStats.m_nodesVisited / hitStats.m_rayCount, rayCount / hitSeconds * 1e-6,
+					(double)occludedStats.m_nodesVisited / occludedStats.m_rayCount, rayCount / occludedSeconds * 1e-6, hitSeconds / occludedSeconds);
+			}
+			else
+			{
+				printf("[Benchmark] %-8s %-7s %5.1lf%% occluded, Hit %10.3lf Mrays/s, Occluded %10.3lf Mrays/s, x%.2lf\n",
+					worldNames[w], accelNames[a], 100.0 * occludedCount / max<size_t>(rays.size(), 1),
+					rayCount / hitSeconds * 1e-6, rayCount / occludedSeconds * 1e-6, hitSeconds / occludedSeconds);
+			}
+			if (mismatches > 0)
+			{
+				printf("[Benchmark] %-8s %-7s %llu occlusions differ from the closest hits over %zu rays\n", worldNames[w], accelNames[a], (unsigned long long)mismatches, rays.size());
+				allMatch = FALSE;
+			}
+		}
+		world->SetAccelerationStructure(ACCELERATION_LINEAR_BVH);
+
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete outputImage;
+	}
+
+	printf("[Benchmark] Occlusions %s\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::HitAttributes(const CommandLineOptions &options)
+{
+	// clouds of small spheres, the denser the more spheres a ray goes through before the closest one
+	const UINT32 SPHERE_COUNT = 100000;
+	const float cloudSizes[] = { 100.0f, 40.0f, 20.0f };
+	const char *accelNames[2] = { "tree", "bvh" };
+	BOOL allMatch = TRUE;
+
+	for (float cloudSize : cloudSizes)
+	{
+		Randomizer::SetSeed(1);
+		World world;
+		vector<Object *> objects(SPHERE_COUNT);
+		vector<AABB> bounds(SPHERE_COUNT);
+		for (UINT32 i = 0; i < SPHERE_COUNT; i++)
+		{
+			Vec3 center = cloudSize * Vec3(Randomizer::RandomUNorm() - 0.5f, Randomizer::RandomUNorm() - 0.5f, Randomizer::RandomUNorm() - 0.5f);
+			objects[i] = new SimpleObjectSphere(center, 0.2f, nullptr, nullptr, &world);
+			bounds[i] = objects[i]->BoundingBox();
+		}
+		SimpleObjectBVHNode *tree = new SimpleObjectBVHNode(objects);
+		LinearBVH bvh;
+		bvh.Build(bounds);
+
+		vector<Ray> rays;
+		for (UINT32 i = 0; i < options.m_width * options.m_height; i++)
+		{
+			Vec3 org = cloudSize * normalize(Randomizer::RomdomInUnitSphere() + Vec3(0.0f, 0.0f, 1e-6f));
+			rays.push_back(Ray(org, 0.4f * cloudSize * Randomizer::RomdomInUnitSphere() - org));
+		}
+
+		for (UINT32 a = 0; a < 2; a++)
+		{
+			auto hitEager = [&](const Ray &r, HitRecord &rec, UINT64 &candidateHits)
+			{
+				float t_min = 0.001f;
+				float t_max = FLT_MAX;
+				if (a == 0)
+					return HitObjectTreeEager(tree, r, t_min, t_max, rec, candidateHits);
+				return bvh.Hit(r, t_min, t_max, [&](UINT32 primitiveIndex, float t_min, float &t_max)
+				{
+					if (!objects[primitiveIndex]->m_hitable->Hit(r, t_min, t_max, rec))
+						return FALSE;
+					t_max = rec.m_time;
+					candidateHits++;
+					return TRUE;
+				});
+			};
+			auto hitDeferred = [&](const Ray &r, HitRecord &rec)
+			{
+				float t_min = 0.001f;
+				float t_max = FLT_MAX;
+				// the tree goes through the same dynamic_cast walk as the eager one
+				BVHTraversalStats stats;
+				if (a == 0)
+					return HitObjectTreeWithStats(tree, r, t_min, t_max, rec, stats);
+				const Object *closest = nullptr;
+				if (!bvh.Hit(r, t_min, t_max, [&](UINT32 primitiveIndex, float t_min, float &t_max)
+				{
+					const Object *hit = objects[primitiveIndex]->Intersect(r, t_min, t_max, rec);
+					if (hit)
+						closest = hit;
+					return hit != nullptr;
+				}))
+					return FALSE;
+				closest->ComputeAttributes(r, rec);
+				return TRUE;
+			};
+
+			// both have to find the same closest hit with the same attributes
+			UINT64 candidateHits = 0;
+			UINT64 hitCount = 0;
+			UINT64 mismatches = 0;
+			for (const Ray &r : rays)
+			{
+				HitRecord eagerRec;
+				HitRecord deferredRec;
+				BOOL eagerHit = hitEager(r, eagerRec, candidateHits);
+				BOOL deferredHit = hitDeferred(r, deferredRec);
+				hitCount += eagerHit;
+				if (eagerHit != deferredHit || (eagerHit && (eagerRec.m_time != deferredRec.m_time || eagerRec.m_u != deferredRec.m_u || eagerRec.m_v != deferredRec.m_v
+					|| (eagerRec.m_normal - deferredRec.m_normal).length() != 0.0f)))
+					mismatches++;
+			}
+
+			// timing, single thread
+			UINT64 ignored = 0;
+			auto start = chrono::steady_clock::now();
+			for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+			{
+				for (const Ray &r : rays)
+				{
+					HitRecord rec;
+					hitEager(r, rec, ignored);
+				}
+			}
+			double eagerSeconds = SecondsSince(start);
+
+			start = chrono::steady_clock::now();
+			for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+			{
+				for (const Ray &r : rays)
+				{
+					HitRecord rec;
+					hitDeferred(r, rec);
+				}
+			}
+			double deferredSeconds = SecondsSince(start);
+
+			UINT64 rayCount = (UINT64)rays.size() * options.m_frameCount;
+			printf("[Benchmark] cloud %5.0f %-4s %6.2lf candidate hits/hit, eager %10.3lf Mrays/s, deferred %10.3lf Mrays/s, x%.2lf\n",
+				cloudSize, accelNames[a], (double)candidateHits / max<UINT64>(hitCount, 1), rayCount / eagerSeconds * 1e-6, rayCount / deferredSeconds * 1e-6, eagerSeconds / deferredSeconds);
+			if (mismatches > 0)
+			{
+				printf("[Benchmark] cloud %5.0f %-4s %llu records differ over %zu rays\n", cloudSize, accelNames[a], (unsigned long long)mismatches, rays.size());
+				allMatch = FALSE;
+			}
+		}
+
+		// the tree deletes the objects
+		delete tree;
+	}
+
+	printf("[Benchmark] Records %s\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::LightSampling(const CommandLineOptions &options)
+{
+	struct Config
+	{
+		const char *	m_name;
+		IntegratorType	m_integrator;
+		BOOL			m_lightSampling;
+	};
+	const Config configs[] =
+	{
+		{ "iterative",			INTEGRATOR_ITERATIVE,	FALSE },
+		{ "iterative, nee",		INTEGRATOR_ITERATIVE,	TRUE },
+		{ "wavefront, nee",		INTEGRATOR_WAVEFRONT,	TRUE },
+	};
+	const UINT32 sppScales[] = { 1, 2, 4 };
+	const UINT32 referenceScale = 32;
+
+	// the area lights of the cornell boxes are small, the case where sampling them pays the most
+	const WorldID worldIDs[] = { WORLD_ID_CORNELL_BOX, WORLD_ID_CORNELL_BOX_MESHES };
+	const char *worldNames[] = { "cornell", "meshes" };
+	BOOL allAgree = TRUE;
+	for (UINT32 w = 0; w < _countof(worldIDs); w++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		OutputImage *referenceImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(worldIDs[w], camera);
+
+		HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+		hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+		hmRayTracer->SetRussianRouletteDepth(options.m_russianRouletteDepth);
+		hmRayTracer->SetThreadCount(options.m_threadCount);
+		printf("[Benchmark] %-8s %u area lights sampled\n", worldNames[w], world->GetLightSources()->GetSampledLightCount());
+
+		// the reference, with many more samples, then both estimators converge to it
+		hmRayTracer->SetIntegrator(INTEGRATOR_ITERATIVE);
+		hmRayTracer->SetLightSampling(TRUE);
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * referenceScale);
+		hmRayTracer->TraceRay(camera, referenceImage);
+		double referenceMean = MeanLuminance(hmRayTracer);
+
+		for (UINT32 sppScale : sppScales)
+		{
+			hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * sppScale);
+			UINT64 samples = (UINT64)options.m_width * (UINT64)options.m_height * (UINT64)hmRayTracer->GetSamplePerPixel();
+			for (const Config &config : configs)
+			{
+				hmRayTracer->SetIntegrator(config.m_integrator);
+				hmRayTracer->SetLightSampling(config.m_lightSampling);
+
+				auto start = chrono::steady_clock::now();
+				hmRayTracer->TraceRay(camera, outputImage);
+				double seconds = SecondsSince(start);
+
+				// error times time, lower is better
+				double mse = ImageMSE(outputImage, referenceImage);
+				double mean = MeanLuminance(hmRayTracer);
+				printf("[Benchmark] %-8s %4u spp %-16s %8.3lfs %6.2lf rays/sample  MSE %.6lf  MSE x time %.6lf  mean %.4lf (reference %.4lf)\n",
+					worldNames[w], hmRayTracer->GetSamplePerPixel(), config.m_name, seconds, (double)hmRayTracer->GetLastPassRayCount() / samples,
+					mse, mse * seconds, mean, referenceMean);
+
+				// the estimators are unbiased, only the noise differs, the tolerance is well above the noise of the means
+				if (sppScale == sppScales[_countof(sppScales) - 1] && fabs(mean - referenceMean) > 0.05 * referenceMean)
+					allAgree = FALSE;
+			}
+		}
+
+		delete hmRayTracer;
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete referenceImage;
+		delete outputImage;
+	}
+
+	printf("[Benchmark] Means %s\n", allAgree ? "agree" : "differ");
+	return allAgree;
+}
+
+BOOL Benchmarks::LightBVHs(const CommandLineOptions &options)
+{
+	OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	OutputImage *referenceImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	World *world = new World();
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+	world->ConstructWorld(WORLD_ID_MANY_LIGHTS, camera);
+	LightSources *lightSources = world->GetLightSources();
+
+	const LightBVH &lightBVH = lightSources->GetLightBVH();
+	printf("[Benchmark] %u lights, light BVH of %u nodes, depth %u\n", lightSources->GetSampledLightCount(), lightBVH.GetNodeCount(), lightBVH.GetDepth());
+
+	// shading points on the ground and on the big spheres, seen from random directions
+	const UINT32 pointCount = 1 << 16;
+	vector<Vec3> positions(pointCount);
+	vector<Vec3> normals(pointCount);
+	Randomizer::BeginStream(options.m_seed);
+	for (UINT32 i = 0; i < pointCount; i++)
+	{
+		if (i % 4 == 0)
+		{
+			normals[i] = normalize(Randomizer::RomdomInUnitSphere());
+			positions[i] = Vec3(4.0f * (float)(i % 3) - 4.0f, 1.0f, 0.0f) + normals[i];
+		}
+		else
+		{
+			normals[i] = Vec3(0.0f, 1.0f, 0.0f);
+			positions[i] = Vec3(20.0f * Randomizer::RandomUNorm() - 10.0f, 0.0f, 20.0f * Randomizer::RandomUNorm() - 10.0f);
+		}
+	}
+
+	// the density SampleLight gives is the one PdfArea finds for the same light, the MIS weights rely on it
+	const LightSelection selections[] = { LIGHT_SELECTION_POWER, LIGHT_SELECTION_BVH };
+	const char *selectionNames[] = { "power", "bvh" };
+	BOOL allMatch = TRUE;
+	for (UINT32 s = 0; s < _countof(selections); s++)
+	{
+		lightSources->SetLightSelection(selections[s]);
+		UINT64 sampled = 0;
+		UINT64 mismatches = 0;
+		auto start = chrono::steady_clock::now();
+		for (UINT32 i = 0; i < pointCount; i++)
+		{
+			LightSample light;
+			if (lightSources->SampleLight(positions[i], normals[i], Randomizer::RandomUNorm(), 0.5f, 0.5f, light))
+				sampled++;
+		}
+		double seconds = SecondsSince(start);
+
+		Randomizer::BeginStream(options.m_seed + 1);
+		for (UINT32 i = 0; i < pointCount; i++)
+		{
+			LightSample light;
+			if (!lightSources->SampleLight(positions[i], normals[i], Randomizer::RandomUNorm(), 0.5f, 0.5f, light))
+				continue;
+
+			float pdfArea = lightSources->PdfArea(light.m_lightSource, positions[i], normals[i]);
+			if (fabsf(pdfArea - light.m_pdfArea) > 1e-3f * light.m_pdfArea)
+				mismatches++;
+		}
+		allMatch = allMatch && (mismatches == 0);
+
+		// error of the one sample estimate of the unshadowed irradiance, what the selection is about.
+		// Against the irradiance of every light, the lights are small enough to be taken as points of their power.
+		const UINT32 estimateCount = 64;
+		double relativeErrorSum = 0.0;
+		UINT32 litCount = 0;
+		for (UINT32 i = 0; i < pointCount; i += 64)
+		{
+			double irradiance = 0.0;
+			for (UINT32 l = 0; l < lightSources->GetSampledLightCount(); l++)
+			{
+				const Object *lightSource = lightSources->GetSampledLight(l);
+				AABB bounds = lightSource->m_hitable->BoundingBox();
+				Vec3 toLight = 0.5f * (bounds.m_min + bounds.m_max) - positions[i];
+				float distanceSquared = dot(toLight, toLight);
+				// the whole surface emits from both sides, the mean of |cos| over it is 1 / 2
+				const XMFLOAT4 &intensity = reinterpret_cast<const DiffuseLight *>(lightSource->m_material)->m_data.intensity;
+				irradiance += (intensity.x + intensity.y + intensity.z) * max(0.0f, dot(normals[i], toLight)) / sqrtf(distanceSquared) * 0.5f * lightSource->m_hitable->Area() / distanceSquared;
+			}
+			if (irradiance <= 0.0)
+				continue;
+
+			double squares = 0.0;
+			for (UINT32 k = 0; k < estimateCount; k++)
+			{
+				LightSample light;
+				double estimate = 0.0;
+				if (lightSources->SampleLight(positions[i], normals[i], Randomizer::RandomUNorm(), Randomizer::RandomUNorm(), Randomizer::RandomUNorm(), light))
+				{
+					Vec3 toLight = light.m_position - positions[i];
+					float distanceSquared = dot(toLight, toLight);
+					float cosine = max(0.0f, dot(normals[i], toLight)) * fabsf(dot(light.m_normal, toLight)) / distanceSquared;
+					estimate = (light.m_emitted.r() + light.m_emitted.g() + light.m_emitted.b()) * cosine / (distanceSquared * light.m_pdfArea);
+				}
+				squares += (estimate - irradiance) * (estimate - irradiance);
+			}
+			relativeErrorSum += sqrt(squares / estimateCount) / irradiance;
+			litCount++;
+		}
+
+		printf("[Benchmark] %-6s %8.1lf ns/light sample, %6.2lf%% of the points lit, %llu densities differ, irradiance relative RMSE %.3lf\n",
+			selectionNames[s], seconds * 1e9 / pointCount, sampled * 100.0 / pointCount, (unsigned long long)mismatches, relativeErrorSum / max(1u, litCount));
+	}
+
+	HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+	hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+	hmRayTracer->SetRussianRouletteDepth(options.m_russianRouletteDepth);
+	hmRayTracer->SetThreadCount(options.m_threadCount);
+	hmRayTracer->SetLightSampling(TRUE);
+
+	// the reference, with many more samples and the light BVH
+	const UINT32 referenceScale = 16;
+	lightSources->SetLightSelection(LIGHT_SELECTION_BVH);
+	hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * referenceScale);
+	hmRayTracer->TraceRay(camera, referenceImage);
+
+	const UINT32 sppScales[] = { 1, 4 };
+	for (UINT32 sppScale : sppScales)
+	{
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * sppScale);
+		for (UINT32 s = 0; s < _countof(selections); s++)
+		{
+			lightSources->SetLightSelection(selections[s]);
+			auto start = chrono::steady_clock::now();
+			hmRayTracer->TraceRay(camera, outputImage);
+			double seconds = SecondsSince(start);
+
+			double mse = ImageMSE(outputImage, referenceImage);
+			printf("[Benchmark] %4u spp %-6s %8.3lfs  MSE %.6lf  MSE x time %.6lf  mean %.4lf\n",
+				hmRayTracer->GetSamplePerPixel(), selectionNames[s], seconds, mse, mse * seconds, MeanLuminance(hmRayTracer));
+		}
+	}
+
+	delete hmRayTracer;
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete referenceImage;
+	delete outputImage;
+
+	printf("[Benchmark] Densities %s\n", allMatch ? "match" : "differ");
+	return allMatch;
+}
+
+BOOL Benchmarks::AdaptiveSampling(const CommandLineOptions &options)
+{
+	// --adaptive picks a single threshold
+	vector<float> thresholds = { 0.1f, 0.05f, 0.02f };
+	if (options.m_adaptiveThreshold > 0.0f)
+		thresholds.assign(1, options.m_adaptiveThreshold);
+	const UINT32 referenceScale = 8;
+
+	// the sky of the random spheres settles in a few samples, the glass and the shadows do not
+	const WorldID worldIDs[] = { WORLD_ID_RANDOM_SPHERES, WORLD_ID_CORNELL_BOX };
+	const char *worldNames[] = { "random", "cornell" };
+	for (UINT32 w = 0; w < _countof(worldIDs); w++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		OutputImage *referenceImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(worldIDs[w], camera);
+
+		HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+		hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+		hmRayTracer->SetRussianRouletteDepth(options.m_russianRouletteDepth);
+		hmRayTracer->SetLightSampling(options.m_lightSampling);
+		hmRayTracer->SetThreadCount(options.m_threadCount);
+		hmRayTracer->SetAdaptiveMinSamplePerPixel(options.m_minSamplePerPixel);
+
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * referenceScale);
+		hmRayTracer->TraceRay(camera, referenceImage);
+
+		// adaptive with every threshold, then uniform at the max and at the same samples as the adaptive ones
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel);
+		vector<UINT32> uniformSPPs = { options.m_samplePerPixel };
+		for (size_t t = 0; t <= thresholds.size(); t++)
+		{
+			BOOL adaptive = (t < thresholds.size());
+			hmRayTracer->SetAdaptiveSampling(adaptive);
+			if (adaptive)
+				hmRayTracer->SetAdaptiveErrorThreshold(thresholds[t]);
+
+			for (size_t u = 0; u < (adaptive ? 1 : uniformSPPs.size()); u++)
+			{
+				if (!adaptive)
+					hmRayTracer->SetSamplePerPixel(uniformSPPs[u]);
+
+				auto start = chrono::steady_clock::now();
+				hmRayTracer->TraceRay(camera, outputImage);
+				double seconds = SecondsSince(start);
+
+				UINT64 samples = hmRayTracer->GetAccumulatedSampleCount();
+				double meanSPP = (double)samples / ((UINT64)options.m_width * options.m_height);
+				if (adaptive)
+					uniformSPPs.push_back(max(1u, (UINT32)(meanSPP + 0.5)));
+
+				char name[32];
+				if (adaptive)
+					sprintf_s(name, "adaptive %.3f", thresholds[t]);
+				else
+					sprintf_s(name, "uniform %u", uniformSPPs[u]);
+				double mse = ImageMSE(outputImage, referenceImage);
+				printf("[Benchmark] %-8s %-16s %8.3lfs %7.2lf spp %10.3lf Mrays  relative error %.4f  MSE %.6lf  MSE x time %.6lf\n",
+					worldNames[w], name, seconds, meanSPP, hmRayTracer->GetLastPassRayCount() * 1e-6, hmRayTracer->EstimateRelativeError(), mse, mse * seconds);
+			}
+		}
+
+		delete hmRayTracer;
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete referenceImage;
+		delete outputImage;
+	}
+	return TRUE;
+}
+
+BOOL Benchmarks::Samplers(const CommandLineOptions &options)
+{
+	const SamplerType samplerTypes[] = { SAMPLER_INDEPENDENT, SAMPLER_SOBOL, SAMPLER_BLUE_NOISE };
+	const UINT32 sppScales[] = { 1, 2, 4 };
+	const UINT32 referenceScale = 32;
+
+	// the cornell box with --nee is mostly direct light, the dimensions the points stratify best
+	const WorldID worldIDs[] = { WORLD_ID_RANDOM_SPHERES, WORLD_ID_CORNELL_BOX };
+	const char *worldNames[] = { "random", "cornell" };
+	for (UINT32 w = 0; w < _countof(worldIDs); w++)
+	{
+		OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		OutputImage *referenceImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+		World *world = new World();
+		SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+		world->ConstructWorld(worldIDs[w], camera);
+
+		HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+		hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+		hmRayTracer->SetRussianRouletteDepth(options.m_russianRouletteDepth);
+		hmRayTracer->SetLightSampling(options.m_lightSampling);
+		hmRayTracer->SetThreadCount(options.m_threadCount);
+
+		// the reference with the independent streams, the other samplers would share their first points with it
+		hmRayTracer->SetSampler(SAMPLER_INDEPENDENT);
+		hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * referenceScale);
+		hmRayTracer->TraceRay(camera, referenceImage);
+
+		double mses[_countof(samplerTypes)][_countof(sppScales)];
+		for (UINT32 t = 0; t < _countof(samplerTypes); t++)
+		{
+			hmRayTracer->SetSampler(samplerTypes[t]);
+			for (UINT32 k = 0; k < _countof(sppScales); k++)
+			{
+				hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel * sppScales[k]);
+
+				auto start = chrono::steady_clock::now();
+				hmRayTracer->TraceRay(camera, outputImage);
+				double seconds = SecondsSince(start);
+
+				mses[t][k] = ImageMSE(outputImage, referenceImage);
+				printf("[Benchmark] %-8s %-12s %4u spp %8.3lfs  RMSE %.5lf  MSE x time %.6lf\n",
+					worldNames[w], ISampler::GetTypeName(samplerTypes[t]), hmRayTracer->GetSamplePerPixel(), seconds, sqrt(mses[t][k]), mses[t][k] * seconds);
+			}
+		}
+
+		// the independent samples an estimator needs for the same error, the Monte Carlo error goes down as 1 / sqrt(N)
+		for (UINT32 t = 1; t < _countof(samplerTypes); t++)
+		{
+			printf("[Benchmark] %-8s %-12s", worldNames[w], ISampler::GetTypeName(samplerTypes[t]));
+			for (UINT32 k = 0; k < _countof(sppScales); k++)
+				printf(" %4u spp worth %6.2lf", options.m_samplePerPixel * sppScales[k], options.m_samplePerPixel * sppScales[k] * mses[0][k] / mses[t][k]);
+			printf(" independent spp\n");
+		}
+
+		delete hmRayTracer;
+		delete camera;
+		world->DeconstructWorld();
+		delete world;
+		delete referenceImage;
+		delete outputImage;
+	}
+	return TRUE;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+struct CommandLineOptions;
+
+// Benchmarks of the tracing core, run with --benchmark <name>
+// Results are printed to stdout, one line per measured configuration.
+class Benchmarks
+{
+public:
+	static BOOL					Run(const CommandLineOptions &options);
+	static void					PrintList();
+
+private:
+	typedef BOOL				(*BenchmarkFunc)(const CommandLineOptions &options);
+	struct Entry
+	{
+		const char *			m_name;
+		const char *			m_description;
+		BenchmarkFunc			m_func;
+	};
+	static const Entry			s_entries[];
+
+	static BOOL					Vec3Backends(const CommandLineOptions &options);
+	static BOOL					RandomGenerators(const CommandLineOptions &options);
+	static BOOL					SampleMappings(const CommandLineOptions &options);
+	static BOOL					MaterialSampling(const CommandLineOptions &options);
+	static BOOL					SphereUVs(const CommandLineOptions &options);
+	static BOOL					TextureFiltering(const CommandLineOptions &options);
+	static BOOL					BVHTraversal(const CommandLineOptions &options);
+	static BOOL					TileScheduling(const CommandLineOptions &options);
+	static BOOL					Integrators(const CommandLineOptions &options);
+	static BOOL					Packets(const CommandLineOptions &options);
+	static BOOL					TriangleMeshes(const CommandLineOptions &options);
+	static BOOL					Instances(const CommandLineOptions &options);
+	static BOOL					Refits(const CommandLineOptions &options);
+	static BOOL					Builds(const CommandLineOptions &options);
+	static BOOL					SceneArenas(const CommandLineOptions &options);
+	static BOOL					Occlusions(const CommandLineOptions &options);
+	static BOOL					HitAttributes(const CommandLineOptions &options);
+	static BOOL					LightSampling(const CommandLineOptions &options);
+	static BOOL					LightBVHs(const CommandLineOptions &options);
+	static BOOL					AdaptiveSampling(const CommandLineOptions &options);
+	static BOOL					Samplers(const CommandLineOptions &options);
+};
@@ -0,0 +1,377 @@
+#include "stdafx.h"
+
+#include "OutputImage.h"
+#include "HomemadeRayTracer.h"
+#include "SimpleCamera.h"
+#include "World.h"
+#include "Randomizer.h"
+#include "RayTracerCLI.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+// Headless render driver, no window, no D3D12 viewer and no hot keys.
+// Build with HEADLESS_RENDERING to compile the D3D12 parts out of the tracing core.
+
+static void PrintUsage()
+{
+	cout << "Usage: RayTracerCLI [options]" << endl;
+	cout << "  --world <name>              random, cornell, meshes, the Cornell box with triangle meshes," << endl;
+	cout << "                              bouncing, the random spheres animated with --frame-time," << endl;
+	cout << "                              lights, " << MANY_LIGHTS_COUNT << " small lights for --nee," << endl;
+	cout << "                              or textured, the checker plate texture on a wide ground (default: cornell)." << endl;
+	cout << "  --accel <name>              bvh: SAH BVHs with a SoA sphere store, objects: one SAH BVH over all objects," << endl;
+	cout << "                              tree: SimpleObjectBVHNode, instances: two-level BVH over shared geometries (default: bvh)." << endl;
+	cout << "  --width <pixels>            Output image width (default: " << DEFAULT_IMAGE_WIDTH << ")." << endl;
+	cout << "  --height <pixels>           Output image height (default: " << DEFAULT_IMAGE_HEIGHT << ")." << endl;
+	cout << "  --spp <count>               Samples per pixel (default: 1)." << endl;
+	cout << "  --pass-spp <count>          Progressive rendering, accumulate passes of <count> samples up to --spp." << endl;
+	cout << "  --target-error <value>      With --pass-spp, stop once the mean relative error is below <value>." << endl;
+	cout << "  --adaptive <error>          Adaptive sampling, only the pixels whose relative error is above <error> get more samples," << endl;
+	cout << "                              from --min-spp up to --spp, with a single TraceRay per frame." << endl;
+	cout << "  --min-spp <count>           With --adaptive, samples of every pixel and of each adaptive pass (default: 8)." << endl;
+	cout << "  --heat-map                  Also output the samples per pixel, as <name>_spp, blue for the fewest, red for the most." << endl;
+	cout << "  --depth <count>             Max sample depth (default: 50)." << endl;
+	cout << "  --integrator <type>         iterative, recursive or wavefront (default: iterative)." << endl;
+	cout << "  --rr-depth <count>          Russian roulette after <count> bounces, iterative and wavefront (default: 5)." << endl;
+	cout << "  --nee                       Next event estimation, sample the area lights at diffuse and glossy hits, iterative and wavefront." << endl;
+	cout << "  --light-select <method>     With --nee, pick the light by power or by bvh, the importance for the point (default: bvh)." << endl;
+	cout << "  --sampler <type>            independent, sobol, Owen-scrambled per pixel, or bluenoise, the same points dithered" << endl;
+	cout << "                              by a blue-noise mask, for the pixel, lens and bounce numbers (default: independent)." << endl;
+	cout << "  --no-texture-lod            Bilinear lookups of the full resolution textures, instead of trilinear over the pixel footprint." << endl;
+	cout << "  --packet <width>            Camera rays traced in packets of 4, 8 or 16, 1 for single rays (default: 8)." << endl;
+	cout << "  --frames <count>            Number of frames to render (default: 1)." << endl;
+	cout << "  --frame-time <seconds>      Animation time between frames, the structures are refit (default: 0)." << endl;
+	cout << "  --seed <value>              Random seed, same seed gives the same image (default: 0)." << endl;
+	cout << "  --threads <count>           Render threads (default: one per hardware thread)." << endl;
+	cout << "  --tile <pixels>             Tile size (default: 32)." << endl;
+	cout << "  --tile-order <order>        scanline, morton or hilbert (default: hilbert)." << endl;
+	cout << "  --no-steal                  Disable work stealing, each thread keeps its own range of tiles." << endl;
+	cout << "  --thread-stats              Print per-thread busy time after each frame." << endl;
+	cout << "  --normal                    Output normals instead of shading." << endl;
+	cout << "  --output <name>             Output image name, without extension (default: OutputImage)." << endl;
+	cout << "  --dir <path>                Output directory (default: ..\\Assets)." << endl;
+	cout << "  --benchmark <name>          Run a benchmark instead of rendering, one of:" << endl;
+	Benchmarks::PrintList();
+	cout << "  --help                      Display this message." << endl;
+}
+
+static BOOL ParseUInt(const char *arg, UINT32 &out_value)
+{
+	char *end = nullptr;
+	unsigned long value = strtoul(arg, &end, 10);
+	if (end == arg || *end != '\0' || value == 0)
+		return FALSE;
+	out_value = static_cast<UINT32>(value);
+	return TRUE;
+}
+
+static BOOL ParseUInt64(const char *arg, UINT64 &out_value)
+{
+	char *end = nullptr;
+	unsigned long long value = strtoull(arg, &end, 10);
+	if (end == arg || *end != '\0')
+		return FALSE;
+	out_value = static_cast<UINT64>(value);
+	return TRUE;
+}
+
+static BOOL ParseFloat(const char *arg, float &out_value)
+{
+	char *end = nullptr;
+	float value = strtof(arg, &end);
+	if (end == arg || *end != '\0' || value < 0.0f)
+		return FALSE;
+	out_value = value;
+	return TRUE;
+}
+
+static BOOL ParseCommandLine(int argc, char *argv[], CommandLineOptions &out_options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		BOOL hasValue = (i + 1 < argc);
+		BOOL valid = TRUE;
+
+		if (arg == "--help")
+		{
+			return FALSE;
+		}
+		else if (arg == "--normal")
+		{
+			out_options.m_normalDisplay = TRUE;
+		}
+		else if (arg == "--no-steal")
+		{
+			out_options.m_workStealing = FALSE;
+		}
+		else if (arg == "--no-texture-lod")
+		{
+			out_options.m_textureLod = FALSE;
+		}
+		else if (arg == "--thread-stats")
+		{
+			out_options.m_threadStats = TRUE;
+		}
+		else if (arg == "--heat-map")
+		{
+			out_options.m_heatMap = TRUE;
+		}
+		else if (!hasValue)
+		{
+			valid = FALSE;
+		}
+		else if (arg == "--world")
+		{
+			string world = argv[++i];
+			if (world == "random" || world == "0")
+				out_options.m_worldID = WORLD_ID_RANDOM_SPHERES;
+			else if (world == "cornell" || world == "1")
+				out_options.m_worldID = WORLD_ID_CORNELL_BOX;
+			else if (world == "meshes" || world == "2")
+				out_options.m_worldID = WORLD_ID_CORNELL_BOX_MESHES;
+			else if (world == "bouncing" || world == "3")
+				out_options.m_worldID = WORLD_ID_BOUNCING_SPHERES;
+			else if (world == "lights" || world == "4")
+				out_options.m_worldID = WORLD_ID_MANY_LIGHTS;
+			else if (world == "textured" || world == "5")
+				out_options.m_worldID = WORLD_ID_TEXTURED;
+			else
+				valid = FALSE;
+		}
+		else if (arg == "--accel")
+		{
+			string accel = argv[++i];
+			if (accel == "bvh")
+				out_options.m_accelerationStructure = ACCELERATION_LINEAR_BVH;
+			else if (accel == "objects")
+				out_options.m_accelerationStructure = ACCELERATION_OBJECT_BVH;
+			else if (accel == "tree")
+				out_options.m_accelerationStructure = ACCELERATION_OBJECT_TREE;
+			else if (accel == "instances")
+				out_options.m_accelerationStructure = ACCELERATION_TWO_LEVEL;
+			else
+				valid = FALSE;
+		}
+		else if (arg == "--width")
+			valid = ParseUInt(argv[++i], out_options.m_width);
+		else if (arg == "--height")
+			valid = ParseUInt(argv[++i], out_options.m_height);
+		else if (arg == "--spp")
+			valid = ParseUInt(argv[++i], out_options.m_samplePerPixel);
+		else if (arg == "--pass-spp")
+			valid = ParseUInt(argv[++i], out_options.m_passSamplePerPixel);
+		else if (arg == "--target-error")
+			valid = ParseFloat(argv[++i], out_options.m_targetError);
+		else if (arg == "--adaptive")
+			valid = ParseFloat(argv[++i], out_options.m_adaptiveThreshold) && out_options.m_adaptiveThreshold > 0.0f;
+		else if (arg == "--min-spp")
+			valid = ParseUInt(argv[++i], out_options.m_minSamplePerPixel);
+		else if (arg == "--depth")
+			valid = ParseUInt(argv[++i], out_options.m_maxSampleDepth);
+		else if (arg == "--integrator")
+		{
+			string integrator = argv[++i];
+			if (integrator == "iterative")
+				out_options.m_integrator = INTEGRATOR_ITERATIVE;
+			else if (integrator == "recursive")
+				out_options.m_integrator = INTEGRATOR_RECURSIVE;
+			else if (integrator == "wavefront")
+				out_options.m_integrator = INTEGRATOR_WAVEFRONT;
+			else
+				valid = FALSE;
+		}
+		else if (arg == "--rr-depth")
+			valid = ParseUInt(argv[++i], out_options.m_russianRouletteDepth);
+		else if (arg == "--nee")
+			out_options.m_lightSampling = TRUE;
+		else if (arg == "--light-select")
+		{
+			string selection = argv[++i];
+			if (selection == "power")
+				out_options.m_lightSelection = LIGHT_SELECTION_POWER;
+			else if (selection == "bvh")
+				out_options.m_lightSelection = LIGHT_SELECTION_BVH;
+			else
+				valid = FALSE;
+		}
+		else if (arg == "--sampler")
+		{
+			string sampler = argv[++i];
+			if (sampler == "independent")
+				out_options.m_samplerType = SAMPLER_INDEPENDENT;
+			else if (sampler == "sobol")
+				out_options.m_samplerType = SAMPLER_SOBOL;
+			else if (sampler == "bluenoise")
+				out_options.m_samplerType = SAMPLER_BLUE_NOISE;
+			else
+				valid = FALSE;
+		}
+		else if (arg == "--packet")
+		{
+			valid = ParseUInt(argv[++i], out_options.m_packetWidth);
+			UINT32 width = out_options.m_packetWidth;
+			if (width != 1 && width != 4 && width != 8 && width != 16)
+				valid = FALSE;
+		}
+		else if (arg == "--frames")
+			valid = ParseUInt(argv[++i], out_options.m_frameCount);
+		else if (arg == "--frame-time")
+			valid = ParseFloat(argv[++i], out_options.m_frameTime);
+		else if (arg == "--seed")
+			valid = ParseUInt64(argv[++i], out_options.m_seed);
+		else if (arg == "--threads")
+			valid = ParseUInt(argv[++i], out_options.m_threadCount);
+		else if (arg == "--tile")
+			valid = ParseUInt(argv[++i], out_options.m_tileSize);
+		else if (arg == "--tile-order")
+		{
+			string order = argv[++i];
+			if (order == "scanline")
+				out_options.m_tileOrder = TILE_ORDER_SCANLINE;
+			else if (order == "morton")
+				out_options.m_tileOrder = TILE_ORDER_MORTON;
+			else if (order == "hilbert")
+				out_options.m_tileOrder = TILE_ORDER_HILBERT;
+			else
+				valid = FALSE;
+		}
+		else if (arg == "--output")
+			out_options.m_outputName = argv[++i];
+		else if (arg == "--dir")
+			out_options.m_outputDir = argv[++i];
+		else if (arg == "--benchmark")
+			out_options.m_benchmark = argv[++i];
+		else
+			valid = FALSE;
+
+		if (!valid)
+		{
+			cerr << "[RayTracerCLI] Invalid argument: " << arg << endl;
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+	CommandLineOptions options;
+	if (!ParseCommandLine(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	cout << "[RayTracerCLI] Vec3 backend: " << VEC3_BACKEND_NAME << endl;
+	Randomizer::SetSeed(options.m_seed);
+	if (!options.m_benchmark.empty())
+	{
+		return Benchmarks::Run(options) ? 0 : 1;
+	}
+
+	cout << "Initialize Program ..." << endl;
+
+	OutputImage *outputImage = new OutputImage(options.m_width, options.m_height, options.m_outputName.c_str());
+	World *world = new World();
+	SimpleCamera *camera = new SimpleCamera(world, nullptr, outputImage->m_aspectRatio);
+	HomemadeRayTracer *hmRayTracer = new HomemadeRayTracer(nullptr, outputImage, world);
+	hmRayTracer->OnInit();
+	hmRayTracer->SetSamplePerPixel(options.m_samplePerPixel);
+	hmRayTracer->SetMaxSampleDepth(options.m_maxSampleDepth);
+	hmRayTracer->SetNormalDisplay(options.m_normalDisplay);
+	hmRayTracer->SetIntegrator(options.m_integrator);
+	hmRayTracer->SetRussianRouletteDepth(options.m_russianRouletteDepth);
+	hmRayTracer->SetLightSampling(options.m_lightSampling);
+	hmRayTracer->SetTextureLod(options.m_textureLod);
+	hmRayTracer->SetAdaptiveSampling(options.m_adaptiveThreshold > 0.0f);
+	hmRayTracer->SetAdaptiveMinSamplePerPixel(options.m_minSamplePerPixel);
+	hmRayTracer->SetAdaptiveErrorThreshold(options.m_adaptiveThreshold);
+	hmRayTracer->SetSampler(options.m_samplerType);
+	hmRayTracer->SetPacketWidth(options.m_packetWidth);
+	hmRayTracer->SetThreadCount(options.m_threadCount);
+	hmRayTracer->SetTileSize(options.m_tileSize, options.m_tileSize);
+	hmRayTracer->SetTileOrder(options.m_tileOrder);
+	hmRayTracer->SetWorkStealing(options.m_workStealing);
+
+	// before the construction, which only builds the structures of the selected one, with the render threads
+	world->SetAccelerationStructure(options.m_accelerationStructure);
+	world->ConstructWorld(options.m_worldID, camera, hmRayTracer->CreateThreadPool());
+	world->GetLightSources()->SetLightSelection(options.m_lightSelection);
+
+	cout << "Done" << endl;
+
+	double totalSeconds = 0.0;
+	UINT64 totalSamples = 0;
+	for (UINT32 frame = 0; frame < options.m_frameCount; frame++)
+	{
+		if (frame > 0 && options.m_frameTime > 0.0f)
+		{
+			auto animateStart = chrono::steady_clock::now();
+			UINT32 rebuiltCount = world->Animate(options.m_frameTime);
+			printf("[RayTracerCLI] Animate: %.3lfms, %u structure(s) rebuilt\n", chrono::duration<double>(chrono::steady_clock::now() - animateStart).count() * 1e3, rebuiltCount);
+		}
+
+		auto start = chrono::steady_clock::now();
+		if (options.m_passSamplePerPixel == 0)
+		{
+			hmRayTracer->TraceRay(camera, outputImage);
+		}
+		else
+		{
+			// progressive, stops at --spp or as soon as the error target is reached
+			hmRayTracer->ResetAccumulation();
+			float lastError = FLT_MAX;
+			while (hmRayTracer->GetAccumulatedSamplePerPixel() < options.m_samplePerPixel)
+			{
+				UINT32 passSPP = min(options.m_passSamplePerPixel, options.m_samplePerPixel - hmRayTracer->GetAccumulatedSamplePerPixel());
+				hmRayTracer->TracePass(camera, outputImage, passSPP);
+				float error = hmRayTracer->EstimateRelativeError();
+				printf("[RayTracerCLI] Pass: %u SPP, relative error %.4f, %.3lfs\n", hmRayTracer->GetAccumulatedSamplePerPixel(), error, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+				// the estimate is too low while only a few samples found the lights, it has to be going down already
+				if (error <= options.m_targetError && error <= lastError)
+					break;
+				lastError = error;
+			}
+		}
+		auto end = chrono::steady_clock::now();
+
+		double seconds = chrono::duration<double>(end - start).count();
+		UINT64 samples = hmRayTracer->GetAccumulatedSampleCount();
+		totalSeconds += seconds;
+		totalSamples += samples;
+		printf("[RayTracerCLI] Frame %u: %.3lfs, %.3lf Msamples/s, %.3lf Mrays/s\n", frame, seconds, samples / seconds * 1e-6, hmRayTracer->GetLastPassRayCount() / seconds * 1e-6);
+		if (options.m_threadStats)
+			hmRayTracer->PrintThreadStats();
+
+		if (options.m_frameCount > 1)
+		{
+			char suffix[16];
+			sprintf_s(suffix, "_%04u", frame);
+			outputImage->m_name = options.m_outputName + suffix;
+		}
+		outputImage->Output(options.m_outputDir.empty() ? nullptr : options.m_outputDir.c_str());
+
+		if (options.m_heatMap)
+		{
+			string name = outputImage->m_name;
+			hmRayTracer->RenderSampleCountHeatMap(outputImage);
+			outputImage->m_name = name + "_spp";
+			outputImage->Output(options.m_outputDir.empty() ? nullptr : options.m_outputDir.c_str());
+			outputImage->m_name = name;
+		}
+	}
+	printf("[RayTracerCLI] Total: %u frame(s), %.3lfs, %.3lf Msamples/s\n", options.m_frameCount, totalSeconds, totalSamples / totalSeconds * 1e-6);
+
+	cout << "Finalize Program ..." << endl;
+	hmRayTracer->OnDestroy();
+	delete hmRayTracer;
+	delete camera;
+	world->DeconstructWorld();
+	delete world;
+	delete outputImage;
+	cout << "Done" << endl;
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "World.h"
+#include "TileScheduler.h"
+#include "HomemadeRayTracer.h"
+#include "LightSources.h"
+
+#define DEFAULT_IMAGE_WIDTH 1280
+#define DEFAULT_IMAGE_HEIGHT 720
+
+struct CommandLineOptions
+{
+	WorldID						m_worldID{ WORLD_ID_CORNELL_BOX };
+	AccelerationStructure		m_accelerationStructure{ ACCELERATION_LINEAR_BVH };
+	UINT32						m_width{ DEFAULT_IMAGE_WIDTH };
+	UINT32						m_height{ DEFAULT_IMAGE_HEIGHT };
+	UINT32						m_samplePerPixel{ 1 };
+	UINT32						m_passSamplePerPixel{ 0 };	// 0 for a single TraceRay per frame
+	float						m_targetError{ 0.0f };
+	float						m_adaptiveThreshold{ 0.0f };	// 0 for uniform sampling
+	UINT32						m_minSamplePerPixel{ 8 };
+	BOOL						m_heatMap{ FALSE };
+	UINT32						m_maxSampleDepth{ 50 };
+	IntegratorType				m_integrator{ INTEGRATOR_ITERATIVE };
+	UINT32						m_russianRouletteDepth{ 5 };
+	BOOL						m_lightSampling{ FALSE };
+	LightSelection				m_lightSelection{ LIGHT_SELECTION_BVH };
+	SamplerType					m_samplerType{ SAMPLER_INDEPENDENT };
+	BOOL						m_textureLod{ TRUE };
+	UINT32						m_packetWidth{ 8 };
+	UINT32						m_frameCount{ 1 };
+	float						m_frameTime{ 0.0f };
+	UINT64						m_seed{ 0 };
+	UINT32						m_threadCount{ 0 };
+	UINT32						m_tileSize{ 32 };
+	TileOrder					m_tileOrder{ TILE_ORDER_HILBERT };
+	BOOL						m_workStealing{ TRUE };
+	BOOL						m_threadStats{ FALSE };
+	BOOL						m_normalDisplay{ FALSE };
+	std::string					m_outputName{ "OutputImage" };
+	std::string					m_outputDir{};
+	std::string					m_benchmark{};
+};
\ No newline at end of file